@@ -0,0 +1,441 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <glib.h>
+#include <iio.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "batch.h"
+#include "libini2.h"
+#include "osc.h"
+#include "profile_log.h"
+
+enum step_result {
+	STEP_DONE,
+	STEP_PASSED,
+	STEP_FAILED,
+	STEP_ERROR,
+	STEP_SKIPPED,
+	STEP_NB_RESULTS,
+};
+
+static const char * const step_result_names[] = {
+	[STEP_DONE] = "done",
+	[STEP_PASSED] = "passed",
+	[STEP_FAILED] = "failed",
+	[STEP_ERROR] = "error",
+	[STEP_SKIPPED] = "skipped",
+};
+
+struct batch_step {
+	int line;
+	char *section;
+	char *key;
+	char *value;
+	/* Value read by a test, NULL for other entries */
+	char *measured;
+	enum step_result result;
+	int err;
+	gint64 duration;
+};
+
+struct batch_board {
+	const struct batch_options *opts;
+	const char *uri;
+	unsigned int index;
+
+	struct iio_context *ctx;
+	struct profile_log *log;
+	GThread *thread;
+
+	GArray *steps;
+	unsigned int counts[STEP_NB_RESULTS];
+	bool connected;
+	/* Error that stopped the board before the end of the profile */
+	int ret;
+	gint64 duration;
+};
+
+/* The INI callback has no user data: each worker finds its board here */
+static GPrivate current_board;
+
+static const char * board_name(const struct batch_board *board)
+{
+	return board->uri ?: "default";
+}
+
+static bool board_passed(const struct batch_board *board)
+{
+	return !board->ret && !board->counts[STEP_FAILED] &&
+		!board->counts[STEP_ERROR];
+}
+
+static void print_step(const struct batch_board *board,
+		const struct batch_step *step)
+{
+	if (step->result == STEP_PASSED || step->result == STEP_FAILED)
+		printf("[%s] Line %i: (%s = %s): value = %s: %s\n",
+				board_name(board), step->line, step->key,
+				step->value, step->measured,
+				step_result_names[step->result]);
+	else if (step->result == STEP_ERROR)
+		fprintf(stderr, "[%s] Line %i: (%s = %s): %s\n",
+				board_name(board), step->line, step->key,
+				step->value, g_strerror(-step->err));
+}
+
+static int batch_wait(const char *value)
+{
+	unsigned int msecs;
+
+	if (sscanf(value, "%u", &msecs) != 1)
+		return -EINVAL;
+
+	g_usleep((gulong)msecs * 1000);
+	return 0;
+}
+
+static int batch_handler(int line, const char *section,
+		const char *name, const char *value)
+{
+	struct batch_board *board = g_private_get(&current_board);
+	struct batch_step step;
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	const char *attr;
+	char measured[64];
+	gint64 start = g_get_monotonic_time();
+	bool debug;
+	int ret;
+
+	memset(&step, 0, sizeof(step));
+
+	if (!strncmp(name, "test.", sizeof("test.") - 1)) {
+		ret = osc_eval_test(board->ctx, name, value,
+				measured, sizeof(measured));
+		if (ret >= 0)
+			step.measured = g_strdup(measured);
+		step.result = ret < 0 ? STEP_ERROR :
+			ret ? STEP_PASSED : STEP_FAILED;
+	} else if (!strncmp(name, "log.", sizeof("log.") - 1)) {
+		ret = osc_log_value_to(board->log, board->ctx, name, value);
+		step.result = ret < 0 ? STEP_ERROR : STEP_DONE;
+	} else if (!strcmp(name, "cycle") && !strncmp(section,
+				CAPTURE_INI_SECTION,
+				sizeof(CAPTURE_INI_SECTION) - 1)) {
+		/* Wait of the capture window, which lets the board settle */
+		ret = batch_wait(value);
+		step.result = ret < 0 ? STEP_ERROR : STEP_DONE;
+	} else if (!osc_identify_attrib(board->ctx, name,
+				&dev, &chn, &attr, &debug)) {
+		ret = osc_write_value(board->ctx, name, value);
+		step.result = ret < 0 ? STEP_ERROR : STEP_DONE;
+	} else {
+		/* Plugin or GUI setting, which needs the application */
+		ret = 0;
+		step.result = STEP_SKIPPED;
+	}
+
+	step.line = line;
+	step.section = g_strdup(section);
+	step.key = g_strdup(name);
+	step.value = g_strdup(value);
+	step.err = ret < 0 ? ret : 0;
+	step.duration = g_get_monotonic_time() - start;
+
+	print_step(board, &step);
+	board->counts[step.result]++;
+	g_array_append_val(board->steps, step);
+
+	return step.err;
+}
+
+static gpointer batch_worker(gpointer data)
+{
+	struct batch_board *board = data;
+	gint64 start = g_get_monotonic_time();
+	char tag[16];
+
+	g_private_set(&current_board, board);
+
+	if (board->uri)
+		board->ctx = iio_create_context_from_uri(board->uri);
+	else
+		board->ctx = iio_create_default_context();
+	if (!board->ctx) {
+		board->ret = errno ? -errno : -ENXIO;
+		fprintf(stderr, "[%s] Unable to connect: %s\n",
+				board_name(board), g_strerror(-board->ret));
+		goto out;
+	}
+	board->connected = true;
+
+	snprintf(tag, sizeof(tag), "%u", board->index);
+	board->log = profile_log_new(board->opts->nb_uris > 1 ? tag : NULL);
+
+	board->ret = foreach_in_ini_unrolled(board->opts->profile,
+			batch_handler, NULL);
+
+	profile_log_free(board->log);
+	iio_context_destroy(board->ctx);
+
+out:
+	board->duration = g_get_monotonic_time() - start;
+	return NULL;
+}
+
+static void batch_step_clear(gpointer data)
+{
+	struct batch_step *step = data;
+
+	g_free(step->section);
+	g_free(step->key);
+	g_free(step->value);
+	g_free(step->measured);
+}
+
+static void write_junit_case(FILE *f, const char *class_name,
+		const char *name, gint64 duration, const char *tag,
+		const char *message)
+{
+	gchar *str = g_markup_printf_escaped("    <testcase classname=\"%s\" "
+			"name=\"%s\" time=\"%.6f\"", class_name, name,
+			duration / (double)G_USEC_PER_SEC);
+
+	fputs(str, f);
+	g_free(str);
+
+	if (!tag) {
+		fputs("/>\n", f);
+		return;
+	}
+
+	str = g_markup_printf_escaped(">\n      <%s message=\"%s\"/>\n"
+			"    </testcase>\n", tag, message);
+	fputs(str, f);
+	g_free(str);
+}
+
+/*
+ * One test suite per board, with the tests as test cases. Other entries
+ * only appear when they fail, as does an error outside of the entries.
+ */
+static void write_junit_suite(FILE *f, const char *class_name,
+		const struct batch_board *board)
+{
+	bool other_error = board->ret && !board->counts[STEP_ERROR];
+	unsigned int i, errors = board->counts[STEP_ERROR] + other_error;
+	gchar *str, *name;
+
+	str = g_markup_printf_escaped("  <testsuite name=\"%s\" tests=\"%u\" "
+			"failures=\"%u\" errors=\"%u\" time=\"%.6f\">\n",
+			board_name(board),
+			board->counts[STEP_PASSED] + board->counts[STEP_FAILED] +
+			errors, board->counts[STEP_FAILED], errors,
+			board->duration / (double)G_USEC_PER_SEC);
+	fputs(str, f);
+	g_free(str);
+
+	if (other_error)
+		write_junit_case(f, class_name,
+				board->connected ? "profile" : "connect",
+				board->duration, "error", g_strerror(-board->ret));
+
+	for (i = 0; i < board->steps->len; i++) {
+		struct batch_step *step = &g_array_index(board->steps,
+				struct batch_step, i);
+		char message[128];
+
+		if (step->result != STEP_PASSED && step->result != STEP_FAILED &&
+				step->result != STEP_ERROR)
+			continue;
+
+		name = g_strdup_printf("line %i: %s = %s",
+				step->line, step->key, step->value);
+		if (step->result == STEP_PASSED) {
+			write_junit_case(f, class_name, name,
+					step->duration, NULL, NULL);
+		} else if (step->result == STEP_FAILED) {
+			snprintf(message, sizeof(message), "value read: %s",
+					step->measured);
+			write_junit_case(f, class_name, name,
+					step->duration, "failure", message);
+		} else {
+			write_junit_case(f, class_name, name, step->duration,
+					"error", g_strerror(-step->err));
+		}
+		g_free(name);
+	}
+
+	fputs("  </testsuite>\n", f);
+}
+
+static int write_junit(const struct batch_options *opts,
+		const struct batch_board *boards)
+{
+	gchar *name = g_path_get_basename(opts->profile), *str;
+	FILE *f = fopen(opts->junit_file, "w");
+	unsigned int i;
+	int ret = 0;
+
+	if (!f) {
+		ret = -errno;
+		fprintf(stderr, "Failed to write %s: %s\n",
+				opts->junit_file, strerror(-ret));
+		goto out;
+	}
+
+	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n", f);
+	str = g_markup_printf_escaped("<testsuites name=\"%s\">\n", name);
+	fputs(str, f);
+	g_free(str);
+
+	for (i = 0; i < opts->nb_uris; i++)
+		write_junit_suite(f, name, &boards[i]);
+
+	fputs("</testsuites>\n", f);
+	if (fclose(f)) {
+		ret = -errno;
+		fprintf(stderr, "Failed to write %s: %s\n",
+				opts->junit_file, strerror(-ret));
+	}
+
+out:
+	g_free(name);
+	return ret;
+}
+
+static json_t * board_to_json(const struct batch_board *board)
+{
+	json_t *obj = json_object(), *steps = json_array(), *item;
+	unsigned int i;
+
+	json_object_set_new(obj, "uri", json_string(board_name(board)));
+	json_object_set_new(obj, "index", json_integer(board->index));
+	json_object_set_new(obj, "result", json_string(board_passed(board) ?
+				"passed" : "failed"));
+	if (board->ret)
+		json_object_set_new(obj, "error",
+				json_string(g_strerror(-board->ret)));
+	json_object_set_new(obj, "time",
+			json_real(board->duration / (double)G_USEC_PER_SEC));
+	json_object_set_new(obj, "passed",
+			json_integer(board->counts[STEP_PASSED]));
+	json_object_set_new(obj, "failed",
+			json_integer(board->counts[STEP_FAILED]));
+	json_object_set_new(obj, "errors",
+			json_integer(board->counts[STEP_ERROR]));
+	json_object_set_new(obj, "skipped",
+			json_integer(board->counts[STEP_SKIPPED]));
+
+	for (i = 0; i < board->steps->len; i++) {
+		struct batch_step *step = &g_array_index(board->steps,
+				struct batch_step, i);
+
+		item = json_object();
+		json_object_set_new(item, "line", json_integer(step->line));
+		json_object_set_new(item, "section", json_string(step->section));
+		json_object_set_new(item, "key", json_string(step->key));
+		json_object_set_new(item, "value", json_string(step->value));
+		json_object_set_new(item, "result",
+				json_string(step_result_names[step->result]));
+		if (step->measured)
+			json_object_set_new(item, "measured",
+					json_string(step->measured));
+		if (step->err)
+			json_object_set_new(item, "error",
+					json_string(g_strerror(-step->err)));
+		json_object_set_new(item, "time",
+				json_real(step->duration / (double)G_USEC_PER_SEC));
+		json_array_append_new(steps, item);
+	}
+
+	json_object_set_new(obj, "steps", steps);
+	return obj;
+}
+
+static int write_json(const struct batch_options *opts,
+		const struct batch_board *boards)
+{
+	json_t *root = json_object(), *array = json_array();
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < opts->nb_uris; i++)
+		json_array_append_new(array, board_to_json(&boards[i]));
+
+	json_object_set_new(root, "profile", json_string(opts->profile));
+	json_object_set_new(root, "boards", array);
+
+	if (json_dump_file(root, opts->json_file,
+				JSON_INDENT(4) | JSON_PRESERVE_ORDER) < 0) {
+		fprintf(stderr, "Failed to write %s\n", opts->json_file);
+		ret = -EIO;
+	}
+
+	json_decref(root);
+	return ret;
+}
+
+int batch_run(const struct batch_options *opts)
+{
+	struct batch_options run = *opts;
+	struct batch_board *boards;
+	unsigned int i, nb_failed = 0;
+	int ret = 0;
+
+	if (!g_file_test(opts->profile, G_FILE_TEST_IS_REGULAR)) {
+		fprintf(stderr, "Unable to find profile %s\n", opts->profile);
+		return -ENOENT;
+	}
+
+	/* Without URIs, the profile runs on the default context */
+	if (!run.nb_uris)
+		run.nb_uris = 1;
+
+	boards = g_new0(struct batch_board, run.nb_uris);
+	for (i = 0; i < run.nb_uris; i++) {
+		boards[i].opts = &run;
+		boards[i].uri = opts->nb_uris ? opts->uris[i] : NULL;
+		boards[i].index = i + 1;
+		boards[i].steps = g_array_new(FALSE, FALSE,
+				sizeof(struct batch_step));
+		g_array_set_clear_func(boards[i].steps, batch_step_clear);
+		boards[i].thread = g_thread_new("batch-worker",
+				batch_worker, &boards[i]);
+	}
+
+	for (i = 0; i < run.nb_uris; i++) {
+		struct batch_board *board = &boards[i];
+
+		g_thread_join(board->thread);
+		printf("[%s] %s: %u passed, %u failed, %u errors, %u skipped "
+				"in %.3f s\n", board_name(board),
+				board_passed(board) ? "PASSED" : "FAILED",
+				board->counts[STEP_PASSED],
+				board->counts[STEP_FAILED],
+				board->counts[STEP_ERROR],
+				board->counts[STEP_SKIPPED],
+				board->duration / (double)G_USEC_PER_SEC);
+		if (!board_passed(board))
+			nb_failed++;
+	}
+
+	if (run.junit_file)
+		ret = write_junit(&run, boards);
+	if (run.json_file)
+		ret = write_json(&run, boards) ?: ret;
+
+	for (i = 0; i < run.nb_uris; i++)
+		g_array_free(boards[i].steps, TRUE);
+	g_free(boards);
+
+	return ret < 0 ? ret : (int)nb_failed;
+}
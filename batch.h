@@ -0,0 +1,38 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/*
+ * Headless execution of a test profile, on one or several boards at once.
+ * Each board gets its own context and worker thread, which runs the
+ * profile sequentially, as the GUI does for profiles with test=1:
+ *  - test.* entries are evaluated and recorded as passed or failed,
+ *  - log.* entries are logged, in files tagged with the index of the board
+ *    when there are several boards (see profile_log.h),
+ *  - device attributes are written, including {expressions},
+ *  - the waits of capture windows (cycle = msecs) are slept through.
+ * Other entries are the settings of plugins and of the GUI: they need the
+ * application and are recorded as skipped. A failed test doesn't stop the
+ * board, any other error does.
+ */
+struct batch_options {
+	const char *profile;
+
+	/* URIs of the boards, or the default context if there is none */
+	const char **uris;
+	unsigned int nb_uris;
+
+	/* Optional reports, in JUnit XML and in JSON */
+	const char *junit_file;
+	const char *json_file;
+};
+
+/* Returns the number of boards that didn't pass, or a negative error code */
+int batch_run(const struct batch_options *opts);
+
+#endif /* __BATCH_H__ */
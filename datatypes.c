@@ -8,6 +8,9 @@
 #include <string.h>
 #include "datatypes.h"
 
+/* Fraction of the gap closed each frame when the envelope shrinks */
+#define EXTREMA_ENVELOPE_DECAY 0.05f
+
 Transform* Transform_new(int type)
 {
 	Transform *tr = (Transform *)calloc(1, sizeof(Transform));
@@ -97,6 +100,7 @@ void Transform_attach_function(Transform *tr, bool (*f)(Transform *tr , gboolean
 
 void Transform_setup(Transform *tr)
 {
+	tr->has_extrema = false;
 	tr->transform_function(tr, TRUE);
 }
 
@@ -105,6 +109,54 @@ bool Transform_update_output(Transform *tr)
 	return tr->transform_function(tr, FALSE);
 }
 
+void Transform_set_y_extrema(Transform *tr, gfloat min, gfloat max)
+{
+	tr->y_min = min;
+	tr->y_max = max;
+
+	if (!tr->has_extrema) {
+		tr->y_env_min = min;
+		tr->y_env_max = max;
+		tr->has_extrema = true;
+		return;
+	}
+
+	/* The envelope follows new peaks instantly and forgets them slowly */
+	if (max >= tr->y_env_max)
+		tr->y_env_max = max;
+	else
+		tr->y_env_max -= (tr->y_env_max - max) * EXTREMA_ENVELOPE_DECAY;
+
+	if (min <= tr->y_env_min)
+		tr->y_env_min = min;
+	else
+		tr->y_env_min += (min - tr->y_env_min) * EXTREMA_ENVELOPE_DECAY;
+}
+
+/*
+ * Scans the whole output, for outputs whose range no pass found on the way:
+ * math channels, and views that differ from the captured samples. Only done
+ * when the plot asks for the range.
+ */
+void Transform_find_y_extrema(Transform *tr)
+{
+	gfloat min, max;
+	unsigned i;
+
+	if (!tr->find_extrema || !tr->y_axis || !tr->y_axis_size)
+		return;
+
+	min = max = tr->y_axis[0];
+	for (i = 1; i < tr->y_axis_size; i++) {
+		if (tr->y_axis[i] < min)
+			min = tr->y_axis[i];
+		else if (tr->y_axis[i] > max)
+			max = tr->y_axis[i];
+	}
+
+	Transform_set_y_extrema(tr, min, max);
+}
+
 TrList* TrList_new(void)
 {
 	TrList *list = (TrList *)malloc(sizeof(TrList));
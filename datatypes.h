@@ -48,10 +48,22 @@ enum plot_channel_constraints {
 typedef struct _transform Transform;
 typedef struct _tr_list TrList;
 
+struct transform_cache_entry;
+struct minmax_pyramid;
+struct playback;
+
 struct extra_info {
 	struct iio_device *dev;
 	gfloat *data_ref;
+	/* Samples in their native width, when capturing in native format */
+	void *raw_ref;
+	unsigned int raw_size;
+	unsigned long converted_seq;
 	off_t offset;
+	/* Range of the samples, written along with them, for extrema_seq */
+	gfloat y_min;
+	gfloat y_max;
+	unsigned long extrema_seq;
 	int shadow_of_enabled;
 	bool may_be_enabled;
 	double lo_freq;
@@ -72,6 +84,14 @@ struct extra_dev_info {
 	gfloat **channels_data_copy;
 	GSList *plots_sample_counts;
 	gfloat plugin_fft_corr;
+	/* Incremented each time fresh samples are demuxed into data_ref */
+	unsigned long frame_seq;
+	/* Wall clock time of the last frame, in microseconds */
+	gint64 frame_time;
+	/* Samples are kept in raw_ref and converted to data_ref on demand */
+	bool native_samples;
+	/* Recording played in place of the device samples, if any */
+	struct playback *playback;
 };
 
 struct buffer {
@@ -114,6 +134,17 @@ struct _transform {
 	bool has_the_marker;
 	void *settings;
 	bool (*transform_function)(Transform *tr, gboolean init_transform);
+	/* Y range of the last output frame and its decayed envelope */
+	bool find_extrema;
+	bool has_extrema;
+	gfloat y_min;
+	gfloat y_max;
+	gfloat y_env_min;
+	gfloat y_env_max;
+	/* Min/max levels used to draw the output once capture is frozen */
+	struct minmax_pyramid *pyramid;
+	gfloat *pyramid_x;
+	unsigned long pyramid_frame;
 };
 
 struct _tr_list {
@@ -143,6 +174,7 @@ struct _fft_settings {
 	struct marker_type **markers_copy;
 	GMutex *marker_lock;
 	enum marker_types *marker_type;
+	struct transform_cache_entry *shared_result;
 };
 
 struct _constellation_settings {
@@ -205,6 +237,8 @@ void Transform_attach_settings(Transform *tr, void *settings);
 void Transform_attach_function(Transform *tr, bool (*f)(Transform *tr , gboolean init_transform));
 void Transform_setup(Transform *tr);
 bool Transform_update_output(Transform *tr);
+void Transform_set_y_extrema(Transform *tr, gfloat min, gfloat max);
+void Transform_find_y_extrema(Transform *tr);
 
 TrList* TrList_new(void);
 void TrList_destroy(TrList *list);
@@ -0,0 +1,759 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <fcntl.h>
+#include <jansson.h>
+#include <limits.h>
+#include <math.h>
+#include <matio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#include "export_worker.h"
+
+/* add backwards compat for <matio-1.5.0 */
+#if MATIO_MAJOR_VERSION == 1 && MATIO_MINOR_VERSION < 5
+typedef int mat_dim;
+#else
+typedef size_t mat_dim;
+#endif
+
+/* Rows formatted before the text is handed to the file */
+#define EXPORT_BLOCK_ROWS 65536
+#define EXPORT_MAX_THREADS 8
+/* Below this many values per block, formatting stays on the worker thread */
+#define EXPORT_PARALLEL_MIN_VALUES 32768
+/* Longest output of export_format_float(), e.g. "-1.17549435e-38" */
+#define EXPORT_FLOAT_MAX_LEN 15
+
+#define SIGMF_VERSION "1.0.0"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#ifdef _WIN32
+#define O_BINARY_FLAG O_BINARY
+
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+static ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	ssize_t ret = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		ssize_t len = write(fd, iov[i].iov_base, iov[i].iov_len);
+
+		if (len < 0)
+			return ret ? ret : len;
+		ret += len;
+		if ((size_t)len < iov[i].iov_len)
+			break;
+	}
+
+	return ret;
+}
+#else
+#define O_BINARY_FLAG 0
+#endif
+
+struct export_chunk {
+	const struct export_section *section;
+	unsigned int first;
+	unsigned int last;
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+struct export_job * export_job_new(enum export_format format, const char *filename)
+{
+	struct export_job *job = g_new0(struct export_job, 1);
+
+	job->format = format;
+	job->filename = g_strdup(filename);
+
+	return job;
+}
+
+struct export_section * export_job_add_section(struct export_job *job,
+		const char *header, const char *sep, const char *last_sep,
+		unsigned int rows)
+{
+	struct export_section *section = g_new0(struct export_section, 1);
+
+	section->header = g_strdup(header);
+	section->sep = sep ?: "";
+	section->last_sep = last_sep ?: section->sep;
+	section->rows = rows;
+	job->sections = g_slist_append(job->sections, section);
+
+	return section;
+}
+
+void export_section_set_footer(struct export_section *section, const char *footer)
+{
+	g_free(section->footer);
+	section->footer = g_strdup(footer);
+}
+
+/* The samples are copied, so the caller is free to overwrite its buffers */
+struct export_column * export_section_add_column(struct export_section *section,
+		const char *name, const gfloat *data, double scale)
+{
+	struct export_column *column;
+
+	section->columns = g_renew(struct export_column, section->columns,
+			section->num_columns + 1);
+	column = &section->columns[section->num_columns++];
+	column->name = g_strdup(name);
+	column->data = g_new(gfloat, section->rows);
+	memcpy(column->data, data, section->rows * sizeof(gfloat));
+	column->scale = scale;
+	column->frequency = 0;
+
+	return column;
+}
+
+void export_job_set_pixbuf(struct export_job *job, GdkPixbuf *pixbuf)
+{
+	if (job->pixbuf)
+		g_object_unref(job->pixbuf);
+	job->pixbuf = pixbuf ? g_object_ref(pixbuf) : NULL;
+}
+
+/*
+ * @timestamp is the capture time in microseconds since the Epoch. With
+ * @int16 the samples are written as 16-bit integers, which is only right
+ * when they were captured as such.
+ */
+void export_job_set_sigmf_info(struct export_job *job, const char *hw,
+		double sample_rate, gint64 timestamp, bool int16)
+{
+	g_free(job->hw);
+	job->hw = g_strdup(hw);
+	job->sample_rate = sample_rate;
+	job->timestamp = timestamp;
+	job->int16 = int16;
+}
+
+/*
+ * Write the shortest text that reads back as the same float. Captured
+ * samples are integers most of the time, so those skip printf entirely.
+ */
+size_t export_format_float(char *buf, gfloat value)
+{
+	char tmp[12], *p = tmp;
+	unsigned int u;
+	size_t len = 0;
+	int prec;
+
+	if (fabsf(value) < 16777216.0f && value == (gfloat)(gint32)value) {
+		gint32 v = (gint32)value;
+
+		if (v < 0) {
+			buf[len++] = '-';
+			u = -v;
+		} else {
+			u = v;
+		}
+		do {
+			*p++ = '0' + u % 10;
+			u /= 10;
+		} while (u);
+		while (p != tmp)
+			buf[len++] = *--p;
+		buf[len] = '\0';
+
+		return len;
+	}
+
+	for (prec = 6; prec < 9; prec++) {
+		len = snprintf(buf, EXPORT_FLOAT_MAX_LEN + 1, "%.*g", prec, value);
+		if (strtof(buf, NULL) == value)
+			return len;
+	}
+
+	return snprintf(buf, EXPORT_FLOAT_MAX_LEN + 1, "%.9g", value);
+}
+
+static size_t export_section_row_size(const struct export_section *section)
+{
+	size_t sep_len = MAX(strlen(section->sep), strlen(section->last_sep));
+
+	return section->num_columns * (EXPORT_FLOAT_MAX_LEN + sep_len) + 1;
+}
+
+static gpointer export_chunk_format(gpointer data)
+{
+	struct export_chunk *chunk = data;
+	const struct export_section *section = chunk->section;
+	size_t sep_len = strlen(section->sep);
+	size_t last_len = strlen(section->last_sep);
+	unsigned int i, j, last_col = section->num_columns - 1;
+	char *p = chunk->buf;
+
+	for (i = chunk->first; i < chunk->last; i++) {
+		for (j = 0; j < section->num_columns; j++) {
+			p += export_format_float(p, section->columns[j].data[i]);
+			if (j < last_col) {
+				memcpy(p, section->sep, sep_len);
+				p += sep_len;
+			} else {
+				memcpy(p, section->last_sep, last_len);
+				p += last_len;
+			}
+		}
+		*p++ = '\n';
+	}
+	chunk->len = p - chunk->buf;
+
+	return NULL;
+}
+
+static double export_job_total_work(const struct export_job *job)
+{
+	const GSList *node;
+	double total = 0;
+
+	for (node = job->sections; node; node = g_slist_next(node)) {
+		const struct export_section *section = node->data;
+
+		if (job->format == EXPORT_MAT)
+			total += section->num_columns;
+		else
+			total += (double)section->rows * MAX(section->num_columns, 1);
+	}
+
+	return total;
+}
+
+static void export_job_set_progress(struct export_job *job, double done, double total)
+{
+	if (total > 0)
+		g_atomic_int_set(&job->progress,
+				(gint)(done * EXPORT_PROGRESS_MAX / total));
+}
+
+/* Format a block of rows, splitting it across threads when it's worth it */
+static unsigned int export_block_format(struct export_chunk *chunks,
+		unsigned int max_threads, const struct export_section *section,
+		unsigned int first, unsigned int count)
+{
+	GThread *threads[EXPORT_MAX_THREADS];
+	size_t row_size = export_section_row_size(section);
+	unsigned int k, n, per_chunk;
+
+	n = (count * section->num_columns < EXPORT_PARALLEL_MIN_VALUES) ?
+		1 : max_threads;
+	per_chunk = (count + n - 1) / n;
+
+	for (k = 0; k < n; k++) {
+		struct export_chunk *chunk = &chunks[k];
+		size_t size;
+
+		chunk->section = section;
+		chunk->first = first + k * per_chunk;
+		chunk->last = MIN(chunk->first + per_chunk, first + count);
+		if (chunk->first >= chunk->last) {
+			n = k;
+			break;
+		}
+
+		/* One extra byte for the terminator written by snprintf() */
+		size = (size_t)(chunk->last - chunk->first) * row_size + 1;
+		if (chunk->size < size) {
+			chunk->buf = g_realloc(chunk->buf, size);
+			chunk->size = size;
+		}
+	}
+
+	for (k = 1; k < n; k++)
+		threads[k] = g_thread_new("export-format",
+				export_chunk_format, &chunks[k]);
+	export_chunk_format(&chunks[0]);
+	for (k = 1; k < n; k++)
+		g_thread_join(threads[k]);
+
+	return n;
+}
+
+static int export_write_text(struct export_job *job)
+{
+	struct export_chunk chunks[EXPORT_MAX_THREADS];
+	unsigned int max_threads, k, n;
+	double done = 0, total = export_job_total_work(job);
+	GSList *node;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(job->filename, "w");
+	if (!fp) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s : %s\n", job->filename,
+				strerror(errno));
+		return ret;
+	}
+
+	max_threads = MIN(MAX(g_get_num_processors(), 1), EXPORT_MAX_THREADS);
+	memset(chunks, 0, sizeof(chunks));
+
+	for (node = job->sections; node && !ret; node = g_slist_next(node)) {
+		const struct export_section *section = node->data;
+		unsigned int row, count;
+
+		if (section->header)
+			fputs(section->header, fp);
+
+		for (row = 0; row < section->rows; row += count) {
+			if (g_atomic_int_get(&job->cancel)) {
+				ret = -ECANCELED;
+				break;
+			}
+
+			count = MIN(section->rows - row, EXPORT_BLOCK_ROWS);
+			n = export_block_format(chunks, max_threads,
+					section, row, count);
+			for (k = 0; k < n; k++)
+				fwrite(chunks[k].buf, 1, chunks[k].len, fp);
+
+			done += (double)count * MAX(section->num_columns, 1);
+			export_job_set_progress(job, done, total);
+		}
+
+		if (section->footer)
+			fputs(section->footer, fp);
+	}
+
+	for (k = 0; k < EXPORT_MAX_THREADS; k++)
+		g_free(chunks[k].buf);
+
+	if (ferror(fp) && !ret)
+		ret = -EIO;
+	if (fclose(fp) && !ret)
+		ret = -errno;
+
+	return ret;
+}
+
+static int export_write_mat(struct export_job *job)
+{
+	double done = 0, total = export_job_total_work(job);
+	mat_dim dims[2] = {-1, 1};
+	matvar_t *matvar;
+	GSList *node;
+	mat_t *mat;
+	unsigned int i, j;
+	int ret = 0;
+
+	mat = Mat_Create(job->filename, NULL);
+	if (!mat) {
+		fprintf(stderr, "Error creating MAT file %s: %s\n",
+				job->filename, strerror(errno));
+		return -EIO;
+	}
+
+	for (node = job->sections; node && !ret; node = g_slist_next(node)) {
+		const struct export_section *section = node->data;
+
+		dims[0] = section->rows;
+		for (i = 0; i < section->num_columns; i++) {
+			const struct export_column *column = &section->columns[i];
+
+			if (g_atomic_int_get(&job->cancel)) {
+				ret = -ECANCELED;
+				break;
+			}
+
+			if (column->scale == 0) {
+				matvar = Mat_VarCreate(column->name, MAT_C_SINGLE,
+						MAT_T_SINGLE, 2, dims, column->data, 0);
+			} else {
+				gdouble *tmp_data = g_new(gdouble, section->rows);
+				double k = 1.0 / column->scale;
+
+				for (j = 0; j < section->rows; j++)
+					tmp_data[j] = (gdouble)column->data[j] * k;
+				matvar = Mat_VarCreate(column->name, MAT_C_DOUBLE,
+						MAT_T_DOUBLE, 2, dims, tmp_data, 0);
+				g_free(tmp_data);
+			}
+
+			if (!matvar) {
+				fprintf(stderr, "error creating matvar on channel %s\n",
+						column->name);
+			} else {
+				Mat_VarWrite(mat, matvar, 0);
+				Mat_VarFree(matvar);
+			}
+
+			export_job_set_progress(job, ++done, total);
+		}
+	}
+
+	Mat_Close(mat);
+
+	return ret;
+}
+
+static int export_write_png(struct export_job *job)
+{
+	GError *err = NULL;
+
+	if (!job->pixbuf) {
+		fprintf(stderr, "error getting the pixbuf to save in %s\n",
+				job->filename);
+		return -EINVAL;
+	}
+
+	if (!gdk_pixbuf_save(job->pixbuf, job->filename, "png", &err, NULL)) {
+		fprintf(stderr, "error creating %s\n", job->filename);
+		if (err) {
+			fprintf(stderr, "error(%d):%s\n", err->code, err->message);
+			g_error_free(err);
+		}
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Write all the vectors, whatever the number of calls writev() needs */
+static int export_writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t ret = writev(fd, iov, MIN(iovcnt, IOV_MAX));
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		while (iovcnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+/* Interleave up to two columns as little endian I/Q samples */
+static void sigmf_interleave(void *out, const struct export_column *columns,
+		unsigned int num_columns, unsigned int first, unsigned int count,
+		bool int16)
+{
+	unsigned int i, j;
+
+	if (int16) {
+		gint16 *p = out;
+
+		for (i = first; i < first + count; i++)
+			for (j = 0; j < num_columns; j++)
+				*p++ = GINT16_TO_LE((gint16)columns[j].data[i]);
+	} else {
+		guint32 *p = out;
+
+		for (i = first; i < first + count; i++) {
+			for (j = 0; j < num_columns; j++) {
+				guint32 v;
+
+				memcpy(&v, &columns[j].data[i], sizeof(v));
+				*p++ = GUINT32_TO_LE(v);
+			}
+		}
+	}
+}
+
+static int sigmf_write_data(struct export_job *job, const char *filename,
+		const struct export_column *columns, unsigned int num_columns,
+		unsigned int rows, double *done, double total)
+{
+	size_t sample_size = num_columns * (job->int16 ? sizeof(gint16) : sizeof(gfloat));
+	unsigned int i, num_blocks = (rows + EXPORT_BLOCK_ROWS - 1) / EXPORT_BLOCK_ROWS;
+	struct iovec *iov;
+	int fd, ret = 0;
+
+	iov = g_new0(struct iovec, num_blocks);
+	for (i = 0; i < num_blocks; i++) {
+		unsigned int first = i * EXPORT_BLOCK_ROWS;
+		unsigned int count = MIN(rows - first, EXPORT_BLOCK_ROWS);
+
+		if (g_atomic_int_get(&job->cancel)) {
+			ret = -ECANCELED;
+			goto out;
+		}
+
+		iov[i].iov_len = count * sample_size;
+		iov[i].iov_base = g_malloc(iov[i].iov_len);
+		sigmf_interleave(iov[i].iov_base, columns, num_columns,
+				first, count, job->int16);
+
+		*done += (double)count * num_columns;
+		export_job_set_progress(job, *done, total);
+	}
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY_FLAG, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s : %s\n", filename, strerror(errno));
+		goto out;
+	}
+
+	/* The whole recording goes out with a single writev() */
+	ret = export_writev_all(fd, iov, num_blocks);
+	if (close(fd) < 0 && !ret)
+		ret = -errno;
+	if (ret)
+		fprintf(stderr, "Failed to write %s : %s\n", filename, strerror(-ret));
+
+out:
+	for (i = 0; i < num_blocks; i++)
+		g_free(iov[i].iov_base);
+	g_free(iov);
+
+	return ret;
+}
+
+static int sigmf_write_meta(struct export_job *job, const char *filename,
+		const struct export_column *columns, unsigned int num_columns)
+{
+	json_t *root, *global, *capture, *captures;
+	GDateTime *time;
+	char datatype[8], *datetime, *desc;
+	int ret = 0;
+
+	snprintf(datatype, sizeof(datatype), "%c%s_le",
+			num_columns == 2 ? 'c' : 'r', job->int16 ? "i16" : "f32");
+	if (num_columns == 2)
+		desc = g_strdup_printf("I: %s, Q: %s", columns[0].name, columns[1].name);
+	else
+		desc = g_strdup(columns[0].name);
+
+	global = json_object();
+	json_object_set_new(global, "core:datatype", json_string(datatype));
+	json_object_set_new(global, "core:sample_rate", json_real(job->sample_rate));
+	json_object_set_new(global, "core:version", json_string(SIGMF_VERSION));
+	json_object_set_new(global, "core:recorder", json_string("IIO Oscilloscope"));
+	if (job->hw)
+		json_object_set_new(global, "core:hw", json_string(job->hw));
+	json_object_set_new(global, "core:description", json_string(desc));
+
+	capture = json_object();
+	json_object_set_new(capture, "core:sample_start", json_integer(0));
+	if (columns[0].frequency != 0)
+		json_object_set_new(capture, "core:frequency",
+				json_real(columns[0].frequency));
+	time = g_date_time_new_from_unix_utc(job->timestamp / G_USEC_PER_SEC);
+	if (time) {
+		char *date = g_date_time_format(time, "%Y-%m-%dT%H:%M:%S");
+
+		datetime = g_strdup_printf("%s.%06dZ", date,
+				(int)(job->timestamp % G_USEC_PER_SEC));
+		json_object_set_new(capture, "core:datetime", json_string(datetime));
+		g_free(datetime);
+		g_free(date);
+		g_date_time_unref(time);
+	}
+
+	captures = json_array();
+	json_array_append_new(captures, capture);
+
+	root = json_object();
+	json_object_set_new(root, "global", global);
+	json_object_set_new(root, "captures", captures);
+	json_object_set_new(root, "annotations", json_array());
+
+	if (json_dump_file(root, filename, JSON_INDENT(4)) < 0) {
+		fprintf(stderr, "Failed to write %s\n", filename);
+		ret = -EIO;
+	}
+
+	json_decref(root);
+	g_free(desc);
+
+	return ret;
+}
+
+/*
+ * Strip any SigMF extension the user typed, files are named
+ * <base>.sigmf-data and <base>.sigmf-meta
+ */
+static char * sigmf_base_name(const char *filename)
+{
+	static const char * const ext[] = { ".sigmf-data", ".sigmf-meta", ".sigmf" };
+	size_t len = strlen(filename);
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(ext); i++) {
+		size_t ext_len = strlen(ext[i]);
+
+		if (len > ext_len && !strcasecmp(filename + len - ext_len, ext[i]))
+			return g_strndup(filename, len - ext_len);
+	}
+
+	return g_strdup(filename);
+}
+
+static int export_write_sigmf(struct export_job *job)
+{
+	const struct export_section *section;
+	double done = 0, total = export_job_total_work(job);
+	unsigned int i, num_columns, num_recordings;
+	char *base;
+	int ret = 0;
+
+	if (!job->sections)
+		return -EINVAL;
+	section = job->sections->data;
+	if (!section->num_columns)
+		return -EINVAL;
+
+	base = sigmf_base_name(job->filename);
+	num_recordings = (section->num_columns + 1) / 2;
+
+	for (i = 0; i < num_recordings && !ret; i++) {
+		const struct export_column *columns = &section->columns[2 * i];
+		char *data_fn, *meta_fn;
+
+		num_columns = MIN(2, section->num_columns - 2 * i);
+		if (num_recordings == 1) {
+			data_fn = g_strdup_printf("%s.sigmf-data", base);
+			meta_fn = g_strdup_printf("%s.sigmf-meta", base);
+		} else {
+			data_fn = g_strdup_printf("%s-%s.sigmf-data", base, columns[0].name);
+			meta_fn = g_strdup_printf("%s-%s.sigmf-meta", base, columns[0].name);
+		}
+
+		ret = sigmf_write_data(job, data_fn, columns, num_columns,
+				section->rows, &done, total);
+		if (!ret)
+			ret = sigmf_write_meta(job, meta_fn, columns, num_columns);
+
+		/* Don't leave half written recordings behind */
+		if (ret) {
+			unlink(data_fn);
+			unlink(meta_fn);
+		}
+
+		g_free(data_fn);
+		g_free(meta_fn);
+	}
+
+	g_free(base);
+
+	return ret;
+}
+
+static gpointer export_job_run(gpointer data)
+{
+	struct export_job *job = data;
+
+	switch (job->format) {
+	case EXPORT_TEXT:
+		job->ret = export_write_text(job);
+		break;
+	case EXPORT_MAT:
+		job->ret = export_write_mat(job);
+		break;
+	case EXPORT_PNG:
+		job->ret = export_write_png(job);
+		break;
+	case EXPORT_SIGMF:
+		job->ret = export_write_sigmf(job);
+		break;
+	default:
+		job->ret = -EINVAL;
+		break;
+	}
+
+	/* Don't leave half written files behind */
+	if (job->ret == -ECANCELED && job->format != EXPORT_SIGMF)
+		unlink(job->filename);
+
+	g_atomic_int_set(&job->progress, EXPORT_PROGRESS_MAX);
+	g_atomic_int_set(&job->done, 1);
+
+	return NULL;
+}
+
+void export_job_start(struct export_job *job)
+{
+	job->thread = g_thread_new("export", export_job_run, job);
+}
+
+void export_job_cancel(struct export_job *job)
+{
+	g_atomic_int_set(&job->cancel, 1);
+}
+
+bool export_job_is_done(struct export_job *job)
+{
+	return !!g_atomic_int_get(&job->done);
+}
+
+double export_job_get_progress(struct export_job *job)
+{
+	return (double)g_atomic_int_get(&job->progress) / EXPORT_PROGRESS_MAX;
+}
+
+int export_job_wait(struct export_job *job)
+{
+	if (job->thread) {
+		g_thread_join(job->thread);
+		job->thread = NULL;
+	}
+
+	return job->ret;
+}
+
+void export_job_free(struct export_job *job)
+{
+	GSList *node;
+	unsigned int i;
+
+	if (!job)
+		return;
+
+	export_job_wait(job);
+
+	for (node = job->sections; node; node = g_slist_next(node)) {
+		struct export_section *section = node->data;
+
+		for (i = 0; i < section->num_columns; i++) {
+			g_free(section->columns[i].name);
+			g_free(section->columns[i].data);
+		}
+		g_free(section->columns);
+		g_free(section->header);
+		g_free(section->footer);
+		g_free(section);
+	}
+	g_slist_free(job->sections);
+
+	if (job->pixbuf)
+		g_object_unref(job->pixbuf);
+	g_free(job->hw);
+	g_free(job->filename);
+	g_free(job);
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __EXPORT_WORKER_H__
+#define __EXPORT_WORKER_H__
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <stdbool.h>
+
+enum export_format {
+	EXPORT_TEXT,
+	EXPORT_MAT,
+	EXPORT_PNG,
+	EXPORT_SIGMF,
+};
+
+/*
+ * A section of a text export is an optional header, followed by one line
+ * per row in which the value of each column is followed by a separator,
+ * and an optional footer. MAT exports save each column as a variable.
+ * SigMF exports pair the columns of the first section as I/Q and write
+ * a recording for each pair (or for the last column alone).
+ */
+struct export_column {
+	char *name;
+	gfloat *data;
+	/* MAT only: when non-zero, save data / scale as doubles */
+	double scale;
+	/* SigMF only: center frequency in Hz, 0 if unknown */
+	double frequency;
+};
+
+struct export_section {
+	char *header;
+	char *footer;
+	const char *sep;
+	const char *last_sep;
+	unsigned int rows;
+	unsigned int num_columns;
+	struct export_column *columns;
+};
+
+struct export_job {
+	enum export_format format;
+	char *filename;
+	GSList *sections;
+	GdkPixbuf *pixbuf;
+
+	/* SigMF only */
+	char *hw;
+	double sample_rate;
+	gint64 timestamp;
+	bool int16;
+
+	GThread *thread;
+	gint progress;
+	gint cancel;
+	gint done;
+	int ret;
+};
+
+#define EXPORT_PROGRESS_MAX 1000
+
+struct export_job * export_job_new(enum export_format format, const char *filename);
+struct export_section * export_job_add_section(struct export_job *job,
+		const char *header, const char *sep, const char *last_sep,
+		unsigned int rows);
+void export_section_set_footer(struct export_section *section, const char *footer);
+struct export_column * export_section_add_column(struct export_section *section,
+		const char *name, const gfloat *data, double scale);
+void export_job_set_pixbuf(struct export_job *job, GdkPixbuf *pixbuf);
+void export_job_set_sigmf_info(struct export_job *job, const char *hw,
+		double sample_rate, gint64 timestamp, bool int16);
+
+void export_job_start(struct export_job *job);
+void export_job_cancel(struct export_job *job);
+bool export_job_is_done(struct export_job *job);
+double export_job_get_progress(struct export_job *job);
+int export_job_wait(struct export_job *job);
+void export_job_free(struct export_job *job);
+
+size_t export_format_float(char *buf, gfloat value);
+
+#endif /* __EXPORT_WORKER_H__ */
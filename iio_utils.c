@@ -1,5 +1,6 @@
 #include "iio_utils.h"
 
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -100,3 +101,224 @@ int str_natural_cmp(const char *s1, const char *s2)
 
 	return 0;
 }
+
+/*
+ * Name index of a context: devices by ID or name, and the position of
+ * devices and channels by label (name, or ID when there is no name). The
+ * first device or channel wins, as with a linear scan. Hits are checked
+ * against the context, so an index that went stale is built again.
+ */
+struct device_index {
+	struct iio_device *dev;
+	unsigned int position;
+	/* Label -> position + 1, filled on the first lookup of a channel */
+	GHashTable *channels;
+};
+
+struct context_index {
+	struct iio_context *ctx;
+	unsigned int nb_devices;
+	GHashTable *by_id_or_name;
+	GHashTable *by_label;
+	GHashTable *by_device;
+};
+
+static GHashTable *context_indexes;
+static GMutex context_indexes_lock;
+
+static const char * device_label(const struct iio_device *dev)
+{
+	return iio_device_get_name(dev) ?: iio_device_get_id(dev);
+}
+
+static const char * channel_label(const struct iio_channel *chn)
+{
+	return iio_channel_get_name(chn) ?: iio_channel_get_id(chn);
+}
+
+static void device_index_free(gpointer data)
+{
+	struct device_index *di = data;
+
+	if (di->channels)
+		g_hash_table_destroy(di->channels);
+	g_free(di);
+}
+
+static void context_index_free(gpointer data)
+{
+	struct context_index *ci = data;
+
+	g_hash_table_destroy(ci->by_id_or_name);
+	g_hash_table_destroy(ci->by_label);
+	g_hash_table_destroy(ci->by_device);
+	g_free(ci);
+}
+
+static void insert_first(GHashTable *table, const char *key, gpointer value)
+{
+	if (key && !g_hash_table_contains(table, key))
+		g_hash_table_insert(table, (gpointer)key, value);
+}
+
+static struct context_index * context_index_build(struct iio_context *ctx)
+{
+	struct context_index *ci = g_new0(struct context_index, 1);
+	unsigned int i;
+
+	ci->ctx = ctx;
+	ci->nb_devices = iio_context_get_devices_count(ctx);
+	ci->by_id_or_name = g_hash_table_new(g_str_hash, g_str_equal);
+	ci->by_label = g_hash_table_new(g_str_hash, g_str_equal);
+	ci->by_device = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, device_index_free);
+
+	for (i = 0; i < ci->nb_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct device_index *di = g_new0(struct device_index, 1);
+
+		di->dev = dev;
+		di->position = i;
+		g_hash_table_insert(ci->by_device, dev, di);
+
+		insert_first(ci->by_id_or_name, iio_device_get_id(dev), di);
+		insert_first(ci->by_id_or_name, iio_device_get_name(dev), di);
+		insert_first(ci->by_label, device_label(dev), di);
+	}
+
+	if (!context_indexes)
+		context_indexes = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, context_index_free);
+	g_hash_table_replace(context_indexes, ctx, ci);
+
+	return ci;
+}
+
+static struct context_index * context_index_get(struct iio_context *ctx)
+{
+	struct context_index *ci = NULL;
+
+	if (context_indexes)
+		ci = g_hash_table_lookup(context_indexes, ctx);
+	if (!ci || ci->nb_devices != iio_context_get_devices_count(ctx))
+		ci = context_index_build(ctx);
+
+	return ci;
+}
+
+static bool device_index_valid(struct context_index *ci,
+		struct device_index *di, bool by_label, const char *name)
+{
+	const char *dev_name;
+
+	if (di->position >= iio_context_get_devices_count(ci->ctx) ||
+			iio_context_get_device(ci->ctx, di->position) != di->dev)
+		return false;
+
+	if (by_label)
+		return !strcmp(device_label(di->dev), name);
+
+	dev_name = iio_device_get_name(di->dev);
+	return !strcmp(iio_device_get_id(di->dev), name) ||
+		(dev_name && !strcmp(dev_name, name));
+}
+
+/* Looks a device up, building the index again once if it went stale */
+static struct device_index * context_index_lookup(struct iio_context *ctx,
+		bool by_label, const char *name)
+{
+	struct context_index *ci = context_index_get(ctx);
+	struct device_index *di;
+
+	di = g_hash_table_lookup(by_label ? ci->by_label : ci->by_id_or_name, name);
+	if (di && !device_index_valid(ci, di, by_label, name)) {
+		ci = context_index_build(ctx);
+		di = g_hash_table_lookup(by_label ? ci->by_label :
+				ci->by_id_or_name, name);
+	}
+
+	return di;
+}
+
+/* Same as iio_context_find_device(), without going through all the devices */
+struct iio_device * iio_utils_find_device(struct iio_context *ctx,
+		const char *name)
+{
+	struct device_index *di;
+
+	if (!ctx || !name)
+		return NULL;
+
+	g_mutex_lock(&context_indexes_lock);
+	di = context_index_lookup(ctx, false, name);
+	g_mutex_unlock(&context_indexes_lock);
+
+	return di ? di->dev : NULL;
+}
+
+int iio_utils_device_position(struct iio_context *ctx, const char *label)
+{
+	struct device_index *di;
+
+	if (!ctx || !label)
+		return -1;
+
+	g_mutex_lock(&context_indexes_lock);
+	di = context_index_lookup(ctx, true, label);
+	g_mutex_unlock(&context_indexes_lock);
+
+	return di ? (int)di->position : -1;
+}
+
+int iio_utils_channel_position(struct iio_device *dev, const char *label)
+{
+	struct iio_context *ctx;
+	struct context_index *ci;
+	struct device_index *di;
+	unsigned int i, nb_channels;
+	int ret = -1;
+
+	if (!dev || !label)
+		return -1;
+
+	ctx = (struct iio_context *)iio_device_get_context(dev);
+	nb_channels = iio_device_get_channels_count(dev);
+
+	g_mutex_lock(&context_indexes_lock);
+	ci = context_index_get(ctx);
+	di = g_hash_table_lookup(ci->by_device, dev);
+	if (!di)
+		goto out;
+
+	if (!di->channels) {
+		di->channels = g_hash_table_new(g_str_hash, g_str_equal);
+		for (i = 0; i < nb_channels; i++)
+			insert_first(di->channels,
+					channel_label(iio_device_get_channel(dev, i)),
+					GUINT_TO_POINTER(i + 1));
+	}
+
+	ret = GPOINTER_TO_UINT(g_hash_table_lookup(di->channels, label)) - 1;
+
+	/* Stale index: look for the channel as if there was none */
+	if (ret >= (int)nb_channels || (ret >= 0 && strcmp(label,
+				channel_label(iio_device_get_channel(dev, ret))))) {
+		g_hash_table_destroy(di->channels);
+		di->channels = NULL;
+		for (ret = -1, i = 0; ret < 0 && i < nb_channels; i++)
+			if (!strcmp(label, channel_label(iio_device_get_channel(dev, i))))
+				ret = i;
+	}
+
+out:
+	g_mutex_unlock(&context_indexes_lock);
+	return ret;
+}
+
+void iio_utils_forget_context(struct iio_context *ctx)
+{
+	g_mutex_lock(&context_indexes_lock);
+	if (context_indexes)
+		g_hash_table_remove(context_indexes, ctx);
+	g_mutex_unlock(&context_indexes_lock);
+}
@@ -16,4 +16,16 @@ GArray * get_iio_channels_naturally_sorted(struct iio_device *dev);
 
 int str_natural_cmp(const char *s1, const char *s2);
 
+/*
+ * Lookups by name through an index of each context, built on first use.
+ * Labels are names, or IDs for devices and channels without a name.
+ * Positions are -1 when nothing matches.
+ */
+struct iio_device * iio_utils_find_device(struct iio_context *ctx,
+		const char *name);
+int iio_utils_device_position(struct iio_context *ctx, const char *label);
+int iio_utils_channel_position(struct iio_device *dev, const char *label);
+/* Must be called before the context is destroyed */
+void iio_utils_forget_context(struct iio_context *ctx);
+
 #endif  /* __IIO_UTILS__ */
@@ -19,6 +19,158 @@ struct update_widgets_params {
 	unsigned int nb;
 };
 
+/*
+ * Attribute values of a device or a channel, all read in a single
+ * iio_*_attr_read_all() call: one round trip on network contexts, instead
+ * of one per widget. iio_update_widgets() refreshes each device or channel
+ * it meets once per call, and only its reads use the values: a single
+ * iio_widget_update() always reads the attribute itself, so it sees writes
+ * done behind the back of the widgets. Writes through a widget drop the
+ * values of the device and of all its channels, as they may depend on each
+ * other.
+ */
+struct attr_cache {
+	struct iio_device *dev;
+	gint64 timestamp;
+	/* Set when the backend can't read all the attributes at once */
+	int ret;
+	/* Attribute name -> GByteArray with the value, as read */
+	GHashTable *values;
+};
+
+/* Device or channel -> struct attr_cache */
+static GHashTable *attr_caches;
+/* Start of the current refresh pass, 0 outside of iio_update_widgets() */
+static gint64 refresh_pass;
+
+static void attr_cache_free(gpointer data)
+{
+	struct attr_cache *cache = data;
+
+	g_hash_table_destroy(cache->values);
+	g_free(cache);
+}
+
+static void byte_array_free(gpointer data)
+{
+	g_byte_array_free(data, TRUE);
+}
+
+static struct attr_cache * attr_cache_get(struct iio_device *dev,
+		struct iio_channel *chn)
+{
+	gconstpointer key = chn ? (gconstpointer)chn : (gconstpointer)dev;
+	struct attr_cache *cache;
+
+	if (!attr_caches)
+		attr_caches = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, attr_cache_free);
+
+	cache = g_hash_table_lookup(attr_caches, key);
+	if (!cache) {
+		cache = g_new0(struct attr_cache, 1);
+		cache->dev = dev;
+		cache->values = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, byte_array_free);
+		g_hash_table_insert(attr_caches, (gpointer)key, cache);
+	}
+
+	return cache;
+}
+
+static void attr_cache_store(struct attr_cache *cache, const char *attr,
+		const char *value, size_t len)
+{
+	GByteArray *array = g_byte_array_sized_new(len);
+
+	g_byte_array_append(array, (const guint8 *)value, len);
+	g_hash_table_replace(cache->values, g_strdup(attr), array);
+}
+
+static int attr_cache_dev_cb(struct iio_device *dev, const char *attr,
+		const char *value, size_t len, void *d)
+{
+	attr_cache_store(d, attr, value, len);
+	return 0;
+}
+
+static int attr_cache_chn_cb(struct iio_channel *chn, const char *attr,
+		const char *value, size_t len, void *d)
+{
+	attr_cache_store(d, attr, value, len);
+	return 0;
+}
+
+static void attr_cache_refresh(struct attr_cache *cache,
+		struct iio_channel *chn)
+{
+	g_hash_table_remove_all(cache->values);
+
+	if (chn)
+		cache->ret = iio_channel_attr_read_all(chn,
+				attr_cache_chn_cb, cache);
+	else
+		cache->ret = iio_device_attr_read_all(cache->dev,
+				attr_cache_dev_cb, cache);
+	cache->timestamp = g_get_monotonic_time();
+}
+
+/* Drop the values of @dev and of its channels */
+static void attr_cache_invalidate(struct iio_device *dev)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!attr_caches)
+		return;
+
+	g_hash_table_iter_init(&iter, attr_caches);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct attr_cache *cache = value;
+
+		if (cache->dev == dev)
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+void iio_widget_cache_flush(void)
+{
+	if (attr_caches)
+		g_hash_table_remove_all(attr_caches);
+}
+
+/* Same as iio_{channel,device}_attr_read(), through the cache in a pass */
+static ssize_t widget_attr_read(struct iio_widget *widget, const char *attr,
+		char *dst, size_t len)
+{
+	struct attr_cache *cache;
+	GByteArray *value;
+
+	if (refresh_pass) {
+		cache = attr_cache_get(widget->dev, widget->chn);
+		if (cache->timestamp < refresh_pass)
+			attr_cache_refresh(cache, widget->chn);
+
+		value = cache->ret ? NULL :
+			g_hash_table_lookup(cache->values, attr);
+		if (value && value->len && value->len <= len) {
+			memcpy(dst, value->data, value->len);
+			dst[value->len - 1] = '\0';
+			return value->len;
+		}
+	}
+
+	if (widget->chn)
+		return iio_channel_attr_read(widget->chn, attr, dst, len);
+	else
+		return iio_device_attr_read(widget->dev, attr, dst, len);
+}
+
+static void widget_attr_written(struct iio_widget *widget)
+{
+	attr_cache_invalidate(widget->dev);
+}
+
 void g_builder_connect_signal(GtkBuilder *builder, const gchar *name,
 	const gchar *signal, GCallback callback, gpointer data)
 {
@@ -129,12 +281,7 @@ static void iio_spin_button_update(struct iio_widget *widget)
 	ssize_t ret;
 	char buf[0x100];
 
-	if (widget->chn)
-		ret = iio_channel_attr_read(widget->chn,
-				widget->attr_name, buf, sizeof(buf));
-	else
-		ret = iio_device_attr_read(widget->dev,
-				widget->attr_name, buf, sizeof(buf));
+	ret = widget_attr_read(widget, widget->attr_name, buf, sizeof(buf));
 	if (ret > 0)
 		iio_spin_button_update_value(widget, buf, ret);
 	else if (ret == -ENODEV)
@@ -171,6 +318,7 @@ static void spin_button_save(struct iio_widget *widget, bool is_double)
 			iio_device_attr_write_longlong(widget->dev,
 					widget->attr_name, (long long) freq);
 	}
+	widget_attr_written(widget);
 }
 
 static void iio_spin_button_savedbl(struct iio_widget *widget)
@@ -221,6 +369,7 @@ static void iio_toggle_button_save(struct iio_widget *widget)
 	else
 		iio_device_attr_write_bool(widget->dev,
 				widget->attr_name, active);
+	widget_attr_written(widget);
 }
 
 static void iio_toggle_button_update_value(struct iio_widget *widget,
@@ -241,12 +390,7 @@ static void iio_toggle_button_update(struct iio_widget *widget)
 	char buf[0x100];
 	ssize_t ret;
 
-	if (widget->chn)
-		ret = iio_channel_attr_read(widget->chn,
-				widget->attr_name, buf, sizeof(buf));
-	else
-		ret = iio_device_attr_read(widget->dev,
-				widget->attr_name, buf, sizeof(buf));
+	ret = widget_attr_read(widget, widget->attr_name, buf, sizeof(buf));
 	if (ret > 0)
 		iio_toggle_button_update_value(widget, buf, ret);
 	else if (ret == -ENODEV)
@@ -270,6 +414,7 @@ static void iio_button_save(struct iio_widget *widget)
 	else
 		iio_device_attr_write_bool(widget->dev,
 						   widget->attr_name, 1);
+	widget_attr_written(widget);
 }
 
 static void iio_button_update_value(struct iio_widget *widget,
@@ -304,6 +449,7 @@ static void iio_combo_box_save(struct iio_widget *widget)
 		iio_channel_attr_write(widget->chn, widget->attr_name, text);
 	else
 		iio_device_attr_write(widget->dev, widget->attr_name, text);
+	widget_attr_written(widget);
 }
 
 static void iio_combo_box_update_value(struct iio_widget *widget,
@@ -322,12 +468,8 @@ static void iio_combo_box_update_value(struct iio_widget *widget,
 	model = gtk_combo_box_get_model(combo_box);
 
 	if (widget->attr_name_avail) {
-		if (widget->chn)
-			ret = iio_channel_attr_read(widget->chn,
-					widget->attr_name_avail, text2, sizeof(text2));
-		else
-			ret = iio_device_attr_read(widget->dev,
-					widget->attr_name_avail, text2, sizeof(text2));
+		ret = widget_attr_read(widget, widget->attr_name_avail,
+				text2, sizeof(text2));
 		if (ret < 0)
 			return;
 
@@ -369,12 +511,7 @@ static void iio_combo_box_update(struct iio_widget *widget)
 	ssize_t len;
 	char text[1024];
 
-	if (widget->chn)
-		len = iio_channel_attr_read(widget->chn,
-				widget->attr_name, text, sizeof(text));
-	else
-		len = iio_device_attr_read(widget->dev,
-				widget->attr_name, text, sizeof(text));
+	len = widget_attr_read(widget, widget->attr_name, text, sizeof(text));
 	if (len > 0)
 		iio_combo_box_update_value(widget, text, len);
 }
@@ -404,10 +541,14 @@ void iio_widget_save(struct iio_widget *widget)
 
 void iio_update_widgets(struct iio_widget *widgets, unsigned int num_widgets)
 {
+	gint64 outer_pass = refresh_pass;
 	unsigned int i;
 
+	/* Updates may trigger callbacks that refresh other widgets */
+	refresh_pass = g_get_monotonic_time();
 	for (i = 0; i < num_widgets; i++)
 		iio_widget_update(&widgets[i]);
+	refresh_pass = outer_pass;
 }
 
 static int __cb_dev_update(struct iio_device *dev, const char *attr,
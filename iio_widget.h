@@ -41,6 +41,8 @@ void iio_widget_update(struct iio_widget *widget);
 void iio_update_widgets_of_device(struct iio_widget *widgets,
 		unsigned int num_widgets, struct iio_device *dev);
 void iio_widget_save(struct iio_widget *widget);
+/* Forget the attribute values read, before the devices are destroyed */
+void iio_widget_cache_flush(void);
 void iio_save_widgets(struct iio_widget *widgets, unsigned int num_widgets);
 
 void iio_spin_button_init(struct iio_widget *widget, struct iio_device *dev,
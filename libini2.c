@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <iio.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <glib.h>
@@ -14,111 +15,402 @@
 #define LONG_LONG_FORMAT "%lld"
 #endif
 
+/*
+ * Callbacks of foreach_in_ini() slower than this are reported in DEBUG
+ * builds; waits such as capture cycles are slow on purpose.
+ */
+#define INI_SLOW_CALLBACK_US 100000
+
+/*
+ * Writing an attribute may change others, which update_from_ini() reads
+ * back and writes again, up to this number of times.
+ */
+#define INI_APPLY_PASSES 3
+
+/* A key/value pair of an INI section, pointing into the INI buffer */
+struct ini_pair {
+	const char *key, *value;
+	size_t klen, vlen;
+};
+
+/* An attribute restored by update_from_ini() */
+struct ini_attr {
+	struct iio_channel *chn;
+	const char *attr;
+	bool debug;
+	char *value;
+	unsigned int rank;
+	unsigned int order;
+
+	/* The device holds the value, as of the last read */
+	bool equal;
+	bool written;
+};
+
 struct load_store_params {
 	const struct iio_device *dev;
-	const char * const *whitelist;
-	size_t list_len;
 	bool is_debug;
 	FILE *f;
 	struct INI *ini;
-	const void *section_top;
+
+	/* Whitelisted keys, and the pairs of the section indexed by key */
+	GHashTable *whitelist;
+	GArray *pairs;
+	GHashTable *index;
+
+	/* Attributes to restore, and their positions in the array by key */
+	GArray *attrs;
+	GHashTable *attrs_index;
+
+	/* Key of the attribute being looked up */
+	GString *key;
 };
 
-static bool attr_matches(const char *dev_name, size_t dev_len,
-		const char *attr, size_t attr_len,
-		const char *key, size_t len, bool debug)
+static guint ini_pair_hash(gconstpointer p)
+{
+	const struct ini_pair *pair = p;
+	guint hash = 5381;
+	size_t i;
+
+	for (i = 0; i < pair->klen; i++)
+		hash = hash * 33 + (guchar) pair->key[i];
+	return hash;
+}
+
+static gboolean ini_pair_equal(gconstpointer a, gconstpointer b)
 {
-	return (!debug && (len == dev_len + 1 + attr_len) &&
-			!strncmp(key, dev_name, dev_len) &&
-			!strncmp(key + dev_len + 1, attr, attr_len)) ||
-		(debug && (len == dev_len + sizeof("debug.") + attr_len) &&
-			!strncmp(key, "debug.", sizeof("debug.") - 1) &&
-			!strncmp(key + sizeof("debug.") - 1, dev_name, dev_len) &&
-			!strncmp(key + sizeof("debug.") + dev_len, attr, attr_len));
+	const struct ini_pair *pa = a, *pb = b;
+
+	return pa->klen == pb->klen && !memcmp(pa->key, pb->key, pa->klen);
 }
 
-static bool attr_in_whitelist(const char *attr,
-		const char *dev_name, size_t dev_len, bool is_debug,
+static void params_init(struct load_store_params *params,
 		const char * const *whitelist, size_t list_len)
 {
 	unsigned int i;
+
+	params->whitelist = g_hash_table_new(g_str_hash, g_str_equal);
 	for (i = 0; i < list_len && whitelist[i]; i++)
-		if ((!is_debug && !strncmp(whitelist[i], dev_name, dev_len) &&
-					!strcmp(whitelist[i] + dev_len + 1, attr)) ||
-				(is_debug && !strncmp(whitelist[i], "debug.", sizeof("debug.") - 1) &&
-					!strncmp(whitelist[i] + sizeof("debug.") - 1, dev_name, dev_len) &&
-					!strcmp(whitelist[i] + sizeof("debug.") + dev_len, attr)))
-			return true;
-	return false;
+		g_hash_table_insert(params->whitelist, (gpointer) whitelist[i],
+				(gpointer) whitelist[i]);
+
+	params->key = g_string_new(NULL);
 }
 
-static ssize_t read_from_ini(struct load_store_params *params,
-		const char *dev_name, size_t name_len,
-		const char *attr, void *buf, size_t len)
+static void params_free(struct load_store_params *params)
 {
-	bool found = false;
-	const char *key, *value;
-	size_t klen, vlen;
+	g_hash_table_destroy(params->whitelist);
+	g_string_free(params->key, TRUE);
 
-	if (!len)
-		return 0;
+	if (params->index)
+		g_hash_table_destroy(params->index);
+	if (params->pairs)
+		g_array_free(params->pairs, TRUE);
 
-	/* Rewind to the beginning of the section */
-	ini_set_read_pointer(params->ini, params->section_top);
+	if (params->attrs) {
+		unsigned int i;
 
-	while (!found && ini_read_pair(params->ini,
-				&key, &klen, &value, &vlen) > 0)
-		found = attr_matches(dev_name, name_len, attr, strlen(attr),
-				key, klen, params->is_debug);
-	if (!found)
+		for (i = 0; i < params->attrs->len; i++)
+			g_free(g_array_index(params->attrs, struct ini_attr, i).value);
+		g_array_free(params->attrs, TRUE);
+	}
+	if (params->attrs_index)
+		g_hash_table_destroy(params->attrs_index);
+}
+
+/* Index the pairs of the section the INI read pointer is in */
+static void index_section(struct load_store_params *params)
+{
+	struct ini_pair pair;
+	unsigned int i;
+
+	params->pairs = g_array_new(FALSE, FALSE, sizeof(struct ini_pair));
+	while (ini_read_pair(params->ini, &pair.key, &pair.klen,
+				&pair.value, &pair.vlen) > 0)
+		g_array_append_val(params->pairs, pair);
+
+	/* Going backwards, the first occurrence of a key is the one kept */
+	params->index = g_hash_table_new(ini_pair_hash, ini_pair_equal);
+	for (i = params->pairs->len; i > 0; i--) {
+		struct ini_pair *p = &g_array_index(params->pairs,
+				struct ini_pair, i - 1);
+
+		g_hash_table_insert(params->index, p, p);
+	}
+}
+
+/* "<device>.<attr>", or "debug.<device>.<attr>" for debug attributes */
+static const char * attr_key(struct load_store_params *params,
+		const char *dev_name, const char *attr)
+{
+	GString *key = params->key;
+
+	g_string_truncate(key, 0);
+	if (params->is_debug)
+		g_string_append(key, "debug.");
+	if (dev_name)
+		g_string_append(key, dev_name);
+	g_string_append_c(key, '.');
+	g_string_append(key, attr);
+
+	return key->str;
+}
+
+static bool attr_in_whitelist(struct load_store_params *params, const char *key)
+{
+	return g_hash_table_lookup(params->whitelist, key) != NULL;
+}
+
+static const struct ini_pair * find_pair(struct load_store_params *params,
+		const char *key)
+{
+	struct ini_pair probe;
+
+	probe.key = key;
+	probe.klen = strlen(key);
+	return g_hash_table_lookup(params->index, &probe);
+}
+
+/* Trim blanks, and the unit that gains are read back with */
+static void value_bounds(const char **str, size_t *len)
+{
+	const char *s = *str, *end = *str + *len;
+
+	while (s < end && g_ascii_isspace(*s))
+		s++;
+	while (end > s && g_ascii_isspace(end[-1]))
+		end--;
+	if (end - s > 2 && !strncmp(end - 2, "dB", 2))
+		for (end -= 2; end > s && end[-1] == ' '; end--);
+
+	*str = s;
+	*len = end - s;
+}
+
+/*
+ * Values read from the device seldom match the profile byte for byte:
+ * numbers are formatted differently, and gains have a " dB" suffix.
+ */
+static bool values_equal(const char *a, const char *b)
+{
+	size_t alen = strlen(a), blen = strlen(b);
+	char *na, *nb, *enda, *endb;
+	double va, vb;
+	bool equal;
+
+	value_bounds(&a, &alen);
+	value_bounds(&b, &blen);
+	if (alen == blen && !memcmp(a, b, alen))
+		return true;
+
+	na = g_strndup(a, alen);
+	nb = g_strndup(b, blen);
+	va = g_ascii_strtod(na, &enda);
+	vb = g_ascii_strtod(nb, &endb);
+	equal = alen && blen && !*enda && !*endb &&
+		fabs(va - vb) <= 1e-12 * MAX(fabs(va), fabs(vb));
+	g_free(na);
+	g_free(nb);
+
+	return equal;
+}
+
+/*
+ * Attributes that others depend on are written first: modes decide what
+ * can be set, and sample rates bound the bandwidths. Others keep the
+ * order of channels, device and debug attributes.
+ */
+static unsigned int attr_rank(const char *attr)
+{
+	if (g_str_has_suffix(attr, "_mode"))
 		return 0;
+	if (g_str_has_suffix(attr, "sampling_frequency"))
+		return 1;
+	if (g_str_has_suffix(attr, "rf_bandwidth"))
+		return 2;
+	return 3;
+}
+
+static gint ini_attr_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct ini_attr *aa = a, *ab = b;
 
-	if (len > vlen)
-		len = vlen;
-	memcpy(buf, value, len);
-	return (ssize_t) len;
+	if (aa->rank != ab->rank)
+		return aa->rank < ab->rank ? -1 : 1;
+	return aa->order < ab->order ? -1 : aa->order > ab->order;
 }
 
-static ssize_t update_from_ini_dev_cb(struct iio_device *dev,
-		const char *attr, void *buf, size_t len, void *d)
+static void add_attr(struct load_store_params *params,
+		struct iio_channel *chn, const char *attr, const char *key)
+{
+	const struct ini_pair *pair;
+	struct ini_attr ia;
+	const char *value;
+	size_t vlen;
+
+	if (!attr_in_whitelist(params, key))
+		return;
+
+	/* Attributes shared by type come once per channel, for one file */
+	if (g_hash_table_contains(params->attrs_index, key))
+		return;
+
+	pair = find_pair(params, key);
+	if (!pair)
+		return;
+
+	value = pair->value;
+	vlen = pair->vlen;
+
+	/* Dirty workaround that strips the "dB" suffix of
+	 * hardwaregain value. Fix me when possible. */
+	if (chn && !strcmp(attr, "hardwaregain"))
+		value_bounds(&value, &vlen);
+
+	ia.chn = chn;
+	ia.attr = attr;
+	ia.debug = params->is_debug;
+	ia.value = g_strndup(value, vlen);
+	ia.rank = attr_rank(attr);
+	ia.order = params->attrs->len;
+	ia.equal = false;
+	ia.written = false;
+	g_array_append_val(params->attrs, ia);
+	g_hash_table_insert(params->attrs_index, g_strdup(key), NULL);
+}
+
+/* Collect the attributes of @dev that the profile sets, in write order */
+static void collect_attrs(struct load_store_params *params,
+		struct iio_device *dev)
 {
-	struct load_store_params *params = (struct load_store_params *) d;
 	const char *dev_name = iio_device_get_name(dev);
-	size_t name_len = dev_name ? strlen(dev_name) : 0;
+	unsigned int i, j;
+
+	params->attrs = g_array_new(FALSE, FALSE, sizeof(struct ini_attr));
+	params->attrs_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+
+	params->is_debug = false;
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		struct iio_channel *chn = iio_device_get_channel(dev, i);
+
+		for (j = 0; j < iio_channel_get_attrs_count(chn); j++) {
+			const char *attr = iio_channel_get_attr(chn, j);
 
-	if (attr_in_whitelist(attr, dev_name, name_len, params->is_debug,
-				params->whitelist, params->list_len))
-		return read_from_ini(params,
-				dev_name, name_len, attr, buf, len);
+			add_attr(params, chn, attr, attr_key(params, dev_name,
+					iio_channel_attr_get_filename(chn, attr)));
+		}
+	}
+
+	for (i = 0; i < iio_device_get_attrs_count(dev); i++) {
+		const char *attr = iio_device_get_attr(dev, i);
+
+		add_attr(params, NULL, attr, attr_key(params, dev_name, attr));
+	}
+
+	params->is_debug = true;
+	for (i = 0; i < iio_device_get_debug_attrs_count(dev); i++) {
+		const char *attr = iio_device_get_debug_attr(dev, i);
+
+		add_attr(params, NULL, attr, attr_key(params, dev_name, attr));
+	}
+
+	g_array_sort(params->attrs, ini_attr_cmp);
+
+	for (i = 0; i < params->attrs->len; i++) {
+		struct ini_attr *ia = &g_array_index(params->attrs,
+				struct ini_attr, i);
+		const char *key;
+
+		params->is_debug = ia->debug;
+		key = attr_key(params, dev_name, ia->chn ?
+				iio_channel_attr_get_filename(ia->chn, ia->attr) :
+				ia->attr);
+		g_hash_table_insert(params->attrs_index, g_strdup(key),
+				GUINT_TO_POINTER(i + 1));
+	}
+}
+
+static void compare_attr(struct load_store_params *params,
+		const char *key, const char *val)
+{
+	gpointer pos = g_hash_table_lookup(params->attrs_index, key);
+	struct ini_attr *ia;
+
+	if (!pos)
+		return;
+
+	ia = &g_array_index(params->attrs, struct ini_attr,
+			GPOINTER_TO_UINT(pos) - 1);
+	ia->equal = values_equal(val, ia->value);
+}
+
+static int compare_dev_cb(struct iio_device *dev,
+		const char *attr, const char *val, size_t len, void *d)
+{
+	struct load_store_params *params = (struct load_store_params *) d;
+
+	compare_attr(params, attr_key(params, iio_device_get_name(dev), attr), val);
 	return 0;
 }
 
-static ssize_t update_from_ini_chn_cb(struct iio_channel *chn,
-		const char *attr, void *buf, size_t len, void *d)
+static int compare_chn_cb(struct iio_channel *chn,
+		const char *attr, const char *val, size_t len, void *d)
 {
 	struct load_store_params *params = (struct load_store_params *) d;
-	const char *dev_name = iio_device_get_name(params->dev);
-	size_t name_len = dev_name ? strlen(dev_name) : 0;
-	bool is_hardwaregain = !strncmp(attr, "hardwaregain", len);
 
 	attr = iio_channel_attr_get_filename(chn, attr);
-	if (attr_in_whitelist(attr, dev_name, name_len, false,
-				params->whitelist, params->list_len)) {
-		ssize_t ret = read_from_ini(params,
-				dev_name, name_len, attr, buf, len);
-
-		/* Dirty workaround that strips the "dB" suffix of
-		 * hardwaregain value. Fix me when possible. */
-		if (is_hardwaregain) {
-			char *tmp = strstr((char *) buf, " dB");
-			if (tmp)
-				*tmp = '\0';
-		}
-		return ret;
-	}
+	compare_attr(params, attr_key(params,
+				iio_device_get_name(params->dev), attr), val);
 	return 0;
 }
 
+/* Read the current values of the device in bulk, and compare them */
+static void compare_attrs(struct load_store_params *params,
+		struct iio_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < params->attrs->len; i++)
+		g_array_index(params->attrs, struct ini_attr, i).equal = false;
+
+	params->is_debug = false;
+	for (i = 0; i < iio_device_get_channels_count(dev); i++)
+		iio_channel_attr_read_all(iio_device_get_channel(dev, i),
+				compare_chn_cb, params);
+
+	if (iio_device_get_attrs_count(dev))
+		iio_device_attr_read_all(dev, compare_dev_cb, params);
+
+	params->is_debug = true;
+	if (iio_device_get_debug_attrs_count(dev))
+		iio_device_debug_attr_read_all(dev, compare_dev_cb, params);
+}
+
+static void write_attr(struct iio_device *dev, struct ini_attr *ia)
+{
+	ssize_t ret;
+
+	if (ia->chn)
+		ret = iio_channel_attr_write(ia->chn, ia->attr, ia->value);
+	else if (ia->debug)
+		ret = iio_device_debug_attr_write(dev, ia->attr, ia->value);
+	else
+		ret = iio_device_attr_write(dev, ia->attr, ia->value);
+
+	if (ret < 0)
+		fprintf(stderr, "Unable to write '%s' to %s:%s: %s\n", ia->value,
+				ia->chn ? iio_channel_get_id(ia->chn) :
+				iio_device_get_name(dev), ia->attr, strerror(-ret));
+	ia->written = true;
+}
+
+/*
+ * Only the attributes that differ from the profile are written. Those that
+ * change as a side effect of other writes are caught by reading back. A
+ * written value that reads back differently was rounded by the driver, and
+ * is not written again.
+ */
 void update_from_ini(const char *ini_file,
 		const char *driver_name, struct iio_device *dev,
 		const char * const *whitelist, size_t list_len)
@@ -126,12 +418,10 @@ void update_from_ini(const char *ini_file,
 	bool found = false;
 	const char *name;
 	size_t nlen, dlen;
-	unsigned int i;
+	unsigned int i, pass, writes;
 	struct INI *ini = ini_open(ini_file);
 	struct load_store_params params = {
 		.dev = dev,
-		.whitelist = whitelist,
-		.list_len = list_len,
 		.is_debug = false,
 		.ini = ini,
 	};
@@ -155,18 +445,29 @@ void update_from_ini(const char *ini_file,
 		return;
 	}
 
-	params.section_top = name + nlen + 1;
+	params_init(&params, whitelist, list_len);
+	index_section(&params);
+	collect_attrs(&params, dev);
 
-	for (i = 0; i < iio_device_get_channels_count(dev); i++)
-		iio_channel_attr_write_all(iio_device_get_channel(dev, i),
-				update_from_ini_chn_cb, &params);
+	for (pass = 0; pass < INI_APPLY_PASSES; pass++) {
+		compare_attrs(&params, dev);
 
-	if (iio_device_get_attrs_count(dev))
-		iio_device_attr_write_all(dev, update_from_ini_dev_cb, &params);
+		writes = 0;
+		for (i = 0; i < params.attrs->len; i++) {
+			struct ini_attr *ia = &g_array_index(params.attrs,
+					struct ini_attr, i);
 
-	params.is_debug = true;
-	iio_device_debug_attr_write_all(dev, update_from_ini_dev_cb, &params);
+			if (!ia->equal && !ia->written) {
+				write_attr(dev, ia);
+				writes++;
+			}
+		}
+
+		if (!writes)
+			break;
+	}
 
+	params_free(&params);
 	ini_close(ini);
 }
 
@@ -199,16 +500,12 @@ char * read_token_from_ini(const char *ini_file,
 	return dup;
 }
 
-static void write_to_ini(struct load_store_params *params, const char *dev_name,
-		size_t name_len, const char *attr, const char *val, size_t len)
+static void write_to_ini(struct load_store_params *params, const char *key,
+		const char *val, size_t len)
 {
 	FILE *f = params->f;
 
-	if (params->is_debug)
-		fwrite("debug.", 1, sizeof("debug.") - 1, f);
-	fwrite(dev_name, 1, name_len, f);
-	fwrite(".", 1, 1, f);
-	fwrite(attr, 1, strlen(attr), f);
+	fwrite(key, 1, strlen(key), f);
 	fwrite(" = ", 1, sizeof(" = ") - 1, f);
 	fwrite(val, 1, len - 1, f);
 	fwrite("\n", 1, 1, f);
@@ -218,12 +515,10 @@ static int save_to_ini_dev_cb(struct iio_device *dev,
 		const char *attr, const char *val, size_t len, void *d)
 {
 	struct load_store_params *params = (struct load_store_params *) d;
-	const char *dev_name = iio_device_get_name(dev);
-	size_t name_len = dev_name ? strlen(dev_name) : 0;
+	const char *key = attr_key(params, iio_device_get_name(dev), attr);
 
-	if (attr_in_whitelist(attr, dev_name, name_len, params->is_debug,
-				params->whitelist, params->list_len))
-		write_to_ini(params, dev_name, name_len, attr, val, len);
+	if (attr_in_whitelist(params, key))
+		write_to_ini(params, key, val, len);
 	return 0;
 }
 
@@ -231,13 +526,12 @@ static int save_to_ini_chn_cb(struct iio_channel *chn,
 		const char *attr, const char *val, size_t len, void *d)
 {
 	struct load_store_params *params = (struct load_store_params *) d;
-	const char *dev_name = iio_device_get_name(params->dev);
-	size_t name_len = dev_name ? strlen(dev_name) : 0;
+	const char *key;
 
 	attr = iio_channel_attr_get_filename(chn, attr);
-	if (attr_in_whitelist(attr, dev_name, name_len, false,
-				params->whitelist, params->list_len))
-		write_to_ini(params, dev_name, name_len, attr, val, len);
+	key = attr_key(params, iio_device_get_name(params->dev), attr);
+	if (attr_in_whitelist(params, key))
+		write_to_ini(params, key, val, len);
 	return 0;
 }
 
@@ -247,12 +541,11 @@ void save_to_ini(FILE *f, const char *driver_name, struct iio_device *dev,
 	unsigned int i;
 	struct load_store_params params = {
 		.dev = dev,
-		.whitelist = whitelist,
-		.list_len = list_len,
 		.is_debug = false,
 		.f = f,
 	};
 
+	params_init(&params, whitelist, list_len);
 	write_driver_name_to_ini(f, driver_name);
 
 	for (i = 0; i < iio_device_get_channels_count(dev); i++)
@@ -262,67 +555,95 @@ void save_to_ini(FILE *f, const char *driver_name, struct iio_device *dev,
 
 	params.is_debug = true;
 	iio_device_debug_attr_read_all(dev, save_to_ini_dev_cb, &params);
+
+	params_free(&params);
 }
 
-int foreach_in_ini(const char *ini_file,
-		int (*cb)(int, const char *, const char *, const char *))
+static int call_timed(const char *ini_file, int line,
+		int (*cb)(int, const char *, const char *, const char *),
+		const char *section, const char *key, const char *value,
+		struct ini_timing *timing)
 {
-	int ret = 0;
-	const char *name, *key, *value;
+	gint64 start, elapsed;
+	int ret;
+
+	start = g_get_monotonic_time();
+	ret = cb(line, section, key, value);
+	elapsed = g_get_monotonic_time() - start;
+
+#ifdef DEBUG
+	if (elapsed >= INI_SLOW_CALLBACK_US)
+		fprintf(stderr, "%s:%d: [%s] %s took %.1f ms\n",
+				ini_file, line, section, key, elapsed / 1000.0);
+#endif
+
+	if (timing) {
+		timing->count++;
+		timing->total += elapsed;
+		if (elapsed > timing->slowest) {
+			timing->slowest = elapsed;
+			timing->slowest_line = line;
+		}
+	}
+
+	return ret;
+}
+
+static int count_lines(const char *from, const char *to)
+{
+	int lines = 0;
+
+	for (; from < to; from++)
+		lines += (*from == '\n');
+	return lines;
+}
+
+/*
+ * Walk through the pairs of an INI buffer. Names, keys and values are
+ * terminated in place, which overwrites the character that follows each
+ * of them: one that libini already went past. Line numbers are counted as
+ * the walk goes, rather than from the top of the buffer for each pair.
+ */
+static int foreach_in_buf(const char *ini_file, char *buf, size_t len,
+		int (*cb)(int, const char *, const char *, const char *),
+		struct ini_timing *timing)
+{
+	const char *name, *key, *value, *counted = buf;
 	size_t nlen, klen, vlen;
-	struct INI *ini = ini_open(ini_file);
+	int ret = 0, line = 1;
+	struct INI *ini;
+	bool newline;
+	char *end;
+
+	ini = ini_open_mem(buf, len);
 	if (!ini)
 		return -1;
 
 	while (ini_next_section(ini, &name, &nlen) > 0) {
-		char *n = malloc(nlen + 1);
-		if (!n)
-			goto err_ini_close;
-
-		snprintf(n, nlen + 1, "%.*s", (int) nlen, name);
+		((char *) name)[nlen] = '\0';
 
 		while (ini_read_pair(ini, &key, &klen, &value, &vlen) > 0) {
-			int line = ini_get_line_number(ini, key);
-			char *v, *k = malloc(klen + 1);
-			if (!k) {
-				free(n);
-				goto err_ini_close;
-			}
+			line += count_lines(counted, key);
 
-			v = malloc(vlen + 1);
-			if (!v) {
-				free(k);
-				free(n);
-				goto err_ini_close;
-			}
+			((char *) key)[klen] = '\0';
+			end = (char *) value + vlen;
+			newline = *end == '\n';
+			*end = '\0';
+			counted = end + 1;
 
-			snprintf(k, klen + 1, "%.*s", (int) klen, key);
-			snprintf(v, vlen + 1, "%.*s", (int) vlen, value);
+			ret = call_timed(ini_file, line, cb, name, key, value, timing);
 
-			ret = cb(line, n, k, v);
+			/* The end of line that was overwritten */
+			line += newline;
 
-			/* only needed when debugging - this should be done in each section
-			if (ret < 0) {
-				fprintf(stderr, "issue in '%s' file: Section:'%s' key:'%s' value:'%s'\n",
-						ini_file, n, k, v);
-			}
-			*/
-
-			free(k);
-			free(v);
-
-			if (ret < 0) {
-				free(n);
+			if (ret < 0)
 				goto err_ini_close;
-			}
 
 			if (ret > 0) {
 				ret = 0;
 				break;
 			}
 		}
-
-		free(n);
 	}
 
 err_ini_close:
@@ -330,6 +651,41 @@ err_ini_close:
 	return ret;
 }
 
+int foreach_in_ini_timed(const char *ini_file,
+		int (*cb)(int, const char *, const char *, const char *),
+		struct ini_timing *timing)
+{
+	gchar *buf;
+	gsize len;
+	int ret;
+
+	if (timing)
+		memset(timing, 0, sizeof(*timing));
+
+	/* A private copy of the file, which is modified in place */
+	if (!g_file_get_contents(ini_file, &buf, &len, NULL)) {
+		fprintf(stderr, "Unable to open file %s\n", ini_file);
+		return -1;
+	}
+
+	if (!len) {
+		fprintf(stderr, "ERROR: File is empty\n");
+		g_free(buf);
+		return -1;
+	}
+
+	ret = foreach_in_buf(ini_file, buf, len, cb, timing);
+	g_free(buf);
+
+	return ret;
+}
+
+int foreach_in_ini(const char *ini_file,
+		int (*cb)(int, const char *, const char *, const char *))
+{
+	return foreach_in_ini_timed(ini_file, cb, NULL);
+}
+
 /*
  * Types of loops that can be handled while parsing .ini files
  * INI_LOOP_SEQ - Loops through a sequence of numbers. Ini syntax:
@@ -373,30 +729,114 @@ struct ini_loop {
  * Structure of a set of parameters that are used when parsing and expanding
  * an ini loop structure and all its inner loops.
  * in_file - input ini file
- * out_file - output (expanded) ini file
+ * line - number of the last line read from the input ini file
  * ini_loops - list of loop and its inner loops
  * unclosed_loops - flag is set when one of the loops is left unclosed in the
  *                  input ini file.
+ * aborted - flag is set when the expanded lines were refused by emit.
+ * emit - called with each expanded line, which it may modify.
+ * out_file - output (expanded) ini file, for ini_unroll()
+ * ini_file, cb, timing, section, skip_section - state of emit_pair(), for
+ *                                               foreach_in_ini_unrolled()
  */
 struct loops_parse_params {
 	FILE *in_file;
-	FILE *out_file;
+	int line;
 	GSList *ini_loops;
 	bool unclosed_loops;
+	bool aborted;
+
+	int (*emit)(struct loops_parse_params *p, char *line);
+	FILE *out_file;
+
+	const char *ini_file;
+	int (*cb)(int, const char *, const char *, const char *);
+	struct ini_timing *timing;
+	char *section;
+	bool skip_section;
 };
 
-static void loops_params_init(struct loops_parse_params *p, FILE *i, FILE *o)
+static void loops_params_init(struct loops_parse_params *p, FILE *i)
 {
 	if (p) {
+		memset(p, 0, sizeof(*p));
 		p->in_file = i;
-		p->out_file = o;
-		p->ini_loops = NULL;
-		p->unclosed_loops = false;
 	} else {
 		printf("Structure to init in %s is invalid\n", __func__);
 	}
 }
 
+static char * read_line(struct loops_parse_params *p, char *buf, int size)
+{
+	char *ret = fgets(buf, size, p->in_file);
+
+	if (ret)
+		p->line++;
+	return ret;
+}
+
+static int emit_line(struct loops_parse_params *p, char *line)
+{
+	fputs(line, p->out_file);
+	return 0;
+}
+
+/*
+ * Split an expanded line into a key/value pair the way libini would, and
+ * hand it over to the callback of foreach_in_ini_unrolled().
+ */
+static int emit_pair(struct loops_parse_params *p, char *line)
+{
+	char *end, *value;
+	int ret;
+
+	/* Blank lines and comments */
+	if (!line[0] || line[0] == '\n' || line[0] == '\r' || line[0] == '#')
+		return 0;
+
+	if (line[0] == '[') {
+		end = strchr(line, ']');
+		if (!end) {
+			fprintf(stderr, "Malformed INI file (malformed section header)\n");
+			return -EIO;
+		}
+		g_free(p->section);
+		p->section = g_strndup(line + 1, end - line - 1);
+		p->skip_section = false;
+		return 0;
+	}
+
+	if (!p->section) {
+		fprintf(stderr, "Malformed INI file (missing section header)\n");
+		return -EIO;
+	}
+
+	/* The callback asked to move on to the next section */
+	if (p->skip_section)
+		return 0;
+
+	value = strchr(line + 1, '=');
+	if (!value) {
+		fprintf(stderr, "ERROR: Unexpected end of line\n");
+		return -EIO;
+	}
+
+	for (end = value; end > line + 1 && (end[-1] == ' ' || end[-1] == '\t'); end--);
+	*end = '\0';
+
+	for (value++; *value == ' ' || *value == '\t'; value++);
+	value[strcspn(value, "\r\n")] = '\0';
+
+	ret = call_timed(p->ini_file, p->line, p->cb, p->section, line, value,
+			p->timing);
+	if (ret > 0) {
+		p->skip_section = true;
+		ret = 0;
+	}
+
+	return ret;
+}
+
 /*
  * Check if a char array starts with a keyword and extracts the keyword.
  * A keyword is any char array between '<' and '>' characters and is found at
@@ -491,6 +931,13 @@ err_close:
 	return loop;
 }
 
+static void ini_loop_free(struct ini_loop *loop)
+{
+	if (loop->for_values)
+		g_strfreev(loop->for_values);
+	free(loop);
+}
+
 /*
  * Get the current iteration that the loop is at.
  */
@@ -518,13 +965,13 @@ static char * ini_loop_get_iteration(struct ini_loop *loop)
 static int loop_expand(struct loops_parse_params *parse_params,
 		char *buf_with_loop, char *loop_name)
 {
-	char *replace, *eol;
+	char *replace, *eol, *expanded;
 	char buf[1024];
 	char inner_loop[128];
 	size_t tmplen;
 	fpos_t pos;
 	long long i, first, inc, last;
-	int ret = 0;
+	int ret = 0, line;
 	struct ini_loop *iniloop;
 	bool unclosed_loop = true;
 
@@ -539,11 +986,13 @@ static int loop_expand(struct loops_parse_params *parse_params,
 	inc = iniloop->inc;
 	last = iniloop->last;
 	fgetpos(parse_params->in_file, &pos);
+	line = parse_params->line;
 	for (i = first; inc > 0 ? i <= last : i >= last; i = i + inc) {
 		fsetpos(parse_params->in_file, &pos);
+		parse_params->line = line;
 		iniloop->i = i;
 
-		while (fgets(buf, sizeof(buf), parse_params->in_file) != NULL) {
+		while (read_line(parse_params, buf, sizeof(buf)) != NULL) {
 			if (ini_line_begins_with_keyword(buf, inner_loop)) {
 				ret = loop_expand(parse_params, buf,
 					inner_loop);
@@ -570,20 +1019,27 @@ static int loop_expand(struct loops_parse_params *parse_params,
 						break;
 				}
 				if (!replace) {
-					fprintf(parse_params->out_file, "%s",
+					ret = parse_params->emit(parse_params,
 						buf);
-					continue;
+				} else {
+					tmplen = strlen(iniloop->var);
+					eol = strchr(buf, '\0');
+					gchar *it = ini_loop_get_iteration(loop);
+					expanded = g_strdup_printf("%.*s%s%.*s",
+						(int) (long) (replace - buf), buf,
+						it, (int) (eol - replace - tmplen),
+						(char *)((uintptr_t) replace + tmplen));
+					ret = parse_params->emit(parse_params,
+						expanded);
+					g_free(expanded);
+					if (it)
+						g_free(it);
 				}
 
-				tmplen = strlen(iniloop->var);
-				eol = strchr(buf, '\0');
-				gchar *it = ini_loop_get_iteration(loop);
-				fprintf(parse_params->out_file, "%.*s%s%.*s",
-					(int) (long) (replace - buf), buf,
-					it, (int) (eol - replace - tmplen),
-					(char *)((uintptr_t) replace + tmplen));
-				if (it)
-					g_free(it);
+				if (ret < 0) {
+					parse_params->aborted = true;
+					goto err_close;
+				}
 			}
 		}
 	}
@@ -593,12 +1049,10 @@ err_close:
 	if (iniloop) {
 		parse_params->ini_loops = g_slist_remove(
 					parse_params->ini_loops, iniloop);
-		if (iniloop->for_values)
-			g_strfreev(iniloop->for_values);
-		free(iniloop);
+		ini_loop_free(iniloop);
 	}
 
-	if (unclosed_loop) {
+	if (unclosed_loop && !parse_params->aborted) {
 		parse_params->unclosed_loops = true;
 		ret = -EINVAL;
 	}
@@ -606,59 +1060,174 @@ err_close:
 	return ret;
 }
 
-int ini_unroll(const char *input, const char *output)
+/*
+ * Check that the loops of the input file are well formed and closed before
+ * any line is handed over, so that a profile doesn't stop halfway through.
+ */
+static int ini_check_loops(struct loops_parse_params *p, const char *input)
 {
-	FILE *in, *out;
 	char buf[1024];
 	char loop_name[128];
+	struct ini_loop *loop;
+	/* End tags of the loops being read, innermost first */
+	GSList *open_loops = NULL;
 	int ret = 0;
-	struct loops_parse_params loops_params;
 
-	in = fopen(input, "r");
-	out = fopen (output, "w");
+	while (read_line(p, buf, sizeof(buf)) != NULL) {
+		if (open_loops && !strncmp(buf, open_loops->data,
+					strlen(open_loops->data))) {
+			g_free(open_loops->data);
+			open_loops = g_slist_delete_link(open_loops, open_loops);
+			continue;
+		}
 
-	if (!in) {
-		ret = -errno;
-		fprintf(stderr, "Failed to open %s : %s\n", input,
-			strerror(-ret));
-		goto err_close;
+		if (!ini_line_begins_with_keyword(buf, loop_name))
+			continue;
+
+		if (!open_loops && !strcmp(loop_name, "COMMENT")) {
+			while (read_line(p, buf, sizeof(buf)) != NULL) {
+				if (!strncmp(buf, "</COMMENT>", strlen("</COMMENT>")))
+					break;
+			}
+			continue;
+		}
+
+		loop = ini_loop_new(buf, loop_name);
+		if (!loop) {
+			fprintf(stderr, "Invalid loop at line %i of %s\n",
+					p->line, input);
+			ret = -EINVAL;
+			break;
+		}
+		open_loops = g_slist_prepend(open_loops,
+				g_strdup(loop->end_loop));
+		ini_loop_free(loop);
 	}
 
-	if (!out) {
-		ret = -errno;
-		fprintf(stderr, "Failed to open %s : %s\n", output,
-			strerror(-ret));
-		goto err_close;
+	if (!ret && open_loops) {
+		printf("loop isn't closed in %s\n", input);
+		ret = -EINVAL;
 	}
 
-	loops_params_init(&loops_params, in, out);
-	while (fgets(buf, sizeof(buf), in) != NULL) {
+	g_slist_free_full(open_loops, g_free);
+	rewind(p->in_file);
+	p->line = 0;
+
+	return ret;
+}
+
+/* Expand the loops of the input file, handing each line over to emit */
+static int ini_expand(struct loops_parse_params *loops_params,
+		const char *input)
+{
+	char buf[1024];
+	char loop_name[128];
+	int ret;
+
+	ret = ini_check_loops(loops_params, input);
+	if (ret < 0)
+		return ret;
+
+	while (read_line(loops_params, buf, sizeof(buf)) != NULL) {
 		if (!buf[0])
 			continue;
 
 		if (!ini_line_begins_with_keyword(buf, loop_name)) {
-			fprintf(out, "%s", buf);
+			ret = loops_params->emit(loops_params, buf);
+			if (ret < 0)
+				break;
 			continue;
 		}
 		if (!strcmp(loop_name, "COMMENT")) {
-			while (fgets(buf, sizeof(buf), in) != NULL) {
+			while (read_line(loops_params, buf, sizeof(buf)) != NULL) {
 				if (!strncmp(buf, "</COMMENT>", strlen("</COMMENT>")))
 					break;
 			}
 			continue;
 		}
 
-		ret = loop_expand(&loops_params, buf, loop_name);
+		ret = loop_expand(loops_params, buf, loop_name);
 		if (ret < 0) {
-			if (loops_params.unclosed_loops)
+			if (loops_params->unclosed_loops)
 				printf("loop isn't closed in %s\n", input);
 			break;
 		}
 	}
 
+	return ret;
+}
+
+int ini_unroll(const char *input, const char *output)
+{
+	FILE *in, *out;
+	int ret = 0;
+	struct loops_parse_params loops_params;
+
+	in = fopen(input, "r");
+	out = fopen (output, "w");
+
+	if (!in) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s : %s\n", input,
+			strerror(-ret));
+		goto err_close;
+	}
+
+	if (!out) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s : %s\n", output,
+			strerror(-ret));
+		goto err_close;
+	}
+
+	loops_params_init(&loops_params, in);
+	loops_params.emit = emit_line;
+	loops_params.out_file = out;
+
+	ret = ini_expand(&loops_params, input);
+
 	err_close:
+	if (in)
+		fclose(in);
+	if (out)
+		fclose(out);
+	return ret;
+}
+
+/*
+ * Like foreach_in_ini() on the output of ini_unroll(), but the pairs are
+ * handed over as the loops are expanded, without going through a file.
+ * Line numbers are those of the input file.
+ */
+int foreach_in_ini_unrolled(const char *ini_file,
+		int (*cb)(int, const char *, const char *, const char *),
+		struct ini_timing *timing)
+{
+	struct loops_parse_params loops_params;
+	FILE *in;
+	int ret;
+
+	if (timing)
+		memset(timing, 0, sizeof(*timing));
+
+	in = fopen(ini_file, "r");
+	if (!in) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s : %s\n", ini_file,
+			strerror(-ret));
+		return ret;
+	}
+
+	loops_params_init(&loops_params, in);
+	loops_params.emit = emit_pair;
+	loops_params.ini_file = ini_file;
+	loops_params.cb = cb;
+	loops_params.timing = timing;
+
+	ret = ini_expand(&loops_params, ini_file);
+
+	g_free(loops_params.section);
 	fclose(in);
-	fclose(out);
 	return ret;
 }
 
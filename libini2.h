@@ -15,10 +15,24 @@ void save_to_ini(FILE *f, const char *driver_name, struct iio_device *dev,
 char * read_token_from_ini(const char *ini_file,
 		const char *driver_name, const char *token);
 
+/* Time spent in the callbacks of foreach_in_ini_timed(), in microseconds */
+struct ini_timing {
+	unsigned int count;
+	int64_t total;
+	int64_t slowest;
+	int slowest_line;
+};
+
 int foreach_in_ini(const char *ini_file,
 		int (*cb)(int, const char *, const char *, const char *));
+int foreach_in_ini_timed(const char *ini_file,
+		int (*cb)(int, const char *, const char *, const char *),
+		struct ini_timing *timing);
 
 int ini_unroll(const char *input, const char *output);
+int foreach_in_ini_unrolled(const char *ini_file,
+		int (*cb)(int, const char *, const char *, const char *),
+		struct ini_timing *timing);
 
 void write_driver_name_to_ini(FILE *f, const char *driver_name);
 
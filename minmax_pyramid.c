@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include "minmax_pyramid.h"
+
+/* Fill in the number of buckets of each level; returns the storage size */
+static size_t minmax_pyramid_layout(struct minmax_pyramid *pyr, unsigned int length)
+{
+	unsigned int buckets = length;
+	size_t size = 0;
+
+	pyr->length = length;
+	pyr->num_levels = 0;
+
+	while (pyr->num_levels < MINMAX_PYRAMID_MAX_LEVELS && buckets > 2) {
+		buckets = (buckets + 1) / 2;
+		pyr->num_levels++;
+		pyr->levels[pyr->num_levels].buckets = buckets;
+		size += 2 * sizeof(gfloat) * buckets;
+	}
+
+	return size;
+}
+
+static void minmax_pyramid_assign(struct minmax_pyramid *pyr, gfloat *base)
+{
+	unsigned int k;
+
+	for (k = 1; k <= pyr->num_levels; k++) {
+		pyr->levels[k].minmax = base;
+		base += 2 * pyr->levels[k].buckets;
+	}
+}
+
+static void minmax_pyramid_build(struct minmax_pyramid *pyr, const gfloat *data)
+{
+	const struct minmax_level *src;
+	struct minmax_level *dst;
+	unsigned int b, k;
+
+	/* The first level is computed from the samples themselves */
+	dst = &pyr->levels[1];
+	for (b = 0; b < dst->buckets; b++) {
+		gfloat v0 = data[2 * b];
+		gfloat v1 = (2 * b + 1 < pyr->length) ? data[2 * b + 1] : v0;
+
+		dst->minmax[2 * b] = v0 < v1 ? v0 : v1;
+		dst->minmax[2 * b + 1] = v0 < v1 ? v1 : v0;
+	}
+
+	/* Each next level merges pairs of buckets of the previous one */
+	for (k = 2; k <= pyr->num_levels; k++) {
+		src = &pyr->levels[k - 1];
+		dst = &pyr->levels[k];
+
+		for (b = 0; b < dst->buckets; b++) {
+			const gfloat *a = &src->minmax[4 * b];
+			gfloat min = a[0], max = a[1];
+
+			if (2 * b + 1 < src->buckets) {
+				if (a[2] < min)
+					min = a[2];
+				if (a[3] > max)
+					max = a[3];
+			}
+			dst->minmax[2 * b] = min;
+			dst->minmax[2 * b + 1] = max;
+		}
+	}
+}
+
+struct minmax_pyramid * minmax_pyramid_new(const gfloat *data, unsigned int length)
+{
+	struct minmax_pyramid *pyr;
+
+	if (!data || length < 4)
+		return NULL;
+
+	pyr = g_new0(struct minmax_pyramid, 1);
+	pyr->storage = g_malloc(minmax_pyramid_layout(pyr, length));
+	minmax_pyramid_assign(pyr, pyr->storage);
+	minmax_pyramid_build(pyr, data);
+
+	return pyr;
+}
+
+void minmax_pyramid_free(struct minmax_pyramid *pyr)
+{
+	if (!pyr)
+		return;
+
+	g_free(pyr->storage);
+	g_free(pyr);
+}
+
+void minmax_pyramid_get_extrema(const struct minmax_pyramid *pyr,
+		gfloat *min, gfloat *max)
+{
+	const struct minmax_level *top = &pyr->levels[pyr->num_levels];
+	unsigned int b;
+
+	*min = top->minmax[0];
+	*max = top->minmax[1];
+	for (b = 1; b < top->buckets; b++) {
+		if (top->minmax[2 * b] < *min)
+			*min = top->minmax[2 * b];
+		if (top->minmax[2 * b + 1] > *max)
+			*max = top->minmax[2 * b + 1];
+	}
+}
+
+/*
+ * Pick the coarsest level that still has at least one bucket per pixel.
+ * Level 0 means the samples themselves should be drawn.
+ */
+unsigned int minmax_pyramid_pick_level(const struct minmax_pyramid *pyr,
+		double samples_per_pixel)
+{
+	unsigned int level = 0;
+
+	while (level < pyr->num_levels &&
+			(double)(2u << level) <= samples_per_pixel)
+		level++;
+
+	return level;
+}
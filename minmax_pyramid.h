@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __MINMAX_PYRAMID_H__
+#define __MINMAX_PYRAMID_H__
+
+#include <glib.h>
+
+#define MINMAX_PYRAMID_MAX_LEVELS 32
+
+/*
+ * Level k (k >= 1) summarizes the source in buckets of 2^k samples. Each
+ * bucket is stored as a (min, max) pair, so a level can be handed as is to
+ * a line graph and draws the envelope of the signal.
+ */
+struct minmax_level {
+	unsigned int buckets;
+	gfloat *minmax;
+};
+
+struct minmax_pyramid {
+	unsigned int length;
+	unsigned int num_levels;
+	struct minmax_level levels[MINMAX_PYRAMID_MAX_LEVELS + 1];
+
+	/* All the levels, in a single allocation */
+	void *storage;
+};
+
+struct minmax_pyramid * minmax_pyramid_new(const gfloat *data, unsigned int length);
+void minmax_pyramid_free(struct minmax_pyramid *pyr);
+/* Min and max of the whole source, from the top level */
+void minmax_pyramid_get_extrema(const struct minmax_pyramid *pyr,
+		gfloat *min, gfloat *max);
+unsigned int minmax_pyramid_pick_level(const struct minmax_pyramid *pyr,
+		double samples_per_pixel);
+
+#endif /* __MINMAX_PYRAMID_H__ */
@@ -10,6 +10,7 @@
 #include <gtkdatabox_points.h>
 #include <gtkdatabox_lines.h>
 #include <gtkdatabox_markers.h>
+#include <float.h>
 #include <math.h>
 #include <stdint.h>
 #include <errno.h>
@@ -31,7 +32,11 @@
 #include "osc.h"
 #include "datatypes.h"
 #include "config.h"
+#include "iio_widget.h"
+#include "iio_utils.h"
 #include "osc_plugin.h"
+#include "playback.h"
+#include "profile_log.h"
 
 GSList *plugin_list = NULL;
 
@@ -46,6 +51,7 @@ static GSList *plugin_lib_list = NULL;
 static GSList *dplugin_list = NULL;
 static struct osc_plugin *spect_analyzer_plugin = NULL;
 static OscPreferences *osc_preferences = NULL;
+static bool capture_native_format = false;
 GtkWidget *notebook;
 GtkWidget *infobar;
 GtkWidget *tooltips_en;
@@ -273,6 +279,19 @@ static void close_active_buffers(void)
 	}
 }
 
+static void close_playbacks(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *info = iio_device_get_data(dev);
+
+		playback_close(info->playback);
+		info->playback = NULL;
+	}
+}
+
 static void stop_sampling(void)
 {
 	stop_capture = TRUE;
@@ -437,7 +456,7 @@ static const char * device_name_check(const char *name)
 	if (!name)
 		return NULL;
 
-	dev = iio_context_find_device(ctx, name);
+	dev = iio_utils_find_device(ctx, name);
 	if (!dev)
 		return NULL;
 
@@ -538,7 +557,7 @@ int plugin_data_capture_size(const char *device)
 	if (!device)
 		return 0;
 
-	dev = iio_context_find_device(ctx, device);
+	dev = iio_utils_find_device(ctx, device);
 	if (!dev)
 		return 0;
 
@@ -555,7 +574,7 @@ int plugin_data_capture_num_active_channels(const char *device)
 	if (!device)
 		return 0;
 
-	dev = iio_context_find_device(ctx, device);
+	dev = iio_utils_find_device(ctx, device);
 	if (!dev)
 		return 0;
 
@@ -576,7 +595,7 @@ int plugin_data_capture_bytes_per_sample(const char *device)
 	if (!device)
 		return 0;
 
-	dev = iio_context_find_device(ctx, device);
+	dev = iio_utils_find_device(ctx, device);
 	if (!dev)
 		return 0;
 
@@ -597,11 +616,11 @@ int plugin_data_capture_of_plot(OscPlot *plot, const char *device, gfloat ***coo
 	if (device == NULL)
 		dev = NULL;
 	else
-		dev = iio_context_find_device(ctx, device);
+		dev = iio_utils_find_device(ctx, device);
 
 	if (plot) {
 		tmp = osc_plot_get_active_device(plot);
-		tmp_dev = iio_context_find_device(ctx, tmp);
+		tmp_dev = iio_utils_find_device(ctx, tmp);
 	}
 
 	/* if there isn't anything to send, clear everything */
@@ -1094,6 +1113,7 @@ static ssize_t demux_sample(const struct iio_channel *chn,
 	struct extra_info *info = iio_channel_get_data(chn);
 	struct extra_dev_info *dev_info = iio_device_get_data(info->dev);
 	const struct iio_data_format *format = iio_channel_get_data_format(chn);
+	gfloat out;
 
 	/* Prevent buffer overflow */
 	if ((unsigned long) info->offset == (unsigned long) dev_info->sample_count)
@@ -1103,35 +1123,194 @@ static ssize_t demux_sample(const struct iio_channel *chn,
 		int8_t val;
 		iio_channel_convert(chn, &val, sample);
 		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
+			out = (gfloat) val;
 		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint8_t)val;
+			out = (gfloat) (uint8_t)val;
 	} else if (size == 2) {
 		int16_t val;
 		iio_channel_convert(chn, &val, sample);
 		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
+			out = (gfloat) val;
 		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint16_t)val;
+			out = (gfloat) (uint16_t)val;
 	} else {
 		int32_t val;
 		iio_channel_convert(chn, &val, sample);
 		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
+			out = (gfloat) val;
 		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint32_t)val;
+			out = (gfloat) (uint32_t)val;
 	}
 
+	*(info->data_ref + info->offset++) = out;
+	if (out < info->y_min)
+		info->y_min = out;
+	if (out > info->y_max)
+		info->y_max = out;
+
 	return size;
 }
 
+/*
+ * Native format capture: deinterleave each enabled channel at once into
+ * its native width buffer. The conversion to floats is postponed until
+ * someone asks for the data with osc_channel_get_data(), and only the
+ * channels that are asked for get a float buffer.
+ */
+static void demux_native(struct iio_device *dev, struct iio_buffer *buf,
+		unsigned int sample_count)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+		struct extra_info *info = iio_channel_get_data(ch);
+		size_t len;
+
+		if (!iio_channel_is_enabled(ch) || !info->raw_ref)
+			continue;
+
+		len = iio_channel_read(ch, buf, info->raw_ref,
+				(size_t)sample_count * info->raw_size);
+		info->offset = len / info->raw_size;
+		info->converted_seq = 0;
+	}
+}
+
+/* Converts a native width buffer, tracking the range of the samples */
+#define CONVERT_NATIVE(cast) \
+	do { \
+		for (i = 0; i < count; i++) { \
+			out[i] = (gfloat) (cast) in[i]; \
+			if (out[i] < min) \
+				min = out[i]; \
+			if (out[i] > max) \
+				max = out[i]; \
+		} \
+	} while (0)
+
+static void convert_native(const struct iio_channel *chn, struct extra_info *info)
+{
+	const struct iio_data_format *format = iio_channel_get_data_format(chn);
+	gfloat *out = info->data_ref;
+	gfloat min = FLT_MAX, max = -FLT_MAX;
+	off_t i, count = info->offset;
+
+	if (info->raw_size == 1) {
+		const int8_t *in = info->raw_ref;
+
+		if (format->is_signed)
+			CONVERT_NATIVE(int8_t);
+		else
+			CONVERT_NATIVE(uint8_t);
+	} else if (info->raw_size == 2) {
+		const int16_t *in = info->raw_ref;
+
+		if (format->is_signed)
+			CONVERT_NATIVE(int16_t);
+		else
+			CONVERT_NATIVE(uint16_t);
+	} else {
+		const int32_t *in = info->raw_ref;
+
+		if (format->is_signed)
+			CONVERT_NATIVE(int32_t);
+		else
+			CONVERT_NATIVE(uint32_t);
+	}
+
+	info->y_min = min;
+	info->y_max = max;
+}
+
+/* Returns the samples of the last frame as floats, converting them if needed */
+gfloat * osc_channel_get_data(struct iio_channel *chn)
+{
+	struct extra_info *info = iio_channel_get_data(chn);
+	struct extra_dev_info *dev_info;
+
+	if (!info)
+		return NULL;
+
+	dev_info = iio_device_get_data(info->dev);
+	if (!dev_info || !dev_info->native_samples || !info->raw_ref)
+		return info->data_ref;
+
+	if (!info->data_ref) {
+		info->data_ref = g_new0(gfloat, dev_info->sample_count);
+		info->converted_seq = 0;
+	}
+
+	if (info->converted_seq != dev_info->frame_seq) {
+		convert_native(chn, info);
+		info->converted_seq = dev_info->frame_seq;
+		info->extrema_seq = dev_info->frame_seq;
+	}
+
+	return info->data_ref;
+}
+
+/*
+ * Range of the first @count samples of the last frame, when the capture
+ * found it while writing them. Returns false when the range has to be
+ * looked for: partial views, samples moved to the trigger, recordings.
+ */
+bool osc_channel_get_extrema(struct iio_channel *chn, unsigned int count,
+		gfloat *min, gfloat *max)
+{
+	struct extra_info *info = iio_channel_get_data(chn);
+	struct extra_dev_info *dev_info;
+
+	if (!info || !count || (off_t)count != info->offset)
+		return false;
+
+	dev_info = iio_device_get_data(info->dev);
+	if (!dev_info || !dev_info->frame_seq ||
+			info->extrema_seq != dev_info->frame_seq)
+		return false;
+
+	*min = info->y_min;
+	*max = info->y_max;
+	return true;
+}
+
+void osc_set_capture_native_format(bool enable)
+{
+	capture_native_format = enable;
+}
+
+bool osc_get_capture_native_format(void)
+{
+	return capture_native_format;
+}
+
+/* Enabled channels take the channels of the recording, in order */
+static void playback_demux(struct iio_device *dev, struct playback *pb,
+		unsigned int sample_count)
+{
+	unsigned int i, k = 0, nb_channels = iio_device_get_channels_count(dev);
+
+	playback_next_frame(pb, sample_count);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+		struct extra_info *info = iio_channel_get_data(ch);
+
+		if (!iio_channel_is_enabled(ch) || !info->data_ref)
+			continue;
+
+		playback_read(pb, k++, info->data_ref, sample_count);
+		info->offset = sample_count;
+	}
+}
+
 static off_t get_trigger_offset(const struct iio_channel *chn,
 		bool falling_edge, float trigger_value)
 {
 	struct extra_info *info = iio_channel_get_data(chn);
 	size_t i;
 
-	if (iio_channel_is_enabled(chn)) {
+	if (iio_channel_is_enabled(chn) && osc_channel_get_data((struct iio_channel *)chn)) {
 		for (i = info->offset / 2; i >= 1; i--) {
 			if (!falling_edge && info->data_ref[i - 1] < trigger_value &&
 					info->data_ref[i] >= trigger_value)
@@ -1148,9 +1327,21 @@ static void apply_trigger_offset(const struct iio_channel *chn, off_t offset)
 {
 	if (offset) {
 		struct extra_info *info = iio_channel_get_data(chn);
+		struct extra_dev_info *dev_info = iio_device_get_data(info->dev);
+
+		/* The range of the samples is no longer the one of the view */
+		info->extrema_seq = 0;
+
+		if (dev_info->native_samples && info->raw_ref) {
+			off_t raw_offset = offset / sizeof(gfloat) * info->raw_size;
 
-		memmove(info->data_ref, (const char *)info->data_ref + offset,
-				info->offset * sizeof(gfloat) - offset);
+			memmove(info->raw_ref, (const char *)info->raw_ref + raw_offset,
+					info->offset * info->raw_size - raw_offset);
+			info->converted_seq = 0;
+		} else if (info->data_ref) {
+			memmove(info->data_ref, (const char *)info->data_ref + offset,
+					info->offset * sizeof(gfloat) - offset);
+		}
 	}
 }
 
@@ -1186,6 +1377,11 @@ static gboolean capture_process(void *data)
 		if (sample_size == 0)
 			continue;
 
+		if (dev_info->playback) {
+			playback_demux(dev, dev_info->playback, sample_count);
+			goto frame_ready;
+		}
+
 		if (dev_info->buffer == NULL || device_is_oneshot(dev)) {
 			dev_info->buffer_size = sample_count;
 			dev_info->buffer = iio_device_create_buffer(dev,
@@ -1201,6 +1397,8 @@ static gboolean capture_process(void *data)
 			struct iio_channel *ch = iio_device_get_channel(dev, i);
 			struct extra_info *info = iio_channel_get_data(ch);
 			info->offset = 0;
+			info->y_min = FLT_MAX;
+			info->y_max = -FLT_MAX;
 		}
 
 		while (true) {
@@ -1213,7 +1411,11 @@ static gboolean capture_process(void *data)
 
 			ret /= iio_buffer_step(dev_info->buffer);
 			if (ret >= sample_count) {
-				iio_buffer_foreach_sample(
+				if (dev_info->native_samples)
+					demux_native(dev, dev_info->buffer,
+							sample_count);
+				else
+					iio_buffer_foreach_sample(
 						dev_info->buffer, demux_sample, NULL);
 
 				if (ret >= sample_count * 2) {
@@ -1233,6 +1435,24 @@ static gboolean capture_process(void *data)
 					dev_info->buffer_size, false);
 		}
 
+frame_ready:
+		/* Tag the new frame so identical transforms of different
+		 * plots can share their results */
+		if (++dev_info->frame_seq == 0)
+			dev_info->frame_seq = 1;
+		dev_info->frame_time = g_get_real_time();
+
+		/* demux_sample() found the range of the samples it wrote */
+		if (!dev_info->playback && !dev_info->native_samples) {
+			for (i = 0; i < nb_channels; i++) {
+				struct iio_channel *ch = iio_device_get_channel(dev, i);
+				struct extra_info *info = iio_channel_get_data(ch);
+
+				if (iio_channel_is_enabled(ch))
+					info->extrema_seq = dev_info->frame_seq;
+			}
+		}
+
 		if (dev_info->channel_trigger_enabled) {
 			chn = iio_device_get_channel(dev, dev_info->channel_trigger);
 			if (!iio_channel_is_enabled(chn))
@@ -1263,19 +1483,25 @@ static gboolean capture_process(void *data)
 		if (dev_info->channels_data_copy) {
 			for (i = 0; i < nb_channels; i++) {
 				struct iio_channel *ch = iio_device_get_channel(dev, i);
-				struct extra_info *info = iio_channel_get_data(ch);
-				memcpy(dev_info->channels_data_copy[i], info->data_ref,
-					sample_count * sizeof(gfloat));
+				gfloat *data = osc_channel_get_data(ch);
+
+				if (data)
+					memcpy(dev_info->channels_data_copy[i], data,
+						sample_count * sizeof(gfloat));
 			}
 			dev_info->channels_data_copy = NULL;
 			G_UNLOCK(buffer_full);
 		}
 
-		if (device_is_oneshot(dev)) {
+		if (device_is_oneshot(dev) && dev_info->buffer) {
 			iio_buffer_destroy(dev_info->buffer);
 			dev_info->buffer = NULL;
 		}
 
+		/* Plots of played back devices are updated with the buffer-less ones */
+		if (dev_info->playback)
+			continue;
+
 		if (!dev_info->channel_trigger_enabled || offset)
 			update_plot(dev_info->buffer);
 	}
@@ -1353,6 +1579,50 @@ static double read_sampling_frequency(const struct iio_device *dev)
 	return freq;
 }
 
+/* Allocate the sample buffers of the enabled channels of a device */
+static void capture_setup_samples(struct iio_device *dev,
+		unsigned int sample_count)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int j, nb_channels = iio_device_get_channels_count(dev);
+
+	/* Native format is possible if all samples fit in 8, 16 or 32 bits */
+	dev_info->native_samples = capture_native_format &&
+		!dev_info->playback;
+	for (j = 0; j < nb_channels; j++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, j);
+		unsigned int length = iio_channel_get_data_format(ch)->length;
+
+		if (iio_channel_is_enabled(ch) && length != 8 &&
+				length != 16 && length != 32)
+			dev_info->native_samples = false;
+	}
+
+	/* Only the enabled channels get sample buffers */
+	for (j = 0; j < nb_channels; j++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, j);
+		struct extra_info *info = iio_channel_get_data(ch);
+
+		g_free(info->data_ref);
+		info->data_ref = NULL;
+		g_free(info->raw_ref);
+		info->raw_ref = NULL;
+		info->converted_seq = 0;
+		info->extrema_seq = 0;
+
+		if (!iio_channel_is_enabled(ch))
+			continue;
+
+		/* In native format, floats are only made for channels in use */
+		if (dev_info->native_samples) {
+			info->raw_size = iio_channel_get_data_format(ch)->length / 8;
+			info->raw_ref = g_malloc0((size_t)sample_count * info->raw_size);
+		} else {
+			info->data_ref = (gfloat *) g_new0(gfloat, sample_count);
+		}
+	}
+}
+
 static int capture_setup(void)
 {
 	unsigned int i, j;
@@ -1386,14 +1656,7 @@ static int capture_setup(void)
 		if (sample_size == 0 || sample_count == 0)
 			continue;
 
-		for (j = 0; j < nb_channels; j++) {
-			struct iio_channel *ch = iio_device_get_channel(dev, j);
-			struct extra_info *info = iio_channel_get_data(ch);
-
-			if (info->data_ref)
-				g_free(info->data_ref);
-			info->data_ref = (gfloat *) g_new0(gfloat, sample_count);
-		}
+		capture_setup_samples(dev, sample_count);
 
 		if (dev_info->buffer)
 			iio_buffer_destroy(dev_info->buffer);
@@ -1583,6 +1846,7 @@ static void do_quit(bool reload)
 	G_TRYLOCK(buffer_full);
 	G_UNLOCK(buffer_full);
 	close_active_buffers();
+	close_playbacks();
 
 	close_all_plots();
 	destroy_all_plots();
@@ -1609,8 +1873,10 @@ static void do_quit(bool reload)
 	 */
 	close_plugins(path);
 	g_free(path);
+	iio_widget_cache_flush();
 
 	if (!reload && ctx) {
+		iio_utils_forget_context(ctx);
 		iio_context_destroy(ctx);
 		ctx = NULL;
 		ctx_destroyed_by_do_quit = true;
@@ -1632,8 +1898,10 @@ void application_reload(struct iio_context *new_ctx, bool load_profile)
 	}
 
 	do_quit(true);
-	if (ctx)
+	if (ctx) {
+		iio_utils_forget_context(ctx);
 		iio_context_destroy(ctx);
+	}
 
 	ctx = new_ctx;
 	do_init(new_ctx);
@@ -1731,7 +1999,7 @@ bool rx_update_device_sampling_freq(const char *device, double freq)
 
 	g_return_val_if_fail(device, false);
 
-	dev = iio_context_find_device(ctx, device);
+	dev = iio_utils_find_device(ctx, device);
 	if (!dev) {
 		fprintf(stderr, "Device: %s not found!\n", device);
 		return false;
@@ -1787,7 +2055,7 @@ bool rx_update_channel_lo_freq(const char *device, const char *channel,
 	g_return_val_if_fail(device, false);
 	g_return_val_if_fail(channel, false);
 
-	dev = iio_context_find_device(ctx, device);
+	dev = iio_utils_find_device(ctx, device);
 	if (!dev) {
 		fprintf(stderr, "Device: %s not found\n!", device);
 		return false;
@@ -1831,6 +2099,148 @@ bool rx_update_channel_lo_freq(const char *device, const char *channel,
 	return true;
 }
 
+static struct extra_dev_info * playback_dev_info(const char *device,
+		struct iio_device **out_dev)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *info;
+
+	dev = ctx ? iio_utils_find_device(ctx, device) : NULL;
+	if (!dev) {
+		fprintf(stderr, "Device: %s not found!\n", device);
+		return NULL;
+	}
+
+	info = iio_device_get_data(dev);
+	if (!info || !info->input_device) {
+		fprintf(stderr, "Device: %s is not an input device\n", device);
+		return NULL;
+	}
+
+	if (out_dev)
+		*out_dev = dev;
+	return info;
+}
+
+/*
+ * Play a recording (SigMF, raw binary or MAT file) in place of the samples
+ * of an input device. The capture plots of that device then go through
+ * the same transforms, markers and math channels with the recorded data.
+ * @device - name of the device
+ * @path   - recording to play, looped
+ */
+int osc_playback_attach(const char *device, const char *path)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *info = playback_dev_info(device, &dev);
+	struct playback *pb;
+
+	if (!info)
+		return -ENODEV;
+
+	pb = playback_open(path);
+	if (!pb)
+		return -EINVAL;
+
+	playback_close(info->playback);
+	info->playback = pb;
+
+	/* The plots of the device follow the buffer-less devices from now on */
+	if (info->buffer) {
+		iio_buffer_destroy(info->buffer);
+		info->buffer = NULL;
+	}
+
+	/* Recordings are played as floats, never in native format */
+	capture_setup_samples(dev, info->sample_count);
+
+	if (pb->sample_rate > 0)
+		rx_update_device_sampling_freq(device, pb->sample_rate);
+	if (pb->frequency > 0)
+		rx_update_channel_lo_freq(device, "all", pb->frequency);
+
+	return 0;
+}
+
+/* Capture the device again; profiles do it with an empty playback.<device> */
+void osc_playback_detach(const char *device)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *info = playback_dev_info(device, &dev);
+
+	if (!info || !info->playback)
+		return;
+
+	playback_close(info->playback);
+	info->playback = NULL;
+
+	/* The device is captured again, in native format if enabled */
+	capture_setup_samples(dev, info->sample_count);
+	rx_update_device_sampling_freq(device, USE_INTERN_SAMPLING_FREQ);
+}
+
+/*
+ * @rate - samples per second to play, or 0 to play the next frame of the
+ *         recording at each capture
+ */
+int osc_playback_set_rate(const char *device, double rate)
+{
+	struct extra_dev_info *info = playback_dev_info(device, NULL);
+
+	if (!info || !info->playback)
+		return -ENODEV;
+
+	playback_set_rate(info->playback, rate);
+
+	return 0;
+}
+
+static void playback_profile_save(FILE *fp)
+{
+	unsigned int i;
+
+	for (i = 0; ctx && i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *info = iio_device_get_data(dev);
+		const char *name = iio_device_get_name(dev) ?:
+			iio_device_get_id(dev);
+
+		if (!info || !info->playback)
+			continue;
+
+		fprintf(fp, "playback.%s=%s\n", name, info->playback->path);
+		fprintf(fp, "playback.%s.rate=%f\n", name, info->playback->rate);
+	}
+}
+
+static void playback_profile_load(const char *filename)
+{
+	unsigned int i;
+
+	for (i = 0; ctx && i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		const char *name = iio_device_get_name(dev) ?:
+			iio_device_get_id(dev);
+		char *key, *value;
+
+		key = g_strdup_printf("playback.%s", name);
+		value = read_token_from_ini(filename, OSC_INI_SECTION, key);
+		g_free(key);
+		if (!value)
+			continue;
+		osc_playback_attach(name, value);
+		free(value);
+
+		key = g_strdup_printf("playback.%s.rate", name);
+		value = read_token_from_ini(filename, OSC_INI_SECTION, key);
+		g_free(key);
+		if (value) {
+			osc_playback_set_rate(name, g_ascii_strtod(value, NULL));
+			free(value);
+		}
+	}
+}
+
 /* Before we really start, let's load the last saved profile */
 bool check_inifile(const char *filepath)
 {
@@ -2039,6 +2449,9 @@ static void capture_profile_save(const char *filename)
 		gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(tooltips_en)));
 	fprintf(fp, "startup_version_check=%d\n",
 		gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(versioncheck_en)));
+	fprintf(fp, "max_fps=%u\n", osc_plot_get_max_fps());
+	fprintf(fp, "capture_native_format=%d\n", capture_native_format);
+	playback_profile_save(fp);
 	if (ctx) {
 		if (!strcmp(iio_context_get_name(ctx), "network")) {
 			char *ip_addr = (char *) iio_context_get_description(ctx);
@@ -2114,6 +2527,26 @@ void save_complete_profile(const char *filename)
 	}
 }
 
+/* Frame rate cap of the plots: at least 1, and no more than a frame per ms */
+static int set_max_fps(const char *value)
+{
+	unsigned long fps;
+	char *end;
+
+	errno = 0;
+	fps = strtoul(value, &end, 10);
+	while (g_ascii_isspace(*end))
+		end++;
+	if (errno || end == value || *end || strchr(value, '-') ||
+			fps < 1 || fps > 1000) {
+		fprintf(stderr, "Invalid max_fps: %s\n", value);
+		return -EINVAL;
+	}
+
+	osc_plot_set_max_fps((unsigned int)fps);
+	return 0;
+}
+
 static int handle_osc_param(int line, const char *name, const char *value)
 {
 	gchar **elems;
@@ -2126,6 +2559,11 @@ static int handle_osc_param(int line, const char *name, const char *value)
 		gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(versioncheck_en),
 				!!atoi(value));
 		return 0;
+	} else if (!strcmp(name, "max_fps")) {
+		return set_max_fps(value);
+	} else if (!strcmp(name, "capture_native_format")) {
+		capture_native_format = !!atoi(value);
+		return 0;
 	}
 
 	if (!strcmp(name, "test") || !strcmp(name, "window_x_pos") ||
@@ -2141,6 +2579,17 @@ static int handle_osc_param(int line, const char *name, const char *value)
 		return 0;
 	}
 
+	if (elems && !strcmp(elems[0], "playback") && elems[1]) {
+		if (elems[2] && !strcmp(elems[2], "rate"))
+			osc_playback_set_rate(elems[1], g_ascii_strtod(value, NULL));
+		else if (!elems[2] && *value)
+			osc_playback_attach(elems[1], value);
+		else if (!elems[2])
+			osc_playback_detach(elems[1]);
+		g_strfreev(elems);
+		return 0;
+	}
+
 	g_strfreev(elems);
 
 	create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
@@ -2178,38 +2627,34 @@ static int load_profile_sequential_handler(int line, const char *section,
 	return 1;
 }
 
+/* Log files of the profile being loaded, closed when it is done */
+static struct profile_log *osc_profile_log;
+
 static int load_profile_sequential(const char *filename)
 {
-	gchar *new_filename;
-	char buf[32];
-	int ret = 0;
-
-	snprintf(buf, sizeof(buf), "osc_%u.ini", getpid());
-
-	new_filename = g_build_filename(getenv("TEMP") ?: P_tmpdir, buf, NULL);
-	unlink(new_filename);
-
-	ret = ini_unroll(filename, new_filename);
-	if (ret < 0)
-		goto err_unlink;
+	struct ini_timing timing;
+	int ret;
 
 	if (!ctx)
 		connect_dialog(false);
 	if (!ctx)
-		goto err_unlink;
+		return 0;
 
-	printf("Loading profile sequentially from %s\n", new_filename);
-	ret = foreach_in_ini(new_filename, load_profile_sequential_handler);
+	/* Loops are expanded as the file is read, no copy is written */
+	printf("Loading profile sequentially from %s\n", filename);
+	ret = foreach_in_ini_unrolled(filename,
+			load_profile_sequential_handler, &timing);
+	profile_log_free(osc_profile_log);
+	osc_profile_log = NULL;
 	if (ret < 0) {
 		fprintf(stderr, "Sequential loading of profile aborted.\n");
 		application_quit();
 	} else {
 		fprintf(stderr, "Sequential loading completed.\n");
 	}
-
-err_unlink:
-	unlink(new_filename);
-	g_free(new_filename);
+	fprintf(stderr, "%u items in %.3f s, slowest at line %d (%.1f ms)\n",
+			timing.count, timing.total / 1e6, timing.slowest_line,
+			timing.slowest / 1000.0);
 
 	return ret;
 }
@@ -2320,6 +2765,21 @@ nope:
 		free(value);
 	}
 
+	value = read_token_from_ini(filename, OSC_INI_SECTION, "max_fps");
+	if (value) {
+		set_max_fps(value);
+		free(value);
+	}
+
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "capture_native_format");
+	if (value) {
+		capture_native_format = !!atoi(value);
+		free(value);
+	}
+
+	playback_profile_load(filename);
+
 	value = read_token_from_ini(filename, OSC_INI_SECTION, "window_x_pos");
 	if (value) {
 		x_pos = atoi(value);
@@ -2370,8 +2830,11 @@ struct iio_context * osc_create_context(void)
 
 void osc_destroy_context(struct iio_context *_ctx)
 {
-	if (_ctx != ctx)
+	iio_widget_cache_flush();
+	if (_ctx != ctx) {
+		iio_utils_forget_context(_ctx);
 		iio_context_destroy(_ctx);
+	}
 }
 
 /* Wait while processing GTK events for a given number of milliseconds. Used
@@ -2392,23 +2855,25 @@ void osc_process_gtk_events(unsigned int msecs)
 	}
 }
 
-/* Test something, according to:
+/* Evaluate a test, according to:
  * test.device.attribute.type = min max
+ * Returns 1 if the value read is within range, 0 if it isn't, or a negative
+ * error code. The value read is printed in @measured.
  */
-int osc_test_value(struct iio_context *_ctx, int line,
-		const char *attribute, const char *value)
+int osc_eval_test(struct iio_context *_ctx, const char *attribute,
+		const char *value, char *measured, size_t len)
 {
 	struct iio_device *dev;
 	struct iio_channel *chn;
 	const char *attr;
-	long long min_i = -1, max_i = -1, val_i;
+	long long min_i, max_i, val_i;
 	double min_d, max_d, val_d;
 	unsigned int i;
 	int ret = -EINVAL;
 
 	gchar **elems = g_strsplit(attribute, ".", 4);
 	if (!elems)
-		goto err_popup;
+		return -EINVAL;
 
 	if (!elems[0] || strcmp(elems[0], "test"))
 		goto cleanup;
@@ -2441,16 +2906,8 @@ int osc_test_value(struct iio_context *_ctx, int line,
 		if (ret < 0)
 			goto cleanup;
 
-		printf("Line %i: (%s = %s): value = %lli\n",
-				line, attribute, value, val_i);
+		snprintf(measured, len, "%lli", val_i);
 		ret = val_i >= min_i && val_i <= max_i;
-		if (!ret)
-			create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
-					"Test failure",
-					"Test failed! Line: %i\n\n"
-					"Test was: %s = %lli %lli\n"
-					"Value read = %lli\n",
-					line, attribute, min_i, max_i, val_i);
 
 	} else if (!strcmp(elems[3], "double")) {
 		gchar *end1, *end2;
@@ -2473,44 +2930,52 @@ int osc_test_value(struct iio_context *_ctx, int line,
 		if (ret < 0)
 			goto cleanup;
 
-		printf("Line %i: (%s = %s): value = %lf\n",
-				line, attribute, value, val_d);
+		snprintf(measured, len, "%lf", val_d);
 		ret = val_d >= min_d && val_d <= max_d;
-		if (!ret)
-			create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
-					"Test failure",
-					"Test failed! Line: %i\n\n"
-					"Test was: %s = %f %f\n"
-					"Value read = %f\n",
-					line, attribute, min_d, max_d, val_d);
 
 	} else {
 		ret = -EINVAL;
-		goto cleanup;
 	}
 
+cleanup:
+	g_strfreev(elems);
+	return ret;
+}
+
+/* Test something, according to:
+ * test.device.attribute.type = min max
+ */
+int osc_test_value(struct iio_context *_ctx, int line,
+		const char *attribute, const char *value)
+{
+	char measured[64];
+	int ret = osc_eval_test(_ctx, attribute, value,
+			measured, sizeof(measured));
+
 	if (ret < 0) {
-		fprintf(stderr, "Unable to test \"%s\": %s\n",
-				attribute, strerror(-ret));
-	} else if (ret == 0) {
-		ret = -1;
+		create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+				"INI parsing failure",
+				"Unable to parse line: %i\n\n%s = %s\n",
+				line, attribute, value);
+		fprintf(stderr, "Unable to parse line: %i: %s = %s\n",
+				line, attribute, value);
+		return ret;
+	}
+
+	printf("Line %i: (%s = %s): value = %s\n",
+			line, attribute, value, measured);
+	if (!ret) {
+		create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+				"Test failure",
+				"Test failed! Line: %i\n\n"
+				"Test was: %s = %s\n"
+				"Value read = %s\n",
+				line, attribute, value, measured);
 		fprintf(stderr, "*** Test failed! ***\n");
-	} else {
-		fprintf(stderr, "Test passed.\n");
+		return -1;
 	}
 
-	g_strfreev(elems);
-	return ret;
-
-cleanup:
-	g_strfreev(elems);
-err_popup:
-	create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
-			"INI parsing failure",
-			"Unable to parse line: %i\n\n%s = %lli %lli\n",
-			line, attribute, min_i, max_i);
-	fprintf(stderr, "Unable to parse line: %i: %s = %lli %lli\n",
-			line, attribute, min_i, max_i);
+	fprintf(stderr, "Test passed.\n");
 	return ret;
 }
 
@@ -2650,27 +3115,26 @@ int osc_read_value(struct iio_context *_ctx,
 	}
 }
 
-FILE * osc_get_log_file(const char *path)
+/*
+ * Ends the current row of a log file of the profile with other values, in
+ * the format of the file; see profile_log_write_record().
+ */
+int osc_log_record(const char *path, const char * const *columns,
+		const char * const *values, unsigned int count)
 {
-	FILE *f;
-	const char *wave = strstr(path, "~/") ?: strstr(path, "~\\");
-	if (wave) {
-		gchar *tmp = g_build_filename(
-				getenv("HOME") ?: getenv("LOCALAPPDATA"),
-				wave + 2, NULL);
-		f = fopen(tmp, "a");
-		g_free(tmp);
-	} else {
-		f = fopen(path, "a");
-	}
+	if (!osc_profile_log)
+		osc_profile_log = profile_log_new(NULL);
 
-	return f;
+	return profile_log_write_record(osc_profile_log, path,
+			columns, values, count);
 }
 
 /* Log the value of a parameter in a text file:
  * log.device.filename = output_file
+ * The file stays open until @log is released; see profile_log.h for the
+ * CSV and JSON lines formats.
  */
-int osc_log_value(struct iio_context *_ctx,
+int osc_log_value_to(struct profile_log *log, struct iio_context *_ctx,
 		const char *attribute, const char *value)
 {
 	int ret;
@@ -2679,7 +3143,6 @@ int osc_log_value(struct iio_context *_ctx,
 	const char *attr;
 	char buf[1024];
 	bool debug;
-	FILE *f;
 
 	if (strncmp(attribute, "log.", sizeof("log.") - 1)) {
 		ret = -EINVAL;
@@ -2701,14 +3164,10 @@ int osc_log_value(struct iio_context *_ctx,
 	if (ret < 0)
 		goto err_ret;
 
-	f = osc_get_log_file(value);
-	if (!f) {
-		ret = -errno;
+	ret = profile_log_write(log, value, attribute + sizeof("log.") - 1, buf);
+	if (ret < 0)
 		goto err_ret;
-	}
 
-	fprintf(f, "%s, ", buf);
-	fclose(f);
 	return 0;
 
 err_ret:
@@ -2717,35 +3176,20 @@ err_ret:
 	return ret;
 }
 
-int osc_plugin_default_handle(struct iio_context *_ctx,
-		int line, const char *attrib, const char *value,
-		int (*driver_handle)(struct osc_plugin *plugin, const char *, const char *),
-		struct osc_plugin *plugin)
+int osc_log_value(struct iio_context *_ctx,
+		const char *attribute, const char *value)
 {
-	struct iio_device *dev;
-	struct iio_channel *chn;
-	const char *attr;
-	bool debug;
-	int ret;
+	if (!osc_profile_log)
+		osc_profile_log = profile_log_new(NULL);
 
-	if (!strncmp(attrib, "test.", sizeof("test.") - 1)) {
-		ret = osc_test_value(_ctx, line, attrib, value);
-		return ret < 1 ? -1 : 0;
-	}
-
-	if (!strncmp(attrib, "log.", sizeof("log.") - 1))
-		return osc_log_value(_ctx, attrib, value);
+	return osc_log_value_to(osc_profile_log, _ctx, attribute, value);
+}
 
-	ret = osc_identify_attrib(_ctx, attrib, &dev, &chn, &attr, &debug);
-	if (ret < 0) {
-		if (driver_handle)
-			return driver_handle(plugin, attrib, value);
-		else {
-			fprintf(stderr, "Error parsing ini file; key:'%s' value:'%s'\n",
-					attrib, value);
-			return ret;
-		}
-	}
+static int write_attrib(struct iio_context *_ctx, struct iio_device *dev,
+		struct iio_channel *chn, const char *attr, bool debug,
+		const char *value)
+{
+	int ret;
 
 	if (value[0] == '{') {
 		long long lval;
@@ -2777,6 +3221,58 @@ int osc_plugin_default_handle(struct iio_context *_ctx,
 	return ret < 0 ? ret : 0;
 }
 
+/* Write a value, or the {expression} of other values, to an attribute:
+ * device.attribute = value
+ */
+int osc_write_value(struct iio_context *_ctx,
+		const char *attrib, const char *value)
+{
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	const char *attr;
+	bool debug;
+	int ret;
+
+	ret = osc_identify_attrib(_ctx, attrib, &dev, &chn, &attr, &debug);
+	if (ret < 0)
+		return ret;
+
+	return write_attrib(_ctx, dev, chn, attr, debug, value);
+}
+
+int osc_plugin_default_handle(struct iio_context *_ctx,
+		int line, const char *attrib, const char *value,
+		int (*driver_handle)(struct osc_plugin *plugin, const char *, const char *),
+		struct osc_plugin *plugin)
+{
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	const char *attr;
+	bool debug;
+	int ret;
+
+	if (!strncmp(attrib, "test.", sizeof("test.") - 1)) {
+		ret = osc_test_value(_ctx, line, attrib, value);
+		return ret < 1 ? -1 : 0;
+	}
+
+	if (!strncmp(attrib, "log.", sizeof("log.") - 1))
+		return osc_log_value(_ctx, attrib, value);
+
+	ret = osc_identify_attrib(_ctx, attrib, &dev, &chn, &attr, &debug);
+	if (ret < 0) {
+		if (driver_handle)
+			return driver_handle(plugin, attrib, value);
+		else {
+			fprintf(stderr, "Error parsing ini file; key:'%s' value:'%s'\n",
+					attrib, value);
+			return ret;
+		}
+	}
+
+	return write_attrib(_ctx, dev, chn, attr, debug, value);
+}
+
 int osc_load_glade_file(GtkBuilder *builder, const char *fname)
 {
 	char path[256];
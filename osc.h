@@ -33,6 +33,7 @@ const void *memrchr(const void *src, int c, size_t length);
 #define SAVE_MAT 1
 #define SAVE_VSA 2
 #define SAVE_PNG 3
+#define SAVE_SIGMF 4
 
 extern GtkWidget *capture_graph;
 extern gint capture_function;
@@ -69,6 +70,7 @@ extern void math_expression_objects_clean(void);
 #endif
 
 struct osc_plugin;
+struct profile_log;
 
 struct marker_type {
 	gfloat x;
@@ -100,6 +102,14 @@ enum marker_types {
 #define USE_INTERN_SAMPLING_FREQ -1.0
 
 bool rx_update_device_sampling_freq(const char *device, double freq);
+gfloat * osc_channel_get_data(struct iio_channel *chn);
+bool osc_channel_get_extrema(struct iio_channel *chn, unsigned int count,
+		gfloat *min, gfloat *max);
+void osc_set_capture_native_format(bool enable);
+bool osc_get_capture_native_format(void);
+int osc_playback_attach(const char *device, const char *path);
+void osc_playback_detach(const char *device);
+int osc_playback_set_rate(const char *device, double rate);
 bool rx_update_channel_lo_freq(const char *device, const char *channel,
 	double lo_freq);
 void dialogs_init(GtkBuilder *builder);
@@ -150,6 +160,8 @@ struct iio_context * osc_create_context(void);
 void osc_destroy_context(struct iio_context *ctx);
 
 void osc_process_gtk_events(unsigned int msecs);
+int osc_eval_test(struct iio_context *ctx, const char *attribute,
+		const char *value, char *measured, size_t len);
 int osc_test_value(struct iio_context *ctx,
 		int line, const char *attribute, const char *value);
 int osc_identify_attrib(struct iio_context *ctx, const char *attrib,
@@ -157,9 +169,14 @@ int osc_identify_attrib(struct iio_context *ctx, const char *attrib,
 		const char **attr, bool *debug);
 int osc_read_value(struct iio_context *ctx,
 		const char *value, long long *out);
-FILE * osc_get_log_file(const char *path);
+int osc_log_record(const char *path, const char * const *columns,
+		const char * const *values, unsigned int count);
 int osc_log_value(struct iio_context *ctx,
 		const char *attribute, const char *value);
+int osc_log_value_to(struct profile_log *log, struct iio_context *ctx,
+		const char *attribute, const char *value);
+int osc_write_value(struct iio_context *ctx,
+		const char *attrib, const char *value);
 int osc_plugin_default_handle(struct iio_context *ctx,
 		int line, const char *attrib, const char *value,
 		int (*driver_handle)(struct osc_plugin *plugin, const char *, const char *),
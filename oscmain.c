@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <getopt.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 #include <iio.h>
@@ -8,6 +9,8 @@
 #include "config.h"
 #include "osc.h"
 #include "backtrace.h"
+#include "batch.h"
+#include "plugins/wavefile_loader.h"
 
 extern GtkWidget *notebook;
 extern GtkWidget *infobar;
@@ -177,9 +180,12 @@ static void usage(char *program)
 
 	/* please keep this list sorted in alphabetical order */
 	printf( "Command line options:\n"
+		"\t-b\trun the profile without GUI on every device given, at once, then exit\n"
+		"\t\t(also --batch, with --junit FILE and --json FILE to write reports)\n"
 		"\t-p\tload specific profile (to skip profile loading use \"-\")\n"
 		"\t-c\tIP address of device to connect to (192.168.2.1)\n"
-		"\t-u\tUniform Resource Identifer (URI) of device to connect to ('usb:3.2.5')\n");
+		"\t-u\tUniform Resource Identifer (URI) of device to connect to ('usb:3.2.5')\n"
+		"\t-w\tbenchmark the loading of the TX waveforms of a directory, then exit\n");
 
 	printf("\nEnvironmental variables:\n"
 		"\tOSC_FORCE_PLUGIN\tforce loading of a specific plugin\n");
@@ -187,39 +193,94 @@ static void usage(char *program)
 	exit(-1);
 }
 
+/* Load the waveforms as the DAC buffer settings would, for two I/Q pairs */
+static void benchmark_waveforms(const char *dir)
+{
+	struct wavefile_params params = {
+		.tx_channels = 4,
+		.full_scale = 1.0,
+		.offset = 0.0,
+		.alignment = 8,
+	};
+
+	exit(wavefile_benchmark(dir, &params, stdout) ? -1 : 0);
+}
+
+/* Run a test profile on all the devices given, without the GUI */
+static void run_batch(const char *profile, char **uris, unsigned int nb_uris,
+		const char *junit_file, const char *json_file)
+{
+	struct batch_options opts = {
+		.profile = profile,
+		.uris = (const char **)uris,
+		.nb_uris = nb_uris,
+		.junit_file = junit_file,
+		.json_file = json_file,
+	};
+
+	if (!profile) {
+		printf("Batch mode needs a profile (-p)\n");
+		exit(-1);
+	}
+
+	exit(batch_run(&opts) ? -1 : 0);
+}
+
 static void sigterm (int signum)
 {
 	application_quit();
 }
 
+enum {
+	OPT_JUNIT = 256,
+	OPT_JSON,
+};
+
+static const struct option options[] = {
+	{ "batch", no_argument, NULL, 'b' },
+	{ "junit", required_argument, NULL, OPT_JUNIT },
+	{ "json", required_argument, NULL, OPT_JSON },
+	{ NULL, 0, NULL, 0 },
+};
+
 gint main (int argc, char **argv)
 {
 	int c;
 
 	char *profile = NULL;
+	char **uris = NULL;
+	unsigned int nb_uris = 0;
+	const char *junit_file = NULL, *json_file = NULL;
+	bool batch = false;
 
 	init_signal_handlers(argv[0]);
 
 	opterr = 0;
-	while ((c = getopt (argc, argv, "c:p:u:")) != -1)
+	while ((c = getopt_long(argc, argv, "bc:p:u:w:", options, NULL)) != -1)
 		switch (c) {
+			case 'b':
+				batch = true;
+				break;
+			case OPT_JUNIT:
+				junit_file = optarg;
+				break;
+			case OPT_JSON:
+				json_file = optarg;
+				break;
 			case 'c':
-				ctx = iio_create_network_context(optarg);
-				if (!ctx) {
-					printf("Failed connecting to remote device: %s\n", optarg);
-					exit(-1);
-				}
+				uris = g_renew(char *, uris, nb_uris + 1);
+				uris[nb_uris++] = g_strdup_printf("ip:%s", optarg);
 				break;
 			case 'u':
-				ctx = iio_create_context_from_uri(optarg);
-				if (!ctx) {
-					printf("Failed connecting to remote device: %s\n", optarg);
-					exit(-1);
-				}
+				uris = g_renew(char *, uris, nb_uris + 1);
+				uris[nb_uris++] = g_strdup(optarg);
 				break;
 			case 'p':
 				profile = strdup(optarg);
 				break;
+			case 'w':
+				benchmark_waveforms(optarg);
+				break;
 			case '?':
 				usage(argv[0]);
 				break;
@@ -229,6 +290,19 @@ gint main (int argc, char **argv)
 				break;
 		}
 
+	if (batch)
+		run_batch(profile, uris, nb_uris, junit_file, json_file);
+
+	/* Outside of batch mode, the last device given is the one used */
+	if (nb_uris) {
+		ctx = iio_create_context_from_uri(uris[nb_uris - 1]);
+		if (!ctx) {
+			printf("Failed connecting to remote device: %s\n",
+					uris[nb_uris - 1]);
+			exit(-1);
+		}
+	}
+
 #ifndef __MINGW32__
 	/* XXX: Enabling threading when compiling for Windows will lock the UI
 	 * as soon as the main window is moved. */
@@ -262,6 +336,9 @@ gint main (int argc, char **argv)
 
 	if (profile)
 	    free(profile);
+	while (nb_uris)
+		g_free(uris[--nb_uris]);
+	g_free(uris);
 
 	if (c == 0 || c == -ENOTTY)
 		return 0;
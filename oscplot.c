@@ -15,7 +15,6 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <math.h>
-#include <matio.h>
 #include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -32,13 +31,9 @@
 #include "osc_plugin.h"
 #include "math_expression_generator.h"
 #include "iio_utils.h"
+#include "minmax_pyramid.h"
+#include "export_worker.h"
 
-/* add backwards compat for <matio-1.5.0 */
-#if MATIO_MAJOR_VERSION == 1 && MATIO_MINOR_VERSION < 5
-typedef int mat_dim;
-#else
-typedef size_t mat_dim;
-#endif
 
 extern void *find_setup_check_fct_by_devname(const char *dev_name);
 
@@ -54,11 +49,16 @@ static void add_grid(OscPlot *plot);
 static void rescale_databox(OscPlotPrivate *priv, GtkDatabox *box, gfloat border);
 static bool call_all_transform_functions(OscPlotPrivate *priv);
 static void capture_start(OscPlotPrivate *priv);
+static void frame_scheduler_request(void);
+static void frame_scheduler_remove(OscPlotPrivate *priv);
+static void plot_pyramids_freeze(OscPlotPrivate *priv);
+static void transform_pyramid_drop(Transform *tr);
 static void plot_profile_save(OscPlot *plot, char *filename);
 static void transform_add_plot_markers(OscPlot *plot, Transform *transform);
 static void osc_plot_finalize(GObject *object);
 static void osc_plot_dispose(GObject *object);
-static void save_as(OscPlot *plot, const char *filename, int type);
+static struct export_job * save_as(OscPlot *plot, const char *filename, int type);
+static void plot_export_run(OscPlot *plot, struct export_job *job, bool wait);
 static void treeview_expand_update(OscPlot *plot);
 static void treeview_icon_color_update(OscPlot *plot);
 static int enabled_channels_of_device(GtkTreeView *treeview, const char *name, unsigned *enabled_mask);
@@ -363,6 +363,7 @@ struct _OscPlotPrivate
 
 	gint line_thickness;
 
+	/* Non-zero while the plot is registered with the frame scheduler */
 	gint redraw_function;
 	gboolean stop_redraw;
 	gboolean redraw;
@@ -495,8 +496,10 @@ struct iio_buffer * osc_plot_get_buffer(OscPlot *plot)
 
 void osc_plot_data_update (OscPlot *plot)
 {
-	if (call_all_transform_functions(plot->priv))
+	if (call_all_transform_functions(plot->priv)) {
 		plot->priv->redraw = TRUE;
+		frame_scheduler_request();
+	}
 
 	if (plot->priv->single_shot_mode) {
 		plot->priv->single_shot_mode = false;
@@ -610,7 +613,7 @@ void osc_plot_save_to_ini (OscPlot *plot, char *filename)
 
 void osc_plot_save_as (OscPlot *plot, char *filename, int type)
 {
-	save_as(plot, filename, type);
+	plot_export_run(plot, save_as(plot, filename, type), true);
 }
 
 const char * osc_plot_get_active_device (OscPlot *plot)
@@ -746,7 +749,7 @@ void osc_plot_set_channel_state(OscPlot *plot, const char *dev, unsigned int cha
 	if (gtk_toggle_tool_button_get_active((GtkToggleToolButton *)priv->capture_button))
 		return;
 
-	iio_dev = iio_context_find_device(ctx, dev);
+	iio_dev = iio_utils_find_device(ctx, dev);
 	if (!iio_dev || !is_input_device(iio_dev))
 		return;
 
@@ -869,10 +872,195 @@ static double win_hanning(int j, int n)
 	return (w);
 }
 
+/*
+ * Transform result cache
+ *
+ * Plots showing the FFT of the same channels compute the same spectrum
+ * every frame. Such transforms share a refcounted entry, looked up by
+ * (device, channels, transform type, settings). The first transform to run
+ * in a frame computes the magnitudes of the frame into the entry and the
+ * others reuse them. Averaging and peak/min hold stay in the output of each
+ * transform, so that resetting one plot doesn't affect the others.
+ */
+struct transform_cache_key {
+	const struct iio_device *dev;
+	const struct iio_channel *chn[2];
+	int type_id;
+	unsigned int fft_size;
+	gfloat fft_pwr_off;
+	int num_active_channels;
+};
+
+struct transform_cache_entry {
+	struct transform_cache_key key;
+	unsigned int refcount;
+	unsigned long frame_seq;
+	gfloat *data;
+	unsigned int size;
+};
+
+static GHashTable *transform_cache = NULL;
+
+static guint transform_cache_key_hash(gconstpointer data)
+{
+	const struct transform_cache_key *key = data;
+	guint hash;
+
+	hash = g_direct_hash(key->dev);
+	hash = hash * 31 + g_direct_hash(key->chn[0]);
+	hash = hash * 31 + g_direct_hash(key->chn[1]);
+	hash = hash * 31 + key->type_id;
+	hash = hash * 31 + key->fft_size;
+	hash = hash * 31 + (guint)(key->fft_pwr_off * 1000);
+	hash = hash * 31 + key->num_active_channels;
+
+	return hash;
+}
+
+static gboolean transform_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct transform_cache_key *ka = a, *kb = b;
+
+	return ka->dev == kb->dev &&
+		ka->chn[0] == kb->chn[0] &&
+		ka->chn[1] == kb->chn[1] &&
+		ka->type_id == kb->type_id &&
+		ka->fft_size == kb->fft_size &&
+		ka->fft_pwr_off == kb->fft_pwr_off &&
+		ka->num_active_channels == kb->num_active_channels;
+}
+
+static bool transform_cache_key_fill(Transform *tr, struct transform_cache_key *key)
+{
+	struct _fft_settings *settings = tr->settings;
+	GSList *node;
+	int i;
+
+	/* Math channels depend on a per-plot expression, never share those */
+	if (tr->plot_channels_type != PLOT_IIO_CHANNEL)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	key->dev = transform_get_device_parent(tr);
+	if (!key->dev)
+		return false;
+
+	for (i = 0, node = tr->plot_channels; node && i < 2;
+			node = g_slist_next(node), i++)
+		key->chn[i] = PLOT_IIO_CHN(node->data)->iio_chn;
+
+	key->type_id = tr->type_id;
+	key->fft_size = settings->fft_size;
+	key->fft_pwr_off = settings->fft_pwr_off;
+	key->num_active_channels = settings->fft_alg_data.num_active_channels;
+
+	return true;
+}
+
+static void transform_cache_release(struct transform_cache_entry *entry)
+{
+	if (!entry || --entry->refcount)
+		return;
+
+	g_hash_table_remove(transform_cache, &entry->key);
+	g_free(entry->data);
+	g_free(entry);
+}
+
+static struct transform_cache_entry *
+transform_cache_acquire(const struct transform_cache_key *key, unsigned int size)
+{
+	struct transform_cache_entry *entry;
+
+	if (!transform_cache)
+		transform_cache = g_hash_table_new(transform_cache_key_hash,
+				transform_cache_key_equal);
+
+	entry = g_hash_table_lookup(transform_cache, key);
+	if (entry) {
+		entry->refcount++;
+		return entry;
+	}
+
+	entry = g_new0(struct transform_cache_entry, 1);
+	entry->key = *key;
+	entry->refcount = 1;
+	entry->size = size;
+	entry->data = g_new(gfloat, size);
+	g_hash_table_insert(transform_cache, &entry->key, entry);
+
+	return entry;
+}
+
+/* Make sure the FFT transform holds the entry matching its current settings */
+static void fft_transform_cache_update(Transform *tr)
+{
+	struct _fft_settings *settings = tr->settings;
+	struct transform_cache_entry *entry = settings->shared_result;
+	struct transform_cache_key key;
+
+	if (!transform_cache_key_fill(tr, &key)) {
+		transform_cache_release(entry);
+		settings->shared_result = NULL;
+		return;
+	}
+
+	if (entry && transform_cache_key_equal(&entry->key, &key) &&
+			entry->size == tr->y_axis_size)
+		return;
+
+	transform_cache_release(entry);
+	settings->shared_result = transform_cache_acquire(&key, tr->y_axis_size);
+}
+
+static void fft_transform_cache_detach(Transform *tr)
+{
+	struct _fft_settings *settings = tr->settings;
+
+	transform_cache_release(settings->shared_result);
+	settings->shared_result = NULL;
+}
+
+static inline gfloat fft_average_bin(gfloat acc, gfloat mag, double avg)
+{
+	if (acc == FLT_MAX) {
+		/* Don't average the first iteration */
+		return mag;
+	} else if (!avg) {
+		/* keep peaks */
+		return acc <= mag ? mag : acc;
+	} else if (avg == 128) {
+		/* keep min */
+		return acc >= mag ? mag : acc;
+	} else {
+		/* do an average */
+		return ((1 - avg) * acc) + (avg * mag);
+	}
+}
+
+/* Apply the averaging of the transform to the magnitudes of a frame */
+static void fft_average(Transform *tr, const gfloat *mag_data, int count,
+		double avg)
+{
+	gfloat *out_data = tr->y_axis;
+	gfloat y_min = FLT_MAX, y_max = -FLT_MAX;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		out_data[i] = fft_average_bin(out_data[i], mag_data[i], avg);
+		if (out_data[i] < y_min)
+			y_min = out_data[i];
+		if (out_data[i] > y_max)
+			y_max = out_data[i];
+	}
+	Transform_set_y_extrema(tr, y_min, y_max);
+}
+
 static void do_fft(Transform *tr)
 {
 	struct _fft_settings *settings = tr->settings;
 	struct _fft_alg_data *fft = &settings->fft_alg_data;
+	struct transform_cache_entry *shared = settings->shared_result;
 	struct marker_type *markers = settings->markers;
 	enum marker_types marker_type = MARKER_OFF;
 	gfloat *in_data = settings->real_source;
@@ -882,15 +1070,37 @@ static void do_fft(Transform *tr)
 	int fft_size = settings->fft_size;
 	int i, j, k;
 	int cnt;
-	gfloat mag;
+	gfloat mag, y_min, y_max;
 	double avg, pwr_offset;
 	int maxX[MAX_MARKERS + 1];
 	gfloat maxY[MAX_MARKERS + 1];
 	gfloat plugin_fft_corr;
+	unsigned long frame_seq;
 
 	if (settings->marker_type)
 		marker_type = *((enum marker_types *)settings->marker_type);
 
+	struct iio_device *iio_dev = transform_get_device_parent(tr);
+	struct extra_dev_info *dev_info = iio_device_get_data(iio_dev);
+	plugin_fft_corr = dev_info->plugin_fft_corr;
+	frame_seq = dev_info->frame_seq;
+
+	fft->m = (fft->num_active_channels == 2) ? fft_size : fft_size / 2;
+
+	avg = (double)settings->fft_avg;
+	if (avg && avg != 128 )
+		avg = 1.0f / avg;
+
+	/* Frames that are not tagged by the capture path can't be shared */
+	if (!frame_seq)
+		shared = NULL;
+
+	/* Another plot already computed this frame: reuse its magnitudes */
+	if (shared && shared->frame_seq == frame_seq) {
+		fft_average(tr, shared->data, fft->m, avg);
+		goto find_peaks;
+	}
+
 	if ((fft->cached_fft_size == -1) || (fft->cached_fft_size != fft_size) ||
 		(fft->cached_num_active_channels != fft->num_active_channels)) {
 
@@ -908,13 +1118,11 @@ static void do_fft(Transform *tr)
 
 		fft->win = fftw_malloc(sizeof(double) * fft_size);
 		if (fft->num_active_channels == 2) {
-			fft->m = fft_size;
 			fft->in_c = fftw_malloc(sizeof(fftw_complex) * fft_size);
 			fft->in = NULL;
 			fft->out = fftw_malloc(sizeof(fftw_complex) * (fft->m + 1));
 			fft->plan_forward = fftw_plan_dft_1d(fft_size, fft->in_c, fft->out, FFTW_FORWARD, FFTW_ESTIMATE);
 		} else {
-			fft->m = fft_size / 2;
 			fft->out = fftw_malloc(sizeof(fftw_complex) * (fft->m + 1));
 			fft->in_c = NULL;
 			fft->in = fftw_malloc(sizeof(double) * fft_size);
@@ -943,21 +1151,12 @@ static void do_fft(Transform *tr)
 		}
 	}
 
-	struct iio_device *iio_dev = transform_get_device_parent(tr);
-	struct extra_dev_info *dev_info = iio_device_get_data(iio_dev);
-	plugin_fft_corr = dev_info->plugin_fft_corr;
-
 	fftw_execute(fft->plan_forward);
-	avg = (double)settings->fft_avg;
-	if (avg && avg != 128 )
-		avg = 1.0f / avg;
 
 	pwr_offset = settings->fft_pwr_off;
 
-	for (j = 0; j <= MAX_MARKERS; j++) {
-		maxX[j] = 0;
-		maxY[j] = -200.0f;
-	}
+	y_min = FLT_MAX;
+	y_max = -FLT_MAX;
 
 	for (i = 0; i < fft->m; ++i) {
 		if (fft->num_active_channels == 2) {
@@ -975,27 +1174,36 @@ static void do_fft(Transform *tr)
 		mag = 10 * log10((creal(fft->out[j]) * creal(fft->out[j]) +
 				cimag(fft->out[j]) * cimag(fft->out[j])) / ((unsigned long long)fft->m * fft->m)) +
 			fft->fft_corr + pwr_offset + plugin_fft_corr;
-		/* it's better for performance to have separate loops,
-		 * rather than do these tests inside the loop, but it makes
-		 * the code harder to understand... Oh well...
-		 ***/
-		if (out_data[i] == FLT_MAX) {
-			/* Don't average the first iteration */
-			 out_data[i] = mag;
-		} else if (!avg) {
-			/* keep peaks */
-			if (out_data[i] <= mag)
-				out_data[i] = mag;
-		} else if (avg == 128) {
-			/* keep min */
-			if (out_data[i] >= mag)
-				out_data[i] = mag;
-		} else {
-			/* do an average */
-			out_data[i] = ((1 - avg) * out_data[i]) + (avg * mag);
-		}
-		if (!settings->markers || i < 2)
+		/* The other users of the entry average the frame their way */
+		if (shared) {
+			shared->data[i] = mag;
 			continue;
+		}
+
+		out_data[i] = fft_average_bin(out_data[i], mag, avg);
+		if (out_data[i] < y_min)
+			y_min = out_data[i];
+		if (out_data[i] > y_max)
+			y_max = out_data[i];
+	}
+
+	if (shared) {
+		shared->frame_seq = frame_seq;
+		fft_average(tr, shared->data, fft->m, avg);
+	} else {
+		Transform_set_y_extrema(tr, y_min, y_max);
+	}
+
+find_peaks:
+	if (!settings->markers)
+		return;
+
+	for (j = 0; j <= MAX_MARKERS; j++) {
+		maxX[j] = 0;
+		maxY[j] = -200.0f;
+	}
+
+	for (i = 2; i < fft->m; ++i) {
 		if (MAX_MARKERS && (marker_type == MARKER_PEAK ||
 				marker_type == MARKER_ONE_TONE ||
 				marker_type == MARKER_IMAGE)) {
@@ -1024,9 +1232,6 @@ static void do_fft(Transform *tr)
 		}
 	}
 
-	if (!settings->markers)
-		return;
-
 	int m = fft->m;
 
 	if ((marker_type == MARKER_ONE_TONE || marker_type == MARKER_IMAGE) &&
@@ -1374,11 +1579,25 @@ bool time_transform_function(Transform *tr, gboolean init_transform)
 		PlotMathChn *m = tr->plot_channels->data;
 		m->math_expression(m->iio_channels_data,
 			m->data_ref, settings->num_samples);
+		Transform_find_y_extrema(tr);
 	} else if (tr->plot_channels_type == PLOT_IIO_CHANNEL) {
+		gfloat min = FLT_MAX, max = -FLT_MAX;
+
 		if (!settings->apply_inverse_funct &&
 				!settings->apply_multiply_funct &&
-				!settings->apply_add_funct)
+				!settings->apply_add_funct) {
+			/* The output aliases the capture buffer, whose range
+			 * the capture found while writing it */
+			if (!tr->find_extrema)
+				return true;
+			if (osc_channel_get_extrema(PLOT_IIO_CHN(
+					tr->plot_channels->data)->iio_chn,
+					tr->y_axis_size, &min, &max))
+				Transform_set_y_extrema(tr, min, max);
+			else
+				Transform_find_y_extrema(tr);
 			return true;
+		}
 
 		in_data = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
 		if (!in_data)
@@ -1397,7 +1616,13 @@ bool time_transform_function(Transform *tr, gboolean init_transform)
 				tr->y_axis[i] *= settings->multiply_value;
 			if (settings->apply_add_funct)
 				tr->y_axis[i] += settings->add_value;
+			if (tr->y_axis[i] < min)
+				min = tr->y_axis[i];
+			if (tr->y_axis[i] > max)
+				max = tr->y_axis[i];
 		}
+		if (tr->y_axis_size)
+			Transform_set_y_extrema(tr, min, max);
 	}
 
 	return true;
@@ -1487,9 +1712,15 @@ bool cross_correlation_transform_function(Transform *tr, gboolean init_transform
 		maxY[j] = -200.0f;
 	}
 
+	gfloat y_min = FLT_MAX, y_max = -FLT_MAX;
+
 	/* find the peaks */
 	for (i = 0; i < 2 * axis_length - 1; i++) {
 		tr->y_axis[i] =  2 * creal(settings->xcorr_data[i]) / (gfloat)axis_length;
+		if (tr->y_axis[i] < y_min)
+			y_min = tr->y_axis[i];
+		if (tr->y_axis[i] > y_max)
+			y_max = tr->y_axis[i];
 		if (!settings->markers)
 			continue;
 
@@ -1519,6 +1750,8 @@ bool cross_correlation_transform_function(Transform *tr, gboolean init_transform
 		}
 	}
 
+	Transform_set_y_extrema(tr, y_min, y_max);
+
 	if (!settings->markers)
 		return true;
 
@@ -1657,6 +1890,9 @@ bool fft_transform_function(Transform *tr, gboolean init_transform)
 	int i;
 
 	if (init_transform) {
+		/* Start from a fresh shared result, if any, after a (re)setup */
+		fft_transform_cache_detach(tr);
+
 		/* Set the sources of the transfrom */
 		settings->real_source = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
 		if (g_slist_length(tr->plot_channels) > 1)
@@ -1721,6 +1957,7 @@ bool fft_transform_function(Transform *tr, gboolean init_transform)
 			m->math_expression(m->iio_channels_data,
 				m->data_ref, settings->fft_size);
 		}
+	fft_transform_cache_update(tr);
 	do_fft(tr);
 
 	return true;
@@ -1805,13 +2042,9 @@ static gfloat* plot_iio_channel_get_data_ref(PlotChn *obj)
 	PlotIioChn *this = (PlotIioChn *)obj;
 	gfloat *ref = NULL;
 
-	if (this && this->iio_chn) {
-		struct extra_info *ch_info;
-
-		ch_info = iio_channel_get_data(this->iio_chn);
-		if (ch_info)
-			ref = ch_info->data_ref;
-	}
+	/* Native format captures only make floats for the channels in use */
+	if (this && this->iio_chn)
+		ref = osc_channel_get_data(this->iio_chn);
 
 	return ref;
 }
@@ -1874,7 +2107,7 @@ static struct iio_device *plot_math_channel_get_iio_parent(PlotChn *obj)
 	struct iio_device *iio_dev = NULL;
 
 	if (this && this->iio_device_name) {
-		iio_dev = iio_context_find_device(this->base.ctx,
+		iio_dev = iio_utils_find_device(this->base.ctx,
 				this->iio_device_name);
 	}
 
@@ -2220,7 +2453,7 @@ static int plot_get_sample_count_of_device(OscPlot *plot, const char *device)
 		count = (int)osc_plot_get_sample_count(plot);
 		break;
 	case 1:
-		iio_dev = iio_context_find_device(ctx, device);
+		iio_dev = iio_utils_find_device(ctx, device);
 		if (!iio_dev)
 			break;
 
@@ -2425,7 +2658,7 @@ static gfloat *** iio_channels_get_data(struct iio_context *ctx,
 	if (!device_name)
 		return NULL;
 
-	iio_dev = iio_context_find_device(ctx, device_name);
+	iio_dev = iio_utils_find_device(ctx, device_name);
 	if (!iio_dev) {
 		fprintf(stderr, "Could not find device %s in %s\n",
 				device_name, __func__);
@@ -2463,6 +2696,9 @@ static void remove_transform_from_list(OscPlot *plot, Transform *tr)
 		priv->tr_with_marker = NULL;
 
 	transform_remove_own_markers(tr);
+	transform_pyramid_drop(tr);
+	if (tr->type_id == FFT_TRANSFORM || tr->type_id == COMPLEX_FFT_TRANSFORM)
+		fft_transform_cache_detach(tr);
 	if (tr->type_id == FREQ_SPECTRUM_TRANSFORM) {
 		free(FREQ_SPECTRUM_SETTINGS(tr)->ffts_alg_data);
 		free(FREQ_SPECTRUM_SETTINGS(tr)->maxXaxis);
@@ -2893,19 +3129,53 @@ static void device_rx_info_update(OscPlot *plot)
 	}
 }
 
+/* Make sure the float samples of the devices used by a transform are current */
+static void transform_sync_channels_data(Transform *tr)
+{
+	GSList *node;
+
+	for (node = tr->plot_channels; node; node = g_slist_next(node)) {
+		PlotChn *plot_ch = node->data;
+		struct iio_device *dev;
+		unsigned int i, nb_channels;
+
+		if (plot_ch->type == PLOT_IIO_CHANNEL) {
+			osc_channel_get_data(PLOT_IIO_CHN(plot_ch)->iio_chn);
+			continue;
+		}
+
+		/* Math expressions may use any channel of their device */
+		dev = plot_ch->get_iio_parent(plot_ch);
+		if (!dev)
+			continue;
+		nb_channels = iio_device_get_channels_count(dev);
+		for (i = 0; i < nb_channels; i++)
+			osc_channel_get_data(iio_device_get_channel(dev, i));
+	}
+}
+
 static bool call_all_transform_functions(OscPlotPrivate *priv)
 {
 	TrList *tr_list = priv->transform_list;
 	Transform *tr;
 	bool valid = true;
 	bool tr_valid;
+	bool autoscale;
 	int i = 0;
 
 	if (priv->redraw_function <= 0)
 		return false;
 
+	/* The Y range of the outputs is only needed to autoscale */
+	autoscale = gtk_toggle_button_get_active(
+			GTK_TOGGLE_BUTTON(priv->enable_auto_scale));
+
 	for (; i < tr_list->size; i++) {
 		tr = tr_list->transforms[i];
+		tr->find_extrema = autoscale;
+		if (!autoscale)
+			tr->has_extrema = false;
+		transform_sync_channels_data(tr);
 		tr_valid = Transform_update_output(tr);
 		if (tr_valid)
 			gtk_databox_graph_set_hide(tr->graph, FALSE);
@@ -2915,45 +3185,187 @@ static bool call_all_transform_functions(OscPlotPrivate *priv)
 	return valid;
 }
 
+/*
+ * Index of the rows of a channel tree by name, kept on its model. Rows are
+ * added to it as they are appended to the model, and the enabled channels
+ * of each device are cached until a row of the model changes.
+ */
+struct tree_dev_index {
+	GtkTreeRowReference *row;
+	/* Channel name -> GtkTreeRowReference */
+	GHashTable *channels;
+
+	bool mask_valid;
+	unsigned int mask_serial;
+	unsigned int enabled_mask;
+	int num_enabled;
+};
+
+struct tree_index {
+	/* Device name -> struct tree_dev_index */
+	GHashTable *devices;
+	unsigned int serial;
+};
+
+static void tree_dev_index_free(gpointer data)
+{
+	struct tree_dev_index *tdi = data;
+
+	gtk_tree_row_reference_free(tdi->row);
+	g_hash_table_destroy(tdi->channels);
+	g_free(tdi);
+}
+
+static void tree_index_free(gpointer data)
+{
+	struct tree_index *ti = data;
+
+	g_hash_table_destroy(ti->devices);
+	g_free(ti);
+}
+
+static void tree_index_model_changed(GtkTreeModel *model, GtkTreePath *path,
+		gpointer data)
+{
+	struct tree_index *ti = data;
+
+	ti->serial++;
+}
+
+static struct tree_index * tree_index_get(GtkTreeModel *model)
+{
+	struct tree_index *ti = g_object_get_data(G_OBJECT(model), "tree-index");
+
+	if (ti)
+		return ti;
+
+	ti = g_new0(struct tree_index, 1);
+	ti->devices = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, tree_dev_index_free);
+	g_object_set_data_full(G_OBJECT(model), "tree-index", ti,
+			tree_index_free);
+
+	g_signal_connect(model, "row-changed",
+			G_CALLBACK(tree_index_model_changed), ti);
+	g_signal_connect(model, "row-inserted",
+			G_CALLBACK(tree_index_model_changed), ti);
+	g_signal_connect(model, "row-deleted",
+			G_CALLBACK(tree_index_model_changed), ti);
+
+	return ti;
+}
+
+static gboolean tree_index_row_iter(GtkTreeModel *model,
+		GtkTreeRowReference *row, GtkTreeIter *iter)
+{
+	GtkTreePath *path;
+	gboolean ret;
+
+	if (!row)
+		return FALSE;
+
+	path = gtk_tree_row_reference_get_path(row);
+	if (!path)
+		return FALSE;
+
+	ret = gtk_tree_model_get_iter(model, iter, path);
+	gtk_tree_path_free(path);
+
+	return ret;
+}
+
+static void tree_index_add_device(GtkTreeModel *model, const char *name,
+		GtkTreeIter *iter)
+{
+	struct tree_index *ti = tree_index_get(model);
+	struct tree_dev_index *tdi = g_hash_table_lookup(ti->devices, name);
+	GtkTreePath *path;
+
+	/* Like a scan of the model, lookups find the first row */
+	if (tdi && gtk_tree_row_reference_valid(tdi->row))
+		return;
+
+	tdi = g_new0(struct tree_dev_index, 1);
+	path = gtk_tree_model_get_path(model, iter);
+	tdi->row = gtk_tree_row_reference_new(model, path);
+	gtk_tree_path_free(path);
+	tdi->channels = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)gtk_tree_row_reference_free);
+
+	g_hash_table_replace(ti->devices, g_strdup(name), tdi);
+}
+
+static void tree_index_add_channel(GtkTreeModel *model, const char *dev_name,
+		const char *name, GtkTreeIter *iter)
+{
+	struct tree_index *ti = tree_index_get(model);
+	struct tree_dev_index *tdi = g_hash_table_lookup(ti->devices, dev_name);
+	GtkTreeIter row_iter;
+	GtkTreePath *path;
+	char *row_name;
+	bool same;
+
+	if (!tdi)
+		return;
+
+	/* Keep the first row, unless it was renamed */
+	if (tree_index_row_iter(model, g_hash_table_lookup(tdi->channels, name),
+				&row_iter)) {
+		gtk_tree_model_get(model, &row_iter, ELEMENT_NAME, &row_name, -1);
+		same = row_name && !strcmp(row_name, name);
+		g_free(row_name);
+		if (same)
+			return;
+	}
+
+	path = gtk_tree_model_get_path(model, iter);
+	g_hash_table_replace(tdi->channels, g_strdup(name),
+			gtk_tree_row_reference_new(model, path));
+	gtk_tree_path_free(path);
+}
+
 static int enabled_channels_of_device(GtkTreeView *treeview, const char *name, unsigned *enabled_mask)
 {
+	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
+	struct tree_index *ti = tree_index_get(model);
+	struct tree_dev_index *tdi = g_hash_table_lookup(ti->devices, name);
 	GtkTreeIter iter;
 	GtkTreeIter child_iter;
 	gboolean next_child_iter;
-	char *str_device;
 	gboolean enabled;
-	int num_enabled = 0;
 	int ch_pos = 0;
 
-	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
-	gboolean next_iter = gtk_tree_model_get_iter_first(model, &iter);
-
 	if (enabled_mask)
 		*enabled_mask = 0;
 
-	while (next_iter) {
-		if (!gtk_tree_model_iter_children(model, &child_iter, &iter)) {
-			next_iter = gtk_tree_model_iter_next(model, &iter);
-			continue;
-		}
-		gtk_tree_model_get(model, &iter, ELEMENT_NAME, &str_device, -1);
-		if (!strcmp(name, str_device)) {
-			next_child_iter = true;
-			while (next_child_iter) {
-				gtk_tree_model_get(model, &child_iter, CHANNEL_ACTIVE, &enabled, -1);
-				if (enabled) {
-					num_enabled++;
-					if (enabled_mask)
-						*enabled_mask |= 1 << ch_pos;
-				}
-				ch_pos++;
-				next_child_iter = gtk_tree_model_iter_next(model, &child_iter);
-			}
+	if (!tdi || !tree_index_row_iter(model, tdi->row, &iter))
+		return 0;
+
+	if (tdi->mask_valid && tdi->mask_serial == ti->serial)
+		goto out;
+
+	tdi->enabled_mask = 0;
+	tdi->num_enabled = 0;
+
+	next_child_iter = gtk_tree_model_iter_children(model, &child_iter, &iter);
+	while (next_child_iter) {
+		gtk_tree_model_get(model, &child_iter, CHANNEL_ACTIVE, &enabled, -1);
+		if (enabled) {
+			tdi->num_enabled++;
+			tdi->enabled_mask |= 1 << ch_pos;
 		}
-		next_iter = gtk_tree_model_iter_next(model, &iter);
+		ch_pos++;
+		next_child_iter = gtk_tree_model_iter_next(model, &child_iter);
 	}
 
-	return num_enabled;
+	tdi->mask_valid = true;
+	tdi->mask_serial = ti->serial;
+
+out:
+	if (enabled_mask)
+		*enabled_mask = tdi->enabled_mask;
+
+	return tdi->num_enabled;
 }
 
 static int num_of_channels_of_device(GtkTreeView *treeview, const char *name)
@@ -3144,15 +3556,79 @@ static void remove_all_transforms(OscPlot *plot)
 		remove_transform_from_list(plot, priv->transform_list->transforms[0]);
 }
 
-static void auto_scale_databox(OscPlotPrivate *priv, GtkDatabox *box)
+/* Shrink the view only when the data uses less than this fraction of it */
+#define AUTOSCALE_SHRINK_RATIO 0.7f
+#define AUTOSCALE_BORDER 0.05f
+
+/* Combine the extrema reported by the transforms, without touching any sample */
+static bool transforms_get_extrema(OscPlotPrivate *priv, gfloat *min_x,
+		gfloat *max_x, gfloat *min_y, gfloat *max_y)
 {
-	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->enable_auto_scale)))
-		return;
+	TrList *tr_list = priv->transform_list;
+	Transform *tr;
+	int i;
 
-	/* Auto scale every 10 seconds */
-	if ((priv->frame_counter == 0) || (priv->do_a_rescale_flag == 1)) {
-		priv->do_a_rescale_flag = 0;
-		rescale_databox(priv, box, 0.05);
+	/* These need the x extrema of the data, or are filled in pieces */
+	if (priv->active_transform_type == CONSTELLATION_TRANSFORM ||
+			priv->active_transform_type == FREQ_SPECTRUM_TRANSFORM)
+		return false;
+
+	if (!tr_list->size)
+		return false;
+
+	for (i = 0; i < tr_list->size; i++) {
+		tr = tr_list->transforms[i];
+		if (!tr->has_extrema || !tr->x_axis || !tr->y_axis_size)
+			return false;
+
+		if (i == 0 || tr->x_axis[0] < *min_x)
+			*min_x = tr->x_axis[0];
+		if (i == 0 || tr->x_axis[tr->y_axis_size - 1] > *max_x)
+			*max_x = tr->x_axis[tr->y_axis_size - 1];
+		if (i == 0 || tr->y_env_min < *min_y)
+			*min_y = tr->y_env_min;
+		if (i == 0 || tr->y_env_max > *max_y)
+			*max_y = tr->y_env_max;
+	}
+
+	return true;
+}
+
+static void auto_scale_databox(OscPlotPrivate *priv, GtkDatabox *box)
+{
+	gfloat min_x, max_x, min_y, max_y;
+	gfloat left, right, top, bottom;
+	gfloat width, height;
+
+	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->enable_auto_scale)))
+		return;
+
+	if (!transforms_get_extrema(priv, &min_x, &max_x, &min_y, &max_y)) {
+		/* Auto scale every 10 seconds */
+		if ((priv->frame_counter == 0) || (priv->do_a_rescale_flag == 1)) {
+			priv->do_a_rescale_flag = 0;
+			rescale_databox(priv, box, AUTOSCALE_BORDER);
+		}
+		return;
+	}
+
+	width = max_x - min_x;
+	height = max_y - min_y;
+	if (height == 0)
+		height = (max_y != 0) ? fabs(max_y) : 1;
+	min_x -= AUTOSCALE_BORDER * width;
+	max_x += AUTOSCALE_BORDER * width;
+	min_y -= AUTOSCALE_BORDER * height;
+	max_y += AUTOSCALE_BORDER * height;
+
+	gtk_databox_get_total_limits(box, &left, &right, &top, &bottom);
+
+	/* Grow as soon as the data leaves the view, shrink with hysteresis */
+	if (priv->do_a_rescale_flag == 1 || left != min_x || right != max_x ||
+			max_y > top || min_y < bottom ||
+			(max_y - min_y) < (top - bottom) * AUTOSCALE_SHRINK_RATIO) {
+		priv->do_a_rescale_flag = 0;
+		gtk_databox_set_total_limits(box, min_x, max_x, max_y, min_y);
 	}
 }
 
@@ -3194,21 +3670,129 @@ static gboolean plot_redraw(OscPlotPrivate *priv)
 			if (show_diff_phase)
 				markers_phase_diff_show(priv);
 	}
-	if (priv->stop_redraw == TRUE)
-		priv->redraw_function = 0;
 
 	priv->redraw = FALSE;
 	return !priv->stop_redraw;
 }
 
+/*
+ * Frame scheduler
+ *
+ * All running plots share a single frame source. The source is only armed
+ * when a plot gets damaged (new transform output or a pending stop), so
+ * idle plots cost nothing. Damage reported by several plots between two
+ * frames is coalesced into one callback, and frames are never dispatched
+ * faster than frame_sched_max_fps (0 means uncapped).
+ */
+#define FRAME_SCHED_DEFAULT_FPS 20
+
+static GSList *frame_sched_plots = NULL;
+static guint frame_sched_source = 0;
+static gint64 frame_sched_last_frame = 0;
+static unsigned int frame_sched_max_fps = FRAME_SCHED_DEFAULT_FPS;
+
+static gboolean frame_scheduler_dispatch(gpointer data)
+{
+	GSList *node, *next;
+
+	frame_sched_source = 0;
+	frame_sched_last_frame = g_get_monotonic_time();
+
+	for (node = frame_sched_plots; node; node = next) {
+		OscPlotPrivate *priv = node->data;
+
+		/* plot_redraw() may retire the plot, so fetch the next node first */
+		next = g_slist_next(node);
+		if (!priv->redraw && !priv->stop_redraw)
+			continue;
+		if (!plot_redraw(priv)) {
+			frame_scheduler_remove(priv);
+			plot_pyramids_freeze(priv);
+		}
+	}
+
+	return FALSE;
+}
+
+static void frame_scheduler_request(void)
+{
+	gint64 elapsed;
+	guint delay = 0;
+
+	if (frame_sched_source || !frame_sched_plots)
+		return;
+
+	if (frame_sched_max_fps) {
+		guint period = 1000 / frame_sched_max_fps;
+
+		elapsed = (g_get_monotonic_time() - frame_sched_last_frame) / 1000;
+		if (elapsed >= 0 && elapsed < period)
+			delay = period - elapsed;
+	}
+
+	frame_sched_source = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, delay,
+			frame_scheduler_dispatch, NULL, NULL);
+}
+
+static void frame_scheduler_add(OscPlotPrivate *priv)
+{
+	if (!g_slist_find(frame_sched_plots, priv))
+		frame_sched_plots = g_slist_prepend(frame_sched_plots, priv);
+	priv->redraw_function = 1;
+}
+
+static void frame_scheduler_remove(OscPlotPrivate *priv)
+{
+	frame_sched_plots = g_slist_remove(frame_sched_plots, priv);
+	priv->redraw_function = 0;
+
+	if (!frame_sched_plots && frame_sched_source) {
+		g_source_remove(frame_sched_source);
+		frame_sched_source = 0;
+	}
+}
+
+void osc_plot_set_max_fps(unsigned int fps)
+{
+	frame_sched_max_fps = fps;
+}
+
+unsigned int osc_plot_get_max_fps(void)
+{
+	return frame_sched_max_fps;
+}
+
 static void capture_start(OscPlotPrivate *priv)
 {
-	if (priv->redraw_function) {
-		priv->stop_redraw = FALSE;
+	priv->stop_redraw = FALSE;
+	frame_scheduler_add(priv);
+}
+
+static void capture_stop(OscPlotPrivate *priv)
+{
+	/* Let the next frame flush any pending damage and retire the plot */
+	priv->stop_redraw = TRUE;
+	frame_scheduler_request();
+}
+
+static GtkDataboxGraph * transform_graph_new(OscPlotPrivate *priv,
+		Transform *transform, guint len, gfloat *x, gfloat *y)
+{
+	GtkDataboxGraph *graph;
+	gchar *plot_type_str;
+
+	plot_type_str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->plot_type));
+	if (strcmp(plot_type_str, "Lines") &&
+		!is_frequency_transform(priv)) {
+		graph = gtk_databox_points_new(len, x, y,
+				transform->graph_color, 3);
 	} else {
-		priv->stop_redraw = FALSE;
-		priv->redraw_function = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, 50, (GSourceFunc) plot_redraw, priv, NULL);
+		graph = gtk_databox_lines_new(len, x, y,
+				transform->graph_color, priv->line_thickness);
 	}
+	g_free(plot_type_str);
+
+	return graph;
 }
 
 static void plot_setup(OscPlot *plot)
@@ -3226,23 +3810,13 @@ static void plot_setup(OscPlot *plot)
 	markers_init(plot);
 	for (i = 0; i < tr_list->size; i++) {
 		transform = tr_list->transforms[i];
+		transform_pyramid_drop(transform);
 		Transform_setup(transform);
 		transform_x_axis = Transform_get_x_axis_ref(transform);
 		transform_y_axis = Transform_get_y_axis_ref(transform);
 
-		gchar *plot_type_str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->plot_type));
-		if (strcmp(plot_type_str, "Lines") &&
-			!is_frequency_transform(priv)) {
-			graph = gtk_databox_points_new(transform->y_axis_size,
-					transform_x_axis, transform_y_axis,
-					transform->graph_color, 3);
-		} else {
-			graph = gtk_databox_lines_new(transform->y_axis_size,
-					transform_x_axis, transform_y_axis,
-					transform->graph_color, priv->line_thickness);
-		}
-		g_free(plot_type_str);
-
+		graph = transform_graph_new(priv, transform, transform->y_axis_size,
+				transform_x_axis, transform_y_axis);
 		transform->graph = graph;
 
 		if (transform->x_axis_size > max_x_axis)
@@ -3353,7 +3927,7 @@ static void capture_button_clicked_cb(GtkToggleToolButton *btn, gpointer data)
 		priv->frame_counter = 0;
 		capture_start(priv);
 	} else {
-		priv->stop_redraw = TRUE;
+		capture_stop(priv);
 		dispose_parameters_from_plot(plot);
 		deassert_used_channels(plot);
 
@@ -3661,7 +4235,7 @@ static void plot_channels_add_device(OscPlot *plot, const char *dev_name)
 	struct iio_device *iio_dev = NULL;
 
 	if (ctx)
-		iio_dev = iio_context_find_device(ctx, dev_name);
+		iio_dev = iio_utils_find_device(ctx, dev_name);
 
 	gtk_tree_store_append(treestore, &iter, NULL);
 	gtk_tree_store_set(treestore, &iter,
@@ -3672,6 +4246,7 @@ static void plot_channels_add_device(OscPlot *plot, const char *dev_name)
 		SENSITIVE, TRUE,
 		EXPANDED, TRUE,
 		-1);
+	tree_index_add_device(GTK_TREE_MODEL(treestore), dev_name, &iter);
 }
 
 static void plot_channels_add_channel(OscPlot *plot, PlotChn *pchn)
@@ -3702,7 +4277,7 @@ static void plot_channels_add_channel(OscPlot *plot, PlotChn *pchn)
 	struct iio_device *iio_dev = NULL;
 	struct iio_channel *iio_chn = NULL;
 
-	if (ctx && (iio_dev = iio_context_find_device(ctx, pchn->parent_name)))
+	if (ctx && (iio_dev = iio_utils_find_device(ctx, pchn->parent_name)))
 		iio_chn = iio_device_find_channel(iio_dev, pchn->name, false);
 
 	bool sensitive = true;
@@ -3727,6 +4302,8 @@ static void plot_channels_add_channel(OscPlot *plot, PlotChn *pchn)
 			SENSITIVE, sensitive,
 			PLOT_TYPE, TIME_PLOT,
 			-1);
+	tree_index_add_channel(GTK_TREE_MODEL(treestore), pchn->parent_name,
+			pchn->name, &child_iter);
 }
 
 static void plot_channels_remove_channel(OscPlot *plot, GtkTreeIter *iter)
@@ -3890,7 +4467,7 @@ static GSList * iio_chn_basenames_get(OscPlot *plot, const char *dev_name)
 	if (!dev_name)
 		return NULL;
 
-	iio_dev = iio_context_find_device(plot->priv->ctx, dev_name);
+	iio_dev = iio_utils_find_device(plot->priv->ctx, dev_name);
 	if (!iio_dev)
 		return NULL;
 
@@ -4071,12 +4648,218 @@ static void rescale_databox(OscPlotPrivate *priv, GtkDatabox *box, gfloat border
 	}
 }
 
+/*
+ * Min/max pyramids
+ *
+ * Once a deep time-domain capture is frozen, its graphs no longer point to
+ * the full resolution samples. Instead they show only the visible part of
+ * the pyramid level holding about one bucket per pixel, so zooming and
+ * panning cost O(pixels) rather than O(samples).
+ */
+#define PYRAMID_MIN_SAMPLES 65536
+
+static void transform_pyramid_drop(Transform *tr)
+{
+	minmax_pyramid_free(tr->pyramid);
+	tr->pyramid = NULL;
+	g_free(tr->pyramid_x);
+	tr->pyramid_x = NULL;
+}
+
+static void transform_graph_replace(OscPlotPrivate *priv, Transform *tr,
+		guint len, gfloat *x, gfloat *y)
+{
+	GtkDatabox *box = GTK_DATABOX(priv->databox);
+	GtkDataboxGraph *graph;
+	gboolean hidden;
+
+	graph = transform_graph_new(priv, tr, len, x, y);
+	hidden = gtk_databox_graph_get_hide(tr->graph);
+	gtk_databox_graph_remove(box, tr->graph);
+	g_object_unref(tr->graph);
+
+	gtk_databox_graph_set_hide(graph, hidden);
+	gtk_databox_graph_add(box, graph);
+	tr->graph = graph;
+}
+
+static unsigned long transform_frame_seq(Transform *tr)
+{
+	struct iio_device *dev = transform_get_device_parent(tr);
+	struct extra_dev_info *dev_info;
+
+	if (!dev)
+		return 0;
+	dev_info = iio_device_get_data(dev);
+
+	return dev_info ? dev_info->frame_seq : 0;
+}
+
+static void transform_pyramid_view(OscPlotPrivate *priv, Transform *tr,
+		gfloat left, gfloat right, int width)
+{
+	struct minmax_level *lvl;
+	unsigned int level, step, b0, b1, n, j;
+	unsigned int size = tr->y_axis_size;
+	double first, last;
+	gfloat x0, dx;
+
+	if (!tr->pyramid)
+		return;
+
+	/* Another plot refreshed the samples: draw them at full resolution */
+	if (tr->pyramid_frame != transform_frame_seq(tr)) {
+		transform_pyramid_drop(tr);
+		transform_graph_replace(priv, tr, size, tr->x_axis, tr->y_axis);
+		return;
+	}
+
+	x0 = tr->x_axis[0];
+	dx = (tr->x_axis[size - 1] - x0) / (size - 1);
+	if (dx <= 0)
+		return;
+
+	first = (left - x0) / dx;
+	last = (right - x0) / dx;
+	if (first < 0)
+		first = 0;
+	if (last > size - 1)
+		last = size - 1;
+	if (last < first)
+		return;
+
+	level = minmax_pyramid_pick_level(tr->pyramid, (last - first) / width);
+	if (level == 0) {
+		b0 = (unsigned int)first;
+		b1 = (unsigned int)last + 1;
+		if (b0)
+			b0--;
+		if (b1 > size - 1)
+			b1 = size - 1;
+		transform_graph_replace(priv, tr, b1 - b0 + 1,
+				tr->x_axis + b0, tr->y_axis + b0);
+		return;
+	}
+
+	/* Keep one extra bucket on each side so lines run off the view */
+	lvl = &tr->pyramid->levels[level];
+	step = 1u << level;
+	b0 = (unsigned int)first / step;
+	b1 = (unsigned int)last / step + 1;
+	if (b0)
+		b0--;
+	if (b1 > lvl->buckets - 1)
+		b1 = lvl->buckets - 1;
+	n = b1 - b0 + 1;
+
+	tr->pyramid_x = g_renew(gfloat, tr->pyramid_x, 2 * n);
+	for (j = 0; j < n; j++) {
+		gfloat x = x0 + ((double)(b0 + j) * step + step / 2.0) * dx;
+
+		tr->pyramid_x[2 * j] = x;
+		tr->pyramid_x[2 * j + 1] = x;
+	}
+
+	transform_graph_replace(priv, tr, 2 * n, tr->pyramid_x,
+			lvl->minmax + 2 * b0);
+}
+
+static void plot_pyramids_update(OscPlotPrivate *priv)
+{
+	TrList *tr_list = priv->transform_list;
+	GtkAllocation alloc;
+	gfloat left, right, top, bottom;
+	int i;
+
+	if (priv->redraw_function > 0 || !GTK_IS_DATABOX(priv->databox))
+		return;
+
+	gtk_widget_get_allocation(priv->databox, &alloc);
+	if (alloc.width <= 1)
+		return;
+
+	gtk_databox_get_visible_limits(GTK_DATABOX(priv->databox),
+			&left, &right, &top, &bottom);
+	for (i = 0; i < tr_list->size; i++)
+		transform_pyramid_view(priv, tr_list->transforms[i],
+				left, right, alloc.width);
+}
+
+static void plot_pyramids_freeze(OscPlotPrivate *priv)
+{
+	TrList *tr_list = priv->transform_list;
+	Transform *tr;
+	int i;
+
+	if (priv->active_transform_type != TIME_TRANSFORM)
+		return;
+
+	for (i = 0; i < tr_list->size; i++) {
+		tr = tr_list->transforms[i];
+		transform_pyramid_drop(tr);
+		if (tr->y_axis_size < PYRAMID_MIN_SAMPLES ||
+				!tr->x_axis || !tr->y_axis || !tr->graph)
+			continue;
+
+		tr->pyramid = minmax_pyramid_new(tr->y_axis, tr->y_axis_size);
+		tr->pyramid_frame = transform_frame_seq(tr);
+	}
+
+	plot_pyramids_update(priv);
+}
+
+/* Fit the view of a frozen plot without scanning the (partial) graphs */
+static bool plot_pyramids_fit(OscPlotPrivate *priv)
+{
+	TrList *tr_list = priv->transform_list;
+	gfloat min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+	gfloat width, height, tr_min, tr_max;
+	Transform *tr;
+	int i;
+
+	for (i = 0; i < tr_list->size; i++) {
+		tr = tr_list->transforms[i];
+		if (!tr->pyramid)
+			return false;
+
+		/* The whole capture, whether autoscale tracked it or not */
+		minmax_pyramid_get_extrema(tr->pyramid, &tr_min, &tr_max);
+
+		if (i == 0 || tr->x_axis[0] < min_x)
+			min_x = tr->x_axis[0];
+		if (i == 0 || tr->x_axis[tr->y_axis_size - 1] > max_x)
+			max_x = tr->x_axis[tr->y_axis_size - 1];
+		if (i == 0 || tr_min < min_y)
+			min_y = tr_min;
+		if (i == 0 || tr_max > max_y)
+			max_y = tr_max;
+	}
+	if (!tr_list->size)
+		return false;
+
+	width = max_x - min_x;
+	height = max_y - min_y;
+	if (height == 0)
+		height = 1;
+	gtk_databox_set_total_limits(GTK_DATABOX(priv->databox),
+			min_x - 0.05 * width, max_x + 0.05 * width,
+			max_y + 0.05 * height, min_y - 0.05 * height);
+
+	return true;
+}
+
+static void databox_view_changed_cb(GObject *object, OscPlot *plot)
+{
+	plot_pyramids_update(plot->priv);
+}
+
 static void zoom_fit(GtkButton *btn, gpointer data)
 {
 	OscPlot *plot = data;
 	OscPlotPrivate *priv = plot->priv;
 
-	rescale_databox(priv, GTK_DATABOX(priv->databox), 0.05);
+	if (!plot_pyramids_fit(priv))
+		rescale_databox(priv, GTK_DATABOX(priv->databox), 0.05);
 }
 
 static void zoom_in(GtkButton *btn, gpointer data)
@@ -4189,13 +4972,14 @@ static void zoom_out(GtkButton *btn, gpointer data)
 	gtk_databox_set_visible_limits(GTK_DATABOX(priv->databox), left, right, top, bottom);
 }
 
-static void transform_csv_print(OscPlotPrivate *priv, FILE *fp, Transform *tr)
+static void transform_csv_export(struct export_job *job, Transform *tr)
 {
+	struct export_section *section;
 	gfloat *tr_data;
 	gfloat *tr_x_axis;
-	unsigned int i;
 	GSList *node;
 	const char *id1 = NULL, *id2 = NULL;
+	char *header = NULL;
 
 	switch (g_slist_length(tr->plot_channels)) {
 	case 2:
@@ -4211,31 +4995,148 @@ static void transform_csv_print(OscPlotPrivate *priv, FILE *fp, Transform *tr)
 	}
 
 	if (tr->type_id == TIME_TRANSFORM)
-		fprintf(fp, "X Axis(Sample Index)    Y Axis(%s)\n", id1);
+		header = g_strdup_printf("X Axis(Sample Index)    Y Axis(%s)\n", id1);
 	else if (tr->type_id == FFT_TRANSFORM)
-		fprintf(fp, "X Axis(Frequency)    Y Axis(FFT - %s)\n", id1);
+		header = g_strdup_printf("X Axis(Frequency)    Y Axis(FFT - %s)\n", id1);
 	else if (tr->type_id == COMPLEX_FFT_TRANSFORM)
-		fprintf(fp, "X Axis(Frequency)    Y Axis(Complex FFT - %s, %s)\n", id1, id2);
+		header = g_strdup_printf("X Axis(Frequency)    Y Axis(Complex FFT - %s, %s)\n", id1, id2);
 	else if (tr->type_id == CONSTELLATION_TRANSFORM)
-		fprintf(fp, "X Axis(%s)    Y Axis(%s)\n", id2, id1);
+		header = g_strdup_printf("X Axis(%s)    Y Axis(%s)\n", id2, id1);
 
 	tr_x_axis = Transform_get_x_axis_ref(tr);
 	tr_data = Transform_get_y_axis_ref(tr);
 
 	if (tr_x_axis == NULL || tr_data == NULL) {
-		fprintf(fp, "No data\n");
+		section = export_job_add_section(job, header, NULL, NULL, 0);
+		export_section_set_footer(section, "No data\n");
+		g_free(header);
 		return;
 	}
 
-	for (i = 0; i < tr->x_axis_size; i++) {
-		fprintf(fp, "%g, %g,\n", tr_x_axis[i], tr_data[i]);
+	section = export_job_add_section(job, header, ", ", ",", tr->x_axis_size);
+	export_section_add_column(section, NULL, tr_x_axis, 0);
+	export_section_add_column(section, NULL, tr_data, 0);
+	export_section_set_footer(section, "\n");
+	g_free(header);
+}
+
+#define EXPORT_PROGRESS_INTERVAL_MS 100
+
+struct export_progress {
+	struct export_job *job;
+	GtkWidget *dialog;
+	GtkWidget *progress_bar;
+};
+
+static void export_job_report(struct export_job *job)
+{
+	if (job->ret < 0 && job->ret != -ECANCELED)
+		fprintf(stderr, "Failed to save %s: %s\n", job->filename,
+				strerror(-job->ret));
+}
+
+/*
+ * Follow a running export. The progress window only shows up for exports
+ * that take a while, and goes away with the job. The job is still followed
+ * to its end if the window was destroyed before, e.g. with its parent.
+ */
+static gboolean export_progress_update(gpointer data)
+{
+	struct export_progress *progress = data;
+
+	if (!export_job_is_done(progress->job)) {
+		if (progress->dialog) {
+			gtk_progress_bar_set_fraction(
+					GTK_PROGRESS_BAR(progress->progress_bar),
+					export_job_get_progress(progress->job));
+			gtk_widget_show_all(progress->dialog);
+		}
+		return TRUE;
 	}
-	fprintf(fp, "\n");
+
+	export_job_wait(progress->job);
+	export_job_report(progress->job);
+	export_job_free(progress->job);
+	if (progress->dialog)
+		gtk_widget_destroy(progress->dialog);
+	g_free(progress);
+
+	return FALSE;
+}
+
+static void export_progress_response_cb(GtkDialog *dialog, gint response_id,
+		struct export_progress *progress)
+{
+	export_job_cancel(progress->job);
+	gtk_dialog_set_response_sensitive(dialog, GTK_RESPONSE_CANCEL, FALSE);
+}
+
+/* Closing the window cancels the export; the window goes away with the job */
+static gboolean export_progress_delete_cb(GtkWidget *dialog, GdkEvent *event,
+		struct export_progress *progress)
+{
+	export_job_cancel(progress->job);
+	gtk_dialog_set_response_sensitive(GTK_DIALOG(dialog),
+			GTK_RESPONSE_CANCEL, FALSE);
+	return TRUE;
+}
+
+static void export_progress_destroy_cb(GtkWidget *dialog,
+		struct export_progress *progress)
+{
+	progress->dialog = NULL;
+	progress->progress_bar = NULL;
+}
+
+/*
+ * Run an export on its own thread. All the data was copied into the job,
+ * so capturing and drawing go on while the file is written. With @wait,
+ * the export is finished when this returns.
+ */
+static void plot_export_run(OscPlot *plot, struct export_job *job, bool wait)
+{
+	OscPlotPrivate *priv = plot->priv;
+	struct export_progress *progress;
+	GtkWidget *content;
+
+	if (!job)
+		return;
+
+	export_job_start(job);
+
+	if (wait) {
+		export_job_wait(job);
+		export_job_report(job);
+		export_job_free(job);
+		return;
+	}
+
+	progress = g_new0(struct export_progress, 1);
+	progress->job = job;
+	progress->dialog = gtk_dialog_new_with_buttons("Saving",
+			GTK_WINDOW(priv->window), 0,
+			GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL, NULL);
+	progress->progress_bar = gtk_progress_bar_new();
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress->progress_bar),
+			job->filename);
+	content = gtk_dialog_get_content_area(GTK_DIALOG(progress->dialog));
+	gtk_box_pack_start(GTK_BOX(content), progress->progress_bar,
+			FALSE, FALSE, 5);
+	g_signal_connect(progress->dialog, "response",
+			G_CALLBACK(export_progress_response_cb), progress);
+	g_signal_connect(progress->dialog, "delete-event",
+			G_CALLBACK(export_progress_delete_cb), progress);
+	g_signal_connect(progress->dialog, "destroy",
+			G_CALLBACK(export_progress_destroy_cb), progress);
+
+	g_timeout_add(EXPORT_PROGRESS_INTERVAL_MS, export_progress_update,
+			progress);
 }
 
 static void plot_destroyed (GtkWidget *object, OscPlot *plot)
 {
 	osc_plot_draw_stop(plot);
+	frame_scheduler_remove(plot->priv);
 	g_slist_free_full(plot->priv->ch_settings_list, (GDestroyNotify)g_free);
 	g_mutex_trylock(&plot->priv->g_marker_copy_lock);
 	g_mutex_unlock(&plot->priv->g_marker_copy_lock);
@@ -4256,13 +5157,12 @@ static GdkPixbuf * window_get_screenshot_pixbuf(GtkWidget *window)
 			gdk_colormap_get_system(), 0, 0, 0, 0, width, height);
 }
 
-static void screenshot_saveas_png(OscPlot *plot)
+static void screenshot_saveas_png(OscPlot *plot, bool wait)
 {
 	OscPlotPrivate *priv = plot->priv;
+	struct export_job *job;
 	GdkPixbuf *pixbuf;
 	char *filename;
-	GError *err = NULL;
-	gboolean ret = true;
 
 	filename = priv->saveas_filename;
 	if (!filename) {
@@ -4270,22 +5170,19 @@ static void screenshot_saveas_png(OscPlot *plot)
 		return;
 	}
 
+	/* Grab the window now, the encoding is done by the export worker */
 	pixbuf = window_get_screenshot_pixbuf(priv->window);
-	if (pixbuf)
-		ret = gdk_pixbuf_save(pixbuf, filename, "png", &err, NULL);
-	else
+	if (!pixbuf) {
 		fprintf(stderr,
 			"error getting the pixbug of the Capture Plot window\n");
-
-
-	if (!ret) {
-		fprintf(stderr, "error creating %s\n", filename);
-		if (err)
-			fprintf(stderr, "error(%d):%s\n", err->code,
-					err->message);
+		return;
 	}
 
-	return;
+	job = export_job_new(EXPORT_PNG, filename);
+	export_job_set_pixbuf(job, pixbuf);
+	g_object_unref(pixbuf);
+
+	plot_export_run(plot, job, wait);
 }
 
 static void copy_channel_state_to_selection_channel(GtkTreeModel *model,
@@ -4371,6 +5268,20 @@ static int * get_user_saveas_channel_selection(OscPlot *plot, unsigned int nb_ch
 	return mask;
 }
 
+/* Convert the samples to be saved and leave out channels that hold none */
+static void saveas_sync_channels_data(struct iio_device *dev, int *mask,
+		unsigned int nb_channels)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_channels; i++) {
+		if (mask[i] == 1)
+			continue;
+		if (!osc_channel_get_data(iio_device_get_channel(dev, i)))
+			mask[i] = 1;
+	}
+}
+
 #define SAVE_AS_RAW_DATA 1
 
 static void saveas_dialog_show(GtkWidget *w, OscPlot *plot)
@@ -4394,27 +5305,46 @@ static void saveas_dialog_show(GtkWidget *w, OscPlot *plot)
 	gtk_widget_show(priv->saveas_dialog);
 }
 
-static void save_as(OscPlot *plot, const char *filename, int type)
+static void saveas_add_channels_columns(struct export_section *section,
+		struct iio_device *dev, const int *mask, unsigned int nb_channels)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_channels; i++) {
+		struct extra_info *info;
+
+		if (mask[i] == 1)
+			continue;
+		info = iio_channel_get_data(iio_device_get_channel(dev, i));
+		export_section_add_column(section, NULL, info->data_ref, 0);
+	}
+}
+
+/*
+ * Take a snapshot of the data to save and return the job that writes it,
+ * or NULL when there is nothing to write in the background (PNG files are
+ * grabbed later, once the dialog is gone).
+ */
+static struct export_job * save_as(OscPlot *plot, const char *filename, int type)
 {
 	OscPlotPrivate *priv = plot->priv;
 	struct iio_context *ctx = priv->ctx;
-	FILE *fp;
-	mat_t *mat;
-	matvar_t *matvar;
+	struct export_job *job = NULL;
+	struct export_section *section;
 	struct iio_device *dev;
 	struct extra_dev_info *dev_info;
 	char tmp[100];
-	mat_dim dims[2] = {-1, 1};
 	double freq;
-	char *name;
+	char *name, *header;
 	gchar *active_device;
 	int *save_channels_mask;
 	int d;
-	unsigned int nb_channels, i, j;
+	unsigned int nb_channels, i;
 	const char *dev_name;
 	unsigned int dev_sample_count;
+	bool is_int16;
 
-	name = malloc(strlen(filename) + 5);
+	name = malloc(strlen(filename) + 7);
 	switch(type) {
 		case SAVE_VSA:
 			/* Save as Agilent VSA formatted file */
@@ -4422,9 +5352,6 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 					strcpy(name, filename);
 				else
 					sprintf(name, "%s.txt", filename);
-			fp = fopen(name, "w");
-			if (!fp)
-				break;
 
 			active_device = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->device_combobox));
 			d = device_find_by_name(ctx, active_device);
@@ -4437,38 +5364,34 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 			/* Find which channel need to be saved */
 			save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+			saveas_sync_channels_data(dev, save_channels_mask, nb_channels);
 
 			/* Make a VSA file header */
-			fprintf(fp, "InputZoom\tTRUE\n");
-			fprintf(fp, "InputCenter\t0\n");
-			fprintf(fp, "InputRange\t1\n");
-			fprintf(fp, "InputRefImped\t50\n");
-			fprintf(fp, "XStart\t0\n");
 			freq = dev_info->adc_freq * prefix2scale(dev_info->adc_scale);
-			fprintf(fp, "XDelta\t%-.17f\n", 1.0/freq);
-			fprintf(fp, "XDomain\t2\n");
-			fprintf(fp, "XUnit\tSec\n");
-			fprintf(fp, "YUnit\tV\n");
-			fprintf(fp, "FreqValidMax\t%e\n", freq / 2);
-			fprintf(fp, "FreqValidMin\t-%e\n", freq / 2);
-			fprintf(fp, "Y\n");
+			header = g_strdup_printf(
+				"InputZoom\tTRUE\n"
+				"InputCenter\t0\n"
+				"InputRange\t1\n"
+				"InputRefImped\t50\n"
+				"XStart\t0\n"
+				"XDelta\t%-.17f\n"
+				"XDomain\t2\n"
+				"XUnit\tSec\n"
+				"YUnit\tV\n"
+				"FreqValidMax\t%e\n"
+				"FreqValidMin\t-%e\n"
+				"Y\n", 1.0/freq, freq / 2, freq / 2);
 
 			dev_sample_count = dev_info->sample_count;
 			if (dev_info->channel_trigger_enabled)
 				dev_sample_count /= 2;
 
-			/* Start writing the samples */
-			for (i = 0; i < dev_sample_count; i++) {
-				for (j = 0; j < nb_channels; j++) {
-					struct extra_info *info = iio_channel_get_data(iio_device_get_channel(dev, j));
-					if (save_channels_mask[j] == 1)
-						continue;
-					fprintf(fp, "%g\t", info->data_ref[i]);
-				}
-				fprintf(fp, "\n");
-			}
-			fprintf(fp, "\n");
-			fclose(fp);
+			job = export_job_new(EXPORT_TEXT, name);
+			section = export_job_add_section(job, header, "\t", "\t",
+					dev_sample_count);
+			export_section_set_footer(section, "\n");
+			saveas_add_channels_columns(section, dev, save_channels_mask, nb_channels);
+			g_free(header);
 			free(save_channels_mask);
 
 			break;
@@ -4478,9 +5401,6 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 					strcpy(name, filename);
 				else
 					sprintf(name, "%s.csv", filename);
-			fp = fopen(name, "w");
-			if (!fp)
-				break;
 			if (priv->active_saveas_type == SAVE_AS_RAW_DATA) {
 				active_device = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->device_combobox));
 				d = device_find_by_name(ctx, active_device);
@@ -4494,29 +5414,25 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 				/* Find which channel need to be saved */
 				save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+				saveas_sync_channels_data(dev, save_channels_mask, nb_channels);
 
 				dev_sample_count = dev_info->sample_count;
 				if (dev_info->channel_trigger_enabled)
 					dev_sample_count /= 2;
 
-				for (i = 0; i < dev_sample_count; i++) {
-					for (j = 0; j < nb_channels; j++) {
-						struct extra_info *info = iio_channel_get_data(iio_device_get_channel(dev, j));
-						if (save_channels_mask[j] == 1)
-							continue;
-						fprintf(fp, "%g, ", info->data_ref[i]);
-					}
-					fprintf(fp, "\n");
-				}
-				fprintf(fp, "\n");
+				job = export_job_new(EXPORT_TEXT, name);
+				section = export_job_add_section(job, NULL, ", ", ", ",
+						dev_sample_count);
+				export_section_set_footer(section, "\n");
+				saveas_add_channels_columns(section, dev, save_channels_mask, nb_channels);
 				free(save_channels_mask);
 			} else {
+				job = export_job_new(EXPORT_TEXT, name);
 				for (d = 0; d < priv->transform_list->size; d++) {
-						transform_csv_print(priv, fp, priv->transform_list->transforms[d]);
+						transform_csv_export(job, priv->transform_list->transforms[d]);
 				}
 			}
-			fprintf(fp, "\n");
-			fclose(fp);
+			export_job_add_section(job, "\n", NULL, NULL, 0);
 			break;
 
 		case SAVE_PNG:
@@ -4538,12 +5454,6 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 				else
 					sprintf(name, "%s.mat", filename);
 
-			mat = Mat_Create(name, NULL);
-			if (!mat) {
-				fprintf(stderr, "Error creating MAT file %s: %s\n", name, strerror(errno));
-				break;
-			}
-
 			active_device = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->device_combobox));
 			d = device_find_by_name(ctx, active_device);
 			g_free(active_device);
@@ -4558,55 +5468,92 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 			/* Find which channel need to be saved */
 			save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+			saveas_sync_channels_data(dev, save_channels_mask, nb_channels);
 
 			dev_sample_count = dev_info->sample_count;
 			if (dev_info->channel_trigger_enabled)
 				dev_sample_count /= 2;
 
-			dims[0] = dev_sample_count;
+			job = export_job_new(EXPORT_MAT, name);
+			section = export_job_add_section(job, NULL, NULL, NULL,
+					dev_sample_count);
 			for (i = 0; i < nb_channels; i++) {
 				struct iio_channel *chn = iio_device_get_channel(dev, i);
 				const char *ch_name = iio_channel_get_name(chn) ?:
 					iio_channel_get_id(chn);
 				struct extra_info *info = iio_channel_get_data(chn);
+				double scale = 0;
+
 				if (save_channels_mask[i] == 1)
 					continue;
 				sprintf(tmp, "%s_%s", dev_name, ch_name);
 				g_strdelimit(tmp, "-", '_');
-				if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->save_mat_scale))) {
-						matvar = Mat_VarCreate(tmp, MAT_C_SINGLE, MAT_T_SINGLE, 2, dims,
-					info->data_ref, 0);
-				} else {
+				if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->save_mat_scale))) {
 					const struct iio_data_format* format = iio_channel_get_data_format(chn);
-					gdouble *tmp_data;
-					double k;
 
-					tmp_data = g_new(gdouble, dev_sample_count);
 					if (format->is_signed)
-						k = format->bits - 1;
+						scale = pow(2.0, format->bits - 1);
 					else
-						k = format->bits;
-					for (j = 0; j < dev_sample_count; j++) {
-						tmp_data[j] = (gdouble)info->data_ref[j] /
-									(pow(2.0, k));
-					}
-					matvar = Mat_VarCreate(tmp, MAT_C_DOUBLE, MAT_T_DOUBLE,
-							2, dims, tmp_data, 0);
-					g_free(tmp_data);
-				}
-
-				if (!matvar)
-					fprintf(stderr,
-						"error creating matvar on channel %s\n",
-						tmp);
-				else {
-					Mat_VarWrite(mat, matvar, 0);
-					Mat_VarFree(matvar);
+						scale = pow(2.0, format->bits);
 				}
+				export_section_add_column(section, tmp, info->data_ref, scale);
 			}
 			free(save_channels_mask);
+			break;
+
+		case SAVE_SIGMF:
+			/* SigMF recording: raw interleaved I/Q plus a JSON sidecar */
+			if (g_str_has_suffix(filename, ".sigmf-data") ||
+					g_str_has_suffix(filename, ".sigmf-meta"))
+				strcpy(name, filename);
+			else
+				sprintf(name, "%s.sigmf", filename);
+
+			active_device = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->device_combobox));
+			d = device_find_by_name(ctx, active_device);
+			g_free(active_device);
+			if (d < 0)
+				break;
+
+			dev = iio_context_get_device(ctx, d);
+			dev_info = iio_device_get_data(dev);
+			nb_channels = iio_device_get_channels_count(dev);
+			dev_name = iio_device_get_name(dev) ?:
+				iio_device_get_id(dev);
 
-			Mat_Close(mat);
+			save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+			saveas_sync_channels_data(dev, save_channels_mask, nb_channels);
+
+			dev_sample_count = dev_info->sample_count;
+			if (dev_info->channel_trigger_enabled)
+				dev_sample_count /= 2;
+
+			/* Samples that fit in 16 signed bits are written as such */
+			job = export_job_new(EXPORT_SIGMF, name);
+			section = export_job_add_section(job, NULL, NULL, NULL,
+					dev_sample_count);
+			is_int16 = true;
+			for (i = 0; i < nb_channels; i++) {
+				struct iio_channel *chn = iio_device_get_channel(dev, i);
+				const char *ch_name = iio_channel_get_name(chn) ?:
+					iio_channel_get_id(chn);
+				const struct iio_data_format *format =
+					iio_channel_get_data_format(chn);
+				struct extra_info *info = iio_channel_get_data(chn);
+				struct export_column *column;
+
+				if (save_channels_mask[i] == 1)
+					continue;
+				if (!format->is_signed || format->bits > 16)
+					is_int16 = false;
+				column = export_section_add_column(section, ch_name,
+						info->data_ref, 0);
+				column->frequency = info->lo_freq;
+			}
+			export_job_set_sigmf_info(job, dev_name,
+					dev_info->adc_freq * prefix2scale(dev_info->adc_scale),
+					dev_info->frame_time, is_int16);
+			free(save_channels_mask);
 			break;
 
 		default:
@@ -4618,6 +5565,8 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 	priv->saveas_filename = g_strdup(name);
 	free(name);
+
+	return job;
 }
 
 void cb_saveas_response(GtkDialog *dialog, gint response_id, OscPlot *plot)
@@ -4629,7 +5578,7 @@ void cb_saveas_response(GtkDialog *dialog, gint response_id, OscPlot *plot)
 
 	if (response_id == GTK_RESPONSE_ACCEPT) {
 		gint type = gtk_combo_box_get_active(GTK_COMBO_BOX(priv->cmb_saveas_type));
-		save_as(plot, priv->saveas_filename, type);
+		plot_export_run(plot, save_as(plot, priv->saveas_filename, type), false);
 	}
 
 	gtk_widget_hide(priv->saveas_dialog);
@@ -4640,7 +5589,7 @@ void cb_saveas_response(GtkDialog *dialog, gint response_id, OscPlot *plot)
 			i++;
 			gtk_main_iteration();
 		}
-		screenshot_saveas_png(plot);
+		screenshot_saveas_png(plot, false);
 		priv->save_as_png = false;
 	}
 }
@@ -4769,44 +5718,34 @@ static gboolean get_iter_by_name(GtkTreeView *tree, GtkTreeIter *iter,
 		const char *dev_name, const char *ch_name)
 {
 	GtkTreeModel *model;
-	GtkTreeIter dev_iter;
+	struct tree_dev_index *tdi;
 	GtkTreeIter ch_iter;
-	gboolean next_dev_iter;
-	gboolean next_ch_iter;
-	char *device;
 	char *channel;
+	gboolean ret;
+
+	if (dev_name == NULL)
+		return FALSE;
 
 	model = gtk_tree_view_get_model(tree);
-	if (!gtk_tree_model_get_iter_first(model, &dev_iter))
+	tdi = g_hash_table_lookup(tree_index_get(model)->devices, dev_name);
+	if (!tdi)
 		return FALSE;
-	if (dev_name == NULL)
+
+	if (ch_name == NULL)
+		return tree_index_row_iter(model, tdi->row, iter);
+
+	if (!tree_index_row_iter(model, g_hash_table_lookup(tdi->channels,
+					ch_name), &ch_iter))
 		return FALSE;
 
-	next_dev_iter = true;
-	while (next_dev_iter) {
-		gtk_tree_model_iter_children(model, &ch_iter, &dev_iter);
-		gtk_tree_model_get(model, &dev_iter, ELEMENT_NAME, &device, -1);
-		if (!strcmp(dev_name, device)) {
-			g_free(device);
-			if (ch_name == NULL) {
-				*iter = dev_iter;
-				return TRUE;
-			}
-			next_ch_iter = true;
-			while (next_ch_iter) {
-				gtk_tree_model_get(model, &ch_iter, ELEMENT_NAME, &channel, -1);
-				if (!strcmp(ch_name, channel)) {
-					g_free(channel);
-					*iter = ch_iter;
-					return TRUE;
-				}
-				next_ch_iter = gtk_tree_model_iter_next(model, &ch_iter);
-			}
-		}
-		next_dev_iter = gtk_tree_model_iter_next(model, &dev_iter);
-	}
+	/* Math channels can be renamed */
+	gtk_tree_model_get(model, &ch_iter, ELEMENT_NAME, &channel, -1);
+	ret = !strcmp(ch_name, channel);
+	g_free(channel);
+	if (ret)
+		*iter = ch_iter;
 
-	return FALSE;
+	return ret;
 }
 
 static void plot_profile_save(OscPlot *plot, char *filename)
@@ -5046,47 +5985,17 @@ static int comboboxtext_get_active_text_as_int(GtkComboBoxText* combobox)
 
 static int device_find_by_name(struct iio_context *ctx, const char *name)
 {
-	unsigned int num_devices = 0;
-	unsigned int i;
-
-	if (!name)
-		return -1;
-	if (ctx)
-		num_devices = iio_context_get_devices_count(ctx);
-
-	for (i = 0; i < num_devices; i++) {
-		struct iio_device *dev = iio_context_get_device(ctx, i);
-		const char *id = iio_device_get_name(dev) ?:
-			iio_device_get_id(dev);
-		if (!strcmp(id, name))
-			return i;
-	}
-	return -1;
+	return iio_utils_device_position(ctx, name);
 }
 
 static int channel_find_by_name(struct iio_context *ctx, int device_index,
 				const char *name)
 {
-	struct iio_device *dev;
-	unsigned int i, nb_channels = 0;
-
-	if (!ctx)
-		return -1;
-	if (!name)
+	if (!ctx || device_index < 0)
 		return -1;
 
-	dev = iio_context_get_device(ctx, device_index);
-	if (dev)
-		nb_channels = iio_device_get_channels_count(dev);
-
-	for (i = 0; i < nb_channels; i++) {
-		struct iio_channel *chn = iio_device_get_channel(dev, i);
-		const char *id = iio_channel_get_name(chn) ?:
-			iio_channel_get_id(chn);
-		if (!strcmp(id, name))
-			return i;
-	}
-	return -1;
+	return iio_utils_channel_position(
+			iio_context_get_device(ctx, device_index), name);
 }
 
 static int count_char_in_string(char c, const char *s)
@@ -5102,6 +6011,42 @@ static int count_char_in_string(char c, const char *s)
 	return i;
 }
 
+/* The active markers end the current row of the log file */
+static void save_markers(OscPlotPrivate *priv, const char *path)
+{
+	const char *columns[(MAX_MARKERS + 1) * 3], *values[(MAX_MARKERS + 1) * 3];
+	gchar *strings[(MAX_MARKERS + 1) * 3 * 2];
+	unsigned int i, n = 0;
+
+	for (i = 0; i <= MAX_MARKERS; i++) {
+		if (!priv->markers[i].active)
+			continue;
+
+		strings[2 * n] = g_strdup_printf("marker%u.x", i);
+		strings[2 * n + 1] = g_strdup_printf("%f", priv->markers[i].x);
+		n++;
+		strings[2 * n] = g_strdup_printf("marker%u.y", i);
+		strings[2 * n + 1] = g_strdup_printf("%f", priv->markers[i].y);
+		n++;
+		if (!isnan(priv->markers[i].angle)) {
+			strings[2 * n] = g_strdup_printf("marker%u.angle", i);
+			strings[2 * n + 1] = g_strdup_printf("%f",
+					priv->markers[i].angle);
+			n++;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		columns[i] = strings[2 * i];
+		values[i] = strings[2 * i + 1];
+	}
+
+	osc_log_record(path, columns, values, n);
+
+	for (i = 0; i < 2 * n; i++)
+		g_free(strings[i]);
+}
+
 int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 		const char *name, const char *value)
 {
@@ -5121,7 +6066,6 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 	gfloat max_f, min_f;
 	PlotChn *csettings;
 	int ret = 0, i;
-	FILE *fd;
 	struct extra_dev_info *dev_info;
 
 	elem_type = count_char_in_string('.', name);
@@ -5250,26 +6194,14 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 					gtk_main_iteration();
 					i++;
 				}
-				screenshot_saveas_png(plot);
+				screenshot_saveas_png(plot, true);
 				priv->save_as_png = false;
 			} else if (MATCH_NAME("cycle")) {
 				unsigned int msecs;
 				sscanf(value, "%u", &msecs);
 				osc_process_gtk_events(msecs);
 			} else if (MATCH_NAME("save_markers")) {
-				fd = osc_get_log_file(value);
-				if (!fd)
-					return 0;
-
-				for (i = 0; i <= MAX_MARKERS; i++) {
-					if (priv->markers[i].active) {
-						fprintf(fd, ", %f, %f", priv->markers[i].x, priv->markers[i].y);
-						if (!isnan(priv->markers[i].angle))
-							fprintf(fd, ", %f", priv->markers[i].angle);
-					}
-				}
-				fprintf(fd, "\n");
-				fclose(fd);
+				save_markers(priv, value);
 			} else if (MATCH_NAME("fru_connect")) {
 				if (atoi(value) == 1) {
 					i = fru_connect();
@@ -5326,7 +6258,7 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 				dev = device_find_by_name(ctx, dev_name);
 				if (dev == -1)
 					goto unhandled;
-				dev_info = iio_device_get_data(iio_context_find_device(ctx, dev_name));
+				dev_info = iio_device_get_data(iio_utils_find_device(ctx, dev_name));
 			}
 
 			if (MATCH(dev_property, "expanded")) {
@@ -5936,7 +6868,7 @@ static GSList * math_expression_get_iio_channel_list(const char *expression, str
 	struct iio_channel *iio_chn;
 	gboolean invalid_list = false, is_match;
 
-	if (!device || !(iio_dev = iio_context_find_device(ctx, device)))
+	if (!device || !(iio_dev = iio_utils_find_device(ctx, device)))
 		return NULL;
 
 	regex = g_regex_new("voltage[0-9]+", 0, 0, NULL);
@@ -6001,7 +6933,7 @@ static void math_chooser_fullscale_key_pressed_cb(GtkButton *btn, OscPlot *plot)
 	device_name = gtk_combo_box_text_get_active_text(
 			GTK_COMBO_BOX_TEXT(priv->math_device_select));
 	if (device_name) {
-		iio_dev = iio_context_find_device(priv->ctx, device_name);
+		iio_dev = iio_utils_find_device(priv->ctx, device_name);
 		if (iio_dev) {
 			unsigned int i;
 			struct iio_channel *iio_chn;
@@ -6067,7 +6999,7 @@ static void math_device_cmb_changed_cb(GtkComboBoxText *box, OscPlot *plot)
 	if (!device_name)
 		return;
 
-	iio_dev = iio_context_find_device(plot->priv->ctx, device_name);
+	iio_dev = iio_utils_find_device(plot->priv->ctx, device_name);
 	if (!iio_dev)
 		goto end;
 
@@ -6259,6 +7191,8 @@ static void channel_edit_settings_cb(GtkMenuItem *menuitem, OscPlot *plot)
 	math_expression_get_settings(plot, settings);
 	gtk_tree_store_set(GTK_TREE_STORE(model), &iter,
 			ELEMENT_NAME, settings->base.name, -1);
+	tree_index_add_channel(model, settings->base.parent_name,
+			settings->base.name, &iter);
 }
 
 static void plot_channel_remove_cb(GtkMenuItem *menuitem, OscPlot *plot)
@@ -6960,6 +7894,10 @@ static void create_plot(OscPlot *plot)
 		G_CALLBACK(zoom_out), plot);
 	g_builder_connect_signal(builder, "zoom_fit", "clicked",
 		G_CALLBACK(zoom_fit), plot);
+	g_signal_connect(priv->databox, "zoomed",
+		G_CALLBACK(databox_view_changed_cb), plot);
+	g_signal_connect(gtk_databox_get_adjustment_x(GTK_DATABOX(priv->databox)),
+		"value-changed", G_CALLBACK(databox_view_changed_cb), plot);
 	g_signal_connect(priv->show_grid, "toggled",
 		G_CALLBACK(show_grid_toggled), plot);
 
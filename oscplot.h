@@ -76,6 +76,8 @@ void          osc_plot_spect_mode       (OscPlot *plot, bool enable);
 void          osc_plot_spect_set_start_f(OscPlot *plot, double freq_mhz);
 void          osc_plot_spect_set_len    (OscPlot *plot, unsigned fft_count);
 void          osc_plot_spect_set_filter_bw(OscPlot *plot, double bw);
+void          osc_plot_set_max_fps      (unsigned int fps);
+unsigned int  osc_plot_get_max_fps      (void);
 
 G_END_DECLS
 
@@ -0,0 +1,395 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <fcntl.h>
+#include <jansson.h>
+#include <matio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "playback.h"
+
+/* Raw recordings named after their SigMF datatype, GNU Radio style */
+static const struct {
+	const char *ext;
+	const char *datatype;
+} raw_extensions[] = {
+	{ ".ci16", "ci16_le" },
+	{ ".cs16", "ci16_le" },
+	{ ".cf32", "cf32_le" },
+	{ ".fc32", "cf32_le" },
+	{ ".cfile", "cf32_le" },
+	{ ".ri16", "ri16_le" },
+	{ ".rf32", "rf32_le" },
+};
+
+/* Datatype assumed for raw recordings with any other extension */
+#define PLAYBACK_DEFAULT_DATATYPE "ci16_le"
+
+static bool has_suffix(const char *str, const char *suffix)
+{
+	size_t len = strlen(str), suffix_len = strlen(suffix);
+
+	return len >= suffix_len &&
+		!strcasecmp(str + len - suffix_len, suffix);
+}
+
+static int playback_parse_datatype(struct playback *pb, const char *datatype,
+		unsigned int sigmf_channels)
+{
+	unsigned int values;
+
+	if (!strcmp(datatype, "ci16_le") || !strcmp(datatype, "ri16_le"))
+		pb->int16 = true;
+	else if (!strcmp(datatype, "cf32_le") || !strcmp(datatype, "rf32_le"))
+		pb->int16 = false;
+	else {
+		fprintf(stderr, "Unsupported datatype %s in %s\n",
+				datatype, pb->path);
+		return -EINVAL;
+	}
+
+	/* Complex samples take two channels: I then Q */
+	values = datatype[0] == 'c' ? 2 : 1;
+	pb->num_channels = values * (sigmf_channels ?: 1);
+
+	return 0;
+}
+
+static int playback_read_sigmf_meta(struct playback *pb, const char *meta_fn)
+{
+	json_t *root, *global, *captures, *val;
+	json_error_t err;
+	unsigned int sigmf_channels = 1;
+	int ret;
+
+	root = json_load_file(meta_fn, 0, &err);
+	if (!root) {
+		fprintf(stderr, "Failed to parse %s: %s (line %d)\n",
+				meta_fn, err.text, err.line);
+		return -EINVAL;
+	}
+
+	global = json_object_get(root, "global");
+	val = json_object_get(global, "core:datatype");
+	if (!json_is_string(val)) {
+		fprintf(stderr, "No core:datatype in %s\n", meta_fn);
+		json_decref(root);
+		return -EINVAL;
+	}
+
+	if (json_is_integer(json_object_get(global, "core:num_channels")))
+		sigmf_channels = json_integer_value(
+				json_object_get(global, "core:num_channels"));
+
+	ret = playback_parse_datatype(pb, json_string_value(val), sigmf_channels);
+
+	val = json_object_get(global, "core:sample_rate");
+	if (json_is_number(val))
+		pb->sample_rate = json_number_value(val);
+
+	captures = json_object_get(root, "captures");
+	val = json_object_get(json_array_get(captures, 0), "core:frequency");
+	if (json_is_number(val))
+		pb->frequency = json_number_value(val);
+
+	json_decref(root);
+
+	return ret;
+}
+
+static int playback_map(struct playback *pb, const char *data_fn)
+{
+	size_t sample_size = pb->num_channels *
+		(pb->int16 ? sizeof(gint16) : sizeof(gfloat));
+#ifndef _WIN32
+	struct stat st;
+	int fd;
+
+	fd = open(data_fn, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s : %s\n", data_fn, strerror(errno));
+		return -errno;
+	}
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sample_size) {
+		fprintf(stderr, "No samples in %s\n", data_fn);
+		close(fd);
+		return -EINVAL;
+	}
+
+	pb->map_size = st.st_size;
+	pb->map = mmap(NULL, pb->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pb->map == MAP_FAILED) {
+		pb->map = NULL;
+		fprintf(stderr, "Failed to map %s : %s\n", data_fn, strerror(errno));
+		return -ENOMEM;
+	}
+	pb->mapped = true;
+#else
+	gchar *contents;
+	gsize size;
+
+	if (!g_file_get_contents(data_fn, &contents, &size, NULL) ||
+			size < sample_size) {
+		fprintf(stderr, "No samples in %s\n", data_fn);
+		return -EINVAL;
+	}
+	pb->map = contents;
+	pb->map_size = size;
+#endif
+
+	pb->samples = pb->map;
+	pb->length = pb->map_size / sample_size;
+
+	return 0;
+}
+
+static int playback_open_binary(struct playback *pb)
+{
+	const char *datatype = PLAYBACK_DEFAULT_DATATYPE;
+	char *base = NULL, *data_fn;
+	unsigned int i;
+	int ret;
+
+	if (has_suffix(pb->path, ".sigmf-meta") || has_suffix(pb->path, ".sigmf-data"))
+		base = g_strndup(pb->path, strlen(pb->path) - strlen(".sigmf-meta"));
+	else if (has_suffix(pb->path, ".sigmf"))
+		base = g_strndup(pb->path, strlen(pb->path) - strlen(".sigmf"));
+
+	if (base) {
+		char *meta_fn = g_strdup_printf("%s.sigmf-meta", base);
+
+		ret = playback_read_sigmf_meta(pb, meta_fn);
+		data_fn = g_strdup_printf("%s.sigmf-data", base);
+		g_free(meta_fn);
+		g_free(base);
+	} else {
+		for (i = 0; i < G_N_ELEMENTS(raw_extensions); i++) {
+			if (has_suffix(pb->path, raw_extensions[i].ext)) {
+				datatype = raw_extensions[i].datatype;
+				break;
+			}
+		}
+		ret = playback_parse_datatype(pb, datatype, 1);
+		data_fn = g_strdup(pb->path);
+	}
+
+	if (!ret)
+		ret = playback_map(pb, data_fn);
+	g_free(data_fn);
+
+	return ret;
+}
+
+/* Load every real vector of the MAT file as a channel, in file order */
+static int playback_open_mat(struct playback *pb)
+{
+	matvar_t *info, *var;
+	mat_t *mat;
+	size_t i, len;
+
+	mat = Mat_Open(pb->path, MAT_ACC_RDONLY);
+	if (!mat) {
+		fprintf(stderr, "Failed to open %s\n", pb->path);
+		return -EINVAL;
+	}
+
+	while ((info = Mat_VarReadNextInfo(mat))) {
+		gfloat *column;
+
+		if (info->rank != 2 || (info->dims[0] != 1 && info->dims[1] != 1) ||
+				info->isComplex) {
+			Mat_VarFree(info);
+			continue;
+		}
+
+		var = Mat_VarRead(mat, info->name);
+		Mat_VarFree(info);
+		if (!var)
+			continue;
+
+		len = var->dims[0] * var->dims[1];
+		column = g_new(gfloat, len);
+		switch (var->class_type) {
+		case MAT_C_SINGLE:
+			memcpy(column, var->data, len * sizeof(gfloat));
+			break;
+		case MAT_C_DOUBLE:
+			for (i = 0; i < len; i++)
+				column[i] = (gfloat)((const double *)var->data)[i];
+			break;
+		case MAT_C_INT32:
+			for (i = 0; i < len; i++)
+				column[i] = (gfloat)((const gint32 *)var->data)[i];
+			break;
+		case MAT_C_INT16:
+			for (i = 0; i < len; i++)
+				column[i] = (gfloat)((const gint16 *)var->data)[i];
+			break;
+		case MAT_C_INT8:
+			for (i = 0; i < len; i++)
+				column[i] = (gfloat)((const gint8 *)var->data)[i];
+			break;
+		default:
+			g_free(column);
+			column = NULL;
+			break;
+		}
+		Mat_VarFree(var);
+
+		if (!column || !len) {
+			g_free(column);
+			continue;
+		}
+
+		pb->columns = g_renew(gfloat *, pb->columns, pb->num_channels + 1);
+		pb->columns[pb->num_channels++] = column;
+		if (pb->num_channels == 1 || len < pb->length)
+			pb->length = len;
+	}
+
+	Mat_Close(mat);
+
+	if (!pb->num_channels) {
+		fprintf(stderr, "No usable variables in %s\n", pb->path);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+struct playback * playback_open(const char *path)
+{
+	struct playback *pb;
+	int ret;
+
+	if (!path)
+		return NULL;
+
+	pb = g_new0(struct playback, 1);
+	pb->path = g_strdup(path);
+
+	if (has_suffix(path, ".mat"))
+		ret = playback_open_mat(pb);
+	else
+		ret = playback_open_binary(pb);
+
+	if (ret) {
+		playback_close(pb);
+		return NULL;
+	}
+
+	pb->rate = pb->sample_rate;
+
+	return pb;
+}
+
+void playback_close(struct playback *pb)
+{
+	unsigned int i;
+
+	if (!pb)
+		return;
+
+#ifndef _WIN32
+	if (pb->mapped)
+		munmap(pb->map, pb->map_size);
+	else
+#endif
+		g_free(pb->map);
+
+	if (pb->columns) {
+		for (i = 0; i < pb->num_channels; i++)
+			g_free(pb->columns[i]);
+		g_free(pb->columns);
+	}
+
+	g_free(pb->path);
+	g_free(pb);
+}
+
+void playback_set_rate(struct playback *pb, double rate)
+{
+	pb->rate = rate > 0 ? rate : 0;
+	pb->last_time = 0;
+}
+
+/*
+ * Move to the next frame. When played at a given rate, the recording moves
+ * forward with the time elapsed since the previous frame, like a device
+ * would, so frames may overlap or skip samples. Otherwise each frame
+ * follows the previous one. Recordings loop around.
+ */
+void playback_next_frame(struct playback *pb, size_t count)
+{
+	gint64 now = g_get_monotonic_time();
+	size_t advance;
+
+	if (!pb->last_time) {
+		pb->last_time = now;
+		return;
+	}
+
+	if (pb->rate > 0) {
+		advance = (size_t)((now - pb->last_time) * pb->rate / G_USEC_PER_SEC);
+		pb->last_time += (gint64)(advance * G_USEC_PER_SEC / pb->rate);
+	} else {
+		advance = count;
+		pb->last_time = now;
+	}
+
+	pb->position = (pb->position + advance % pb->length) % pb->length;
+}
+
+/* Copy @count samples of @channel from the current frame into @out */
+void playback_read(const struct playback *pb, unsigned int channel,
+		gfloat *out, size_t count)
+{
+	size_t i, n, pos = pb->position;
+	unsigned int stride = pb->num_channels;
+
+	if (channel >= pb->num_channels) {
+		memset(out, 0, count * sizeof(gfloat));
+		return;
+	}
+
+	while (count) {
+		n = MIN(count, pb->length - pos);
+
+		if (pb->columns) {
+			memcpy(out, pb->columns[channel] + pos, n * sizeof(gfloat));
+		} else if (pb->int16) {
+			const gint16 *in = (const gint16 *)pb->samples +
+				pos * stride + channel;
+
+			for (i = 0; i < n; i++)
+				out[i] = (gfloat)GINT16_FROM_LE(in[i * stride]);
+		} else {
+			const guint32 *in = (const guint32 *)pb->samples +
+				pos * stride + channel;
+
+			for (i = 0; i < n; i++) {
+				guint32 v = GUINT32_FROM_LE(in[i * stride]);
+
+				memcpy(&out[i], &v, sizeof(v));
+			}
+		}
+
+		out += n;
+		count -= n;
+		pos = 0;
+	}
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __PLAYBACK_H__
+#define __PLAYBACK_H__
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A recording played back in place of the samples of a capture device.
+ * Binary recordings (SigMF, or raw files named after their SigMF datatype
+ * such as .ci16 or .cf32) are memory-mapped and read in place, MAT files
+ * are loaded once.
+ */
+struct playback {
+	char *path;
+
+	/* Interleaved little endian samples, for binary recordings */
+	const void *samples;
+	void *map;
+	size_t map_size;
+	bool mapped;
+	bool int16;
+
+	/* One array per variable, for MAT recordings */
+	gfloat **columns;
+
+	unsigned int num_channels;
+	size_t length;
+
+	/* Recorded sample rate and center frequency, 0 if unknown */
+	double sample_rate;
+	double frequency;
+
+	/* Samples per second to play back, 0 to play one frame per capture */
+	double rate;
+	size_t position;
+	gint64 last_time;
+};
+
+struct playback * playback_open(const char *path);
+void playback_close(struct playback *pb);
+void playback_set_rate(struct playback *pb, double rate);
+void playback_next_frame(struct playback *pb, size_t count);
+void playback_read(const struct playback *pb, unsigned int channel,
+		gfloat *out, size_t count);
+
+#endif /* __PLAYBACK_H__ */
@@ -31,8 +31,6 @@
 
 static unsigned int buffer_size;
 static uint8_t *soft_buffer_ch0;
-static unsigned int current_sample = 0;
-static gint fill_buffer_function = 0;
 static struct iio_device *dev;
 static bool dev_opened;
 static struct iio_context *ctx, *thread_ctx;
@@ -53,6 +51,15 @@ static GtkWidget *radio_single_val;
 static GtkWidget *radio_waveform;
 static GtkWidget *databox;
 static GtkWidget *preview_graph;
+static GtkWidget *label_pushed;
+
+/* Waveform generator thread, and the block of whole periods it pushes */
+static GThread *gen_thread;
+static gint gen_stop;
+static gint gen_blocks;
+static uint8_t *gen_block;
+static unsigned int gen_block_size;
+static guint gen_status_id;
 
 static GdkColor color_background = {
 	.red = 0,
@@ -80,6 +87,7 @@ static gdouble wave_ampl;
 static gdouble wave_offset;
 
 #define IIO_BUFFER_SIZE 400
+#define PUSHED_UPDATE_INTERVAL_MS 500
 
 static int buffer_open(unsigned int length)
 {
@@ -89,7 +97,7 @@ static int buffer_open(unsigned int length)
 	iio_device_set_trigger(dev, trigger);
 	iio_channel_enable(ch0);
 
-	dac_buff = iio_device_create_buffer(dev, IIO_BUFFER_SIZE, false);
+	dac_buff = iio_device_create_buffer(dev, length, false);
 
 	return (dac_buff) ? 0 : 1;
 }
@@ -201,7 +209,6 @@ static void generateWavePeriod(void)
 		buffer_size = 2;
 	else if (buffer_size > 10000)
 		buffer_size = 10000;
-	current_sample = 0;
 
 	soft_buffer_ch0 = g_renew(uint8_t, soft_buffer_ch0, buffer_size);
 
@@ -235,32 +242,83 @@ static void generateWavePeriod(void)
 	gtk_databox_set_total_limits(GTK_DATABOX(databox), -0.2, (i - 1), 3.5, -0.2);
 }
 
-static gboolean fillBuffer(void)
+/*
+ * The device is fed through a software buffer that doesn't repeat cyclic
+ * data, so the waveform is pushed continuously. Blocks hold whole periods
+ * and are copied in one go.
+ */
+static gpointer fillBuffer(gpointer data)
 {
-	unsigned int i;
-	uint8_t *buf;
-	int ret;
-
-	while (true) {
-		buf = iio_buffer_start(dac_buff);
-		for (i = 0; i < IIO_BUFFER_SIZE; i++) {
-			buf[i] = soft_buffer_ch0[current_sample];
-			current_sample++;
-			if (current_sample >= buffer_size)
-				current_sample = 0;
-		}
+	ssize_t ret;
+
+	while (!g_atomic_int_get(&gen_stop)) {
+		memcpy(iio_buffer_start(dac_buff), gen_block, gen_block_size);
 
 		ret = iio_buffer_push(dac_buff);
-		if (ret < 0)
-			printf("Error occured while writing to buffer: %d\n", ret);
+		if (ret < 0) {
+			if (!g_atomic_int_get(&gen_stop))
+				printf("Error occured while writing to buffer: %zd\n", ret);
+			break;
+		}
+		g_atomic_int_inc(&gen_blocks);
 	}
 
+	return NULL;
+}
+
+static gboolean updatePushedSamples(gpointer data)
+{
+	gchar *text;
+
+	text = g_strdup_printf("Samples pushed: %" G_GUINT64_FORMAT,
+			(guint64)g_atomic_int_get(&gen_blocks) * gen_block_size);
+	gtk_label_set_text(GTK_LABEL(label_pushed), text);
+	g_free(text);
+
 	return TRUE;
 }
 
+static void stopWaveGeneration(void)
+{
+	if (gen_status_id) {
+		g_source_remove(gen_status_id);
+		gen_status_id = 0;
+	}
+
+	if (gen_thread) {
+		g_atomic_int_set(&gen_stop, 1);
+		iio_buffer_cancel(dac_buff);
+		g_thread_join(gen_thread);
+		gen_thread = NULL;
+	}
+
+	if (dev_opened) {
+		buffer_close();
+		dev_opened = false;
+	}
+}
+
 static void startWaveGeneration(void)
 {
-	g_thread_new("fill_buffer_thread", (void *) &fillBuffer, NULL);
+	unsigned int i;
+
+	gen_block_size = buffer_size *
+		((IIO_BUFFER_SIZE + buffer_size - 1) / buffer_size);
+	gen_block = g_renew(uint8_t, gen_block, gen_block_size);
+	for (i = 0; i < gen_block_size; i += buffer_size)
+		memcpy(gen_block + i, soft_buffer_ch0, buffer_size);
+
+	dev_opened = !buffer_open(gen_block_size);
+	if (!dev_opened) {
+		fprintf(stderr, "Unable to create buffer: %s\n", strerror(errno));
+		return;
+	}
+
+	g_atomic_int_set(&gen_stop, 0);
+	g_atomic_int_set(&gen_blocks, 0);
+	gen_thread = g_thread_new("fill_buffer_thread", fillBuffer, NULL);
+	gen_status_id = g_timeout_add(PUSHED_UPDATE_INTERVAL_MS,
+			updatePushedSamples, NULL);
 }
 
 static void tx_update_values(void)
@@ -277,16 +335,21 @@ static void rx_update_values(void)
 
 static void wave_param_changed(GtkRange *range, gpointer user_data)
 {
+	bool running = gen_thread != NULL;
+
+	/* Restart the generator with the new waveform */
+	if (running)
+		stopWaveGeneration();
+
 	generateWavePeriod();
+
+	if (running)
+		startWaveGeneration();
 }
 
 static void save_button_clicked(GtkButton *btn, gpointer data)
 {
-	if (dev_opened) {
-		g_source_remove(fill_buffer_function);
-		buffer_close();
-		dev_opened = false;
-	}
+	stopWaveGeneration();
 
 	if (gtk_toggle_button_get_active((GtkToggleButton *)radio_single_val)){
 		iio_save_widgets(tx_widgets, num_tx);
@@ -295,7 +358,6 @@ static void save_button_clicked(GtkButton *btn, gpointer data)
 			USE_INTERN_SAMPLING_FREQ);
 	} else if (gtk_toggle_button_get_active((GtkToggleButton *)radio_waveform)){
 		generateWavePeriod();
-		dev_opened = !buffer_open(buffer_size);
 		startWaveGeneration();
 	}
 }
@@ -305,7 +367,7 @@ static GtkWidget * AD7303_init(struct osc_plugin *plugin, GtkWidget *notebook, c
 	struct iio_channel *ch0, *ch1;
 	GtkBuilder *builder;
 	GtkWidget *AD7303_panel;
-	GtkWidget *table;
+	GtkWidget *table, *vbox;
 
 	ctx = osc_create_context();
 	if (!ctx)
@@ -368,7 +430,11 @@ static GtkWidget * AD7303_init(struct osc_plugin *plugin, GtkWidget *notebook, c
 	/* Create a GtkDatabox widget */
 	gtk_databox_create_box_with_scrollbars_and_rulers(&databox, &table,
 						TRUE, TRUE, TRUE, TRUE);
-	gtk_container_add(GTK_CONTAINER(preview_graph), table);
+	vbox = gtk_vbox_new(FALSE, 0);
+	label_pushed = gtk_label_new("");
+	gtk_box_pack_start(GTK_BOX(vbox), table, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), label_pushed, FALSE, FALSE, 0);
+	gtk_container_add(GTK_CONTAINER(preview_graph), vbox);
 	gtk_widget_modify_bg(databox, GTK_STATE_NORMAL, &color_background);
 	gtk_widget_set_size_request(table, 450, 300);
 
@@ -382,10 +448,9 @@ static GtkWidget * AD7303_init(struct osc_plugin *plugin, GtkWidget *notebook, c
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	if (dac_buff) {
-		iio_buffer_destroy(dac_buff);
-		dac_buff = NULL;
-	}
+	stopWaveGeneration();
+	g_free(gen_block);
+	gen_block = NULL;
 
 	osc_destroy_context(ctx);
 	osc_destroy_context(thread_ctx);
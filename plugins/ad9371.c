@@ -31,6 +31,7 @@
 #include "../eeprom.h"
 #include "../fru.h"
 #include "../iio_utils.h"
+#include "../poll_scheduler.h"
 #include "block_diagram.h"
 #include "dac_data_manager.h"
 //#include "fir_filter.h"
@@ -81,6 +82,10 @@ static char last_profile[PATH_MAX];
 static struct iio_context *ctx;
 static struct iio_device *dev, *dds, *cap, *udc_rx, *udc_tx, *cap_obs;
 
+static struct poll_set *display_poll;
+/* Set while the display is updated: labels take their values from it */
+static struct poll_set *display_values;
+
 enum {
 	SECTION_GLOBAL,
 	SECTION_TX,
@@ -330,15 +335,39 @@ static void fixup_label(GtkLabel *label, const char *search, const char *replace
 	g_free(line);
 }
 
+static int read_chn_longlong(const char *channel, const char *attribute,
+		bool output, long long *val)
+{
+	struct iio_channel *ch = iio_device_find_channel(dev, channel, output);
+	const char *value;
+	char *end;
+
+	if (!display_values)
+		return iio_channel_attr_read_longlong(ch, attribute, val);
+
+	value = poll_set_get_value(display_values, dev, ch, attribute, NULL);
+	if (!value)
+		return -EIO;
+
+	*val = strtoll(value, &end, 0);
+	return end == value ? -EINVAL : 0;
+}
+
+static void display_update_widget(struct iio_widget *widget)
+{
+	if (display_values)
+		poll_set_update_widget(display_values, widget);
+	else
+		iio_widget_update(widget);
+}
+
 static void update_lable_from(GtkWidget *label, const char *channel,
 			      const char *attribute, bool output, const char *unit, int scale)
 {
 	char buf[80];
 	long long val = 0;
 
-	int ret = iio_channel_attr_read_longlong(
-			iio_device_find_channel(dev, channel, output),
-			attribute, &val);
+	int ret = read_chn_longlong(channel, attribute, output, &val);
 
 	if (scale == 1)
 		snprintf(buf, sizeof(buf), "%lld %s", val, unit);
@@ -362,9 +391,7 @@ static void update_lable_from_prms(GtkWidget *label, const char *channel,
 	char buf[80];
 	long long val = 0;
 
-	int ret = iio_channel_attr_read_longlong(
-		iio_device_find_channel(dev, channel, output),
-						 attribute, &val);
+	int ret = read_chn_longlong(channel, attribute, output, &val);
 
 	snprintf(buf, sizeof(buf), "%.2f %s", (float)val / scale + 21, unit);
 
@@ -380,9 +407,7 @@ static void update_dpd_status_from(GtkWidget *label, const char *channel,
 {
 	long long val = 0;
 
-	int ret = iio_channel_attr_read_longlong(
-		iio_device_find_channel(dev, channel, true),
-						 attribute, &val);
+	int ret = read_chn_longlong(channel, attribute, true, &val);
 
 	if (ret >= 0)
 		gtk_label_set_text(GTK_LABEL(label), dpd_status_strings[val]);
@@ -396,9 +421,7 @@ static void update_vswr_status_from(GtkWidget *label, const char *channel,
 {
 	long long val = 0;
 
-	int ret = iio_channel_attr_read_longlong(
-		iio_device_find_channel(dev, channel, true),
-						 attribute, &val);
+	int ret = read_chn_longlong(channel, attribute, true, &val);
 
 	if (ret >= 0)
 		gtk_label_set_text(GTK_LABEL(label), vswr_status_strings[val]);
@@ -412,9 +435,7 @@ static void update_clgc_status_from(GtkWidget *label, const char *channel,
 {
 	long long val = 0;
 
-	int ret = iio_channel_attr_read_longlong(
-		iio_device_find_channel(dev, channel, true),
-						 attribute, &val);
+	int ret = read_chn_longlong(channel, attribute, true, &val);
 
 	if (ret >= 0)
 		gtk_label_set_text(GTK_LABEL(label), clgc_status_strings[val]);
@@ -455,7 +476,7 @@ static void clgc_update_labels(void)
 {
 
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(tx_widgets[tx1_clgc].widget))) {
-		iio_widget_update(&tx_widgets[tx1_clgc_desired_gain]);
+		display_update_widget(&tx_widgets[tx1_clgc_desired_gain]);
 		update_clgc_status_from(tx1_clgc_status, "voltage0", "clgc_status");
 		update_lable_from(tx1_clgc_track_count, "voltage0", "clgc_track_count", true, "", 1);
 		update_lable_from(tx1_clgc_current_gain, "voltage0", "clgc_current_gain", true, "dB", 100);
@@ -465,7 +486,7 @@ static void clgc_update_labels(void)
 	}
 
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(tx_widgets[tx2_clgc].widget))) {
-		iio_widget_update(&tx_widgets[tx2_clgc_desired_gain]);
+		display_update_widget(&tx_widgets[tx2_clgc_desired_gain]);
 		update_clgc_status_from(tx2_clgc_status, "voltage1", "clgc_status");
 		update_lable_from(tx2_clgc_track_count, "voltage1", "clgc_track_count", true, "", 1);
 		update_lable_from(tx2_clgc_current_gain, "voltage1", "clgc_current_gain", true, "dB", 100);
@@ -685,20 +706,20 @@ static void sample_frequency_changed_cb(void *data)
 
 static void rssi_update_label(GtkWidget *label, const char *chn,  bool is_tx)
 {
+	struct iio_channel *ch = iio_device_find_channel(dev, chn, is_tx);
+	const char *value = NULL;
 	char buf[1024];
-	int ret;
 
 	/* don't update if it is hidden (to quiet down SPI) */
 	if (!gtk_widget_is_drawable(GTK_WIDGET(label)))
 		return;
 
-	ret = iio_channel_attr_read(
-			iio_device_find_channel(dev, chn, is_tx),
-			"rssi", buf, sizeof(buf));
-	if (ret > 0)
-		gtk_label_set_text(GTK_LABEL(label), buf);
-	else
-		gtk_label_set_text(GTK_LABEL(label), "<error>");
+	if (display_values)
+		value = poll_set_get_value(display_values, dev, ch, "rssi", NULL);
+	else if (iio_channel_attr_read(ch, "rssi", buf, sizeof(buf)) > 0)
+		value = buf;
+
+	gtk_label_set_text(GTK_LABEL(label), value ?: "<error>");
 }
 
 static void rssi_update_labels(void)
@@ -712,29 +733,138 @@ static void rssi_update_labels(void)
 	rssi_update_label(obs_rssi, "voltage2", false);
 }
 
-static gboolean update_display(gpointer foo)
+static gboolean display_visible(gpointer foo)
 {
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		const char *gain_mode;
-
-		rssi_update_labels();
-		gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx1));
-		if (gain_mode && strcmp(gain_mode, "manual")) {
-			iio_widget_update(&rx_widgets[rx1_gain]);
-			if (is_2rx_2tx)
-				iio_widget_update(&rx_widgets[rx2_gain]);
-		}
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
 
-		if (has_dpd) {
-			dpd_update_labels();
-			clgc_update_labels();
-			vswr_update_labels();
-		}
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	const char *gain_mode;
 
-		iio_widget_update(&rx_widgets[rx2_gain]);
+	display_values = set;
+
+	rssi_update_labels();
+	gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx1));
+	if (gain_mode && strcmp(gain_mode, "manual")) {
+		display_update_widget(&rx_widgets[rx1_gain]);
+		if (is_2rx_2tx)
+			display_update_widget(&rx_widgets[rx2_gain]);
 	}
 
-	return TRUE;
+	if (has_dpd) {
+		dpd_update_labels();
+		clgc_update_labels();
+		vswr_update_labels();
+	}
+
+	if (is_2rx_2tx)
+		display_update_widget(&rx_widgets[rx2_gain]);
+
+	display_values = NULL;
+}
+
+static const char * const dpd_attrs[] = {
+	"dpd_track_count", "dpd_model_error", "dpd_external_path_delay",
+	"dpd_status",
+};
+
+static const char * const clgc_attrs[] = {
+	"clgc_status", "clgc_track_count", "clgc_current_gain",
+	"clgc_orx_rms", "clgc_tx_gain", "clgc_tx_rms",
+};
+
+static const char * const vswr_attrs[] = {
+	"vswr_status", "vswr_track_count", "vswr_forward_gain",
+	"vswr_forward_gain_imag", "vswr_forward_gain_real", "vswr_forward_orx",
+	"vswr_forward_tx", "vswr_reflected_gain", "vswr_reflected_gain_imag",
+	"vswr_reflected_gain_real", "vswr_reflected_orx", "vswr_reflected_tx",
+};
+
+static void display_poll_add(const char *channel, bool output,
+		const char *attr)
+{
+	struct iio_channel *ch = iio_device_find_channel(dev, channel, output);
+
+	if (ch)
+		poll_set_add_attr(display_poll, dev, ch, attr);
+}
+
+static void display_poll_add_rssi(GtkWidget *label, const char *channel)
+{
+	/* Hidden labels aren't updated (to quiet down SPI) */
+	if (gtk_widget_is_drawable(label))
+		display_poll_add(channel, false, "rssi");
+}
+
+/* Adds the attributes of a tracking group, if its toggle is active */
+static bool display_poll_add_tracking(unsigned int toggle,
+		const char *channel, const char * const *attrs, unsigned int nb)
+{
+	unsigned int i;
+
+	if (!gtk_toggle_button_get_active(
+				GTK_TOGGLE_BUTTON(tx_widgets[toggle].widget)))
+		return false;
+
+	for (i = 0; i < nb; i++)
+		display_poll_add(channel, true, attrs[i]);
+	return true;
+}
+
+/* Polls only what the display shows: the set is built again when a label
+ * is shown or hidden, and when a tracking toggle changes */
+static void display_poll_start(void)
+{
+	poll_set_free(display_poll);
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
+
+	display_poll_add_rssi(rx1_rssi, "voltage0");
+	display_poll_add_rssi(obs_rssi, "voltage2");
+	poll_set_add_widget(display_poll, &rx_widgets[rx1_gain]);
+	if (is_2rx_2tx) {
+		display_poll_add_rssi(rx2_rssi, "voltage1");
+		poll_set_add_widget(display_poll, &rx_widgets[rx2_gain]);
+	}
+
+	if (!has_dpd)
+		return;
+
+	display_poll_add_tracking(tx1_dpd, "voltage0",
+			dpd_attrs, ARRAY_SIZE(dpd_attrs));
+	display_poll_add_tracking(tx2_dpd, "voltage1",
+			dpd_attrs, ARRAY_SIZE(dpd_attrs));
+	if (display_poll_add_tracking(tx1_clgc, "voltage0",
+				clgc_attrs, ARRAY_SIZE(clgc_attrs)))
+		poll_set_add_widget(display_poll,
+				&tx_widgets[tx1_clgc_desired_gain]);
+	if (display_poll_add_tracking(tx2_clgc, "voltage1",
+				clgc_attrs, ARRAY_SIZE(clgc_attrs)))
+		poll_set_add_widget(display_poll,
+				&tx_widgets[tx2_clgc_desired_gain]);
+	display_poll_add_tracking(tx1_vswr, "voltage0",
+			vswr_attrs, ARRAY_SIZE(vswr_attrs));
+	display_poll_add_tracking(tx2_vswr, "voltage1",
+			vswr_attrs, ARRAY_SIZE(vswr_attrs));
+}
+
+static void display_poll_changed_cb(GtkWidget *widget, gpointer data)
+{
+	if (display_poll)
+		display_poll_start();
+}
+
+static void display_poll_connect(GtkWidget *widget, bool toggle)
+{
+	if (toggle) {
+		g_signal_connect_after(widget, "toggled",
+			G_CALLBACK(display_poll_changed_cb), NULL);
+	} else {
+		g_signal_connect_after(widget, "map",
+			G_CALLBACK(display_poll_changed_cb), NULL);
+		g_signal_connect_after(widget, "unmap",
+			G_CALLBACK(display_poll_changed_cb), NULL);
+	}
 }
 
 const double RX_CENTER_FREQ = 340; /* MHz */
@@ -1829,7 +1959,18 @@ static GtkWidget * ad9371_init(struct osc_plugin *plugin, GtkWidget *notebook, c
 	if (!dac_tx_manager)
 		gtk_widget_hide(gtk_widget_get_parent(section_setting[SECTION_FPGA]));
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	display_poll_connect(rx1_rssi, false);
+	display_poll_connect(rx2_rssi, false);
+	display_poll_connect(obs_rssi, false);
+	if (has_dpd) {
+		display_poll_connect(tx_widgets[tx1_dpd].widget, true);
+		display_poll_connect(tx_widgets[tx2_dpd].widget, true);
+		display_poll_connect(tx_widgets[tx1_clgc].widget, true);
+		display_poll_connect(tx_widgets[tx2_clgc].widget, true);
+		display_poll_connect(tx_widgets[tx1_vswr].widget, true);
+		display_poll_connect(tx_widgets[tx2_vswr].widget, true);
+	}
+	display_poll_start();
 	can_update_widgets = true;
 
 	return ad9371_panel;
@@ -1895,7 +2036,8 @@ static void save_profile(const struct osc_plugin *plugin, const char *ini_fn)
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 
 	if (ini_fn)
 		save_profile(NULL, ini_fn);
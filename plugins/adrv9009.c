@@ -33,6 +33,7 @@
 //#include "block_diagram.h"
 #include "dac_data_manager.h"
 #include "../iio_utils.h"
+#include "../poll_scheduler.h"
 
 #define HANNING_ENBW 1.50
 
@@ -144,6 +145,8 @@ static GtkNotebook *nbook;
 static GtkWidget *adrv9009_panel;
 static gboolean plugin_detached;
 
+static struct poll_set *display_poll;
+
 static const char *adrv9009_sr_attribs[] = {
 	".calibrate_fhm_en",
 	".calibrate_rx_phase_correction_en",
@@ -599,25 +602,57 @@ static void rssi_update_labels(void)
 	}
 }
 
-static gboolean update_display(gpointer foo)
+static void rssi_poll_label(struct poll_set *set, GtkWidget *label,
+		struct iio_device *dev, struct iio_channel *ch)
 {
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		const char *gain_mode;
-		guint i = 0;
+	const char *value;
 
-		rssi_update_labels();
-		
-		for (; i < phy_devs_count; i++) {
-			gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(subcomponents[i].rx_gain_control_modes_rx1));
+	if (!gtk_widget_is_drawable(GTK_WIDGET(label)))
+		return;
 
-			if (gain_mode && strcmp(gain_mode, "manual")) {
-				iio_widget_update(&subcomponents[i].rx_widgets[subcomponents[i].rx1_gain]);
-				iio_widget_update(&subcomponents[i].rx_widgets[subcomponents[i].rx2_gain]);
-			}
+	value = poll_set_get_value(set, dev, ch, "rssi", NULL);
+	gtk_label_set_text(GTK_LABEL(label), value ?: "<error>");
+}
+
+static gboolean display_visible(gpointer foo)
+{
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
+
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	const char *gain_mode;
+	guint i = 0;
+
+	for (; i < phy_devs_count; i++) {
+		rssi_poll_label(set, subcomponents[i].rx1_rssi,
+				subcomponents[i].iio_dev, subcomponents[i].ch0);
+		rssi_poll_label(set, subcomponents[i].rx2_rssi,
+				subcomponents[i].iio_dev, subcomponents[i].ch1);
+
+		gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(subcomponents[i].rx_gain_control_modes_rx1));
+
+		if (gain_mode && strcmp(gain_mode, "manual")) {
+			poll_set_update_widget(set, &subcomponents[i].rx_widgets[subcomponents[i].rx1_gain]);
+			poll_set_update_widget(set, &subcomponents[i].rx_widgets[subcomponents[i].rx2_gain]);
 		}
 	}
+}
 
-	return TRUE;
+static void display_poll_start(void)
+{
+	guint i = 0;
+
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
+
+	for (; i < phy_devs_count; i++) {
+		poll_set_add_attr(display_poll, subcomponents[i].iio_dev,
+				subcomponents[i].ch0, "rssi");
+		poll_set_add_attr(display_poll, subcomponents[i].iio_dev,
+				subcomponents[i].ch1, "rssi");
+		poll_set_add_widget(display_poll, &subcomponents[i].rx_widgets[subcomponents[i].rx1_gain]);
+		poll_set_add_widget(display_poll, &subcomponents[i].rx_widgets[subcomponents[i].rx2_gain]);
+	}
 }
 
 static void rx_phase_rotation_update()
@@ -1663,7 +1698,7 @@ static GtkWidget *adrv9009_init(struct osc_plugin *plugin, GtkWidget *notebook,
 	if (plugin_single_device_mode)
 		gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(builder, "mcs_sync")));
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	display_poll_start();
 	can_update_widgets = true;
 
 	multichip_sync();
@@ -1748,7 +1783,8 @@ static void save_profile(const struct osc_plugin *plugin, const char *ini_fn)
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 
 	if (ini_fn)
 		save_profile(NULL, ini_fn);
@@ -27,6 +27,7 @@
 #include "../osc.h"
 #include "../iio_widget.h"
 #include "../osc_plugin.h"
+#include "../poll_scheduler.h"
 #include "../config.h"
 
 #define THIS_DRIVER "CN0357"
@@ -57,6 +58,7 @@ static int num_adc_iio_widgets;
 static struct iio_context *ctx;
 static struct iio_device *adc, *dpot;
 static struct iio_channel *adc_ch, *pwr_ch;
+static struct poll_set *display_poll;
 
 static GtkWidget *update_rates;
 static GtkWidget *feedback_type;
@@ -100,24 +102,37 @@ static double ad7790_voltage_conversion(long long raw, double vref, double gain)
 	return (((raw / pow(2, N_BITS - 1)) - 1) * vref / gain);
 }
 
-static int get_adc_voltage(double *out_data)
+static int poll_read_raw(struct poll_set *set, struct iio_channel *ch,
+		long long *raw)
+{
+	const char *value = poll_set_get_value(set, adc, ch, "raw", NULL);
+	char *end;
+
+	if (!value)
+		return -EIO;
+
+	*raw = strtoll(value, &end, 0);
+	return end == value ? -EINVAL : 0;
+}
+
+static int get_adc_voltage(struct poll_set *set, double *out_data)
 {
 	long long raw;
 	int ret;
 
-	ret = iio_channel_attr_read_longlong(adc_ch, "raw", &raw);
+	ret = poll_read_raw(set, adc_ch, &raw);
 	if (!ret)
 		*out_data = V_TO_MV(ad7790_voltage_conversion(raw, V_REF_ADC, GAIN_ADC));
 
 	return ret;
 }
 
-static int get_adc_power_supply(double *out_data)
+static int get_adc_power_supply(struct poll_set *set, double *out_data)
 {
 	long long raw;
 	int ret;
 
-	ret = iio_channel_attr_read_longlong(pwr_ch, "raw", &raw);
+	ret = poll_read_raw(set, pwr_ch, &raw);
 	if (!ret)
 		*out_data = ad7790_voltage_conversion(raw, V_REF_PWR, GAIN_PWR);
 
@@ -134,14 +149,14 @@ static void entry_set_double(GtkWidget *entry, double value, int digits)
 	g_free(s);
 }
 
-static int cn0357_get_data(struct _cn0357_data *data)
+static int cn0357_get_data(struct poll_set *set, struct _cn0357_data *data)
 {
 	int ret;
 
-	ret = get_adc_voltage(&data->adc_conversion);
+	ret = get_adc_voltage(set, &data->adc_conversion);
 	if (ret)
 		return ret;
-	ret = get_adc_power_supply(&data->adc_supply);
+	ret = get_adc_power_supply(set, &data->adc_supply);
 	if (ret)
 		return ret;
 	data->rdac_resistance = feedback_resistance;
@@ -233,14 +248,15 @@ static void program_rdac_clicked_cb(GtkButton *btn, gpointer data)
 	iio_channel_attr_write(rdac_ch, "raw", gtk_entry_get_text(GTK_ENTRY(rdac_val)));
 }
 
-static gboolean update_display(gpointer foo)
+static gboolean display_visible(gpointer foo)
 {
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		cn0357_read_status = cn0357_get_data(&cn0357_data);
-		cn0357_update_widgets(&cn0357_data);
-	}
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
 
-	return TRUE;
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	cn0357_read_status = cn0357_get_data(set, &cn0357_data);
+	cn0357_update_widgets(&cn0357_data);
 }
 
 static void save_widget_value(GtkWidget *widget, struct iio_widget *iio_w)
@@ -335,7 +351,9 @@ static GtkWidget* cn0357_init(struct osc_plugin *plugin, GtkWidget *notebook, co
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(sensor), 65);
 	program_rdac_clicked_cb(GTK_BUTTON(program_rdac), NULL);
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
+	poll_set_add_attr(display_poll, adc, adc_ch, "raw");
+	poll_set_add_attr(display_poll, adc, pwr_ch, "raw");
 
 	return cn0357_panel;
 }
@@ -356,7 +374,8 @@ static void cn0357_get_preferred_size(const struct osc_plugin *plugin, int *widt
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 	osc_destroy_context(ctx);
 }
 
@@ -24,6 +24,7 @@
 #include "../iio_widget.h"
 #include "../osc_plugin.h"
 #include "../config.h"
+#include "../poll_scheduler.h"
 
 #define THIS_DRIVER "CN0508"
 
@@ -57,6 +58,7 @@ static struct iio_channel *u2_temp_ch, *u3_temp_ch, *out_current_ch;
 static struct iio_channel *in_v_attenuator_ch, *out_v_attenuator_ch,
 	       *current_pot_pos_ch, *voltage_pot_pos_ch;
 static struct iio_channel *dac_ch;
+static struct poll_set *display_poll;
 
 static struct iio_widget iio_widgets[25];
 static unsigned int num_widgets;
@@ -89,16 +91,22 @@ static double ad7124_voltage_conversion(long long raw, double vref, double gain)
 	return ((raw / pow(2, N_BITS)) * vref / gain);
 }
 
-static int get_adc_voltage(struct iio_channel *adc_ch, double *out_data)
+static int get_adc_voltage(struct poll_set *set, struct iio_channel *adc_ch,
+		double *out_data)
 {
+	const char *value = poll_set_get_value(set, adc, adc_ch, "raw", NULL);
 	long long raw;
-	int ret;
+	char *end;
 
-	ret = iio_channel_attr_read_longlong(adc_ch, "raw", &raw);
-	if (!ret)
-		*out_data = ad7124_voltage_conversion(raw, V_REF_ADC, GAIN_ADC);
+	if (!value)
+		return -EIO;
 
-	return ret;
+	raw = strtoll(value, &end, 0);
+	if (end == value)
+		return -EINVAL;
+
+	*out_data = ad7124_voltage_conversion(raw, V_REF_ADC, GAIN_ADC);
+	return 0;
 }
 
 static void cn0508_update_widgets(struct _cn0508_data *data)
@@ -124,41 +132,41 @@ static void cn0508_update_widgets(struct _cn0508_data *data)
 	gtk_progress_bar_set_text ((GtkProgressBar *)pot_current, text);
 }
 
-static int cn0508_get_data(struct _cn0508_data *data)
+static int cn0508_get_data(struct poll_set *set, struct _cn0508_data *data)
 {
 	int ret;
 
-	ret = get_adc_voltage(u2_temp_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, u2_temp_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->u2_temp = data->adc_conversion * 1000; /* 1mV/ºC */
 
-	ret = get_adc_voltage(u3_temp_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, u3_temp_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->u3_temp = data->adc_conversion * 1000; /* 1mV/ºC */
 
-	ret = get_adc_voltage(out_current_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, out_current_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->output_current = data->adc_conversion / 0.2; /* 200mV/A */
 
-	ret = get_adc_voltage(voltage_pot_pos_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, voltage_pot_pos_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->pot_voltage = data->adc_conversion / V_REF_ADC; /* 0% = 0V, 100% = 2.5V */
 
-	ret = get_adc_voltage(current_pot_pos_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, current_pot_pos_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->pot_current = data->adc_conversion / V_REF_ADC; /* 0% = 0V, 100% = 2.5V */
 
-	ret = get_adc_voltage(out_v_attenuator_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, out_v_attenuator_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->output_voltage = data->adc_conversion * 10.52;
 
-	ret = get_adc_voltage(in_v_attenuator_ch, &data->adc_conversion);
+	ret = get_adc_voltage(set, in_v_attenuator_ch, &data->adc_conversion);
 	if (ret)
 		return ret;
 	data->input_voltage = data->adc_conversion * 14.33;
@@ -176,18 +184,15 @@ static void save_widget_value(GtkWidget *widget, struct iio_widget *iio_w)
 	iio_w->save(iio_w);
 }
 
-static gboolean update_display(gpointer foo)
+static gboolean display_visible(gpointer foo)
 {
-	int ret = FALSE;
-
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		ret = cn0508_get_data(&cn0508_data);
-		cn0508_update_widgets(&cn0508_data);
-	}
-	if (ret)
-		return ret;
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
 
-	return TRUE;
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	cn0508_get_data(set, &cn0508_data);
+	cn0508_update_widgets(&cn0508_data);
 }
 
 static void make_widget_update_signal_based(struct iio_widget *widgets,
@@ -270,7 +275,14 @@ static GtkWidget* cn0508_init(struct osc_plugin *plugin, GtkWidget *notebook,
 	make_widget_update_signal_based(iio_widgets, num_widgets);
 	update_values();
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
+	poll_set_add_attr(display_poll, adc, u2_temp_ch, "raw");
+	poll_set_add_attr(display_poll, adc, u3_temp_ch, "raw");
+	poll_set_add_attr(display_poll, adc, out_current_ch, "raw");
+	poll_set_add_attr(display_poll, adc, in_v_attenuator_ch, "raw");
+	poll_set_add_attr(display_poll, adc, out_v_attenuator_ch, "raw");
+	poll_set_add_attr(display_poll, adc, current_pot_pos_ch, "raw");
+	poll_set_add_attr(display_poll, adc, voltage_pot_pos_ch, "raw");
 
 	return cn0508_panel;
 }
@@ -293,7 +305,8 @@ static void cn0508_get_preferred_size(const struct osc_plugin *plugin,
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 	osc_destroy_context(ctx);
 }
 
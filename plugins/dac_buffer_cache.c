@@ -0,0 +1,231 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "dac_buffer_cache.h"
+
+/* Bumped whenever the conversion of waveforms changes the packed output */
+#define DAC_BUFFER_CACHE_MAGIC "OSCDACB2"
+
+/* Least recently used entries are removed past this size */
+#define DAC_BUFFER_CACHE_MAX_SIZE (512ULL * 1024 * 1024)
+
+struct cache_entry {
+	char *path;
+	time_t mtime;
+	guint64 size;
+};
+
+static char * cache_dir(void)
+{
+	return g_build_filename(g_get_user_cache_dir(), "osc", "dac_buffers", NULL);
+}
+
+static char * cache_path(const char *key)
+{
+	char *dir, *hash, *name, *path;
+
+	dir = cache_dir();
+	hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	name = g_strdup_printf("%s.bin", hash);
+	path = g_build_filename(dir, name, NULL);
+
+	g_free(name);
+	g_free(hash);
+	g_free(dir);
+
+	return path;
+}
+
+char * dac_buffer_cache_key(const char *file_name, double full_scale,
+		unsigned int buffer_channels, unsigned int alignment, double offset)
+{
+	struct stat st;
+
+	if (stat(file_name, &st) < 0)
+		return NULL;
+
+	return g_strdup_printf("%s\n%lld\n%lld\n%.17g\n%u\n%u\n%.17g",
+			file_name, (long long)st.st_mtime, (long long)st.st_size,
+			full_scale, buffer_channels, alignment, offset);
+}
+
+/*
+ * Look up the buffer converted with @key. On a hit, the returned file is
+ * positioned at the start of the @size bytes of the buffer.
+ */
+FILE * dac_buffer_cache_open(const char *key, size_t *size)
+{
+	char magic[sizeof(DAC_BUFFER_CACHE_MAGIC) - 1], *path, *stored;
+	guint32 key_len;
+	guint64 data_size;
+	struct stat st;
+	bool valid;
+	FILE *f;
+
+	if (!key)
+		return NULL;
+
+	path = cache_path(key);
+	f = fopen(path, "rb");
+	if (!f) {
+		g_free(path);
+		return NULL;
+	}
+
+	valid = fread(magic, sizeof(magic), 1, f) == 1 &&
+		!memcmp(magic, DAC_BUFFER_CACHE_MAGIC, sizeof(magic)) &&
+		fread(&key_len, sizeof(key_len), 1, f) == 1 &&
+		key_len == strlen(key);
+
+	if (valid) {
+		stored = g_malloc(key_len);
+		valid = fread(stored, 1, key_len, f) == key_len &&
+			!memcmp(stored, key, key_len);
+		g_free(stored);
+	}
+
+	/* Truncated entries are misses, not read errors later on */
+	valid = valid && fread(&data_size, sizeof(data_size), 1, f) == 1 &&
+		!fstat(fileno(f), &st) &&
+		(guint64)st.st_size == (guint64)ftell(f) + data_size;
+
+	if (!valid) {
+		fclose(f);
+		g_free(path);
+		return NULL;
+	}
+
+	/* Mark the entry as recently used */
+	utime(path, NULL);
+	g_free(path);
+
+	*size = (size_t)data_size;
+	return f;
+}
+
+int dac_buffer_cache_read(FILE *f, void *dst, size_t size)
+{
+	size_t ret = fread(dst, 1, size, f);
+
+	fclose(f);
+
+	return ret == size ? 0 : -EIO;
+}
+
+static gint cache_entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct cache_entry *ea = a, *eb = b;
+
+	return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime;
+}
+
+static void dac_buffer_cache_prune(const char *dir)
+{
+	GArray *entries;
+	const char *name;
+	guint64 total = 0;
+	struct stat st;
+	unsigned int i;
+	GDir *d;
+
+	d = g_dir_open(dir, 0, NULL);
+	if (!d)
+		return;
+
+	entries = g_array_new(FALSE, FALSE, sizeof(struct cache_entry));
+	while ((name = g_dir_read_name(d))) {
+		struct cache_entry entry;
+
+		if (!g_str_has_suffix(name, ".bin"))
+			continue;
+
+		entry.path = g_build_filename(dir, name, NULL);
+		if (stat(entry.path, &st) < 0) {
+			g_free(entry.path);
+			continue;
+		}
+		entry.mtime = st.st_mtime;
+		entry.size = st.st_size;
+		total += entry.size;
+		g_array_append_val(entries, entry);
+	}
+	g_dir_close(d);
+
+	g_array_sort(entries, cache_entry_cmp);
+
+	for (i = 0; i < entries->len; i++) {
+		struct cache_entry *entry = &g_array_index(entries,
+				struct cache_entry, i);
+
+		if (total > DAC_BUFFER_CACHE_MAX_SIZE && !g_unlink(entry->path))
+			total -= entry->size;
+		g_free(entry->path);
+	}
+	g_array_free(entries, TRUE);
+}
+
+void dac_buffer_cache_store(const char *key, const void *buf, size_t size)
+{
+	char *dir, *path, *tmp;
+	guint32 key_len;
+	guint64 data_size = size;
+	bool ok;
+	FILE *f;
+
+	if (!key || size > DAC_BUFFER_CACHE_MAX_SIZE)
+		return;
+
+	dir = cache_dir();
+	if (g_mkdir_with_parents(dir, 0755) < 0) {
+		fprintf(stderr, "Unable to create %s: %s\n", dir, strerror(errno));
+		g_free(dir);
+		return;
+	}
+
+	path = cache_path(key);
+	tmp = g_strdup_printf("%s.%d.tmp", path, (int)getpid());
+
+	f = fopen(tmp, "wb");
+	if (!f) {
+		fprintf(stderr, "Unable to create %s: %s\n", tmp, strerror(errno));
+		goto out;
+	}
+
+	key_len = strlen(key);
+	ok = fwrite(DAC_BUFFER_CACHE_MAGIC, sizeof(DAC_BUFFER_CACHE_MAGIC) - 1, 1, f) == 1 &&
+		fwrite(&key_len, sizeof(key_len), 1, f) == 1 &&
+		fwrite(key, 1, key_len, f) == key_len &&
+		fwrite(&data_size, sizeof(data_size), 1, f) == 1 &&
+		fwrite(buf, 1, size, f) == size;
+	ok = !fclose(f) && ok;
+
+	/* Readers never see a partially written entry */
+#ifdef _WIN32
+	if (ok)
+		g_unlink(path);
+#endif
+	if (!ok || g_rename(tmp, path) < 0) {
+		fprintf(stderr, "Unable to write %s\n", path);
+		g_unlink(tmp);
+		goto out;
+	}
+
+	dac_buffer_cache_prune(dir);
+out:
+	g_free(tmp);
+	g_free(path);
+	g_free(dir);
+}
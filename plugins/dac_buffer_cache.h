@@ -0,0 +1,25 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DAC_BUFFER_CACHE_H__
+#define __DAC_BUFFER_CACHE_H__
+
+#include <glib.h>
+#include <stdio.h>
+
+/*
+ * On-disk cache of waveforms already converted to DAC buffers. Entries are
+ * keyed by everything the conversion depends on: the path, modification
+ * time and size of the waveform file, the full-scale setting, the number
+ * of buffer channels, the buffer alignment and the DAC offset.
+ */
+char * dac_buffer_cache_key(const char *file_name, double full_scale,
+		unsigned int buffer_channels, unsigned int alignment, double offset);
+FILE * dac_buffer_cache_open(const char *key, size_t *size);
+int dac_buffer_cache_read(FILE *f, void *dst, size_t size);
+void dac_buffer_cache_store(const char *key, const void *buf, size_t size);
+
+#endif /* __DAC_BUFFER_CACHE_H__ */
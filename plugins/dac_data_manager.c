@@ -8,10 +8,14 @@
 #ifdef __linux__
 #include <sys/utsname.h>
 #endif
-#include <matio.h>
 #include <unistd.h>
 
 #include "dac_data_manager.h"
+#include "wavefile_loader.h"
+#include "dac_buffer_cache.h"
+#include "dac_stream.h"
+#include "dac_pack.h"
+#include "dac_synth.h"
 #include "../iio_widget.h"
 #include "../osc.h"
 
@@ -39,8 +43,14 @@
 #define TX_CHANNEL_ACTIVE 1
 #define TX_CHANNEL_REF_INDEX 2
 
-#define WAVEFORM_TXT_INVALID_FORMAT 1
-#define WAVEFORM_MAT_INVALID_FORMAT 2
+/* Size in bytes of the blocks pushed to the DAC when streaming */
+#define DAC_STREAM_BLOCK_SIZE (1024 * 1024)
+#define DAC_STREAM_STATUS_INTERVAL_MS 500
+
+/* Longest waveform period generated, in samples */
+#define DAC_SYNTH_MAX_LENGTH 65536
+/* Generated buffers repeat the period up to at least this many samples */
+#define DAC_SYNTH_MIN_LENGTH 1024
 
 extern bool dma_valid_selection(const char *device, unsigned mask, unsigned channel_count);
 
@@ -114,6 +124,9 @@ struct dac_buffer {
 	GtkWidget *buffer_fchooser_btn;
 	GtkWidget *tx_channels_view;
 	GtkWidget *scale;
+	GtkWidget *stream_btn;
+	GtkWidget *synth_type;
+	GtkWidget *synth_params;
 	GtkTextBuffer *load_status_buf;
 };
 
@@ -133,6 +146,8 @@ struct dac_data_manager {
 	bool dds_activated;
 	bool dds_disabled;
 	struct iio_buffer *dds_buffer;
+	struct dac_stream *dac_stream;
+	guint stream_status_id;
 	bool is_local;
 
 	GtkWidget *container;
@@ -140,6 +155,19 @@ struct dac_data_manager {
 
 static bool tx_channels_check_valid_setup(struct dac_buffer *dbuf);
 
+/* Waveforms of the generator, in the order of enum dac_synth_type */
+static const struct {
+	const char *name;
+	const char *params;
+	const char *help;
+} synth_waveforms[] = {
+	{ "Multi-tone", "1, -2.5", "Tone frequencies in MHz" },
+	{ "Chirp", "-10, 10", "Start and stop frequencies in MHz" },
+	{ "Multi-tone noise", "20", "Bandwidth in MHz" },
+	{ "AWGN", "", "No parameters" },
+	{ "PRBS QPSK", "4, 9", "Samples per symbol and PRBS order (7, 9, 11 or 15, with at most 2 samples per symbol for 15)" },
+};
+
 static const gdouble abs_mhz_scale = -1000000.0;
 static const gdouble khz_scale = 1000.0;
 
@@ -170,16 +198,6 @@ static double db_full_scale_convert(double value, bool inverse)
 	}
 }
 
-/* add backwards compat for <matio-1.5.0 */
-#if MATIO_MAJOR_VERSION == 1 && MATIO_MINOR_VERSION < 5
-typedef struct ComplexSplit mat_complex_split_t;
-#endif
-
-struct _complex_ref {
-	double *re;
-	double *im;
-};
-
 static double dac_offset_get_value(struct iio_device *dac)
 {
 	double offset;
@@ -196,377 +214,6 @@ static double dac_offset_get_value(struct iio_device *dac)
 	return offset;
 }
 
-/*
- * Fill empty channels with copies of other channels
- * E.g. (data, NULL, NULL, NULL) becomes (data, data, data, data)
- * E.g. (data1, data2, NULL, NULL) becomes (data1, data2, data1, data2)
- * ...
- */
-static void replicate_tx_data_channels(struct _complex_ref *data, int count)
-{
-	if (!data)
-		return;
-
-	if (count > 2)
-		replicate_tx_data_channels(data, count / 2);
-
-	int i, half = count / 2;
-
-	/* Check if the second half of the array needs to be filled */
-	if (data[half].re == NULL || data[half].im == NULL) {
-		for (i = 0; i < half; i++) {
-				data[half + i].re = data[i].re;
-				data[half + i].im = data[i].im;
-		}
-	}
-}
-
-static unsigned short convert(double scale, float val, double offset)
-{
-	return (short) (val * scale + offset);
-}
-
-static int parse_wavefile_line(const char *line, double *vals,
-	unsigned int max_num_vals)
-{
-	unsigned int n = 0;
-	gchar *endptr;
-
-	while (n < max_num_vals) {
-		/* Skip white space */
-		while (*line == ' ' || *line == '\t' || *line == ',')
-			line++;
-
-		if (*line == '\n' || *line == '\r' || *line == '\0')
-			break;
-
-		vals[n++] = g_ascii_strtod(line, &endptr);
-
-		/*
-		 * If endptr did not advance this means the value is not a
-		 * number. In that case abort and return an error.
-		 */
-		if (errno || line == (const char *)endptr)
-			return -1;
-		line = (const char *)endptr;
-	}
-
-	return n;
-}
-
-static int analyse_wavefile(struct dac_data_manager *manager,
-		const char *file_name, char **buf, int *count, int tx_channels, double full_scale)
-{
-	int ret, rep;
-	unsigned int size, j, i = 0;
-	double max = 0.0, val[8], scale = 0.0;
-	double offset;
-	char line[80];
-	mat_t *matfp;
-	matvar_t **matvars;
-
-
-	FILE *infile = fopen(file_name, "r");
-
-	*buf = NULL;
-
-	if (infile == NULL)
-		return -errno;
-
-	offset = dac_offset_get_value(manager->dac1.iio_dac);
-
-	if (fgets(line, 80, infile) != NULL) {
-		if (strncmp(line, "TEXT", 4) == 0) {
-			/* Unscaled samples need to be in the range +- 2047 */
-			if (strncmp(line, "TEXTU", 5) == 0)
-				scale = 16.0;	/* scale up to 16-bit */
-			ret = sscanf(line, "TEXT%*c REPEAT %d", &rep);
-			if (ret != 1) {
-				rep = 1;
-			}
-			size = 0;
-			while (fgets(line, 80, infile)) {
-				ret = parse_wavefile_line(line, val, 8);
-				if (ret == 0)
-					continue;
-				if (!(ret == 4 || ret == 2 || ret == 8)) {
-					fclose(infile);
-					fprintf(stderr, "ERROR: No 2, 4 or 8 columns of data inside the text file\n");
-					return WAVEFORM_TXT_INVALID_FORMAT;
-				}
-
-				for (i = 0; i < (unsigned int) ret; i++)
-					if (fabs(val[i]) > max)
-						max = fabs(val[i]);
-
-				size += tx_channels * 2;
-			}
-
-			size *= rep;
-			if (scale == 0.0)
-				scale = 32767.0 * full_scale / max;
-
-			while ((size % manager->alignment) != 0)
-				size *= 2;
-
-			*buf = malloc(size);
-			if (*buf == NULL)
-				return -errno;
-
-			unsigned long long *sample = *((unsigned long long **) buf);
-			unsigned int *sample_32 = *((unsigned int **) buf);
-			unsigned short *sample_16 = *((unsigned short **) buf);
-
-			rewind(infile);
-
-			if (fgets(line, 80, infile) != NULL) {
-				if (strncmp(line, "TEXT", 4) == 0) {
-					size = 0;
-					i = 0;
-					while (fgets(line, 80, infile)) {
-						ret = parse_wavefile_line(line, val, 8);
-						if (ret == 0)
-							continue;
-
-						for (j = 0; j < (unsigned int) rep; j++) {
-							if (ret == 8 && tx_channels == 8) {
-								sample[i++] = ((unsigned long long) convert(scale, val[3], offset) << 48) |
-								((unsigned long long) convert(scale, val[2], offset) << 32) |
-								((unsigned long long) convert(scale, val[1], offset) << 16) |
-								((unsigned long long) convert(scale, val[0], offset) << 0);
-
-								sample[i++] = ((unsigned long long) convert(scale, val[7], offset) << 48) |
-								((unsigned long long) convert(scale, val[6], offset) << 32) |
-								((unsigned long long) convert(scale, val[5], offset) << 16) |
-								((unsigned long long) convert(scale, val[4], offset) << 0);
-
-							} else if (ret == 4 && tx_channels >= 4) {
-								sample[i++] = ((unsigned long long) convert(scale, val[3], offset) << 48) |
-								    ((unsigned long long) convert(scale, val[2], offset) << 32) |
-								    ((unsigned long long) convert(scale, val[1], offset) << 16) |
-								    ((unsigned long long) convert(scale, val[0], offset) << 0);
-
-								if (tx_channels == 8)
-									sample[i++] = ((unsigned long long) convert(scale, val[3], offset) << 48) |
-									((unsigned long long) convert(scale, val[2], offset) << 32) |
-									((unsigned long long) convert(scale, val[1], offset) << 16) |
-									((unsigned long long) convert(scale, val[0], offset) << 0);
-
-							} else if (ret == 2 && tx_channels >= 4) {
-								sample[i++] = ((unsigned long long) convert(scale, val[1], offset) << 48) |
-								    ((unsigned long long) convert(scale, val[0], offset) << 32) |
-								    ((unsigned long long) convert(scale, val[1], offset) << 16) |
-								    ((unsigned long long) convert(scale, val[0], offset) << 0);
-
-								if (tx_channels == 8)
-									sample[i++] = ((unsigned long long) convert(scale, val[1], offset) << 48) |
-									((unsigned long long) convert(scale, val[0], offset) << 32) |
-									((unsigned long long) convert(scale, val[1], offset) << 16) |
-									((unsigned long long) convert(scale, val[0], offset) << 0);
-
-							} else if (ret > 1 && tx_channels == 2) {
-								sample_32[i++] = ((unsigned int) convert(scale, val[1], offset) << 16) |
-										((unsigned int) convert(scale, val[0], offset) << 0);
-							} else if (ret > 1 && tx_channels == 1) {
-								sample_16[i++] = convert(scale, val[0], offset);
-							}
-
-							size += tx_channels * 2;
-						}
-					}
-				}
-			}
-
-			/* When we are in 1 TX mode it is possible that the number of bytes
-			 * is not a multiple of 8, but only a multiple of 4. In this case
-			 * we'll send the same buffer twice to make sure that it becomes a
-			 * multiple of 8. (default manager->alignment)
-			 */
-
-			while ((size % manager->alignment) != 0) {
-				memcpy(*buf + size, *buf, size);
-				size += size;
-			}
-
-			fclose(infile);
-			*count = size;
-
-		} else {
-			fclose(infile);
-			ret = 0;
-			/* Is it a MATLAB file?
-			 * http://na-wiki.csc.kth.se/mediawiki/index.php/MatIO
-			 */
-			matfp = Mat_Open(file_name, MAT_ACC_RDONLY);
-			if (matfp == NULL) {
-				fprintf(stderr, "ERROR: Could not open %s as a matlab file\n", file_name);
-				return WAVEFORM_MAT_INVALID_FORMAT;
-			}
-
-			bool complex_format = false;
-			bool real_format = false;
-
-			rep = 0;
-			matvars = malloc(sizeof(matvar_t *) * tx_channels);
-
-			while (rep < tx_channels && (matvars[rep] = Mat_VarReadNextInfo(matfp)) != NULL) {
-				/* must be a vector */
-				if (matvars[rep]->rank !=2 || (matvars[rep]->dims[0] > 1 && matvars[rep]->dims[1] > 1)) {
-					fprintf(stderr, "ERROR: Data inside the matlab file must be a vector\n");
-					free(matvars);
-					return WAVEFORM_MAT_INVALID_FORMAT;
-				}
-				/* should be a double */
-				if (matvars[rep]->class_type != MAT_C_DOUBLE) {
-					fprintf(stderr, "ERROR: Data inside the matlab file must be of type double\n");
-					free(matvars);
-					return WAVEFORM_MAT_INVALID_FORMAT;
-				}
-/*
-	printf("%s : %s\n", __func__, matvars[rep]->name);
-	printf("  rank %d\n", matvars[rep]->rank);
-	printf("  dims %d x %d\n", matvars[rep]->dims[0], matvars[rep]->dims[1]);
-	printf("  data %d\n", matvars[rep]->data_type);
-	printf("  class %d\n", matvars[rep]->class_type);
-*/
-				Mat_VarReadDataAll(matfp, matvars[rep]);
-
-				if (matvars[rep]->isComplex) {
-					mat_complex_split_t *complex_data = matvars[rep]->data;
-					double *re, *im;
-					re = complex_data->Re;
-					im = complex_data->Im;
-
-					for (j = 0; j < (unsigned int) matvars[rep]->dims[0] ; j++) {
-						 if (fabs(re[j]) > max)
-							 max = fabs(re[j]);
-						 if (fabs(im[j]) > max)
-							 max = fabs(im[j]);
-					}
-					complex_format = true;
-				} else {
-					double re;
-
-					for (j = 0; j < (unsigned int) matvars[rep]->dims[0] ; j++) {
-						re = ((double *)matvars[rep]->data)[j];
-						if (fabs(re) > max)
-							max = fabs(re);
-					}
-					real_format = true;
-				}
-				rep++;
-			}
-			rep--;
-
-//	printf("read %i vars, length %i, max value %f\n", rep, matvars[rep]->dims[0], max);
-
-			if (rep < 0) {
-				fprintf(stderr, "ERROR: Could not find any valid data in %s\n", file_name);
-				free(matvars);
-				return WAVEFORM_MAT_INVALID_FORMAT;
-			}
-
-			if (max <= 1.0)
-				max = 1.0;
-
-			scale = 32767.0 * full_scale / max;
-
-			size = matvars[0]->dims[0];
-
-			for (i = 0; i <= (unsigned int) rep; i++) {
-				if (size != (unsigned int) matvars[i]->dims[0]) {
-					fprintf(stderr, "ERROR: Vector dimensions in the matlab file don't match\n");
-					free(matvars);
-					return WAVEFORM_MAT_INVALID_FORMAT;
-				}
-			}
-
-			if (complex_format && real_format) {
-				fprintf(stderr, "ERROR: Both complex and real data formats in the same matlab file are not supported\n");
-				free(matvars);
-				return WAVEFORM_MAT_INVALID_FORMAT;
-			}
-
-			*buf = malloc((size + 1) * tx_channels * 2);
-
-			if (*buf == NULL) {
-				free(matvars);
-				return -errno;
-			}
-
-			*count = size * tx_channels * 2;
-
-			unsigned long long *sample = *((unsigned long long **) buf);
-			unsigned int *sample_32 = *((unsigned int **) buf);
-			unsigned short *sample_16 = *((unsigned short **) buf);
-
-			struct _complex_ref tx_data[4] = {{NULL, NULL}, {NULL, NULL}, {NULL, NULL}, {NULL, NULL}};
-			mat_complex_split_t *complex_data[4];
-
-			if (complex_format) {
-				for (i = 0; i <= (unsigned int) rep; i++) {
-					complex_data[i] = matvars[i]->data;
-					tx_data[i].re = complex_data[i]->Re;
-					tx_data[i].im = complex_data[i]->Im;
-				}
-			} else if (real_format) {
-				for (i = 0; i <= (unsigned int) rep; i++) {
-					if (i % 2)
-						tx_data[i / 2].im = matvars[i]->data;
-					else
-						tx_data[i / 2].re = matvars[i]->data;
-				}
-			}
-			replicate_tx_data_channels(tx_data, tx_channels);
-
-			switch (tx_channels) {
-			case 1:
-				for (i = 0 ; i < size; i++) {
-					sample_16[i] = convert(scale, tx_data[0].re[i], offset);
-				}
-				break;
-			case 2:
-				for (i = 0 ; i < size; i++) {
-					sample_32[i] = ((unsigned int) convert(scale, tx_data[0].im[i], offset) << 16) |
-						       ((unsigned int) convert(scale, tx_data[0].re[i], offset) << 0);
-				}
-				break;
-			case 4:
-				for (i = 0 ; i < size; i++) {
-					sample[i] = ((unsigned long long) convert(scale, tx_data[1].im[i], offset) << 48) |
-						    ((unsigned long long) convert(scale, tx_data[1].re[i], offset) << 32) |
-							((unsigned long long) convert(scale, tx_data[0].im[i], offset) << 16) |
-							((unsigned long long) convert(scale, tx_data[0].re[i], offset) << 0);
-				 }
-				break;
-			case 8:
-				for (i = 0, j = 0; i < size; i++) {
-					sample[j++] = ((unsigned long long) convert(scale, tx_data[3].im[i], offset) << 48) |
-						    ((unsigned long long) convert(scale, tx_data[3].re[i], offset) << 32) |
-							((unsigned long long) convert(scale, tx_data[2].im[i], offset) << 16) |
-							((unsigned long long) convert(scale, tx_data[2].re[i], offset) << 0);
-					sample[j++] = ((unsigned long long) convert(scale, tx_data[1].im[i], offset) << 48) |
-						    ((unsigned long long) convert(scale, tx_data[1].re[i], offset) << 32) |
-							((unsigned long long) convert(scale, tx_data[0].im[i], offset) << 16) |
-							((unsigned long long) convert(scale, tx_data[0].re[i], offset) << 0);
-				}
-				break;
-			}
-
-			for (j = 0; j <= (unsigned int) rep; j++) {
-				Mat_VarFree(matvars[j]);
-			}
-			free(matvars);
-			Mat_Close(matfp);
-			return ret;
-		}
-	} else {
-		fclose(infile);
-		return -EINVAL;
-	}
-	return 0;
-}
-
 static gboolean scale_spin_button_output_cb(GtkSpinButton *spin, gpointer data)
 {
 	GtkAdjustment *adj;
@@ -639,6 +286,47 @@ static void enable_dds_channels(struct dac_buffer *db)
 	}
 }
 
+static void dac_buffer_stop(struct dac_data_manager *manager)
+{
+	if (manager->stream_status_id) {
+		g_source_remove(manager->stream_status_id);
+		manager->stream_status_id = 0;
+	}
+
+	if (manager->dac_stream) {
+		dac_stream_free(manager->dac_stream);
+		manager->dac_stream = NULL;
+	}
+
+	if (manager->dds_buffer) {
+		iio_buffer_destroy(manager->dds_buffer);
+		manager->dds_buffer = NULL;
+	}
+}
+
+static gboolean dac_stream_status_update(struct dac_data_manager *manager)
+{
+	struct dac_stream *stream = manager->dac_stream;
+	int ret = dac_stream_get_error(stream);
+	gchar *msg;
+
+	if (ret < 0)
+		msg = g_strdup_printf("Streaming stopped: %s.", strerror(-ret));
+	else
+		msg = g_strdup_printf("Streaming: %" G_GUINT64_FORMAT " samples pushed, %u underflows.",
+				dac_stream_get_pushed(stream),
+				dac_stream_get_underflows(stream));
+	gtk_text_buffer_set_text(manager->dac_buffer_module.load_status_buf, msg, -1);
+	g_free(msg);
+
+	if (ret < 0) {
+		manager->stream_status_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static void enable_dds(struct dac_data_manager *manager, bool on_off)
 {
 	struct iio_device *dac1 = NULL;
@@ -649,10 +337,7 @@ static void enable_dds(struct dac_data_manager *manager, bool on_off)
 		return;
 	manager->dds_activated = on_off;
 
-	if (manager->dds_buffer) {
-		iio_buffer_destroy(manager->dds_buffer);
-		manager->dds_buffer = NULL;
-	}
+	dac_buffer_stop(manager);
 
 	dac1 = manager->dac1.iio_dac;
 	if (manager->dacs_count == 2)
@@ -675,20 +360,22 @@ static void enable_dds(struct dac_data_manager *manager, bool on_off)
 static int process_dac_buffer_file (struct dac_data_manager *manager, const char *file_name, char **stat_msg)
 {
 	int ret, size = 0, s_size;
-	double scale;
 	/*
 	struct stat st;
 	*/
 	char *buf = NULL, *tmp;
+	char *cache_key = NULL;
+	/* When set, the waveform is read from this file rather than buf */
+	FILE *data_file = NULL;
+	size_t data_size = 0, block_samples;
 	/*
 	FILE *infile;
 	*/
 	unsigned int buffer_channels = 0;
+	bool streaming = gtk_toggle_button_get_active(
+			GTK_TOGGLE_BUTTON(manager->dac_buffer_module.stream_btn));
 
-	if (manager->dds_buffer) {
-		iio_buffer_destroy(manager->dds_buffer);
-		manager->dds_buffer = NULL;
-	}
+	dac_buffer_stop(manager);
 
 	if (manager->is_local) {
 #ifdef __linux__
@@ -713,36 +400,52 @@ static int process_dac_buffer_file (struct dac_data_manager *manager, const char
 	}
 
 
-	if (g_str_has_suffix(file_name, ".bin")) {
-		FILE *infile;
+	if (g_str_has_suffix(file_name, ".bin") && streaming) {
 		struct stat st;
 
-		/* Assume Binary format */
-		stat(file_name, &st);
-		buf = malloc(st.st_size);
-		if (buf == NULL) {
+		/* Binary files are streamed as they are, without loading them */
+		data_file = fopen(file_name, "rb");
+		if (!data_file || fstat(fileno(data_file), &st) < 0) {
+			ret = -errno;
 			if (stat_msg)
-				*stat_msg = g_strdup_printf("Internal memory allocation failed.");
-			return -errno;
+				*stat_msg = g_strdup_printf("Error while opening file: %s.", strerror(-ret));
+			if (data_file)
+				fclose(data_file);
+			return ret;
 		}
-		infile = fopen(file_name, "r");
-		size = fread(buf, 1, st.st_size, infile);
-		fclose(infile);
+		data_size = st.st_size;
 	} else {
-
-		scale = db_full_scale_convert(gtk_spin_button_get_value(GTK_SPIN_BUTTON(manager->dac_buffer_module.scale)), false);
-		ret = analyse_wavefile(manager, file_name, &buf, &size, buffer_channels, scale);
-		if (ret < 0) {
-			if (stat_msg)
-				*stat_msg = g_strdup_printf("Error while parsing file: %s.", strerror(-ret));
-			free(buf);
-			return ret;
-		} else if (ret > 0) {
-			if (stat_msg)
-				*stat_msg = g_strdup_printf("Invalid data format");
-			free(buf);
-			return -EINVAL;
+		struct wavefile_params params;
+
+		params.tx_channels = buffer_channels;
+		params.full_scale = db_full_scale_convert(gtk_spin_button_get_value(GTK_SPIN_BUTTON(manager->dac_buffer_module.scale)), false);
+		params.offset = dac_offset_get_value(manager->dac1.iio_dac);
+		params.alignment = manager->alignment;
+
+		/* Binary files are used as they are, others are converted once */
+		if (!g_str_has_suffix(file_name, ".bin"))
+			cache_key = dac_buffer_cache_key(file_name, params.full_scale,
+					buffer_channels, params.alignment, params.offset);
+
+		/* On a hit the buffer is read straight into the iio buffer */
+		data_file = dac_buffer_cache_open(cache_key, &data_size);
+		if (!data_file) {
+			ret = wavefile_load(file_name, &params, &buf, &data_size);
+			if (ret == -EBADMSG) {
+				if (stat_msg)
+					*stat_msg = g_strdup_printf("Invalid data format");
+				g_free(cache_key);
+				return -EINVAL;
+			} else if (ret < 0) {
+				if (stat_msg)
+					*stat_msg = g_strdup_printf("Error while parsing file: %s.", strerror(-ret));
+				g_free(cache_key);
+				return ret;
+			}
+			dac_buffer_cache_store(cache_key, buf, data_size);
 		}
+		size = data_size;
+		g_free(cache_key);
 	}
 
 	usleep(1000); /* FIXME: Temp Workaround needs some investigation */
@@ -758,14 +461,53 @@ static int process_dac_buffer_file (struct dac_data_manager *manager, const char
 		if (stat_msg)
 			*stat_msg = g_strdup_printf("Unable to create buffer due to sample size");
 		free(buf);
+		if (data_file)
+			fclose(data_file);
 		return -EINVAL;
 	}
 
+	if (streaming) {
+		if (data_size % s_size != 0) {
+			fprintf(stderr, "Unable to stream due to sample size and number of samples");
+			if (stat_msg)
+				*stat_msg = g_strdup_printf("Unable to stream due to sample size and number of samples");
+			free(buf);
+			if (data_file)
+				fclose(data_file);
+			return -EINVAL;
+		}
+
+		/* Blocks must keep the buffer alignment */
+		block_samples = DAC_STREAM_BLOCK_SIZE / s_size;
+		while ((block_samples * s_size) % manager->alignment != 0)
+			block_samples--;
+
+		if (data_file)
+			manager->dac_stream = dac_stream_new_from_file(dac, data_file, data_size);
+		else
+			manager->dac_stream = dac_stream_new_from_buffer(dac, buf, data_size);
+
+		ret = dac_stream_start(manager->dac_stream, block_samples);
+		if (ret < 0) {
+			if (stat_msg)
+				*stat_msg = g_strdup_printf("Unable to start streaming: %s", strerror(-ret));
+			dac_stream_free(manager->dac_stream);
+			manager->dac_stream = NULL;
+			return ret;
+		}
+
+		manager->stream_status_id = g_timeout_add(DAC_STREAM_STATUS_INTERVAL_MS,
+				(GSourceFunc) dac_stream_status_update, manager);
+		goto out;
+	}
+
 	if (size % manager->alignment != 0 || size % s_size != 0) {
 		fprintf(stderr, "Unable to create buffer due to sample size and number of samples");
 		if (stat_msg)
 			*stat_msg = g_strdup_printf("Unable to create buffer due to sample size and number of samples");
 		free(buf);
+		if (data_file)
+			fclose(data_file);
 		return -EINVAL;
 	}
 
@@ -775,15 +517,31 @@ static int process_dac_buffer_file (struct dac_data_manager *manager, const char
 		if (stat_msg)
 			*stat_msg = g_strdup_printf("Unable to create iio buffer: %s", strerror(errno));
 		free(buf);
+		if (data_file)
+			fclose(data_file);
 		return -errno;
 	}
 
-	memcpy(iio_buffer_start(manager->dds_buffer), buf,
-			iio_buffer_end(manager->dds_buffer) - iio_buffer_start(manager->dds_buffer));
+	if (data_file) {
+		ret = dac_buffer_cache_read(data_file, iio_buffer_start(manager->dds_buffer),
+				iio_buffer_end(manager->dds_buffer) - iio_buffer_start(manager->dds_buffer));
+		if (ret < 0) {
+			fprintf(stderr, "Unable to read cached waveform: %s\n", strerror(-ret));
+			if (stat_msg)
+				*stat_msg = g_strdup_printf("Error while reading cached waveform: %s.", strerror(-ret));
+			iio_buffer_destroy(manager->dds_buffer);
+			manager->dds_buffer = NULL;
+			return ret;
+		}
+	} else {
+		memcpy(iio_buffer_start(manager->dds_buffer), buf,
+				iio_buffer_end(manager->dds_buffer) - iio_buffer_start(manager->dds_buffer));
+	}
 
 	iio_buffer_push(manager->dds_buffer);
 	free(buf);
 
+out:
 	tmp = strdup(file_name);
 
 	if (manager->dac_buffer_module.dac_buf_filename)
@@ -797,6 +555,151 @@ static int process_dac_buffer_file (struct dac_data_manager *manager, const char
 	return 0;
 }
 
+/*
+ * Generate a waveform and pack it straight into a cyclic DAC buffer. The
+ * period returned by the generator is repeated to fill the buffer, which
+ * keeps the buffer alignment.
+ */
+static int process_dac_buffer_synth(struct dac_data_manager *manager, char **stat_msg)
+{
+	struct dac_buffer *dbuf = &manager->dac_buffer_module;
+	struct iio_device *dac = dbuf->dac_with_scanelems;
+	struct dac_synth synth;
+	const gfloat **in;
+	gfloat *i_data, *q_data;
+	double vals[DAC_SYNTH_MAX_TONES], sample_rate, scale, max = 0.0;
+	size_t period, length, n;
+	unsigned int k, nb_vals = 0, channels;
+	GString *desc;
+	gchar **params, *end;
+	int ret, s_size;
+
+	memset(&synth, 0, sizeof(synth));
+	synth.type = gtk_combo_box_get_active(GTK_COMBO_BOX(dbuf->synth_type));
+
+	params = g_strsplit_set(gtk_entry_get_text(GTK_ENTRY(dbuf->synth_params)), ", ", -1);
+	for (k = 0; params[k]; k++) {
+		if (!*params[k])
+			continue;
+		if (nb_vals == G_N_ELEMENTS(vals)) {
+			*stat_msg = g_strdup_printf("Too many parameters.");
+			g_strfreev(params);
+			return -EINVAL;
+		}
+		vals[nb_vals++] = g_ascii_strtod(params[k], &end);
+		if (*end) {
+			*stat_msg = g_strdup_printf("Invalid parameter: %s.", params[k]);
+			g_strfreev(params);
+			return -EINVAL;
+		}
+	}
+	g_strfreev(params);
+
+	/* The output keeps running until the waveform is ready */
+	enable_dds_channels(dbuf);
+
+	s_size = iio_device_get_sample_size(dac);
+	if (s_size <= 0) {
+		*stat_msg = g_strdup_printf("Unable to create buffer due to sample size");
+		return -EINVAL;
+	}
+	channels = s_size / 2;
+
+	switch (synth.type) {
+	case DAC_SYNTH_TONES:
+	case DAC_SYNTH_CHIRP:
+	case DAC_SYNTH_MULTITONE_NOISE:
+		sample_rate = dac_device_sample_rate(dac);
+		if (sample_rate <= 0) {
+			*stat_msg = g_strdup_printf("Unable to read the DAC sample rate.");
+			return -EINVAL;
+		}
+		synth.nb_tones = nb_vals;
+		for (k = 0; k < nb_vals; k++)
+			synth.freqs[k] = vals[k] * 1e6 / sample_rate;
+		break;
+	case DAC_SYNTH_QPSK:
+		synth.samples_per_symbol = nb_vals > 0 ? (unsigned int) vals[0] : 4;
+		synth.prbs_order = nb_vals > 1 ? (unsigned int) vals[1] : 9;
+		/* fall-through */
+	default:
+		sample_rate = 0.0;
+		break;
+	}
+
+	synth.max_length = DAC_SYNTH_MAX_LENGTH;
+	synth.align = manager->alignment / dac_pack_gcd(manager->alignment, s_size);
+	synth.seed = g_random_int();
+
+	ret = dac_synth_generate(&synth, &i_data, &q_data, &period);
+	if (ret == -E2BIG) {
+		*stat_msg = g_strdup_printf("The waveform needs more than %u samples.",
+				DAC_SYNTH_MAX_LENGTH);
+		return ret;
+	} else if (ret) {
+		*stat_msg = g_strdup_printf("Unable to generate the waveform: %s.", strerror(-ret));
+		return ret;
+	}
+
+	length = period;
+	while (length % synth.align || length < DAC_SYNTH_MIN_LENGTH)
+		length += period;
+
+	for (n = 0; n < period; n++) {
+		max = MAX(max, fabs(i_data[n]));
+		max = MAX(max, fabs(q_data[n]));
+	}
+	scale = db_full_scale_convert(gtk_spin_button_get_value(GTK_SPIN_BUTTON(dbuf->scale)), false);
+	scale = max > 0.0 ? 32767.0 * scale / max : 0.0;
+
+	dac_buffer_stop(manager);
+	enable_dds(manager, false);
+
+	manager->dds_buffer = iio_device_create_buffer(dac, length, true);
+	if (!manager->dds_buffer) {
+		ret = -errno;
+		fprintf(stderr, "Unable to create buffer: %s\n", strerror(errno));
+		*stat_msg = g_strdup_printf("Unable to create iio buffer: %s", strerror(-ret));
+		g_free(i_data);
+		g_free(q_data);
+		return ret;
+	}
+
+	/* Each pair of channels plays the I/Q waveform */
+	in = g_new(const gfloat *, channels);
+	for (k = 0; k < channels; k++)
+		in[k] = (k % 2) ? q_data : i_data;
+
+	dac_pack_float(iio_buffer_start(manager->dds_buffer), period, channels,
+			in, 1, scale, dac_offset_get_value(manager->dac1.iio_dac));
+	dac_pack_replicate(iio_buffer_start(manager->dds_buffer),
+			period * s_size, length * s_size);
+	iio_buffer_push(manager->dds_buffer);
+
+	g_free(in);
+	g_free(i_data);
+	g_free(q_data);
+
+	desc = g_string_new(NULL);
+	g_string_printf(desc, "Generated %zu samples (period of %zu).", length, period);
+	if (synth.type == DAC_SYNTH_TONES) {
+		g_string_append(desc, " Tones at");
+		for (k = 0; k < synth.nb_tones; k++)
+			g_string_append_printf(desc, "%s %.6f", k ? "," : "",
+					synth.freqs[k] * sample_rate / 1e6);
+		g_string_append(desc, " MHz.");
+	} else if (synth.type == DAC_SYNTH_CHIRP) {
+		g_string_append_printf(desc, " Stops at %.6f MHz.",
+				synth.freqs[1] * sample_rate / 1e6);
+	} else if (synth.type == DAC_SYNTH_MULTITONE_NOISE) {
+		g_string_append_printf(desc, " Bandwidth of %.6f MHz.",
+				synth.freqs[0] * sample_rate / 1e6);
+	}
+	*stat_msg = g_string_free(desc, FALSE);
+
+	return 0;
+}
+
 static bool tx_channels_check_valid_setup(struct dac_buffer *dbuf)
 {
 	struct iio_device *dac = dbuf->dac_with_scanelems;
@@ -834,6 +737,26 @@ static void dac_buffer_config_file_set_cb (GtkFileChooser *chooser, struct dac_b
 	gtk_text_buffer_set_text(dbuf->load_status_buf, "", -1);
 }
 
+/* Text waveforms are recognized by their header, whatever their name */
+static void waveform_filters_add(GtkFileChooser *chooser)
+{
+	GtkFileFilter *filter;
+
+	filter = gtk_file_filter_new();
+	gtk_file_filter_set_name(filter, "Waveforms (.txt, .bin, .mat, SigMF)");
+	gtk_file_filter_add_pattern(filter, "*.txt");
+	gtk_file_filter_add_pattern(filter, "*.bin");
+	gtk_file_filter_add_pattern(filter, "*.mat");
+	gtk_file_filter_add_pattern(filter, "*.sigmf-meta");
+	gtk_file_filter_add_pattern(filter, "*.sigmf-data");
+	gtk_file_chooser_add_filter(chooser, filter);
+
+	filter = gtk_file_filter_new();
+	gtk_file_filter_set_name(filter, "All files");
+	gtk_file_filter_add_pattern(filter, "*");
+	gtk_file_chooser_add_filter(chooser, filter);
+}
+
 static void waveform_load_button_clicked_cb (GtkButton *btn, struct dac_buffer *dbuf)
 {
 	gchar *filename = dbuf->dac_buf_filename;
@@ -841,8 +764,8 @@ static void waveform_load_button_clicked_cb (GtkButton *btn, struct dac_buffer *
 
 	if (!filename || g_str_has_suffix(filename, "(null)")) {
 		status_msg = g_strdup_printf("No file selected.");
-	} else if (!g_str_has_suffix(filename, ".txt") && !g_str_has_suffix(filename, ".mat") && !g_str_has_suffix(filename, ".bin")) {
-		status_msg = g_strdup_printf("Invalid file type. Please select a .txt, .bin or .mat file.");
+	} else if (wavefile_detect_format(filename) == WAVEFILE_FORMAT_UNKNOWN) {
+		status_msg = g_strdup_printf("Invalid file type. Please select a text, .bin, .mat or SigMF file.");
 	} else if (!tx_channels_check_valid_setup(dbuf)) {
 		status_msg = g_strdup_printf("Invalid channel selection.");
 	} else {
@@ -853,6 +776,30 @@ static void waveform_load_button_clicked_cb (GtkButton *btn, struct dac_buffer *
 		g_free(status_msg);
 }
 
+static void synth_type_changed_cb(GtkComboBox *box, struct dac_buffer *dbuf)
+{
+	gint type = gtk_combo_box_get_active(box);
+
+	if (type < 0)
+		return;
+
+	gtk_entry_set_text(GTK_ENTRY(dbuf->synth_params), synth_waveforms[type].params);
+	gtk_widget_set_tooltip_text(dbuf->synth_params, synth_waveforms[type].help);
+}
+
+static void synth_generate_button_clicked_cb(GtkButton *btn, struct dac_buffer *dbuf)
+{
+	gchar *status_msg;
+
+	if (!tx_channels_check_valid_setup(dbuf))
+		status_msg = g_strdup_printf("Invalid channel selection.");
+	else
+		process_dac_buffer_synth(dbuf->parent, &status_msg);
+
+	gtk_text_buffer_set_text(dbuf->load_status_buf, status_msg, -1);
+	g_free(status_msg);
+}
+
 static GtkWidget *spin_button_create(double min, double max, double step, unsigned digits)
 {
 	GtkWidget *spin_button;
@@ -1128,20 +1075,24 @@ static GtkWidget *gui_dac_buffer_create(struct dac_buffer *d_buffer)
 	GtkWidget *load_status_txt;
 	GtkWidget *scale;
 	GtkWidget *tx_channels_frame;
+	GtkWidget *synth_frame;
+	GtkWidget *synth_btn;
 	GtkTextBuffer *load_status_tb;
+	unsigned int i;
 
-	dacbuf_frame = frame_with_table_create("<b>DAC Buffer Settings</b>", 2, 1);
+	dacbuf_frame = frame_with_table_create("<b>DAC Buffer Settings</b>", 3, 1);
 	dacbuf_align = gtk_bin_get_child(GTK_BIN(dacbuf_frame));
 	dacbuf_table = gtk_bin_get_child(GTK_BIN(dacbuf_align));
 	fchooser_btn = gtk_file_chooser_button_new("Select a File",
 			GTK_FILE_CHOOSER_ACTION_OPEN);
+	waveform_filters_add(GTK_FILE_CHOOSER(fchooser_btn));
 	fileload_btn = gtk_button_new_with_label("Load");
 	load_status_tb = gtk_text_buffer_new(NULL);
 	load_status_txt = gtk_text_view_new_with_buffer(load_status_tb);
 
 	gtk_alignment_set_padding(GTK_ALIGNMENT(dacbuf_align), 5, 5, 5, 5);
 
-	fchooser_frame = frame_with_table_create("<b>File Selection</b>", 3, 2);
+	fchooser_frame = frame_with_table_create("<b>File Selection</b>", 4, 2);
 	tx_channels_frame = frame_with_table_create("<b>DAC Channels</b>", 1, 1);
 
 	gtk_text_view_set_editable(GTK_TEXT_VIEW(load_status_txt), false);
@@ -1171,6 +1122,39 @@ static GtkWidget *gui_dac_buffer_create(struct dac_buffer *d_buffer)
 	gtk_table_attach(GTK_TABLE(table), scale,
 			 0, 2, 2, 3, GTK_FILL, GTK_FILL, 0, 0);
 
+	d_buffer->stream_btn = gtk_check_button_new_with_label("Stream (non-cyclic)");
+	gtk_widget_set_tooltip_text(d_buffer->stream_btn,
+		"Keep pushing the waveform to the DAC instead of loading it in a cyclic buffer, for waveforms larger than one buffer");
+	gtk_table_attach(GTK_TABLE(table), d_buffer->stream_btn,
+			 0, 2, 3, 4, GTK_FILL, GTK_FILL, 0, 0);
+
+	synth_frame = frame_with_table_create("<b>Waveform Generator</b>", 2, 2);
+	align = gtk_bin_get_child(GTK_BIN(synth_frame));
+	table = gtk_bin_get_child(GTK_BIN(align));
+
+	gtk_frame_set_shadow_type(GTK_FRAME(synth_frame), GTK_SHADOW_NONE);
+	gtk_alignment_set_padding(GTK_ALIGNMENT(align), 0, 0, 0, 0);
+
+	d_buffer->synth_type = gtk_combo_box_text_new();
+	for (i = 0; i < G_N_ELEMENTS(synth_waveforms); i++)
+		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(d_buffer->synth_type),
+				synth_waveforms[i].name);
+	d_buffer->synth_params = gtk_entry_new();
+	synth_btn = gtk_button_new_with_label("Generate");
+
+	gtk_table_attach(GTK_TABLE(table), d_buffer->synth_type,
+		0, 1, 0, 1, GTK_FILL | GTK_EXPAND, GTK_FILL, 0, 0);
+	gtk_table_attach(GTK_TABLE(table), synth_btn,
+		1, 2, 0, 1, GTK_FILL, GTK_FILL, 0, 0);
+	gtk_table_attach(GTK_TABLE(table), d_buffer->synth_params,
+		0, 2, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL, 0, 0);
+
+	g_signal_connect(d_buffer->synth_type, "changed",
+		G_CALLBACK(synth_type_changed_cb), d_buffer);
+	g_signal_connect(synth_btn, "clicked",
+		G_CALLBACK(synth_generate_button_clicked_cb), d_buffer);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(d_buffer->synth_type), DAC_SYNTH_TONES);
+
 	align = gtk_bin_get_child(GTK_BIN(tx_channels_frame));
 	table = gtk_bin_get_child(GTK_BIN(align));
 
@@ -1183,6 +1167,8 @@ static GtkWidget *gui_dac_buffer_create(struct dac_buffer *d_buffer)
 
 	gtk_table_attach(GTK_TABLE(dacbuf_table), fchooser_frame,
 		0, 1, 0, 1, GTK_FILL | GTK_EXPAND, GTK_FILL, 0, 0);
+	gtk_table_attach(GTK_TABLE(dacbuf_table), synth_frame,
+		0, 1, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL, 0, 0);
 	gtk_table_attach(GTK_TABLE(dacbuf_table), tx_channels_frame,
 		0, 1, 2, 3, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 0, 0);
 
@@ -1588,10 +1574,8 @@ static void manage_dds_mode (GtkComboBox *box, struct dds_tx *tx)
 			}
 		}
 
-		if (!manager->dds_activated && manager->dds_buffer) {
-			iio_buffer_destroy(manager->dds_buffer);
-			manager->dds_buffer = NULL;
-		}
+		if (!manager->dds_activated)
+			dac_buffer_stop(manager);
 		manager->dds_disabled = true;
 		enable_dds(manager, start_dds);
 
@@ -2038,10 +2022,7 @@ void dac_data_manager_free(struct dac_data_manager *manager)
 	if (manager) {
 		free(manager->dac1.txs);
 		free(manager->dac2.txs);
-		if (manager->dds_buffer) {
-			iio_buffer_destroy(manager->dds_buffer);
-			manager->dds_buffer = NULL;
-		}
+		dac_buffer_stop(manager);
 		g_slist_free(manager->dds_tones);
 		free(manager);
 	}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <string.h>
+
+#include "dac_pack.h"
+
+/*
+ * The kernels below are written so that the compiler can vectorize them:
+ * called with a constant channel count, the inner loop is unrolled and
+ * the saturation turns into min/max instructions.
+ */
+static inline guint16 dac_pack_sample(double val, double lo, double hi)
+{
+	val = val >= lo ? val : lo;
+	val = val > hi ? hi : val;
+
+	return (guint16)(gint32)val;
+}
+
+static inline void pack_float(guint16 *out, size_t count, unsigned int channels,
+		const gfloat *const *in, size_t stride, double scale,
+		double offset, double lo, double hi)
+{
+	size_t i;
+	unsigned int ch;
+
+	for (i = 0; i < count; i++, out += channels)
+		for (ch = 0; ch < channels; ch++)
+			out[ch] = dac_pack_sample(in[ch][i * stride] * scale + offset,
+					lo, hi);
+}
+
+static inline void pack_double(guint16 *out, size_t count, unsigned int channels,
+		const double *const *in, size_t stride, double scale,
+		double offset, double lo, double hi)
+{
+	size_t i;
+	unsigned int ch;
+
+	for (i = 0; i < count; i++, out += channels)
+		for (ch = 0; ch < channels; ch++)
+			out[ch] = dac_pack_sample(in[ch][i * stride] * scale + offset,
+					lo, hi);
+}
+
+void dac_pack_float(guint16 *out, size_t count, unsigned int channels,
+		const gfloat *const *in, size_t stride, double scale, double offset)
+{
+	double lo = offset ? 0.0 : -32768.0, hi = offset ? 65535.0 : 32767.0;
+
+	switch (channels) {
+	case 1:
+		pack_float(out, count, 1, in, stride, scale, offset, lo, hi);
+		break;
+	case 2:
+		pack_float(out, count, 2, in, stride, scale, offset, lo, hi);
+		break;
+	case 4:
+		pack_float(out, count, 4, in, stride, scale, offset, lo, hi);
+		break;
+	case 8:
+		pack_float(out, count, 8, in, stride, scale, offset, lo, hi);
+		break;
+	default:
+		pack_float(out, count, channels, in, stride, scale, offset, lo, hi);
+		break;
+	}
+}
+
+void dac_pack_double(guint16 *out, size_t count, unsigned int channels,
+		const double *const *in, size_t stride, double scale, double offset)
+{
+	double lo = offset ? 0.0 : -32768.0, hi = offset ? 65535.0 : 32767.0;
+
+	switch (channels) {
+	case 1:
+		pack_double(out, count, 1, in, stride, scale, offset, lo, hi);
+		break;
+	case 2:
+		pack_double(out, count, 2, in, stride, scale, offset, lo, hi);
+		break;
+	case 4:
+		pack_double(out, count, 4, in, stride, scale, offset, lo, hi);
+		break;
+	case 8:
+		pack_double(out, count, 8, in, stride, scale, offset, lo, hi);
+		break;
+	default:
+		pack_double(out, count, channels, in, stride, scale, offset, lo, hi);
+		break;
+	}
+}
+
+size_t dac_pack_gcd(size_t a, size_t b)
+{
+	size_t t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+void dac_pack_replicate(void *buf, size_t size, size_t total)
+{
+	size_t n;
+
+	if (!size)
+		return;
+
+	while (size < total) {
+		n = MIN(size, total - size);
+		memcpy((char *)buf + size, buf, n);
+		size += n;
+	}
+}
@@ -0,0 +1,30 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DAC_PACK_H__
+#define __DAC_PACK_H__
+
+#include <glib.h>
+#include <stddef.h>
+
+/*
+ * DAC buffers hold one 16-bit word per enabled channel for each sample.
+ * The packing kernels read @channels input arrays, taking every @stride-th
+ * value of each, and store value * @scale + @offset in channel order. The
+ * result saturates to the range of the DAC: signed 16-bit, or unsigned
+ * 16-bit when an @offset makes the DAC offset binary.
+ */
+void dac_pack_float(guint16 *out, size_t count, unsigned int channels,
+		const gfloat *const *in, size_t stride, double scale, double offset);
+void dac_pack_double(guint16 *out, size_t count, unsigned int channels,
+		const double *const *in, size_t stride, double scale, double offset);
+
+size_t dac_pack_gcd(size_t a, size_t b);
+
+/* Repeat the first @size bytes of @buf until it holds @total bytes */
+void dac_pack_replicate(void *buf, size_t size, size_t total);
+
+#endif /* __DAC_PACK_H__ */
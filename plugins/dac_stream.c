@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dac_stream.h"
+
+/* Number of blocks queued in the kernel ahead of the DAC */
+#define DAC_STREAM_KERNEL_BUFFERS 4
+
+struct dac_stream {
+	struct iio_device *dac;
+	struct iio_buffer *buffer;
+	size_t block_samples;
+	double sample_rate;
+
+	/* The waveform is read from @f at @data_offset, or copied from @data */
+	FILE *f;
+	off_t data_offset;
+	char *data;
+	size_t size;
+	size_t position;
+
+	GThread *thread;
+	gint stop;
+	gint blocks;
+	gint underflows;
+	gint ret;
+};
+
+double dac_device_sample_rate(struct iio_device *dac)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dac);
+	double rate;
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dac, i);
+
+		if (!iio_channel_is_output(ch) || !iio_channel_is_scan_element(ch))
+			continue;
+		if (!iio_channel_attr_read_double(ch, "sampling_frequency", &rate))
+			return rate;
+	}
+
+	if (!iio_device_attr_read_double(dac, "sampling_frequency", &rate))
+		return rate;
+
+	return 0.0;
+}
+
+static struct dac_stream * dac_stream_new(struct iio_device *dac, size_t size)
+{
+	struct dac_stream *stream;
+
+	if (!size)
+		return NULL;
+
+	stream = g_new0(struct dac_stream, 1);
+	stream->dac = dac;
+	stream->size = size;
+
+	return stream;
+}
+
+/* The stream takes ownership of @f, positioned at the start of the data */
+struct dac_stream * dac_stream_new_from_file(struct iio_device *dac,
+		FILE *f, size_t size)
+{
+	struct dac_stream *stream = dac_stream_new(dac, size);
+
+	if (!stream) {
+		fclose(f);
+		return NULL;
+	}
+
+	stream->f = f;
+	stream->data_offset = ftello(f);
+
+	return stream;
+}
+
+/* The stream takes ownership of @buf, which is released with free() */
+struct dac_stream * dac_stream_new_from_buffer(struct iio_device *dac,
+		char *buf, size_t size)
+{
+	struct dac_stream *stream = dac_stream_new(dac, size);
+
+	if (!stream) {
+		free(buf);
+		return NULL;
+	}
+
+	stream->data = buf;
+
+	return stream;
+}
+
+/* Fill @dst with the next @len bytes of the waveform, looping around */
+static int dac_stream_fill(struct dac_stream *stream, char *dst, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		n = MIN(len, stream->size - stream->position);
+
+		if (stream->data) {
+			memcpy(dst, stream->data + stream->position, n);
+		} else if (fread(dst, 1, n, stream->f) != n) {
+			return ferror(stream->f) ? -EIO : -ENODATA;
+		}
+
+		dst += n;
+		len -= n;
+		stream->position += n;
+
+		if (stream->position == stream->size) {
+			stream->position = 0;
+			if (stream->f && fseeko(stream->f, stream->data_offset, SEEK_SET))
+				return -errno;
+		}
+	}
+
+	return 0;
+}
+
+static gpointer dac_stream_thread(gpointer data)
+{
+	struct dac_stream *stream = data;
+	gint64 t0 = 0, now;
+	guint64 pushed = 0;
+	ssize_t ret = 0;
+	char *start;
+	size_t len;
+
+	while (!g_atomic_int_get(&stream->stop)) {
+		/* With mmap buffers, every push hands out a different block */
+		start = iio_buffer_start(stream->buffer);
+		len = (char *)iio_buffer_end(stream->buffer) - start;
+
+		ret = dac_stream_fill(stream, start, len);
+		if (ret < 0)
+			break;
+
+		/*
+		 * The DAC ran dry if it should have played more samples since
+		 * it was started than were pushed. It restarts with this block.
+		 */
+		now = g_get_monotonic_time();
+		if (t0 && stream->sample_rate > 0 &&
+				(now - t0) * stream->sample_rate / G_USEC_PER_SEC > pushed) {
+			g_atomic_int_inc(&stream->underflows);
+			t0 = 0;
+		}
+
+		ret = iio_buffer_push(stream->buffer);
+		if (ret < 0)
+			break;
+
+		if (!t0) {
+			t0 = now;
+			pushed = 0;
+		}
+		pushed += stream->block_samples;
+		g_atomic_int_inc(&stream->blocks);
+	}
+
+	if (!g_atomic_int_get(&stream->stop) && ret < 0) {
+		fprintf(stderr, "DAC stream stopped: %s\n", strerror(-ret));
+		g_atomic_int_set(&stream->ret, ret);
+	}
+
+	return NULL;
+}
+
+int dac_stream_start(struct dac_stream *stream, size_t block_samples)
+{
+	int ret;
+
+	if (!stream || !block_samples)
+		return -EINVAL;
+
+	ret = iio_device_set_kernel_buffers_count(stream->dac,
+			DAC_STREAM_KERNEL_BUFFERS);
+	if (ret < 0)
+		fprintf(stderr, "Unable to set the number of kernel buffers: %s\n",
+				strerror(-ret));
+
+	stream->buffer = iio_device_create_buffer(stream->dac, block_samples, false);
+	if (!stream->buffer) {
+		ret = -errno;
+		fprintf(stderr, "Unable to create buffer: %s\n", strerror(errno));
+		return ret;
+	}
+
+	stream->block_samples = block_samples;
+	stream->sample_rate = dac_device_sample_rate(stream->dac);
+	stream->thread = g_thread_new("dac-stream", dac_stream_thread, stream);
+
+	return 0;
+}
+
+void dac_stream_free(struct dac_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->thread) {
+		g_atomic_int_set(&stream->stop, 1);
+		/* Unblock the producer if it waits for room in the queue */
+		iio_buffer_cancel(stream->buffer);
+		g_thread_join(stream->thread);
+	}
+
+	if (stream->buffer)
+		iio_buffer_destroy(stream->buffer);
+	if (stream->f)
+		fclose(stream->f);
+	free(stream->data);
+	g_free(stream);
+}
+
+guint64 dac_stream_get_pushed(struct dac_stream *stream)
+{
+	return (guint64)g_atomic_int_get(&stream->blocks) * stream->block_samples;
+}
+
+unsigned int dac_stream_get_underflows(struct dac_stream *stream)
+{
+	return g_atomic_int_get(&stream->underflows);
+}
+
+int dac_stream_get_error(struct dac_stream *stream)
+{
+	return g_atomic_int_get(&stream->ret);
+}
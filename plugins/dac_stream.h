@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DAC_STREAM_H__
+#define __DAC_STREAM_H__
+
+#include <glib.h>
+#include <iio.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Non-cyclic playback of waveforms that don't fit in a single DAC buffer.
+ * A producer thread keeps the kernel queue of the DAC topped up with
+ * blocks of the waveform, which loops around, either read from a file or
+ * copied from memory. Underflows are counted from the DAC sample rate:
+ * the DAC ran dry whenever it would have played more samples than were
+ * pushed since it was last restarted.
+ */
+struct dac_stream;
+
+struct dac_stream * dac_stream_new_from_file(struct iio_device *dac,
+		FILE *f, size_t size);
+struct dac_stream * dac_stream_new_from_buffer(struct iio_device *dac,
+		char *buf, size_t size);
+int dac_stream_start(struct dac_stream *stream, size_t block_samples);
+void dac_stream_free(struct dac_stream *stream);
+
+guint64 dac_stream_get_pushed(struct dac_stream *stream);
+unsigned int dac_stream_get_underflows(struct dac_stream *stream);
+int dac_stream_get_error(struct dac_stream *stream);
+
+/* Sample rate of the output channels of @dac, 0 if unknown */
+double dac_device_sample_rate(struct iio_device *dac);
+
+#endif /* __DAC_STREAM_H__ */
@@ -0,0 +1,305 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <fftw3.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dac_synth.h"
+
+/* How far from a whole number of cycles a tone may end and be coherent */
+#define DAC_SYNTH_COHERENCE_TOLERANCE 1e-6
+
+/* Feedback taps of the PRBS generators, as in ITU-T O.150 */
+static const struct {
+	unsigned int order;
+	unsigned int tap;
+} prbs_taps[] = {
+	{ 7, 6 },
+	{ 9, 5 },
+	{ 11, 9 },
+	{ 15, 14 },
+	{ 20, 3 },
+	{ 23, 18 },
+};
+
+static size_t align_down(size_t len, size_t align)
+{
+	return len - len % align;
+}
+
+static bool is_coherent(double freq, size_t len)
+{
+	double cycles = freq * len;
+
+	return fabs(cycles - round(cycles)) < DAC_SYNTH_COHERENCE_TOLERANCE;
+}
+
+/*
+ * One period of exp(j * 2 * pi * m / len), from which any tone that is
+ * coherent with the period is read at a constant stride.
+ */
+static void fill_table(gfloat *cos_table, gfloat *sin_table, size_t len)
+{
+	size_t m;
+
+	for (m = 0; m < len; m++) {
+		double phase = 2.0 * M_PI * m / len;
+
+		cos_table[m] = (gfloat)cos(phase);
+		sin_table[m] = (gfloat)sin(phase);
+	}
+}
+
+static int synth_tones(struct dac_synth *synth, gfloat *i_out, gfloat *q_out,
+		size_t *length)
+{
+	gfloat *cos_table, *sin_table;
+	size_t len, n, idx, step;
+	unsigned int t;
+
+	if (!synth->nb_tones || synth->nb_tones > DAC_SYNTH_MAX_TONES)
+		return -EINVAL;
+
+	/* Shortest period in which every tone is coherent */
+	for (len = synth->align; len <= synth->max_length; len += synth->align) {
+		for (t = 0; t < synth->nb_tones; t++)
+			if (!is_coherent(synth->freqs[t], len))
+				break;
+		if (t == synth->nb_tones)
+			break;
+	}
+
+	/* None: use the longest period, with the tones on its bins */
+	if (len > synth->max_length)
+		len = align_down(synth->max_length, synth->align);
+
+	cos_table = g_new(gfloat, len);
+	sin_table = g_new(gfloat, len);
+	fill_table(cos_table, sin_table, len);
+
+	memset(i_out, 0, len * sizeof(*i_out));
+	memset(q_out, 0, len * sizeof(*q_out));
+
+	for (t = 0; t < synth->nb_tones; t++) {
+		long bin = lround(synth->freqs[t] * len);
+
+		synth->freqs[t] = (double)bin / len;
+		step = (size_t)(((bin % (long)len) + (long)len) % (long)len);
+
+		for (n = 0, idx = 0; n < len; n++) {
+			i_out[n] += cos_table[idx];
+			q_out[n] += sin_table[idx];
+			idx += step;
+			if (idx >= len)
+				idx -= len;
+		}
+	}
+
+	g_free(cos_table);
+	g_free(sin_table);
+
+	*length = len;
+	return 0;
+}
+
+/*
+ * Linear chirp over the whole period. The stop frequency is adjusted so
+ * that the phase completes a whole number of cycles at the end.
+ */
+static int synth_chirp(struct dac_synth *synth, gfloat *i_out, gfloat *q_out,
+		size_t *length)
+{
+	size_t n, len = align_down(synth->max_length, synth->align);
+	double f0 = synth->freqs[0], f1, cycles, slope, phase;
+
+	if (synth->nb_tones < 2)
+		return -EINVAL;
+
+	cycles = round(len * (f0 + synth->freqs[1]) / 2.0);
+	f1 = 2.0 * cycles / len - f0;
+	slope = (f1 - f0) / len;
+
+	for (n = 0; n < len; n++) {
+		phase = f0 * n + slope * n * n / 2.0;
+		phase = 2.0 * M_PI * (phase - floor(phase));
+		i_out[n] = (gfloat)cos(phase);
+		q_out[n] = (gfloat)sin(phase);
+	}
+
+	synth->freqs[1] = f1;
+	*length = len;
+	return 0;
+}
+
+/*
+ * Noise made of every tone of the period within the bandwidth, with
+ * random phases, like an OFDM symbol with all its subcarriers in use.
+ */
+static int synth_multitone_noise(struct dac_synth *synth, gfloat *i_out,
+		gfloat *q_out, size_t *length)
+{
+	size_t n, len = align_down(synth->max_length, synth->align);
+	long bin, max_bin;
+	fftw_complex *in, *out;
+	fftw_plan plan;
+	GRand *rand;
+
+	if (!synth->nb_tones)
+		return -EINVAL;
+
+	max_bin = lround(fabs(synth->freqs[0]) * len / 2.0);
+	if (max_bin < 1)
+		return -EINVAL;
+	max_bin = MIN(max_bin, (long)len / 2 - 1);
+	synth->freqs[0] = 2.0 * max_bin / len;
+
+	in = fftw_malloc(sizeof(fftw_complex) * len);
+	out = fftw_malloc(sizeof(fftw_complex) * len);
+	memset(in, 0, sizeof(fftw_complex) * len);
+
+	rand = g_rand_new_with_seed(synth->seed);
+	for (bin = -max_bin; bin <= max_bin; bin++) {
+		double phase = g_rand_double_range(rand, 0.0, 2.0 * M_PI);
+		size_t k = bin < 0 ? len + bin : (size_t)bin;
+
+		/* Leave the carrier out */
+		if (!bin)
+			continue;
+		in[k][0] = cos(phase);
+		in[k][1] = sin(phase);
+	}
+	g_rand_free(rand);
+
+	plan = fftw_plan_dft_1d(len, in, out, FFTW_BACKWARD, FFTW_ESTIMATE);
+	fftw_execute(plan);
+	fftw_destroy_plan(plan);
+
+	for (n = 0; n < len; n++) {
+		i_out[n] = (gfloat)out[n][0];
+		q_out[n] = (gfloat)out[n][1];
+	}
+
+	fftw_free(in);
+	fftw_free(out);
+
+	*length = len;
+	return 0;
+}
+
+/* Complex white Gaussian noise, using the Box-Muller transform */
+static int synth_awgn(struct dac_synth *synth, gfloat *i_out, gfloat *q_out,
+		size_t *length)
+{
+	size_t n, len = align_down(synth->max_length, synth->align);
+	GRand *rand = g_rand_new_with_seed(synth->seed);
+
+	for (n = 0; n < len; n++) {
+		double r = sqrt(-2.0 * log(1.0 - g_rand_double(rand)));
+		double phase = g_rand_double_range(rand, 0.0, 2.0 * M_PI);
+
+		i_out[n] = (gfloat)(r * cos(phase));
+		q_out[n] = (gfloat)(r * sin(phase));
+	}
+
+	g_rand_free(rand);
+
+	*length = len;
+	return 0;
+}
+
+/*
+ * QPSK symbols from a PRBS sequence, two bits per symbol, each held for
+ * a number of samples. The sequence length is odd, so a period holds
+ * each symbol pattern once.
+ */
+static int synth_qpsk(struct dac_synth *synth, gfloat *i_out, gfloat *q_out,
+		size_t *length)
+{
+	unsigned int order = synth->prbs_order, tap = 0, sps = synth->samples_per_symbol;
+	size_t n, s, len, symbols;
+	guint32 state = (1u << order) - 1;
+	unsigned int t, bits[2], b;
+
+	for (t = 0; t < G_N_ELEMENTS(prbs_taps); t++)
+		if (prbs_taps[t].order == order)
+			tap = prbs_taps[t].tap;
+	if (!tap || !sps)
+		return -EINVAL;
+
+	symbols = ((size_t)1 << order) - 1;
+	len = symbols * sps;
+	if (len > synth->max_length) {
+		fprintf(stderr, "PRBS%u at %u samples per symbol needs %zu samples\n",
+				order, sps, len);
+		return -E2BIG;
+	}
+
+	for (s = 0; s < symbols; s++) {
+		for (b = 0; b < 2; b++) {
+			bits[b] = ((state >> (order - 1)) ^ (state >> (tap - 1))) & 1;
+			state = ((state << 1) | bits[b]) & ((1u << order) - 1);
+		}
+
+		for (n = s * sps; n < (s + 1) * sps; n++) {
+			i_out[n] = bits[0] ? (gfloat)-M_SQRT1_2 : (gfloat)M_SQRT1_2;
+			q_out[n] = bits[1] ? (gfloat)-M_SQRT1_2 : (gfloat)M_SQRT1_2;
+		}
+	}
+
+	*length = len;
+	return 0;
+}
+
+/*
+ * Generate one period of the waveform. On success, @i and @q hold
+ * @length samples and must be released with g_free().
+ */
+int dac_synth_generate(struct dac_synth *synth, gfloat **i, gfloat **q,
+		size_t *length)
+{
+	int ret;
+
+	if (!synth->align)
+		synth->align = 1;
+	if (synth->max_length < synth->align)
+		return -EINVAL;
+
+	*i = g_new(gfloat, synth->max_length);
+	*q = g_new(gfloat, synth->max_length);
+
+	switch (synth->type) {
+	case DAC_SYNTH_TONES:
+		ret = synth_tones(synth, *i, *q, length);
+		break;
+	case DAC_SYNTH_CHIRP:
+		ret = synth_chirp(synth, *i, *q, length);
+		break;
+	case DAC_SYNTH_MULTITONE_NOISE:
+		ret = synth_multitone_noise(synth, *i, *q, length);
+		break;
+	case DAC_SYNTH_AWGN:
+		ret = synth_awgn(synth, *i, *q, length);
+		break;
+	case DAC_SYNTH_QPSK:
+		ret = synth_qpsk(synth, *i, *q, length);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	if (ret) {
+		g_free(*i);
+		g_free(*q);
+		*i = *q = NULL;
+	}
+
+	return ret;
+}
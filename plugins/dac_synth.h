@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DAC_SYNTH_H__
+#define __DAC_SYNTH_H__
+
+#include <glib.h>
+#include <stddef.h>
+
+enum dac_synth_type {
+	DAC_SYNTH_TONES,
+	DAC_SYNTH_CHIRP,
+	DAC_SYNTH_MULTITONE_NOISE,
+	DAC_SYNTH_AWGN,
+	DAC_SYNTH_QPSK,
+};
+
+#define DAC_SYNTH_MAX_TONES 16
+
+/*
+ * Complex baseband waveforms generated in place of a waveform file. The
+ * generator returns a single period, which loops without discontinuity
+ * in a cyclic buffer: tones are moved to the closest frequencies that
+ * complete an integer number of cycles in the period, chirps end on a
+ * whole cycle, noise is built from tones of the period and PRBS sequences
+ * are played in full.
+ */
+struct dac_synth {
+	enum dac_synth_type type;
+
+	/*
+	 * Frequencies in cycles per sample, in [-0.5, 0.5]: the tones, the
+	 * start and stop frequencies of a chirp, or the bandwidth of
+	 * multi-tone noise. They are updated with the frequencies generated.
+	 */
+	unsigned int nb_tones;
+	double freqs[DAC_SYNTH_MAX_TONES];
+
+	/* QPSK only */
+	unsigned int samples_per_symbol;
+	unsigned int prbs_order;
+
+	/* Longest period to generate, in samples */
+	size_t max_length;
+	/* Periods are a multiple of this number of samples, except for QPSK */
+	size_t align;
+	guint32 seed;
+};
+
+int dac_synth_generate(struct dac_synth *synth, gfloat **i, gfloat **q,
+		size_t *length);
+
+#endif /* __DAC_SYNTH_H__ */
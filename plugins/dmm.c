@@ -28,6 +28,7 @@
 #include "../iio_widget.h"
 #include "../osc_plugin.h"
 #include "../config.h"
+#include "dmm_engine.h"
 
 static GtkWidget *dmm_results;
 static GtkWidget *select_all_channels;
@@ -94,13 +95,6 @@ static struct iio_channel * get_channel(const struct iio_device *dev,
 	return NULL;
 }
 
-static double read_double_attr(const struct iio_channel *chn, const char *name)
-{
-	double val;
-	int ret = iio_channel_attr_read_double(chn, name, &val);
-	return ret < 0 ? -1.0 : val;
-}
-
 static void build_channel_list(void)
 {
 	GtkTreeIter iter, iter2, iter3;
@@ -293,91 +287,263 @@ static void init_device_list(void)
 		0, GTK_SORT_ASCENDING);
 }
 
+/* Refresh period of the results, independent of the acquisition rate */
+#define DMM_DISPLAY_INTERVAL_MS 250
+/* Number of values in the trend of each channel */
+#define DMM_TREND_LEN 2048
+
+static const struct dmm_unit {
+	const char *prefix;
+	double divisor;
+	int precision;
+	const char *name;
+} dmm_units[] = {
+	{ "voltage", 1000.0, 6, " Volts" },
+	{ "temp", 1000.0, 2, " °C" },
+	{ "current", 1.0, 6, " Milliampere" },
+	{ "accel", 1.0, 6, " m/s²" },
+	{ "anglvel", 1.0, 6, " rad/s" },
+	{ "pressure", 1.0, 6, " kPa" },
+	{ "magn", 1.0, 6, " Gauss" },
+};
+
+static const struct dmm_unit dmm_no_unit = { "", 1.0, 6, "" };
+
+struct dmm_row {
+	char *name;
+	const struct dmm_unit *unit;
+	int index;
+	gfloat *trend;
+	GtkDataboxGraph *graph;
+};
+
 static gboolean dmm_update_loop_running;
+static guint dmm_timer;
+static struct dmm_engine *dmm_engine;
+static GArray *dmm_rows;
+static GtkWidget *dmm_trend;
+static gfloat *dmm_trend_x;
+
+static GdkColor dmm_trend_background = {
+	.red = 0,
+	.green = 0,
+	.blue = 0,
+};
 
-static gboolean dmm_update(gpointer foo)
+static GdkColor dmm_trend_colors[] = {
+	{ .red = 0, .green = 65535, .blue = 0 },
+	{ .red = 65535, .green = 65535, .blue = 0 },
+	{ .red = 0, .green = 65535, .blue = 65535 },
+	{ .red = 65535, .green = 0, .blue = 65535 },
+	{ .red = 65535, .green = 32768, .blue = 0 },
+	{ .red = 32768, .green = 32768, .blue = 65535 },
+};
+
+static const struct dmm_unit * dmm_unit_of(const char *channel)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(dmm_units); i++)
+		if (!strncmp(channel, dmm_units[i].prefix,
+					strlen(dmm_units[i].prefix)))
+			return &dmm_units[i];
+
+	return &dmm_no_unit;
+}
+
+/* The graphs point at the trends of the rows: they go away first */
+static void dmm_remove_graphs(void)
+{
+	unsigned int i;
+
+	gtk_databox_graph_remove_all(GTK_DATABOX(dmm_trend));
+
+	for (i = 0; dmm_rows && i < dmm_rows->len; i++) {
+		struct dmm_row *row = &g_array_index(dmm_rows, struct dmm_row, i);
+
+		if (row->graph)
+			g_object_unref(row->graph);
+		row->graph = NULL;
+	}
+}
+
+static void dmm_stop(void)
 {
+	unsigned int i;
 
+	dmm_engine_free(dmm_engine);
+	dmm_engine = NULL;
+
+	if (!dmm_rows)
+		return;
+
+	dmm_remove_graphs();
+	gtk_widget_queue_draw(dmm_trend);
+
+	for (i = 0; i < dmm_rows->len; i++) {
+		struct dmm_row *row = &g_array_index(dmm_rows, struct dmm_row, i);
+
+		g_free(row->name);
+		g_free(row->trend);
+	}
+	g_array_free(dmm_rows, TRUE);
+	dmm_rows = NULL;
+}
+
+static int dmm_start(void)
+{
 	GtkTreeIter tree_iter;
-	char *name, *device, *channel, tmp[128];
+	char *name, *device, *channel;
 	gboolean loop, enabled;
-	double value;
 
-	GtkTextBuffer *buf;
-	GtkTextIter text_iter;
+	dmm_stop();
 
-	/* start at the top every time */
-	buf = gtk_text_buffer_new(NULL);
-	gtk_text_buffer_get_iter_at_offset(buf, &text_iter, 0);
+	dmm_engine = dmm_engine_new(DMM_TREND_LEN);
+	if (!dmm_engine)
+		return -ENOMEM;
+	dmm_rows = g_array_new(FALSE, FALSE, sizeof(struct dmm_row));
 
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		loop = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(channel_list_store), &tree_iter);
-		while (loop) {
-			gtk_tree_model_get(GTK_TREE_MODEL(channel_list_store), &tree_iter,
-					0, &name,
-					1, &enabled,
-					2, &device,
-					3, &channel,
-					-1);
-			if (enabled) {
-				struct iio_device *dev =
-					get_device(device);
-				struct iio_channel *chn =
-					get_channel(dev, channel);
-
-				if (iio_channel_find_attr(chn, "raw"))
-					value = read_double_attr(chn, "raw");
-				else if (iio_channel_find_attr(chn, "processed"))
-					value = read_double_attr(chn, "processed");
-				else if (iio_channel_find_attr(chn, "input"))
-					value = read_double_attr(chn, "input");
-				else {
-					sprintf(tmp, "skipping %s", name);
-					goto dmm_update_next;
-				}
+	loop = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(channel_list_store), &tree_iter);
+	while (loop) {
+		gtk_tree_model_get(GTK_TREE_MODEL(channel_list_store), &tree_iter,
+				0, &name,
+				1, &enabled,
+				2, &device,
+				3, &channel,
+				-1);
+		if (enabled) {
+			struct iio_device *dev = get_device(device);
+			struct iio_channel *chn = dev ? get_channel(dev, channel) : NULL;
+			struct dmm_row row = {
+				.name = name,
+				.unit = dmm_unit_of(channel),
+				.index = -ENODEV,
+			};
+
+			if (chn)
+				row.index = dmm_engine_add_channel(dmm_engine, chn);
+			if (row.index >= 0)
+				row.trend = g_new0(gfloat, DMM_TREND_LEN);
+
+			g_array_append_val(dmm_rows, row);
+			name = NULL;
+		}
 
-				if (iio_channel_find_attr(chn, "offset"))
-					value += read_double_attr(chn,
-							"offset");
-				if (iio_channel_find_attr(chn, "scale"))
-					value *= read_double_attr(chn,
-							"scale");
-
-				if (!strncmp(channel, "voltage", 7))
-					sprintf(tmp, "%s = %f Volts\n", name, value / 1000);
-				else if (!strncmp(channel, "temp", 4))
-					sprintf(tmp, "%s = %3.2f °C\n", name, value / 1000);
-				else if (!strncmp(channel, "current", 4))
-					sprintf(tmp, "%s = %f Milliampere\n", name, value);
-				else if (!strncmp(channel, "accel", 5))
-					sprintf(tmp, "%s = %f m/s²\n", name, value);
-				else if (!strncmp(channel, "anglvel", 7))
-					sprintf(tmp, "%s = %f rad/s\n", name, value);
-				else if (!strncmp(channel, "pressure", 8))
-					sprintf(tmp, "%s = %f kPa\n", name, value);
-				else if (!strncmp(channel, "magn", 4))
-					sprintf(tmp, "%s = %f Gauss\n", name, value);
-				else
-					sprintf(tmp, "%s = %f\n", name, value);
-
-				gtk_text_buffer_insert(buf, &text_iter, tmp, -1);
-			}
-dmm_update_next:
-			loop = gtk_tree_model_iter_next(GTK_TREE_MODEL(channel_list_store), &tree_iter);
+		g_free(name);
+		g_free(device);
+		g_free(channel);
+		loop = gtk_tree_model_iter_next(GTK_TREE_MODEL(channel_list_store), &tree_iter);
+	}
+
+	return dmm_engine_start(dmm_engine);
+}
+
+static void dmm_update_trend(void)
+{
+	unsigned int i, n, longest = 0;
+	gfloat min = 0.0f, max = 0.0f;
+	bool first = true;
+
+	dmm_remove_graphs();
+
+	for (i = 0; i < dmm_rows->len; i++) {
+		struct dmm_row *row = &g_array_index(dmm_rows, struct dmm_row, i);
+		GdkColor *color = &dmm_trend_colors[i % G_N_ELEMENTS(dmm_trend_colors)];
+		unsigned int j;
+
+		if (row->index < 0)
+			continue;
+
+		n = dmm_engine_get_trend(dmm_engine, row->index, row->trend);
+		if (!n)
+			continue;
+
+		for (j = 0; j < n; j++) {
+			row->trend[j] /= row->unit->divisor;
+			if (first || row->trend[j] < min)
+				min = row->trend[j];
+			if (first || row->trend[j] > max)
+				max = row->trend[j];
+			first = false;
+		}
+		longest = MAX(longest, n);
+
+		row->graph = gtk_databox_lines_new(n, dmm_trend_x, row->trend,
+				color, 1);
+		gtk_databox_graph_add(GTK_DATABOX(dmm_trend), row->graph);
+	}
+
+	if (longest > 1) {
+		gfloat margin = (max - min) * 0.05f ?: 0.5f;
+
+		gtk_databox_set_total_limits(GTK_DATABOX(dmm_trend), 0.0,
+				longest - 1, max + margin, min - margin);
+	}
+	gtk_widget_queue_draw(dmm_trend);
+}
+
+static gboolean dmm_update(gpointer foo)
+{
+	GString *text;
+	unsigned int i;
+
+	if (!(this_page == gtk_notebook_get_current_page(nbook) || plugin_detached))
+		return TRUE;
+
+	text = g_string_new(NULL);
+
+	for (i = 0; i < dmm_rows->len; i++) {
+		struct dmm_row *row = &g_array_index(dmm_rows, struct dmm_row, i);
+		const struct dmm_unit *unit = row->unit;
+		struct dmm_stats stats;
+
+		if (row->index < 0) {
+			g_string_append_printf(text, "skipping %s\n", row->name);
+			continue;
 		}
 
-		gtk_text_view_set_buffer(GTK_TEXT_VIEW(dmm_results), buf);
-		g_object_unref(buf);
+		if (!dmm_engine_get_stats(dmm_engine, row->index, &stats)) {
+			g_string_append_printf(text, "%s = ...\n", row->name);
+			continue;
+		}
+
+		g_string_append_printf(text, "%s = %.*f%s\n"
+				"    min %.*f  max %.*f  mean %.*f  stddev %.*f"
+				"  (%" G_GUINT64_FORMAT " samples%s)\n",
+				row->name,
+				unit->precision, stats.last / unit->divisor, unit->name,
+				unit->precision, stats.min / unit->divisor,
+				unit->precision, stats.max / unit->divisor,
+				unit->precision, stats.mean / unit->divisor,
+				unit->precision, stats.stddev / unit->divisor,
+				stats.count,
+				dmm_engine_is_buffered(dmm_engine, row->index) ?
+					", buffered" : "");
 	}
 
-	return dmm_update_loop_running;
+	gtk_text_buffer_set_text(gtk_text_view_get_buffer(
+				GTK_TEXT_VIEW(dmm_results)), text->str, -1);
+	g_string_free(text, TRUE);
+
+	dmm_update_trend();
+
+	return TRUE;
 }
 
 static void dmm_button_clicked(GtkToggleToolButton *btn, gpointer data)
 {
 	dmm_update_loop_running = gtk_toggle_tool_button_get_active(btn);
-	if (dmm_update_loop_running)
-		g_timeout_add(500, (GSourceFunc) dmm_update, ctx);
+	if (dmm_update_loop_running) {
+		dmm_start();
+		if (!dmm_timer)
+			dmm_timer = g_timeout_add(DMM_DISPLAY_INTERVAL_MS,
+					(GSourceFunc) dmm_update, ctx);
+	} else {
+		if (dmm_timer)
+			g_source_remove(dmm_timer);
+		dmm_timer = 0;
+		dmm_stop();
+	}
 }
 
 static gboolean dmm_button_icon_transform(GBinding *binding,
@@ -397,7 +563,8 @@ static gboolean dmm_button_icon_transform(GBinding *binding,
 static GtkWidget * dmm_init(struct osc_plugin *plugin, GtkWidget *notebook, const char *ini_fn)
 {
 	GtkBuilder *builder;
-	GtkWidget *dmm_panel;
+	GtkWidget *dmm_panel, *table;
+	unsigned int i;
 
 	builder = gtk_builder_new();
 	nbook = GTK_NOTEBOOK(notebook);
@@ -440,6 +607,20 @@ static GtkWidget * dmm_init(struct osc_plugin *plugin, GtkWidget *notebook, cons
 	gtk_widget_show_all(dmm_panel);
 	gtk_widget_hide(select_all_channels);
 
+	/* Trend of the values of the channels, in their unit */
+	gtk_databox_create_box_with_scrollbars_and_rulers(&dmm_trend, &table,
+			TRUE, TRUE, TRUE, TRUE);
+	gtk_box_pack_start(GTK_BOX(gtk_builder_get_object(builder, "disp_dmm")),
+			table, TRUE, TRUE, 0);
+	/* Kept until the plugin is destroyed, to release its graphs */
+	g_object_ref(dmm_trend);
+	gtk_widget_modify_bg(dmm_trend, GTK_STATE_NORMAL, &dmm_trend_background);
+	gtk_widget_set_size_request(table, 450, 200);
+
+	dmm_trend_x = g_new(gfloat, DMM_TREND_LEN);
+	for (i = 0; i < DMM_TREND_LEN; i++)
+		dmm_trend_x[i] = i;
+
 	init_device_list();
 
 	/* we are looking for almost random numbers, so this will work */
@@ -517,6 +698,12 @@ static void update_active_page(struct osc_plugin *plugin, gint active_page, gboo
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
 	g_source_remove_by_user_data(ctx);
+	dmm_timer = 0;
+	dmm_stop();
+	g_object_unref(dmm_trend);
+	dmm_trend = NULL;
+	g_free(dmm_trend_x);
+	dmm_trend_x = NULL;
 	osc_destroy_context(ctx);
 }
 
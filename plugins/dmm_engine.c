@@ -0,0 +1,526 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dmm_engine.h"
+
+/* Reads of attributes are never closer than this */
+#define DMM_POLL_MIN_INTERVAL_MS 20
+/* A buffer holds about this long of samples, within the limits below */
+#define DMM_BUFFER_DURATION_MS 50
+#define DMM_BUFFER_MIN_SAMPLES 1
+#define DMM_BUFFER_MAX_SAMPLES 4096
+/* Samples of a buffer when the sampling frequency is unknown */
+#define DMM_BUFFER_DEFAULT_SAMPLES 16
+
+struct dmm_channel {
+	struct iio_channel *chn;
+	/* Attribute holding the value: raw, processed or input */
+	const char *attr;
+	double offset;
+	double scale;
+	bool buffered;
+
+	/* Running statistics (Welford), under the lock of the engine */
+	guint64 count;
+	double last, min, max, mean, m2;
+	gfloat *trend;
+	unsigned int trend_pos;
+};
+
+struct dmm_device {
+	struct dmm_engine *engine;
+	struct iio_device *dev;
+	GPtrArray *channels;
+	double rate;
+	/* Time between two reads of the attributes, in microseconds */
+	gint64 interval;
+	GThread *thread;
+
+	/* Read through a buffer, created for each block only */
+	bool buffered;
+	size_t buffer_samples;
+	/* Buffer of the current block, under the stop lock of the engine */
+	struct iio_buffer *buffer;
+};
+
+struct dmm_engine {
+	GPtrArray *channels;
+	GPtrArray *devices;
+	unsigned int trend_len;
+
+	GMutex lock;
+
+	/* Wakes the threads up when the engine stops */
+	GMutex stop_lock;
+	GCond stop_cond;
+	gint stop;
+};
+
+static double dmm_device_rate(struct iio_device *dev)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	double rate;
+
+	if (!iio_device_attr_read_double(dev, "sampling_frequency", &rate))
+		return rate;
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_output(ch))
+			continue;
+		if (!iio_channel_attr_read_double(ch, "sampling_frequency", &rate))
+			return rate;
+	}
+
+	return 0.0;
+}
+
+static void dmm_channel_add_value(struct dmm_engine *engine,
+		struct dmm_channel *dc, double raw)
+{
+	double value = (raw + dc->offset) * dc->scale;
+	double delta;
+
+	dc->count++;
+	delta = value - dc->mean;
+	dc->mean += delta / dc->count;
+	dc->m2 += delta * (value - dc->mean);
+
+	if (dc->count == 1 || value < dc->min)
+		dc->min = value;
+	if (dc->count == 1 || value > dc->max)
+		dc->max = value;
+	dc->last = value;
+
+	dc->trend[dc->trend_pos] = value;
+	dc->trend_pos = (dc->trend_pos + 1) % engine->trend_len;
+}
+
+static double dmm_sample_value(const struct iio_channel *chn, const void *src)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(chn);
+	uint64_t val = 0;
+
+	iio_channel_convert(chn, &val, src);
+
+	switch (fmt->length / 8) {
+	case 1:
+		return fmt->is_signed ? (double)(int8_t)val : (double)(uint8_t)val;
+	case 2:
+		return fmt->is_signed ? (double)(int16_t)val : (double)(uint16_t)val;
+	case 4:
+		return fmt->is_signed ? (double)(int32_t)val : (double)(uint32_t)val;
+	default:
+		return fmt->is_signed ? (double)(int64_t)val : (double)val;
+	}
+}
+
+/* Waits until @until, monotonic time; returns false if the engine stopped */
+static bool dmm_wait_until(struct dmm_engine *engine, gint64 until)
+{
+	bool running;
+
+	g_mutex_lock(&engine->stop_lock);
+	while (!g_atomic_int_get(&engine->stop) &&
+			g_cond_wait_until(&engine->stop_cond,
+				&engine->stop_lock, until))
+		;
+	running = !g_atomic_int_get(&engine->stop);
+	g_mutex_unlock(&engine->stop_lock);
+
+	return running;
+}
+
+static void dmm_read_attributes(struct dmm_device *dd)
+{
+	struct dmm_engine *engine = dd->engine;
+	unsigned int i;
+	double raw;
+
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		if (iio_channel_attr_read_double(dc->chn, dc->attr, &raw))
+			continue;
+
+		g_mutex_lock(&engine->lock);
+		dmm_channel_add_value(engine, dc, raw);
+		g_mutex_unlock(&engine->lock);
+	}
+}
+
+static void dmm_device_set_buffered(struct dmm_device *dd, bool buffered)
+{
+	unsigned int i;
+
+	g_mutex_lock(&dd->engine->lock);
+	dd->buffered = buffered;
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		dc->buffered = buffered;
+	}
+	g_mutex_unlock(&dd->engine->lock);
+}
+
+/* The channel mask is shared with captures, which may change it */
+static void dmm_device_enable_channels(struct dmm_device *dd)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dd->dev);
+
+	for (i = 0; i < nb_channels; i++)
+		iio_channel_disable(iio_device_get_channel(dd->dev, i));
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		iio_channel_enable(dc->chn);
+	}
+}
+
+static bool dmm_device_channels_enabled(struct dmm_device *dd)
+{
+	unsigned int i;
+
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		if (!iio_channel_is_enabled(dc->chn))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Reads one block through a buffer. The buffer is released right after, so
+ * that a capture of the oscilloscope can use the device in between: blocks
+ * are then read through attributes until the capture releases it.
+ * Returns false when the device can't be read through a buffer at all.
+ */
+static bool dmm_read_block(struct dmm_device *dd)
+{
+	struct dmm_engine *engine = dd->engine;
+	struct iio_buffer *buffer;
+	unsigned int i;
+	ssize_t ret;
+	int err;
+
+	g_mutex_lock(&engine->stop_lock);
+	if (g_atomic_int_get(&engine->stop)) {
+		g_mutex_unlock(&engine->stop_lock);
+		return true;
+	}
+	/* A capture may have changed the channels in between */
+	if (!dmm_device_channels_enabled(dd))
+		dmm_device_enable_channels(dd);
+	buffer = iio_device_create_buffer(dd->dev, dd->buffer_samples, false);
+	err = errno;
+	dd->buffer = buffer;
+	g_mutex_unlock(&engine->stop_lock);
+
+	if (!buffer) {
+		if (err == EBUSY) {
+			dmm_read_attributes(dd);
+			dmm_wait_until(engine,
+					g_get_monotonic_time() + dd->interval);
+			return true;
+		}
+		fprintf(stderr, "DMM: unable to create buffer of %s, "
+				"reading attributes instead: %s\n",
+				iio_device_get_id(dd->dev), strerror(err));
+		return false;
+	}
+
+	ret = iio_buffer_refill(buffer);
+	if (ret >= 0) {
+		ptrdiff_t step = iio_buffer_step(buffer);
+		const char *end = iio_buffer_end(buffer);
+
+		g_mutex_lock(&engine->lock);
+		for (i = 0; i < dd->channels->len; i++) {
+			struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+			const char *ptr = iio_buffer_first(buffer, dc->chn);
+
+			for (; ptr < end; ptr += step)
+				dmm_channel_add_value(engine, dc,
+						dmm_sample_value(dc->chn, ptr));
+		}
+		g_mutex_unlock(&engine->lock);
+	}
+
+	g_mutex_lock(&engine->stop_lock);
+	dd->buffer = NULL;
+	iio_buffer_destroy(buffer);
+	g_mutex_unlock(&engine->stop_lock);
+
+	if (ret < 0 && !g_atomic_int_get(&engine->stop)) {
+		fprintf(stderr, "DMM: unable to refill buffer of %s, "
+				"reading attributes instead: %s\n",
+				iio_device_get_id(dd->dev), strerror(-ret));
+		return false;
+	}
+
+	return true;
+}
+
+static gpointer dmm_device_thread(gpointer data)
+{
+	struct dmm_device *dd = data;
+	struct dmm_engine *engine = dd->engine;
+	gint64 next = g_get_monotonic_time();
+
+	while (!g_atomic_int_get(&engine->stop)) {
+		if (dd->buffered) {
+			if (!dmm_read_block(dd))
+				dmm_device_set_buffered(dd, false);
+			continue;
+		}
+
+		dmm_read_attributes(dd);
+
+		next += dd->interval;
+		if (!dmm_wait_until(engine, next))
+			break;
+	}
+
+	return NULL;
+}
+
+struct dmm_engine * dmm_engine_new(unsigned int trend_len)
+{
+	struct dmm_engine *engine;
+
+	if (!trend_len)
+		return NULL;
+
+	engine = g_new0(struct dmm_engine, 1);
+	engine->channels = g_ptr_array_new();
+	engine->devices = g_ptr_array_new();
+	engine->trend_len = trend_len;
+	g_mutex_init(&engine->lock);
+	g_mutex_init(&engine->stop_lock);
+	g_cond_init(&engine->stop_cond);
+
+	return engine;
+}
+
+static void dmm_device_free(struct dmm_device *dd)
+{
+	unsigned int i;
+
+	if (dd->thread) {
+		/* Unblock the thread if it waits for samples */
+		g_mutex_lock(&dd->engine->stop_lock);
+		if (dd->buffer)
+			iio_buffer_cancel(dd->buffer);
+		g_mutex_unlock(&dd->engine->stop_lock);
+		g_thread_join(dd->thread);
+	}
+
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		g_free(dc->trend);
+		g_free(dc);
+	}
+	g_ptr_array_free(dd->channels, TRUE);
+	g_free(dd);
+}
+
+void dmm_engine_free(struct dmm_engine *engine)
+{
+	unsigned int i;
+
+	if (!engine)
+		return;
+
+	g_mutex_lock(&engine->stop_lock);
+	g_atomic_int_set(&engine->stop, 1);
+	g_cond_broadcast(&engine->stop_cond);
+	g_mutex_unlock(&engine->stop_lock);
+
+	for (i = 0; i < engine->devices->len; i++)
+		dmm_device_free(g_ptr_array_index(engine->devices, i));
+
+	g_ptr_array_free(engine->devices, TRUE);
+	g_ptr_array_free(engine->channels, TRUE);
+	g_mutex_clear(&engine->lock);
+	g_mutex_clear(&engine->stop_lock);
+	g_cond_clear(&engine->stop_cond);
+	g_free(engine);
+}
+
+static struct dmm_device * dmm_engine_get_device(struct dmm_engine *engine,
+		struct iio_device *dev)
+{
+	struct dmm_device *dd;
+	unsigned int i;
+
+	for (i = 0; i < engine->devices->len; i++) {
+		dd = g_ptr_array_index(engine->devices, i);
+		if (dd->dev == dev)
+			return dd;
+	}
+
+	dd = g_new0(struct dmm_device, 1);
+	dd->engine = engine;
+	dd->dev = dev;
+	dd->channels = g_ptr_array_new();
+	g_ptr_array_add(engine->devices, dd);
+
+	return dd;
+}
+
+int dmm_engine_add_channel(struct dmm_engine *engine,
+		struct iio_channel *chn)
+{
+	struct dmm_channel *dc;
+	const char *attr;
+	double val;
+
+	if (iio_channel_find_attr(chn, "raw"))
+		attr = "raw";
+	else if (iio_channel_find_attr(chn, "processed"))
+		attr = "processed";
+	else if (iio_channel_find_attr(chn, "input"))
+		attr = "input";
+	else
+		return -ENOENT;
+
+	dc = g_new0(struct dmm_channel, 1);
+	dc->chn = chn;
+	dc->attr = attr;
+	dc->scale = 1.0;
+	dc->trend = g_new0(gfloat, engine->trend_len);
+
+	if (iio_channel_find_attr(chn, "offset") &&
+			!iio_channel_attr_read_double(chn, "offset", &val))
+		dc->offset = val;
+	if (iio_channel_find_attr(chn, "scale") &&
+			!iio_channel_attr_read_double(chn, "scale", &val))
+		dc->scale = val;
+
+	g_ptr_array_add(dmm_engine_get_device(engine,
+				(struct iio_device *)iio_channel_get_device(chn))->channels, dc);
+	g_ptr_array_add(engine->channels, dc);
+
+	return engine->channels->len - 1;
+}
+
+/* Only raw samples can go through a buffer, as scale and offset are known */
+static bool dmm_device_can_buffer(struct dmm_device *dd)
+{
+	unsigned int i;
+
+	for (i = 0; i < dd->channels->len; i++) {
+		struct dmm_channel *dc = g_ptr_array_index(dd->channels, i);
+
+		if (strcmp(dc->attr, "raw") || !iio_channel_is_scan_element(dc->chn))
+			return false;
+	}
+
+	return dd->channels->len > 0;
+}
+
+int dmm_engine_start(struct dmm_engine *engine)
+{
+	unsigned int i;
+
+	for (i = 0; i < engine->devices->len; i++) {
+		struct dmm_device *dd = g_ptr_array_index(engine->devices, i);
+
+		if (dd->thread)
+			continue;
+
+		dd->rate = dmm_device_rate(dd->dev);
+		dd->interval = DMM_POLL_MIN_INTERVAL_MS * 1000;
+		if (dd->rate > 0.0 && G_USEC_PER_SEC / dd->rate > dd->interval)
+			dd->interval = G_USEC_PER_SEC / dd->rate;
+
+		dd->buffer_samples = DMM_BUFFER_DEFAULT_SAMPLES;
+		if (dd->rate > 0.0)
+			dd->buffer_samples = CLAMP(
+					dd->rate * DMM_BUFFER_DURATION_MS / 1000,
+					DMM_BUFFER_MIN_SAMPLES, DMM_BUFFER_MAX_SAMPLES);
+
+		if (dmm_device_can_buffer(dd)) {
+			dmm_device_enable_channels(dd);
+			dmm_device_set_buffered(dd, true);
+		}
+
+		dd->thread = g_thread_new("dmm", dmm_device_thread, dd);
+	}
+
+	return 0;
+}
+
+gboolean dmm_engine_get_stats(struct dmm_engine *engine, unsigned int idx,
+		struct dmm_stats *stats)
+{
+	struct dmm_channel *dc;
+
+	if (idx >= engine->channels->len)
+		return FALSE;
+
+	dc = g_ptr_array_index(engine->channels, idx);
+
+	g_mutex_lock(&engine->lock);
+	stats->count = dc->count;
+	stats->last = dc->last;
+	stats->min = dc->min;
+	stats->max = dc->max;
+	stats->mean = dc->mean;
+	stats->stddev = dc->count > 1 ? sqrt(dc->m2 / (dc->count - 1)) : 0.0;
+	g_mutex_unlock(&engine->lock);
+
+	return stats->count > 0;
+}
+
+unsigned int dmm_engine_get_trend(struct dmm_engine *engine,
+		unsigned int idx, gfloat *dst)
+{
+	struct dmm_channel *dc;
+	unsigned int n, first;
+
+	if (idx >= engine->channels->len)
+		return 0;
+
+	dc = g_ptr_array_index(engine->channels, idx);
+
+	g_mutex_lock(&engine->lock);
+	if (dc->count < engine->trend_len) {
+		n = dc->count;
+		first = 0;
+	} else {
+		n = engine->trend_len;
+		first = dc->trend_pos;
+	}
+
+	memcpy(dst, dc->trend + first, (n - first) * sizeof(*dst));
+	memcpy(dst + n - first, dc->trend, first * sizeof(*dst));
+	g_mutex_unlock(&engine->lock);
+
+	return n;
+}
+
+gboolean dmm_engine_is_buffered(struct dmm_engine *engine, unsigned int idx)
+{
+	struct dmm_channel *dc;
+
+	if (idx >= engine->channels->len)
+		return FALSE;
+
+	dc = g_ptr_array_index(engine->channels, idx);
+	return dc->buffered;
+}
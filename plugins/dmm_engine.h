@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DMM_ENGINE_H__
+#define __DMM_ENGINE_H__
+
+#include <glib.h>
+#include <iio.h>
+
+/*
+ * Continuous acquisition of DMM channels. Each device gets a thread that
+ * reads its channels as fast as the device produces them: through a buffer
+ * when all its channels are raw scan elements, with reads of the value
+ * attribute paced by the sampling frequency otherwise. The buffer only lives
+ * for one block of samples, so that a capture can still use the device; the
+ * attributes are read while it does. Each channel is read on its own, as
+ * libiio can't read the attributes of several channels at once. Scale and
+ * offset are read once, when a channel is added. Every value updates the
+ * running statistics of its channel and a trend of the latest values.
+ */
+struct dmm_engine;
+
+struct dmm_stats {
+	guint64 count;
+	double last;
+	double min;
+	double max;
+	double mean;
+	double stddev;
+};
+
+struct dmm_engine * dmm_engine_new(unsigned int trend_len);
+void dmm_engine_free(struct dmm_engine *engine);
+
+/* Returns the index of the channel in the engine, or a negative error code */
+int dmm_engine_add_channel(struct dmm_engine *engine,
+		struct iio_channel *chn);
+int dmm_engine_start(struct dmm_engine *engine);
+
+/* Returns FALSE until the channel has a value */
+gboolean dmm_engine_get_stats(struct dmm_engine *engine, unsigned int idx,
+		struct dmm_stats *stats);
+/* Copies the trend to @dst, oldest first; returns the number of values */
+unsigned int dmm_engine_get_trend(struct dmm_engine *engine,
+		unsigned int idx, gfloat *dst);
+gboolean dmm_engine_is_buffered(struct dmm_engine *engine, unsigned int idx);
+
+#endif /* __DMM_ENGINE_H__ */
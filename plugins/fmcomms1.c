@@ -28,6 +28,7 @@
 #include "../osc_plugin.h"
 #include "../config.h"
 #include "../eeprom.h"
+#include "../poll_scheduler.h"
 #include "scpi.h"
 #include "dac_data_manager.h"
 
@@ -160,6 +161,7 @@ static const char *fmcomms1_driver_attribs[] = {
 };
 
 static int kill_thread;
+static struct poll_set *temp_poll;
 static int fmcomms1_cal_eeprom(void);
 
 static struct s_cal_eeprom_v1 {
@@ -617,15 +619,17 @@ static void cal_rx_button_clicked(void)
 	gtk_widget_hide(cal_rx);
 }
 
-static gboolean display_temp(void *ptr)
+static void display_temp(struct poll_set *set, gpointer ptr)
 {
 	double temp, tmp;
 	struct iio_channel *chn = iio_device_find_channel(dac, "temp0", false);
+	const char *value;
 
 	if (kill_thread)
-		return FALSE;
+		return;
 
-	if (iio_channel_attr_read_double(chn, "input", &temp) < 0) {
+	value = poll_set_get_value(set, dac, chn, "input", NULL);
+	if (!value) {
 		/* Just assume it's 25C, units are in milli-degrees C */
 		temp = 25 * 1000;
 		iio_channel_attr_write_double(chn, "input", temp);
@@ -635,11 +639,10 @@ static gboolean display_temp(void *ptr)
 		printf("AD9122 temp cal value : %hu\n", temp_calibbias);
 	} else {
 		char buf[25];
+		temp = g_ascii_strtod(value, NULL);
 		sprintf(buf, "%2.1f", temp/1000);
 		gtk_label_set_text(GTK_LABEL(ad9122_temp), buf);
 	}
-
-	return TRUE;
 }
 
 #define RX_CAL_THRESHOLD -75
@@ -1284,7 +1287,9 @@ static void cal_dialog(GtkButton *btn, Dialogs *data)
 	if (fmcomms1_cal_eeprom() < 0)
 		gtk_widget_hide(load_eeprom);
 
-	g_timeout_add(500, &display_temp, data);
+	temp_poll = poll_set_new(500, NULL, display_temp, data);
+	poll_set_add_attr(temp_poll, dac,
+			iio_device_find_channel(dac, "temp0", false), "input");
 
 	do {
 		ret = gtk_dialog_run(GTK_DIALOG(dialogs.calibrate));
@@ -1335,7 +1340,8 @@ static void cal_dialog(GtkButton *btn, Dialogs *data)
 	 to die which won't die until it will get one last batch of data. */
 	if (calib_plot_exists)
 		osc_plot_draw_stop(plot_fft_2ch);
-	g_source_remove_by_user_data(data);
+	poll_set_free(temp_poll);
+	temp_poll = NULL;
 
 	if (thid_rx)
 		g_thread_join(thid_rx);
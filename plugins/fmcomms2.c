@@ -34,6 +34,7 @@
 #include "../eeprom.h"
 #include "../fru.h"
 #include "../iio_utils.h"
+#include "../poll_scheduler.h"
 #include "block_diagram.h"
 #include "dac_data_manager.h"
 #include "fir_filter.h"
@@ -146,6 +147,8 @@ static GtkNotebook *nbook;
 static GtkWidget *fmcomms2_panel;
 static gboolean plugin_detached;
 
+static struct poll_set *display_poll;
+
 static const char *fmcomms2_sr_attribs[] = {
 	PHY_DEVICE".trx_rate_governor",
 	PHY_DEVICE".dcxo_tune_coarse",
@@ -384,6 +387,14 @@ static void tx_sample_frequency_changed_cb(void *data)
 	sample_frequency_changed_cb(NULL);
 }
 
+static void rssi_set_label(GtkWidget *label, const char *value)
+{
+	if (value)
+		gtk_label_set_text(GTK_LABEL(label), value);
+	else
+		gtk_label_set_text(GTK_LABEL(label), "<error>");
+}
+
 static void rssi_update_label(GtkWidget *label, const char *chn,  bool is_tx)
 {
 	char buf[1024];
@@ -396,10 +407,7 @@ static void rssi_update_label(GtkWidget *label, const char *chn,  bool is_tx)
 	ret = iio_channel_attr_read(
 			iio_device_find_channel(dev, chn, is_tx),
 			"rssi", buf, sizeof(buf));
-	if (ret > 0)
-		gtk_label_set_text(GTK_LABEL(label), buf);
-	else
-		gtk_label_set_text(GTK_LABEL(label), "<error>");
+	rssi_set_label(label, ret > 0 ? buf : NULL);
 }
 
 static void rssi_update_labels(void)
@@ -414,22 +422,83 @@ static void rssi_update_labels(void)
 	}
 }
 
-static gboolean update_display(gpointer foo)
+static void rssi_poll_label(struct poll_set *set, GtkWidget *label,
+		const char *chn, bool is_tx)
+{
+	if (!gtk_widget_is_drawable(GTK_WIDGET(label)))
+		return;
+
+	rssi_set_label(label, poll_set_get_value(set, dev,
+			iio_device_find_channel(dev, chn, is_tx), "rssi", NULL));
+}
+
+static void rssi_poll_add(struct poll_set *set, GtkWidget *label,
+		const char *chn, bool is_tx)
 {
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		const char *gain_mode;
+	/* Hidden labels aren't updated (to quiet down SPI) */
+	if (gtk_widget_is_drawable(GTK_WIDGET(label)))
+		poll_set_add_attr(set, dev,
+				iio_device_find_channel(dev, chn, is_tx), "rssi");
+}
 
-		rssi_update_labels();
-		gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx1));
-		if (gain_mode && strcmp(gain_mode, "manual"))
-			iio_widget_update(&rx_widgets[rx1_gain]);
+static gboolean display_visible(gpointer foo)
+{
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
+
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	const char *gain_mode;
 
-		gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx2));
-		if (is_2rx_2tx && gain_mode && strcmp(gain_mode, "manual"))
-			iio_widget_update(&rx_widgets[rx2_gain]);
+	rssi_poll_label(set, rx1_rssi, "voltage0", false);
+	if (tx_rssi_available)
+		rssi_poll_label(set, tx1_rssi, "voltage0", true);
+	if (is_2rx_2tx) {
+		rssi_poll_label(set, rx2_rssi, "voltage1", false);
+		if (tx_rssi_available)
+			rssi_poll_label(set, tx2_rssi, "voltage1", true);
 	}
 
-	return TRUE;
+	gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx1));
+	if (gain_mode && strcmp(gain_mode, "manual"))
+		poll_set_update_widget(set, &rx_widgets[rx1_gain]);
+
+	gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes_rx2));
+	if (is_2rx_2tx && gain_mode && strcmp(gain_mode, "manual"))
+		poll_set_update_widget(set, &rx_widgets[rx2_gain]);
+}
+
+/* The set is built again when a RSSI label is shown or hidden */
+static void display_poll_start(void)
+{
+	poll_set_free(display_poll);
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
+
+	rssi_poll_add(display_poll, rx1_rssi, "voltage0", false);
+	if (tx_rssi_available)
+		rssi_poll_add(display_poll, tx1_rssi, "voltage0", true);
+	poll_set_add_widget(display_poll, &rx_widgets[rx1_gain]);
+
+	if (is_2rx_2tx) {
+		rssi_poll_add(display_poll, rx2_rssi, "voltage1", false);
+		if (tx_rssi_available)
+			rssi_poll_add(display_poll, tx2_rssi, "voltage1", true);
+		poll_set_add_widget(display_poll, &rx_widgets[rx2_gain]);
+	}
+}
+
+static void rssi_label_mapped_cb(GtkWidget *label, gpointer data)
+{
+	if (display_poll)
+		display_poll_start();
+}
+
+static void rssi_label_connect(GtkWidget *label)
+{
+	g_signal_connect_after(label, "map",
+		G_CALLBACK(rssi_label_mapped_cb), NULL);
+	g_signal_connect_after(label, "unmap",
+		G_CALLBACK(rssi_label_mapped_cb), NULL);
 }
 
 const double RX_CENTER_FREQ = 340; /* MHz */
@@ -2028,7 +2097,11 @@ static GtkWidget * fmcomms2_init(struct osc_plugin *plugin, GtkWidget *notebook,
 	if (!dac_tx_manager)
 		gtk_widget_hide(gtk_widget_get_parent(section_setting[SECTION_FPGA]));
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	rssi_label_connect(rx1_rssi);
+	rssi_label_connect(rx2_rssi);
+	rssi_label_connect(tx1_rssi);
+	rssi_label_connect(tx2_rssi);
+	display_poll_start();
 	can_update_widgets = true;
 
 	return fmcomms2_panel;
@@ -2100,7 +2173,8 @@ static void save_profile(const struct osc_plugin *plugin, const char *ini_fn)
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 
 	if (ini_fn)
 		save_profile(NULL, ini_fn);
@@ -30,6 +30,7 @@
 #include "../eeprom.h"
 #include "../libini2.h"
 #include "../iio_utils.h"
+#include "../poll_scheduler.h"
 #include "./block_diagram.h"
 #include "dac_data_manager.h"
 #include "fir_filter.h"
@@ -119,6 +120,8 @@ static GtkNotebook *nbook;
 static GtkWidget *fmcomms5_panel;
 static gboolean plugin_detached;
 
+static struct poll_set *display_poll;
+
 static const char *fmcomms5_sr_attribs[] = {
 	PHY_DEVICE1".trx_rate_governor",
 	PHY_DEVICE1".dcxo_tune_coarse",
@@ -512,21 +515,60 @@ static void rssi_update_labels(void)
 	}
 }
 
-static gboolean update_display(gpointer foo)
+static void rssi_poll_label(struct poll_set *set, GtkWidget *label,
+		struct iio_device *dev, const char *chn, bool is_tx)
 {
-	if (this_page == gtk_notebook_get_current_page(nbook) || plugin_detached) {
-		const char *gain_mode;
-		int i;
-
-		rssi_update_labels();
-		for (i = 1; i <= 4; i++) {
-			gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes[i]));
-			if (gain_mode && strcmp(gain_mode, "manual"))
-				iio_widget_update(&rx_widgets[rx_gains[i]]);
-		}
+	const char *value;
+
+	if (!gtk_widget_is_drawable(GTK_WIDGET(label)))
+		return;
+
+	value = poll_set_get_value(set, dev,
+			iio_device_find_channel(dev, chn, is_tx), "rssi", NULL);
+	gtk_label_set_text(GTK_LABEL(label), value ?: "<error>");
+}
+
+static gboolean display_visible(gpointer foo)
+{
+	return this_page == gtk_notebook_get_current_page(nbook) || plugin_detached;
+}
+
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	const char *gain_mode;
+	int i;
+
+	for (i = 1; i <= 4; i++) {
+		const char *chn = (i - 1) % 2 ? "voltage1" : "voltage0";
+		struct iio_device *phy = (i < 3) ? dev1 : dev2;
+
+		rssi_poll_label(set, rx_rssi[i], phy, chn, false);
+		if (tx_rssi_available)
+			rssi_poll_label(set, tx_rssi[i], phy, chn, true);
+
+		gain_mode = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(rx_gain_control_modes[i]));
+		if (gain_mode && strcmp(gain_mode, "manual"))
+			poll_set_update_widget(set, &rx_widgets[rx_gains[i]]);
 	}
+}
+
+static void display_poll_start(void)
+{
+	int i;
+
+	display_poll = poll_set_new(1000, display_visible, update_display, NULL);
 
-	return TRUE;
+	for (i = 1; i <= 4; i++) {
+		const char *chn = (i - 1) % 2 ? "voltage1" : "voltage0";
+		struct iio_device *phy = (i < 3) ? dev1 : dev2;
+
+		poll_set_add_attr(display_poll, phy,
+				iio_device_find_channel(phy, chn, false), "rssi");
+		if (tx_rssi_available)
+			poll_set_add_attr(display_poll, phy,
+					iio_device_find_channel(phy, chn, true), "rssi");
+		poll_set_add_widget(display_poll, &rx_widgets[rx_gains[i]]);
+	}
 }
 
 static void filter_fir_update(void)
@@ -1642,7 +1684,7 @@ static GtkWidget * fmcomms5_init(struct osc_plugin *plugin, GtkWidget *notebook,
 	dac_data_manager_set_buffer_chooser_current_folder(dac_tx_manager, OSC_WAVEFORM_FILE_PATH);
 	dac_data_manager_set_buffer_size_alignment(dac_tx_manager, 16);
 
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	display_poll_start();
 	can_update_widgets = true;
 
 	return fmcomms5_panel;
@@ -1726,7 +1768,8 @@ static void save_profile(const struct osc_plugin *plugin, const char *ini_fn)
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(display_poll);
+	display_poll = NULL;
 
 	if (ini_fn)
 		save_profile(NULL, ini_fn);
@@ -23,6 +23,7 @@
 #include "../iio_widget.h"
 #include "../osc_plugin.h"
 #include "../config.h"
+#include "../poll_scheduler.h"
 #include "../libini2.c"
 
 #define THIS_DRIVER "Motor Control"
@@ -49,6 +50,7 @@ static struct iio_device *crt_device, *pid_devs[2], *adv_dev,
 				*resolver_dev;
 static struct iio_context *ctx;
 static unsigned gpo_mask;
+static struct poll_set *resolver_poll;
 
 /* Global Widgets */
 static GtkWidget *controllers_notebook;
@@ -148,44 +150,35 @@ static void save_widget_value(GtkWidget *widget, struct iio_widget *iio_w)
 	iio_w->save(iio_w);
 }
 
-static gboolean update_display(gpointer foo)
+static gboolean display_visible(gpointer foo)
 {
 	if (this_page != gtk_notebook_get_current_page(nbook) &&
 			!plugin_detached)
-		goto end;
+		return FALSE;
 
 	/* Update values only if "Resolver" tab is selected */
-	if (gtk_notebook_get_current_page(
-			GTK_NOTEBOOK(controllers_notebook)) != 2)
-		goto end;
+	return gtk_notebook_get_current_page(
+			GTK_NOTEBOOK(controllers_notebook)) == 2;
+}
 
-	char buf[1024];
+static void resolver_set_label(struct poll_set *set, GtkWidget *label,
+		const char *chn)
+{
 	struct iio_channel *iio_chn;
-	ssize_t ret;
+	const char *value;
 
-	iio_chn = iio_device_find_channel(resolver_dev, "angl0", false);
+	iio_chn = iio_device_find_channel(resolver_dev, chn, false);
 	if (!iio_chn)
-		goto end;
-	ret = iio_channel_attr_read(iio_chn, "raw", buf, sizeof(buf));
-	if (ret > 0)
-		gtk_label_set_text(GTK_LABEL(resolver_angle), buf);
-	else
-		gtk_label_set_text(GTK_LABEL(resolver_angle), "<error>");
+		return;
 
-	iio_chn = iio_device_find_channel(resolver_dev, "anglvel0",
-			false);
-	if (!iio_chn)
-		goto end;
-	ret = iio_channel_attr_read(iio_chn, "raw", buf, sizeof(buf));
-	if (ret > 0)
-		gtk_label_set_text(GTK_LABEL(resolver_angle_veloc),
-			buf);
-	else
-		gtk_label_set_text(GTK_LABEL(resolver_angle_veloc),
-			"<error>");
+	value = poll_set_get_value(set, resolver_dev, iio_chn, "raw", NULL);
+	gtk_label_set_text(GTK_LABEL(label), value ?: "<error>");
+}
 
-end:
-	return TRUE;
+static void update_display(struct poll_set *set, gpointer foo)
+{
+	resolver_set_label(set, resolver_angle, "angl0");
+	resolver_set_label(set, resolver_angle_veloc, "anglvel0");
 }
 
 static gboolean change_controller_type_label(GBinding *binding,
@@ -528,6 +521,7 @@ static void advanced_controller_init(GtkBuilder *builder)
 
 static void resolver_init(GtkBuilder *builder)
 {
+	struct iio_channel *iio_chn;
 
 	resolver_angle = GTK_WIDGET(gtk_builder_get_object(builder,
 					"resolver_angle"));
@@ -545,7 +539,13 @@ static void resolver_init(GtkBuilder *builder)
 		G_CALLBACK(resolver_resolution_changed_cb), NULL);
 
 	/* Set up a periodic read-only widget update function */
-	g_timeout_add(1000, (GSourceFunc) update_display, ctx);
+	resolver_poll = poll_set_new(1000, display_visible, update_display, NULL);
+	iio_chn = iio_device_find_channel(resolver_dev, "angl0", false);
+	if (iio_chn)
+		poll_set_add_attr(resolver_poll, resolver_dev, iio_chn, "raw");
+	iio_chn = iio_device_find_channel(resolver_dev, "anglvel0", false);
+	if (iio_chn)
+		poll_set_add_attr(resolver_poll, resolver_dev, iio_chn, "raw");
 }
 
 static int motor_control_handle_driver(struct osc_plugin *plugin, const char *attrib, const char *value)
@@ -783,7 +783,8 @@ static void save_profile(const struct osc_plugin *plugin, const char *ini_fn)
 
 static void context_destroy(struct osc_plugin *plugin, const char *ini_fn)
 {
-	g_source_remove_by_user_data(ctx);
+	poll_set_free(resolver_poll);
+	resolver_poll = NULL;
 
 	if (ini_fn)
 		save_profile(NULL, ini_fn);
@@ -0,0 +1,547 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <glib.h>
+#include <math.h>
+#include <matio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "wavefile_loader.h"
+#include "wavefile_text.h"
+#include "dac_pack.h"
+#include "../playback.h"
+
+/* add backwards compat for <matio-1.5.0 */
+#if MATIO_MAJOR_VERSION == 1 && MATIO_MINOR_VERSION < 5
+typedef struct ComplexSplit mat_complex_split_t;
+#endif
+
+/* Enough to tell text files from MAT files */
+#define WAVEFILE_HEADER_SIZE 8
+
+/* Each waveform is loaded this many times, and the fastest run reported */
+#define WAVEFILE_BENCHMARK_RUNS 3
+
+static const char * const format_names[] = {
+	[WAVEFILE_FORMAT_UNKNOWN] = "unknown",
+	[WAVEFILE_FORMAT_TEXT] = "text",
+	[WAVEFILE_FORMAT_MAT] = "mat",
+	[WAVEFILE_FORMAT_BIN] = "bin",
+	[WAVEFILE_FORMAT_SIGMF] = "sigmf",
+};
+
+struct _complex_ref {
+	double *re;
+	double *im;
+};
+
+const char * wavefile_format_name(enum wavefile_format format)
+{
+	if ((unsigned int)format >= G_N_ELEMENTS(format_names))
+		return format_names[WAVEFILE_FORMAT_UNKNOWN];
+
+	return format_names[format];
+}
+
+enum wavefile_format wavefile_detect_format(const char *file_name)
+{
+	char header[WAVEFILE_HEADER_SIZE];
+	size_t len = 0;
+	FILE *f;
+
+	if (g_str_has_suffix(file_name, ".bin"))
+		return WAVEFILE_FORMAT_BIN;
+	if (g_str_has_suffix(file_name, ".sigmf-meta") ||
+			g_str_has_suffix(file_name, ".sigmf-data"))
+		return WAVEFILE_FORMAT_SIGMF;
+
+	f = fopen(file_name, "rb");
+	if (f) {
+		len = fread(header, 1, sizeof(header), f);
+		fclose(f);
+	}
+
+	if (len >= 4 && !strncmp(header, "TEXT", 4))
+		return WAVEFILE_FORMAT_TEXT;
+	/* Level 5 and HDF5 MAT files start with a text header... */
+	if (len >= 6 && !strncmp(header, "MATLAB", 6))
+		return WAVEFILE_FORMAT_MAT;
+	/* ...level 4 ones have none */
+	if (g_str_has_suffix(file_name, ".mat"))
+		return WAVEFILE_FORMAT_MAT;
+
+	return WAVEFILE_FORMAT_UNKNOWN;
+}
+
+/*
+ * Size of the buffer holding @len bytes of waveform: when it is not a
+ * multiple of @alignment, the waveform is repeated until it is.
+ */
+static size_t aligned_size(size_t len, unsigned int alignment)
+{
+	if (!alignment)
+		return len;
+
+	return len * (alignment / dac_pack_gcd(len, alignment));
+}
+
+static bool find_max(const double *val, size_t count, double *max)
+{
+	size_t n;
+
+	for (n = 0; n < count; n++) {
+		if (!isfinite(val[n]))
+			return false;
+		if (fabs(val[n]) > *max)
+			*max = fabs(val[n]);
+	}
+
+	return true;
+}
+
+/*
+ * Fill empty channels with copies of other channels
+ * E.g. (data, NULL, NULL, NULL) becomes (data, data, data, data)
+ * E.g. (data1, data2, NULL, NULL) becomes (data1, data2, data1, data2)
+ * ...
+ */
+static void replicate_tx_data_channels(struct _complex_ref *data, int count)
+{
+	int i, half = count / 2;
+
+	if (!data)
+		return;
+
+	if (count > 2)
+		replicate_tx_data_channels(data, count / 2);
+
+	/* Check if the second half of the array needs to be filled */
+	if (data[half].re == NULL || data[half].im == NULL) {
+		for (i = 0; i < half; i++) {
+			data[half + i].re = data[i].re;
+			data[half + i].im = data[i].im;
+		}
+	}
+}
+
+/*
+ * Scale the parsed samples and pack them the way the DAC buffer expects,
+ * repeating each one as requested by the file. Each DAC channel takes a
+ * column, going around when there are more channels than columns.
+ */
+static int wavefile_load_text(const char *file_name,
+		const struct wavefile_params *params, char **buf, size_t *size)
+{
+	unsigned int i, tx_channels = params->tx_channels;
+	unsigned int sample_size = tx_channels * 2;
+	struct wavefile_text txt;
+	const gfloat *in[8];
+	guint16 *out, *packed;
+	size_t row, len;
+	double scale;
+	int ret;
+
+	ret = wavefile_text_parse(file_name, &txt);
+	if (ret == -ENOEXEC)
+		return -EBADMSG;
+	if (ret)
+		return ret;
+
+	if (!txt.rows) {
+		fprintf(stderr, "ERROR: No 2, 4 or 8 columns of data inside the text file\n");
+		wavefile_text_free(&txt);
+		return -EBADMSG;
+	}
+
+	/* Unscaled samples need to be in the range +- 2047 */
+	if (txt.unscaled)
+		scale = 16.0;	/* scale up to 16-bit */
+	else
+		scale = 32767.0 * params->full_scale / txt.max;
+
+	len = txt.rows * sample_size * txt.repeat;
+	*size = aligned_size(len, params->alignment);
+	*buf = malloc(*size);
+	if (*buf == NULL) {
+		wavefile_text_free(&txt);
+		return -ENOMEM;
+	}
+	out = (guint16 *) *buf;
+
+	for (i = 0; i < tx_channels; i++)
+		in[i] = txt.values + i % txt.columns;
+
+	if (txt.repeat == 1) {
+		dac_pack_float(out, txt.rows, tx_channels, in, txt.columns,
+				scale, params->offset);
+	} else {
+		/* Convert each sample once, then copy it for the repetitions */
+		packed = g_new(guint16, txt.rows * tx_channels);
+		dac_pack_float(packed, txt.rows, tx_channels, in, txt.columns,
+				scale, params->offset);
+
+		for (row = 0; row < txt.rows; row++) {
+			memcpy(out, packed + row * tx_channels, sample_size);
+			dac_pack_replicate(out, sample_size, sample_size * txt.repeat);
+			out += tx_channels * txt.repeat;
+		}
+		g_free(packed);
+	}
+
+	/* When we are in 1 TX mode it is possible that the number of bytes
+	 * is not a multiple of 8, but only a multiple of 4. In this case
+	 * we'll send the same buffer twice to make sure that it becomes a
+	 * multiple of 8. (default alignment)
+	 */
+	dac_pack_replicate(*buf, len, *size);
+
+	wavefile_text_free(&txt);
+
+	return 0;
+}
+
+/* Is it a MATLAB file?
+ * http://na-wiki.csc.kth.se/mediawiki/index.php/MatIO
+ */
+static int wavefile_load_mat(const char *file_name,
+		const struct wavefile_params *params, char **buf, size_t *size)
+{
+	struct _complex_ref tx_data[4] = {{NULL, NULL}, {NULL, NULL}, {NULL, NULL}, {NULL, NULL}};
+	unsigned int i, j, nb_vars = 0, tx_channels = params->tx_channels;
+	bool complex_format = false, real_format = false, valid;
+	matvar_t *matvars[8], *var;
+	const double *mat_in[8];
+	size_t length = 0, len;
+	double max = 0.0, scale;
+	mat_t *matfp;
+	int ret = -EBADMSG;
+
+	matfp = Mat_Open(file_name, MAT_ACC_RDONLY);
+	if (matfp == NULL) {
+		fprintf(stderr, "ERROR: Could not open %s as a matlab file\n", file_name);
+		return -EBADMSG;
+	}
+
+	while (nb_vars < tx_channels && (var = Mat_VarReadNextInfo(matfp)) != NULL) {
+		matvars[nb_vars++] = var;
+
+		/* must be a vector */
+		if (var->rank != 2 || (var->dims[0] > 1 && var->dims[1] > 1)) {
+			fprintf(stderr, "ERROR: Data inside the matlab file must be a vector\n");
+			goto out;
+		}
+		/* should be a double */
+		if (var->class_type != MAT_C_DOUBLE) {
+			fprintf(stderr, "ERROR: Data inside the matlab file must be of type double\n");
+			goto out;
+		}
+
+		len = var->dims[0] * var->dims[1];
+		if (nb_vars == 1) {
+			length = len;
+		} else if (len != length) {
+			fprintf(stderr, "ERROR: Vector dimensions in the matlab file don't match\n");
+			goto out;
+		}
+
+		Mat_VarReadDataAll(matfp, var);
+		if (!var->data || !len) {
+			fprintf(stderr, "ERROR: Could not read %s in %s\n", var->name, file_name);
+			goto out;
+		}
+
+		if (var->isComplex) {
+			mat_complex_split_t *complex_data = var->data;
+
+			valid = find_max(complex_data->Re, len, &max) &&
+				(!complex_data->Im || find_max(complex_data->Im, len, &max));
+			complex_format = true;
+		} else {
+			valid = find_max(var->data, len, &max);
+			real_format = true;
+		}
+
+		if (!valid) {
+			fprintf(stderr, "ERROR: Data inside the matlab file must be finite\n");
+			goto out;
+		}
+	}
+
+	if (!nb_vars) {
+		fprintf(stderr, "ERROR: Could not find any valid data in %s\n", file_name);
+		goto out;
+	}
+
+	if (complex_format && real_format) {
+		fprintf(stderr, "ERROR: Both complex and real data formats in the same matlab file are not supported\n");
+		goto out;
+	}
+
+	if (max <= 1.0)
+		max = 1.0;
+
+	scale = 32767.0 * params->full_scale / max;
+
+	if (complex_format) {
+		for (i = 0; i < nb_vars && i < G_N_ELEMENTS(tx_data); i++) {
+			mat_complex_split_t *complex_data = matvars[i]->data;
+
+			tx_data[i].re = complex_data->Re;
+			tx_data[i].im = complex_data->Im;
+		}
+	} else {
+		for (i = 0; i < nb_vars; i++) {
+			if (i % 2)
+				tx_data[i / 2].im = matvars[i]->data;
+			else
+				tx_data[i / 2].re = matvars[i]->data;
+		}
+	}
+	replicate_tx_data_channels(tx_data, MAX(tx_channels / 2, 1));
+
+	/*
+	 * I/Q pairs are laid out in order, except with 8 channels where the
+	 * first sample word holds the last two pairs.
+	 */
+	for (i = 0; i < tx_channels; i++) {
+		j = i / 2;
+		if (tx_channels == 8)
+			j = (j + 2) % 4;
+		mat_in[i] = (i % 2 && tx_data[j].im) ? tx_data[j].im : tx_data[j].re;
+	}
+
+	len = length * tx_channels * 2;
+	*size = aligned_size(len, params->alignment);
+	*buf = malloc(*size);
+	if (*buf == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	dac_pack_double((guint16 *) *buf, length, tx_channels, mat_in, 1,
+			scale, params->offset);
+	dac_pack_replicate(*buf, len, *size);
+	ret = 0;
+
+out:
+	for (i = 0; i < nb_vars; i++)
+		Mat_VarFree(matvars[i]);
+	Mat_Close(matfp);
+
+	return ret;
+}
+
+/*
+ * SigMF recordings are read with the playback code, which maps the data
+ * file. Complex recordings give I and Q channels, and integer samples are
+ * taken relative to the full scale of their type.
+ */
+static int wavefile_load_sigmf(const char *file_name,
+		const struct wavefile_params *params, char **buf, size_t *size)
+{
+	unsigned int i, tx_channels = params->tx_channels;
+	struct playback *pb;
+	gfloat **columns;
+	const gfloat *in[8];
+	double max = 0.0, scale;
+	size_t n, len;
+	int ret = -EBADMSG;
+
+	pb = playback_open(file_name);
+	if (!pb)
+		return -EBADMSG;
+
+	columns = g_new0(gfloat *, pb->num_channels);
+	for (i = 0; i < pb->num_channels; i++) {
+		columns[i] = g_new(gfloat, pb->length);
+		playback_read(pb, i, columns[i], pb->length);
+
+		for (n = 0; n < pb->length; n++) {
+			if (!isfinite(columns[i][n])) {
+				fprintf(stderr, "ERROR: Samples of %s must be finite\n", file_name);
+				goto out;
+			}
+			if (fabsf(columns[i][n]) > max)
+				max = fabsf(columns[i][n]);
+		}
+	}
+
+	if (pb->int16)
+		max = 32767.0;
+	else if (max <= 1.0)
+		max = 1.0;
+
+	scale = 32767.0 * params->full_scale / max;
+
+	for (i = 0; i < tx_channels; i++)
+		in[i] = columns[i % pb->num_channels];
+
+	len = pb->length * tx_channels * 2;
+	*size = aligned_size(len, params->alignment);
+	*buf = malloc(*size);
+	if (*buf == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	dac_pack_float((guint16 *) *buf, pb->length, tx_channels, in, 1,
+			scale, params->offset);
+	dac_pack_replicate(*buf, len, *size);
+	ret = 0;
+
+out:
+	for (i = 0; i < pb->num_channels; i++)
+		g_free(columns[i]);
+	g_free(columns);
+	playback_close(pb);
+
+	return ret;
+}
+
+static int wavefile_load_bin(const char *file_name, char **buf, size_t *size)
+{
+	struct stat st;
+	FILE *f;
+	int ret;
+
+	f = fopen(file_name, "rb");
+	if (!f)
+		return -errno;
+
+	if (fstat(fileno(f), &st) < 0) {
+		ret = -errno;
+		fclose(f);
+		return ret;
+	}
+
+	if (!st.st_size) {
+		fprintf(stderr, "ERROR: %s is empty\n", file_name);
+		fclose(f);
+		return -EBADMSG;
+	}
+
+	*buf = malloc(st.st_size);
+	if (*buf == NULL) {
+		fclose(f);
+		return -ENOMEM;
+	}
+
+	if (fread(*buf, 1, st.st_size, f) != (size_t)st.st_size) {
+		free(*buf);
+		*buf = NULL;
+		fclose(f);
+		return -EIO;
+	}
+	fclose(f);
+
+	*size = st.st_size;
+
+	return 0;
+}
+
+int wavefile_load(const char *file_name, const struct wavefile_params *params,
+		char **buf, size_t *size)
+{
+	enum wavefile_format format = wavefile_detect_format(file_name);
+
+	*buf = NULL;
+	*size = 0;
+
+	if (format == WAVEFILE_FORMAT_BIN)
+		return wavefile_load_bin(file_name, buf, size);
+
+	if (params->tx_channels < 1 || params->tx_channels > 8)
+		return -EINVAL;
+
+	switch (format) {
+	case WAVEFILE_FORMAT_TEXT:
+		return wavefile_load_text(file_name, params, buf, size);
+	case WAVEFILE_FORMAT_MAT:
+		return wavefile_load_mat(file_name, params, buf, size);
+	case WAVEFILE_FORMAT_SIGMF:
+		return wavefile_load_sigmf(file_name, params, buf, size);
+	default:
+		if (!g_file_test(file_name, G_FILE_TEST_IS_REGULAR))
+			return -ENOENT;
+		fprintf(stderr, "ERROR: Unknown waveform format for %s\n", file_name);
+		return -EBADMSG;
+	}
+}
+
+/*
+ * Load every waveform of @dir, such as the waveforms/ directory of osc,
+ * and report the fastest of a few runs for each. Returns the number of
+ * files that could not be loaded, or a negative error code.
+ */
+int wavefile_benchmark(const char *dir, const struct wavefile_params *params,
+		FILE *out)
+{
+	GSList *names = NULL, *node;
+	enum wavefile_format format;
+	const char *name;
+	gint64 start, best;
+	unsigned int run;
+	int failed = 0, ret;
+	struct stat st;
+	size_t size;
+	char *buf, *path;
+	GDir *d;
+
+	d = g_dir_open(dir, 0, NULL);
+	if (!d) {
+		fprintf(stderr, "Unable to open %s\n", dir);
+		return -ENOENT;
+	}
+
+	while ((name = g_dir_read_name(d)))
+		names = g_slist_insert_sorted(names, g_strdup(name),
+				(GCompareFunc) strcmp);
+	g_dir_close(d);
+
+	fprintf(out, "%-48s %-6s %12s %10s %10s\n",
+			"waveform", "format", "bytes", "ms", "MB/s");
+
+	for (node = names; node; node = g_slist_next(node)) {
+		path = g_build_filename(dir, node->data, NULL);
+		format = wavefile_detect_format(path);
+
+		if (format == WAVEFILE_FORMAT_UNKNOWN || stat(path, &st) < 0 ||
+				!S_ISREG(st.st_mode)) {
+			g_free(path);
+			continue;
+		}
+
+		best = G_MAXINT64;
+		for (run = 0; run < WAVEFILE_BENCHMARK_RUNS; run++) {
+			start = g_get_monotonic_time();
+			ret = wavefile_load(path, params, &buf, &size);
+			best = MIN(best, g_get_monotonic_time() - start);
+			free(buf);
+			if (ret < 0)
+				break;
+		}
+
+		if (ret < 0) {
+			fprintf(out, "%-48s %-6s %s\n", (char *)node->data,
+					wavefile_format_name(format), strerror(-ret));
+			failed++;
+		} else {
+			fprintf(out, "%-48s %-6s %12lld %10.3f %10.1f\n",
+					(char *)node->data, wavefile_format_name(format),
+					(long long)st.st_size, best / 1000.0,
+					best ? (double)st.st_size / best : 0.0);
+		}
+		g_free(path);
+	}
+
+	g_slist_free_full(names, g_free);
+
+	return failed;
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __WAVEFILE_LOADER_H__
+#define __WAVEFILE_LOADER_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * TX waveform files, converted to the content of a DAC buffer: one 16-bit
+ * word per DAC channel for each sample. The format is detected from the
+ * content of the file, or from its name when there is no header:
+ *  - text files start with a TEXT or TEXTU header (see wavefile_text.h),
+ *  - MAT files hold one double vector per channel, real or complex,
+ *  - SigMF recordings are named .sigmf-meta or .sigmf-data,
+ *  - .bin files already hold the DAC buffer and are used as they are.
+ */
+enum wavefile_format {
+	WAVEFILE_FORMAT_UNKNOWN,
+	WAVEFILE_FORMAT_TEXT,
+	WAVEFILE_FORMAT_MAT,
+	WAVEFILE_FORMAT_BIN,
+	WAVEFILE_FORMAT_SIGMF,
+};
+
+struct wavefile_params {
+	/* DAC channels in the buffer, from 1 to 8 */
+	unsigned int tx_channels;
+	/* Peak of the converted samples, relative to the DAC full scale */
+	double full_scale;
+	/* Added to every sample, for offset binary DACs */
+	double offset;
+	/* The size of the buffer is a multiple of this number of bytes */
+	unsigned int alignment;
+};
+
+enum wavefile_format wavefile_detect_format(const char *file_name);
+const char * wavefile_format_name(enum wavefile_format format);
+
+/*
+ * Returns 0 and a buffer to release with free(), -EBADMSG when the content
+ * of the file is not a valid waveform, or another negative error code.
+ */
+int wavefile_load(const char *file_name, const struct wavefile_params *params,
+		char **buf, size_t *size);
+
+int wavefile_benchmark(const char *dir, const struct wavefile_params *params,
+		FILE *out);
+
+#endif /* __WAVEFILE_LOADER_H__ */
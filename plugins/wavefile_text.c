@@ -0,0 +1,362 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "wavefile_text.h"
+
+#define WAVEFILE_MAX_COLUMNS 8
+#define WAVEFILE_MAX_THREADS 8
+/* Files smaller than this are parsed by the calling thread alone */
+#define WAVEFILE_CHUNK_MIN_SIZE (256 * 1024)
+
+struct wavefile_chunk {
+	const char *start;
+	const char *end;
+
+	gfloat *values;
+	size_t size;
+	size_t rows;
+	unsigned int columns;
+	double max;
+	int ret;
+};
+
+static const double pow10_table[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* Anything the fast path doesn't handle (inf, nan, hex, ...) goes here */
+static bool parse_double_slow(const char **str, const char *end, double *val)
+{
+	char tmp[64], *endptr;
+	size_t len = MIN((size_t)(end - *str), sizeof(tmp) - 1);
+
+	memcpy(tmp, *str, len);
+	tmp[len] = '\0';
+
+	*val = g_ascii_strtod(tmp, &endptr);
+	if (endptr == tmp)
+		return false;
+
+	*str += endptr - tmp;
+	return true;
+}
+
+/*
+ * Parse a decimal number in [str, end). The digits are accumulated as an
+ * integer and scaled once by an exact power of ten, which is as accurate
+ * as strtod for the up to 19 significant digits found in waveform files.
+ */
+bool wavefile_parse_double(const char **str, const char *end, double *val)
+{
+	const char *p = *str;
+	uint64_t mantissa = 0;
+	int digits = 0, exp10 = 0, exp = 0;
+	bool negative = false, exp_negative = false, any = false;
+	double v;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				digits++;
+		} else {
+			exp10++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa)
+					digits++;
+				exp10--;
+			}
+		}
+	}
+
+	if (!any)
+		return parse_double_slow(str, end, val);
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *e = p + 1;
+
+		if (e < end && (*e == '-' || *e == '+'))
+			exp_negative = *e++ == '-';
+		if (e < end && *e >= '0' && *e <= '9') {
+			for (; e < end && *e >= '0' && *e <= '9'; e++)
+				if (exp < 10000)
+					exp = exp * 10 + (*e - '0');
+			exp10 += exp_negative ? -exp : exp;
+			p = e;
+		}
+	}
+
+	if (exp10 < -22 || exp10 > 22 || mantissa > (1ULL << 53))
+		return parse_double_slow(str, end, val);
+
+	v = (double)mantissa;
+	if (exp10 < 0)
+		v /= pow10_table[-exp10];
+	else
+		v *= pow10_table[exp10];
+
+	*val = negative ? -v : v;
+	*str = p;
+	return true;
+}
+
+static void chunk_push_row(struct wavefile_chunk *chunk, const double *vals,
+		unsigned int n)
+{
+	unsigned int i;
+
+	if ((chunk->rows + 1) * n > chunk->size) {
+		chunk->size = MAX(chunk->size * 2, 1024 * n);
+		chunk->values = g_renew(gfloat, chunk->values, chunk->size);
+	}
+
+	for (i = 0; i < n; i++) {
+		chunk->values[chunk->rows * n + i] = (gfloat)vals[i];
+		if (fabs(vals[i]) > chunk->max)
+			chunk->max = fabs(vals[i]);
+	}
+	chunk->rows++;
+}
+
+static gpointer wavefile_chunk_parse(gpointer data)
+{
+	struct wavefile_chunk *chunk = data;
+	const char *p = chunk->start, *end = chunk->end;
+	double vals[WAVEFILE_MAX_COLUMNS];
+
+	while (p < end) {
+		unsigned int n = 0;
+
+		while (true) {
+			/* Skip white space */
+			while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+				p++;
+
+			if (p == end || *p == '\n' || *p == '\r')
+				break;
+
+			if (n == WAVEFILE_MAX_COLUMNS) {
+				/* Extra values are ignored, as they always were */
+				while (p < end && *p != '\n')
+					p++;
+				break;
+			}
+
+			if (!wavefile_parse_double(&p, end, &vals[n++])) {
+				chunk->ret = -EBADMSG;
+				return NULL;
+			}
+		}
+
+		/* Move to the next line */
+		while (p < end && *p != '\n')
+			p++;
+		if (p < end)
+			p++;
+
+		if (n == 0)
+			continue;
+
+		if (!(n == 2 || n == 4 || n == 8) ||
+				(chunk->columns && n != chunk->columns)) {
+			fprintf(stderr, "ERROR: No 2, 4 or 8 columns of data inside the text file\n");
+			chunk->ret = -EBADMSG;
+			return NULL;
+		}
+
+		chunk->columns = n;
+		chunk_push_row(chunk, vals, n);
+	}
+
+	return NULL;
+}
+
+static const char * map_file(const char *file_name, size_t *size, void **map)
+{
+#ifndef _WIN32
+	struct stat st;
+	int fd;
+
+	fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*size = st.st_size;
+	*map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (*map == MAP_FAILED) {
+		*map = NULL;
+		return NULL;
+	}
+#else
+	gchar *contents;
+	gsize len;
+
+	if (!g_file_get_contents(file_name, &contents, &len, NULL)) {
+		errno = ENOENT;
+		return NULL;
+	}
+	if (!len) {
+		g_free(contents);
+		errno = EINVAL;
+		return NULL;
+	}
+	*size = len;
+	*map = contents;
+#endif
+
+	return *map;
+}
+
+static void unmap_file(void *map, size_t size)
+{
+#ifndef _WIN32
+	munmap(map, size);
+#else
+	g_free(map);
+#endif
+}
+
+/*
+ * Parse a text waveform in a single pass over the memory-mapped file.
+ * Big files are cut on line boundaries and parsed by several threads.
+ * Returns 0 on success, -ENOEXEC if the file is not a text waveform,
+ * -EBADMSG if its data can't be parsed or a negative errno code.
+ */
+int wavefile_text_parse(const char *file_name, struct wavefile_text *txt)
+{
+	struct wavefile_chunk chunks[WAVEFILE_MAX_THREADS];
+	GThread *threads[WAVEFILE_MAX_THREADS];
+	const char *data, *p, *end, *eol;
+	unsigned int i, n;
+	size_t size, offset;
+	void *map;
+	char header[64];
+	int ret = 0, rep;
+
+	memset(txt, 0, sizeof(*txt));
+
+	data = map_file(file_name, &size, &map);
+	if (!data)
+		return -errno;
+	end = data + size;
+
+	if (size < 4 || strncmp(data, "TEXT", 4)) {
+		unmap_file(map, size);
+		return -ENOEXEC;
+	}
+
+	eol = memchr(data, '\n', size);
+	if (!eol)
+		eol = end;
+
+	/* Unscaled samples need to be in the range +- 2047 */
+	txt->unscaled = size >= 5 && data[4] == 'U';
+	snprintf(header, sizeof(header), "%.*s", (int)(eol - data), data);
+	if (sscanf(header, "TEXT%*c REPEAT %d", &rep) != 1 || rep < 1)
+		rep = 1;
+	txt->repeat = rep;
+
+	p = eol < end ? eol + 1 : end;
+
+	n = 1;
+	if ((size_t)(end - p) >= WAVEFILE_CHUNK_MIN_SIZE)
+		n = MIN(MAX(g_get_num_processors(), 1), WAVEFILE_MAX_THREADS);
+
+	memset(chunks, 0, sizeof(chunks));
+	for (i = 0; i < n; i++) {
+		chunks[i].start = p;
+		if (i == n - 1) {
+			chunks[i].end = end;
+		} else {
+			offset = (end - p) / (n - i);
+			eol = memchr(p + offset, '\n', end - p - offset);
+			chunks[i].end = eol ? eol + 1 : end;
+		}
+		p = chunks[i].end;
+	}
+
+	for (i = 1; i < n; i++)
+		threads[i] = g_thread_new("wavefile-parse",
+				wavefile_chunk_parse, &chunks[i]);
+	wavefile_chunk_parse(&chunks[0]);
+	for (i = 1; i < n; i++)
+		g_thread_join(threads[i]);
+
+	unmap_file(map, size);
+
+	/* Stitch the chunks back together */
+	for (i = 0; i < n; i++) {
+		if (chunks[i].ret) {
+			ret = chunks[i].ret;
+			continue;
+		}
+		if (!chunks[i].rows)
+			continue;
+		if (txt->columns && chunks[i].columns != txt->columns) {
+			fprintf(stderr, "ERROR: No 2, 4 or 8 columns of data inside the text file\n");
+			ret = -EBADMSG;
+			continue;
+		}
+		txt->columns = chunks[i].columns;
+		txt->rows += chunks[i].rows;
+		txt->max = MAX(txt->max, chunks[i].max);
+	}
+
+	if (!ret) {
+		txt->values = g_new(gfloat, MAX(txt->rows, 1) * MAX(txt->columns, 1));
+		for (i = 0, offset = 0; i < n; i++) {
+			size_t len = chunks[i].rows * txt->columns;
+
+			memcpy(txt->values + offset, chunks[i].values,
+					len * sizeof(gfloat));
+			offset += len;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		g_free(chunks[i].values);
+
+	return ret;
+}
+
+void wavefile_text_free(struct wavefile_text *txt)
+{
+	g_free(txt->values);
+	txt->values = NULL;
+	txt->rows = 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __WAVEFILE_TEXT_H__
+#define __WAVEFILE_TEXT_H__
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Text waveforms start with a "TEXT" (or "TEXTU" for samples that are not
+ * scaled yet) header, optionally followed by "REPEAT <n>", then one line
+ * per sample with 2, 4 or 8 values separated by spaces, tabs or commas.
+ */
+struct wavefile_text {
+	gfloat *values;
+	unsigned int columns;
+	size_t rows;
+	unsigned int repeat;
+	bool unscaled;
+	/* Largest absolute value */
+	double max;
+};
+
+int wavefile_text_parse(const char *file_name, struct wavefile_text *txt);
+void wavefile_text_free(struct wavefile_text *txt);
+bool wavefile_parse_double(const char **str, const char *end, double *val);
+
+#endif /* __WAVEFILE_TEXT_H__ */
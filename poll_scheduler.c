@@ -0,0 +1,366 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "poll_scheduler.h"
+
+/* Period of the timer shared by all the poll sets */
+#define POLL_TICK_MS 250
+#define POLL_VALUE_MAX 1024
+
+struct poll_attr {
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	char *attr;
+	bool remote;
+};
+
+struct poll_set {
+	/* Interval, and ticks left until the next poll */
+	unsigned int ticks;
+	unsigned int countdown;
+
+	gboolean (*visible)(gpointer data);
+	void (*apply)(struct poll_set *set, gpointer data);
+	gpointer data;
+
+	GArray *attrs;
+	/* Job being applied, during the apply callback */
+	struct poll_job *job;
+};
+
+/* What is read from a device or a channel, for all the sets of a job */
+struct poll_source {
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	bool remote;
+	/* Attribute names, owned by the sets */
+	GPtrArray *attrs;
+	/* Attribute name -> GByteArray with the value */
+	GHashTable *values;
+};
+
+struct poll_job {
+	GPtrArray *sets;
+	/* Device or channel -> struct poll_source */
+	GHashTable *sources;
+};
+
+static GList *poll_sets;
+static guint poll_timer;
+static GThreadPool *poll_pool;
+
+/* Job handed to the worker, until it is applied in the main loop */
+static struct poll_job *poll_job;
+/* Set while the worker uses the devices, which must stay alive */
+static bool poll_reading;
+static GMutex poll_lock;
+static GCond poll_cond;
+
+static void byte_array_free(gpointer data)
+{
+	g_byte_array_free(data, TRUE);
+}
+
+static void poll_source_free(gpointer data)
+{
+	struct poll_source *src = data;
+
+	g_ptr_array_free(src->attrs, TRUE);
+	g_hash_table_destroy(src->values);
+	g_free(src);
+}
+
+static struct poll_job * poll_job_new(void)
+{
+	struct poll_job *job = g_new0(struct poll_job, 1);
+
+	job->sets = g_ptr_array_new();
+	job->sources = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, poll_source_free);
+
+	return job;
+}
+
+static void poll_job_free(struct poll_job *job)
+{
+	g_ptr_array_free(job->sets, TRUE);
+	g_hash_table_destroy(job->sources);
+	g_free(job);
+}
+
+static void poll_job_add_set(struct poll_job *job, struct poll_set *set)
+{
+	unsigned int i;
+
+	g_ptr_array_add(job->sets, set);
+
+	for (i = 0; i < set->attrs->len; i++) {
+		struct poll_attr *pa = &g_array_index(set->attrs,
+				struct poll_attr, i);
+		gpointer key = pa->chn ? (gpointer)pa->chn : (gpointer)pa->dev;
+		struct poll_source *src = g_hash_table_lookup(job->sources, key);
+
+		if (!src) {
+			src = g_new0(struct poll_source, 1);
+			src->dev = pa->dev;
+			src->chn = pa->chn;
+			src->remote = pa->remote;
+			src->attrs = g_ptr_array_new();
+			src->values = g_hash_table_new_full(g_str_hash,
+					g_str_equal, g_free, byte_array_free);
+			g_hash_table_insert(job->sources, key, src);
+		}
+
+		g_ptr_array_add(src->attrs, pa->attr);
+	}
+}
+
+static void poll_source_store(struct poll_source *src, const char *attr,
+		const char *value, size_t len)
+{
+	GByteArray *array = g_byte_array_sized_new(len + 1);
+
+	/* Values are used as strings, even when they come unterminated */
+	g_byte_array_append(array, (const guint8 *)value, len);
+	g_byte_array_append(array, (const guint8 *)"", 1);
+	array->len--;
+
+	g_hash_table_replace(src->values, g_strdup(attr), array);
+}
+
+static int poll_dev_cb(struct iio_device *dev, const char *attr,
+		const char *value, size_t len, void *d)
+{
+	poll_source_store(d, attr, value, len);
+	return 0;
+}
+
+static int poll_chn_cb(struct iio_channel *chn, const char *attr,
+		const char *value, size_t len, void *d)
+{
+	poll_source_store(d, attr, value, len);
+	return 0;
+}
+
+static void poll_source_read(struct poll_source *src)
+{
+	char buf[POLL_VALUE_MAX];
+	unsigned int i;
+	ssize_t ret;
+
+	if (src->remote) {
+		if (src->chn)
+			ret = iio_channel_attr_read_all(src->chn, poll_chn_cb, src);
+		else
+			ret = iio_device_attr_read_all(src->dev, poll_dev_cb, src);
+		if (ret >= 0)
+			return;
+	}
+
+	for (i = 0; i < src->attrs->len; i++) {
+		const char *attr = g_ptr_array_index(src->attrs, i);
+
+		if (g_hash_table_contains(src->values, attr))
+			continue;
+
+		if (src->chn)
+			ret = iio_channel_attr_read(src->chn, attr, buf, sizeof(buf));
+		else
+			ret = iio_device_attr_read(src->dev, attr, buf, sizeof(buf));
+		if (ret > 0)
+			poll_source_store(src, attr, buf, ret);
+	}
+}
+
+static gboolean poll_apply(gpointer data)
+{
+	struct poll_job *job = data;
+	unsigned int i;
+
+	for (i = 0; i < job->sets->len; i++) {
+		struct poll_set *set = g_ptr_array_index(job->sets, i);
+
+		/* The set may have been released while it was read */
+		if (!g_list_find(poll_sets, set))
+			continue;
+
+		set->job = job;
+		set->apply(set, set->data);
+		if (g_list_find(poll_sets, set))
+			set->job = NULL;
+	}
+
+	poll_job = NULL;
+	poll_job_free(job);
+
+	return FALSE;
+}
+
+static void poll_worker(gpointer data, gpointer user_data)
+{
+	struct poll_job *job = data;
+	GHashTableIter iter;
+	gpointer src;
+
+	g_hash_table_iter_init(&iter, job->sources);
+	while (g_hash_table_iter_next(&iter, NULL, &src))
+		poll_source_read(src);
+
+	g_mutex_lock(&poll_lock);
+	poll_reading = false;
+	g_cond_broadcast(&poll_cond);
+	g_mutex_unlock(&poll_lock);
+
+	g_idle_add(poll_apply, job);
+}
+
+static gboolean poll_tick(gpointer data)
+{
+	struct poll_job *job = NULL;
+	GList *node;
+
+	/* The previous job isn't done yet: its sets will be late */
+	if (poll_job)
+		return TRUE;
+
+	for (node = poll_sets; node; node = node->next) {
+		struct poll_set *set = node->data;
+
+		if (set->countdown > 1) {
+			set->countdown--;
+			continue;
+		}
+
+		/* Hidden sets stay due, and are read once they are shown */
+		if (set->visible && !set->visible(set->data))
+			continue;
+
+		set->countdown = set->ticks;
+		if (!job)
+			job = poll_job_new();
+		poll_job_add_set(job, set);
+	}
+
+	if (job) {
+		poll_job = job;
+		poll_reading = true;
+		g_thread_pool_push(poll_pool, job, NULL);
+	}
+
+	return TRUE;
+}
+
+struct poll_set * poll_set_new(unsigned int interval_ms,
+		gboolean (*visible)(gpointer data),
+		void (*apply)(struct poll_set *set, gpointer data),
+		gpointer data)
+{
+	struct poll_set *set;
+
+	if (!poll_pool)
+		poll_pool = g_thread_pool_new(poll_worker, NULL, 1, FALSE, NULL);
+
+	set = g_new0(struct poll_set, 1);
+	set->ticks = MAX(1, (interval_ms + POLL_TICK_MS - 1) / POLL_TICK_MS);
+	set->countdown = 1;
+	set->visible = visible;
+	set->apply = apply;
+	set->data = data;
+	set->attrs = g_array_new(FALSE, FALSE, sizeof(struct poll_attr));
+
+	poll_sets = g_list_append(poll_sets, set);
+	if (!poll_timer)
+		poll_timer = g_timeout_add(POLL_TICK_MS, poll_tick, NULL);
+
+	return set;
+}
+
+void poll_set_free(struct poll_set *set)
+{
+	unsigned int i;
+
+	if (!set)
+		return;
+
+	poll_sets = g_list_remove(poll_sets, set);
+	if (!poll_sets && poll_timer) {
+		g_source_remove(poll_timer);
+		poll_timer = 0;
+	}
+
+	/* The devices of the set may be destroyed once it is released */
+	g_mutex_lock(&poll_lock);
+	while (poll_reading)
+		g_cond_wait(&poll_cond, &poll_lock);
+	g_mutex_unlock(&poll_lock);
+
+	for (i = 0; i < set->attrs->len; i++)
+		g_free(g_array_index(set->attrs, struct poll_attr, i).attr);
+	g_array_free(set->attrs, TRUE);
+	g_free(set);
+}
+
+void poll_set_add_attr(struct poll_set *set, struct iio_device *dev,
+		struct iio_channel *chn, const char *attr)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct poll_attr pa = {
+		.dev = dev,
+		.chn = chn,
+		.attr = g_strdup(attr),
+		.remote = !!strcmp(iio_context_get_name(ctx), "local"),
+	};
+
+	g_array_append_val(set->attrs, pa);
+}
+
+void poll_set_add_widget(struct poll_set *set, struct iio_widget *widget)
+{
+	poll_set_add_attr(set, widget->dev, widget->chn, widget->attr_name);
+}
+
+const char * poll_set_get_value(struct poll_set *set,
+		struct iio_device *dev, struct iio_channel *chn,
+		const char *attr, size_t *len)
+{
+	gpointer key = chn ? (gpointer)chn : (gpointer)dev;
+	struct poll_source *src;
+	GByteArray *value;
+
+	if (!set->job)
+		return NULL;
+
+	src = g_hash_table_lookup(set->job->sources, key);
+	if (!src)
+		return NULL;
+
+	value = g_hash_table_lookup(src->values, attr);
+	if (!value)
+		return NULL;
+
+	if (len)
+		*len = value->len;
+	return (const char *)value->data;
+}
+
+gboolean poll_set_update_widget(struct poll_set *set,
+		struct iio_widget *widget)
+{
+	const char *value;
+	size_t len;
+
+	value = poll_set_get_value(set, widget->dev, widget->chn,
+			widget->attr_name, &len);
+	if (!value)
+		return FALSE;
+
+	widget->update_value(widget, value, len);
+	return TRUE;
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __POLL_SCHEDULER_H__
+#define __POLL_SCHEDULER_H__
+
+#include <glib.h>
+#include <iio.h>
+
+#include "iio_widget.h"
+
+/*
+ * Periodic readings of attributes, shared by all the plugins. A poll set
+ * is a group of attributes read at a given interval, as long as its page
+ * is visible. A single main-loop timer drives every set: intervals are
+ * rounded to its tick, so sets due together are read together. The reads
+ * are done on a worker thread, one device or channel at a time: all its
+ * attributes at once on remote contexts, where a round trip costs more
+ * than a read, and only the attributes polled on local ones. The values
+ * are then handed to the sets, in a single main-loop callback.
+ */
+struct poll_set;
+
+struct poll_set * poll_set_new(unsigned int interval_ms,
+		gboolean (*visible)(gpointer data),
+		void (*apply)(struct poll_set *set, gpointer data),
+		gpointer data);
+void poll_set_free(struct poll_set *set);
+
+void poll_set_add_attr(struct poll_set *set, struct iio_device *dev,
+		struct iio_channel *chn, const char *attr);
+void poll_set_add_widget(struct poll_set *set, struct iio_widget *widget);
+
+/* Only valid in the apply callback: the values just read, NULL if unread */
+const char * poll_set_get_value(struct poll_set *set,
+		struct iio_device *dev, struct iio_channel *chn,
+		const char *attr, size_t *len);
+gboolean poll_set_update_widget(struct poll_set *set,
+		struct iio_widget *widget);
+
+#endif /* __POLL_SCHEDULER_H__ */
@@ -0,0 +1,354 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile_log.h"
+
+/* stdio buffer of each log file, flushed when it is full or closed */
+#define PROFILE_LOG_BUFFER_SIZE (64 * 1024)
+
+enum profile_log_format {
+	PROFILE_LOG_LEGACY,
+	PROFILE_LOG_CSV,
+	PROFILE_LOG_JSON,
+};
+
+struct log_file {
+	FILE *f;
+	char *buf;
+	enum profile_log_format format;
+
+	/* Column names, and the values of the current row in the same order */
+	GPtrArray *columns;
+	GPtrArray *row;
+	unsigned int filled;
+	gint64 row_time;
+
+	/* CSV columns can't change once the first row is written */
+	bool columns_done;
+	bool has_header;
+};
+
+struct profile_log {
+	GHashTable *files;
+	gint64 start_time;
+	char *tag;
+};
+
+gchar * profile_log_expand_path(const char *path)
+{
+	const char *wave = strstr(path, "~/") ?: strstr(path, "~\\");
+
+	if (wave)
+		return g_build_filename(getenv("HOME") ?: getenv("LOCALAPPDATA"),
+				wave + 2, NULL);
+
+	return g_strdup(path);
+}
+
+static enum profile_log_format format_from_name(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	if (!ext)
+		return PROFILE_LOG_LEGACY;
+	if (!g_ascii_strcasecmp(ext, ".csv"))
+		return PROFILE_LOG_CSV;
+	if (!g_ascii_strcasecmp(ext, ".json") ||
+			!g_ascii_strcasecmp(ext, ".jsonl") ||
+			!g_ascii_strcasecmp(ext, ".ndjson"))
+		return PROFILE_LOG_JSON;
+
+	return PROFILE_LOG_LEGACY;
+}
+
+static void write_csv_field(FILE *f, const char *str)
+{
+	if (!strpbrk(str, ",\"\r\n")) {
+		fputs(str, f);
+		return;
+	}
+
+	fputc('"', f);
+	for (; *str; str++) {
+		if (*str == '"')
+			fputc('"', f);
+		fputc(*str, f);
+	}
+	fputc('"', f);
+}
+
+/* Numbers are written as they were read, other values as strings */
+static bool is_json_number(const char *str)
+{
+	char *end;
+
+	if (!*str || !strchr("-0123456789", *str) ||
+			str[strspn(str, "-+.0123456789eE")])
+		return false;
+
+	g_ascii_strtod(str, &end);
+	return !*end;
+}
+
+static void write_json_value(FILE *f, const char *str)
+{
+	if (is_json_number(str)) {
+		fputs(str, f);
+		return;
+	}
+
+	fputc('"', f);
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void write_header(struct log_file *lf)
+{
+	unsigned int i;
+
+	fputs("time", lf->f);
+	for (i = 0; i < lf->columns->len; i++) {
+		fputc(',', lf->f);
+		write_csv_field(lf->f, g_ptr_array_index(lf->columns, i));
+	}
+	fputc('\n', lf->f);
+}
+
+/* Inserts the tag of the log before the extension of the file name */
+static gchar * tagged_name(const struct profile_log *log, const char *path)
+{
+	gchar *file_name = profile_log_expand_path(path), *tagged;
+	const char *ext, *base;
+
+	if (!log->tag)
+		return file_name;
+
+	base = strrchr(file_name, G_DIR_SEPARATOR) ?: file_name;
+	ext = strrchr(base, '.') ?: base + strlen(base);
+	tagged = g_strdup_printf("%.*s-%s%s", (int)(ext - file_name), file_name,
+			log->tag, ext);
+	g_free(file_name);
+	return tagged;
+}
+
+static void end_row(struct log_file *lf, gint64 start_time)
+{
+	double time = (lf->row_time - start_time) / (double)G_USEC_PER_SEC;
+	const char *value;
+	unsigned int i;
+
+	if (!lf->filled)
+		return;
+
+	if (lf->format == PROFILE_LOG_CSV) {
+		if (!lf->has_header)
+			write_header(lf);
+		lf->has_header = true;
+		lf->columns_done = true;
+
+		fprintf(lf->f, "%.6f", time);
+		for (i = 0; i < lf->columns->len; i++) {
+			fputc(',', lf->f);
+			value = g_ptr_array_index(lf->row, i);
+			if (value)
+				write_csv_field(lf->f, value);
+		}
+	} else {
+		fprintf(lf->f, "{\"time\":%.6f", time);
+		for (i = 0; i < lf->columns->len; i++) {
+			value = g_ptr_array_index(lf->row, i);
+			if (!value)
+				continue;
+			fputc(',', lf->f);
+			write_json_value(lf->f, g_ptr_array_index(lf->columns, i));
+			fputc(':', lf->f);
+			write_json_value(lf->f, value);
+		}
+		fputc('}', lf->f);
+	}
+	fputc('\n', lf->f);
+
+	for (i = 0; i < lf->row->len; i++) {
+		g_free(g_ptr_array_index(lf->row, i));
+		g_ptr_array_index(lf->row, i) = NULL;
+	}
+	lf->filled = 0;
+}
+
+static void log_file_free(struct log_file *lf, gint64 start_time)
+{
+	end_row(lf, start_time);
+	if (fclose(lf->f))
+		fprintf(stderr, "Unable to write log file: %s\n",
+				strerror(errno));
+	g_free(lf->buf);
+
+	g_ptr_array_free(lf->columns, TRUE);
+	g_ptr_array_free(lf->row, TRUE);
+	g_free(lf);
+}
+
+struct profile_log * profile_log_new(const char *tag)
+{
+	struct profile_log *log = g_new0(struct profile_log, 1);
+
+	log->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+	log->tag = g_strdup(tag);
+
+	return log;
+}
+
+void profile_log_free(struct profile_log *log)
+{
+	GHashTableIter iter;
+	gpointer lf;
+
+	if (!log)
+		return;
+
+	g_hash_table_iter_init(&iter, log->files);
+	while (g_hash_table_iter_next(&iter, NULL, &lf))
+		log_file_free(lf, log->start_time);
+
+	g_hash_table_destroy(log->files);
+	g_free(log->tag);
+	g_free(log);
+}
+
+static struct log_file * log_file_get(struct profile_log *log,
+		const char *path)
+{
+	struct log_file *lf;
+	gchar *file_name;
+	FILE *f;
+
+	file_name = tagged_name(log, path);
+	lf = g_hash_table_lookup(log->files, file_name);
+	if (lf) {
+		g_free(file_name);
+		return lf;
+	}
+
+	f = fopen(file_name, "a");
+	if (!f) {
+		g_free(file_name);
+		return NULL;
+	}
+
+	if (!g_hash_table_size(log->files))
+		log->start_time = g_get_monotonic_time();
+
+	lf = g_new0(struct log_file, 1);
+	lf->f = f;
+	lf->buf = g_malloc(PROFILE_LOG_BUFFER_SIZE);
+	setvbuf(f, lf->buf, _IOFBF, PROFILE_LOG_BUFFER_SIZE);
+	lf->format = format_from_name(file_name);
+	lf->columns = g_ptr_array_new_with_free_func(g_free);
+	lf->row = g_ptr_array_new();
+
+	/* Appending to a previous log: its header is already there */
+	if (lf->format == PROFILE_LOG_CSV && !fseek(f, 0, SEEK_END))
+		lf->has_header = ftell(f) > 0;
+
+	g_hash_table_insert(log->files, file_name, lf);
+	return lf;
+}
+
+static int column_index(struct log_file *lf, const char *column)
+{
+	unsigned int i;
+
+	for (i = 0; i < lf->columns->len; i++)
+		if (!strcmp(g_ptr_array_index(lf->columns, i), column))
+			return i;
+
+	if (lf->columns_done) {
+		fprintf(stderr, "Column %s is not in the header of the log file, "
+				"value ignored\n", column);
+		return -ENOENT;
+	}
+
+	g_ptr_array_add(lf->columns, g_strdup(column));
+	g_ptr_array_add(lf->row, NULL);
+	return i;
+}
+
+static void log_file_set(struct log_file *lf, gint64 start_time,
+		const char *column, const char *value)
+{
+	int idx = column_index(lf, column);
+
+	if (idx < 0)
+		return;
+
+	/* The column comes around again: the previous sweep step is done */
+	if (g_ptr_array_index(lf->row, idx))
+		end_row(lf, start_time);
+	if (!lf->filled)
+		lf->row_time = g_get_monotonic_time();
+
+	g_ptr_array_index(lf->row, idx) = g_strstrip(g_strdup(value));
+	lf->filled++;
+}
+
+int profile_log_write(struct profile_log *log, const char *path,
+		const char *column, const char *value)
+{
+	struct log_file *lf = log_file_get(log, path);
+
+	if (!lf)
+		return -errno;
+
+	if (lf->format == PROFILE_LOG_LEGACY)
+		fprintf(lf->f, "%s, ", value);
+	else
+		log_file_set(lf, log->start_time, column, value);
+
+	return 0;
+}
+
+int profile_log_write_record(struct profile_log *log, const char *path,
+		const char * const *columns, const char * const *values,
+		unsigned int count)
+{
+	struct log_file *lf = log_file_get(log, path);
+	unsigned int i;
+
+	if (!lf)
+		return -errno;
+
+	for (i = 0; i < count; i++) {
+		if (lf->format == PROFILE_LOG_LEGACY)
+			fprintf(lf->f, ", %s", values[i]);
+		else
+			log_file_set(lf, log->start_time, columns[i], values[i]);
+	}
+
+	if (lf->format == PROFILE_LOG_LEGACY)
+		fputc('\n', lf->f);
+	else
+		end_row(lf, log->start_time);
+
+	/* Records are read while the profile still runs */
+	fflush(lf->f);
+	return 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright (C) 2019 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __PROFILE_LOG_H__
+#define __PROFILE_LOG_H__
+
+#include <glib.h>
+
+/*
+ * Log files written by the log.* entries of a profile. Each file is opened
+ * on first use and stays open, buffered, until the profile_log is released
+ * at the end of the profile run. The format follows the extension
+ * of the file name:
+ *  - .csv: a header with the column names, then one row per sweep step,
+ *  - .json, .jsonl or .ndjson: one JSON object per sweep step,
+ *  - anything else: the values separated by commas, as they are logged.
+ * A sweep step ends when a column already filled in the current row is
+ * logged again. Rows start with the time in seconds since the first log
+ * file of the run was opened, from the monotonic clock.
+ *
+ * When several boards run the same profile, each one has its own
+ * profile_log with a tag, which is added to the names of its files:
+ * "sweep.csv" is written to "sweep-<tag>.csv".
+ */
+struct profile_log;
+
+/* Resolves ~/ to the home directory, release with g_free() */
+gchar * profile_log_expand_path(const char *path);
+
+struct profile_log * profile_log_new(const char *tag);
+void profile_log_free(struct profile_log *log);
+int profile_log_write(struct profile_log *log, const char *path,
+		const char *column, const char *value);
+/*
+ * Adds @count values to the current row, which they end: the markers of a
+ * plot saved after the logged values of a sweep step, for instance. Other
+ * files get ", value" for each, then the end of the line.
+ */
+int profile_log_write_record(struct profile_log *log, const char *path,
+		const char * const *columns, const char * const *values,
+		unsigned int count);
+
+#endif /* __PROFILE_LOG_H__ */